@@ -0,0 +1,131 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Static control flow and cycle analysis of a program image, without running it
+// Builds the control flow graph from the reset vector (0x1FF, which runs into 0x000) and every CALL target, splits
+// it into routines and basic blocks, finds the loops and works out best and worst case cycle counts per routine
+// with the same rules the engines use: 2 cycles for GOTO, CALL, RETLW and anything that writes PCL, 1 for the rest,
+// plus 1 for the NOP a taken skip runs in place of the next instruction. A CALL costs its 2 cycles plus the callee.
+//
+// Loops are bounded in the number of times round (times the loop header runs):
+//   - counted loops, DECFSZ/INCFSZ on a register that's literal-initialised (MOVLW k, MOVWF f or CLRF f) right
+//     before the loop, that nothing else in the loop writes, and that every way round goes through
+//   - bounds given with analysis_set_loop_bound(), for loops that depend on data (like tests/divide's subtraction)
+// Anything else, and anything that can't be proven to finish (a main loop, recursion), makes the worst case
+// ANALYSIS_UNBOUNDED. Computed jumps (writes to PCL) are taken to be jump tables: the run of RETLW/GOTO straight
+// after them are the targets, and with no such table the routine they're in is unbounded.
+//
+// The page bits in STATUS are part of the target of every GOTO and CALL, but on the 12F508 they sit above the
+// 9 bits of PC, so targets here are just the low 9 bits like the engines' PC.
+
+#define ANALYSIS_WORDS        512
+#define ANALYSIS_RESET_VECTOR 0x1FF
+#define ANALYSIS_MAX_ROUTINES 64
+#define ANALYSIS_MAX_LOOPS    64
+#define ANALYSIS_MAX_EXITS    16  // Distinct places a single loop can be left for
+#define ANALYSIS_MAX_BOUNDS   64
+#define ANALYSIS_UNBOUNDED    UINT64_MAX
+
+// Per-word flags
+#define ANALYSIS_REACHABLE     0x01
+#define ANALYSIS_BLOCK_START   0x02
+#define ANALYSIS_LOOP_HEADER   0x04
+#define ANALYSIS_ROUTINE_ENTRY 0x08
+#define ANALYSIS_COMPUTED_JUMP 0x10 // Writes PCL
+#define ANALYSIS_UNRESOLVED    0x20 // Computed jump with no table after it
+
+// Where a loop's bound came from
+#define LOOP_UNBOUNDED 0
+#define LOOP_COUNTED   1
+#define LOOP_USER      2
+
+// Error codes, negative like everywhere else
+#define ANALYSIS_OK            0
+#define ANALYSIS_ERR_FULL     -1 // More routines, loops, loop exits or bounds than there's room for
+#define ANALYSIS_ERR_ADDRESS  -2 // Not a program memory address
+#define ANALYSIS_ERR_MEMORY   -3
+
+// Straight line code, entered only at the top and left only from the bottom
+typedef struct AnalysisBlock {
+    uint16_t start;
+    uint16_t length;     // Words
+    uint16_t cycles;     // Running it top to bottom (CALLs as 2, a skip at the end as not taken)
+    uint16_t succ[2];    // Where it goes next: fall through/skip not taken, then GOTO target/skip taken
+    uint8_t num_succ;    // 0 after RETLW, SLEEP or a computed jump
+    bool calls;          // Ends in a CALL, succ[0] is where it returns to
+} AnalysisBlock;
+
+// Exit targets that aren't addresses
+#define ANALYSIS_RETURN 0xFFFF // Left through a RETLW
+#define ANALYSIS_SLEEP  0xFFFE // Went to sleep
+
+typedef struct AnalysisExit {
+    uint16_t target;     // ANALYSIS_RETURN or ANALYSIS_SLEEP when the loop leaves the routine altogether
+    uint64_t best;       // From entering the loop to getting to target, all the times round included
+    uint64_t worst;
+} AnalysisExit;
+
+typedef struct AnalysisLoop {
+    uint16_t header;
+    uint16_t routine;       // Entry of the routine it's in
+    int bound;              // LOOP_*
+    uint8_t counter;        // LOOP_COUNTED: the register counting
+    uint32_t min_trips;     // Times round, the last one being the one that leaves
+    uint32_t max_trips;     // 0 for LOOP_UNBOUNDED
+    uint64_t trip_best;     // Header back to header
+    uint64_t trip_worst;
+    int num_words;
+    uint8_t body[ANALYSIS_WORDS / 8];
+    AnalysisExit exits[ANALYSIS_MAX_EXITS];
+    int num_exits;
+} AnalysisLoop;
+
+typedef struct AnalysisRoutine {
+    uint16_t entry;
+    uint64_t best;          // First instruction up to and including the RETLW (or SLEEP)
+    uint64_t worst;         // ANALYSIS_UNBOUNDED when it can't be bounded or never finishes
+    bool returns;           // Has a RETLW
+    bool sleeps;            // Has a SLEEP
+    bool recursive;
+    int num_words;
+    int state;              // Internal: not done/in progress/done
+} AnalysisRoutine;
+
+typedef struct Analysis {
+    uint16_t inst[ANALYSIS_WORDS];
+    uint8_t ops[ANALYSIS_WORDS];   // instruction_decode() of every word
+    uint8_t flags[ANALYSIS_WORDS]; // ANALYSIS_* flags
+
+    AnalysisBlock blocks[ANALYSIS_WORDS]; // In address order
+    int num_blocks;
+    AnalysisRoutine routines[ANALYSIS_MAX_ROUTINES]; // The reset vector first, then CALL targets by address
+    int num_routines;
+    AnalysisLoop loops[ANALYSIS_MAX_LOOPS];
+    int num_loops;
+
+    // Bounds from analysis_set_loop_bound(), kept across analysis_run()
+    struct {
+        uint16_t header;
+        uint32_t min_trips;
+        uint32_t max_trips;
+    } bounds[ANALYSIS_MAX_BOUNDS];
+    int num_bounds;
+
+    int error;   // First ANALYSIS_ERR_* analysis_run() ran into, the results are still as good as they could be made
+} Analysis;
+
+void analysis_init(Analysis *an);
+// Times round a loop whose count depends on data, by the address of its first instruction
+int analysis_set_loop_bound(Analysis *an, uint16_t header, uint32_t min_trips, uint32_t max_trips);
+// Analyses 512 words of program memory (cpu->inst or a FirmwareImage's inst both work)
+int analysis_run(Analysis *an, const uint16_t *inst);
+
+// Lookups, NULL if there's no such thing
+const AnalysisRoutine *analysis_routine(const Analysis *an, uint16_t entry);
+const AnalysisLoop *analysis_loop(const Analysis *an, uint16_t header);
+const AnalysisBlock *analysis_block(const Analysis *an, uint16_t addr); // The block addr is in
+
+void analysis_print(const Analysis *an, FILE *out);
+const char *analysis_strerror(int err);
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Test benches: peripheral models attached to a CPU's pins, instead of hand written GPIO read callbacks
+// Models only get run when one of their pins changes level or when a timer they scheduled goes off, never per read.
+// The CPU's GPIO and TRIS writes end the current run (cpu->yield) when they change what it's driving, so models see
+// edges right after the instruction that made them. So do GPIO writes over input pins' latch bits and OPTION changes
+// (pull-ups, T0CS), so reads after them see the pins resolved again. Whatever the models drive goes back in through cpu_setgpio()
+// before the next one, so pin change wakeups and MCLR work as usual and reads are just the GPIO register.
+//
+// Each pin resolves, strongest first, to:
+//   - the CPU's latch if it's an output (TRIS bit clear, and not GP3 or GP2 while TOCS is set)
+//   - whatever models are driving it, low wins if they disagree (so open-drain buses just work)
+//   - a model's pull (say a resistor), or the CPU's weak pull-up (GP0, GP1, GP3 with GPPU clear)
+//   - otherwise it floats and keeps its last level
+// Time is the CPU's cycle counter, see bench_now().
+//
+// Models embed Peripheral as their first member and fill in ops, see models.h for the stock ones.
+
+#define BENCH_MAX_PERIPHERALS 32
+#define BENCH_NO_TIMER        UINT64_MAX
+#define BENCH_MAX_SETTLE      16 // Rounds of models reacting to each other before giving up on a pin settling
+
+// Error codes, negative like everywhere else
+#define BENCH_OK         0
+#define BENCH_ERR_FULL  -1 // Out of peripheral slots
+
+struct Bench;
+struct Peripheral;
+
+typedef struct PeripheralOps {
+    const char *name;
+    // Some of its pins changed level, pins has all six levels and changed the ones that just did
+    // Also called with changed of 0 when it's attached, so it can pick up the starting levels
+    void (*pins_changed)(struct Peripheral *p, struct Bench *bench, uint8_t pins, uint8_t changed);
+    // Its timer went off (it's already been cleared, so scheduling another from in here works)
+    void (*timer)(struct Peripheral *p, struct Bench *bench);
+} PeripheralOps;
+
+typedef struct Peripheral {
+    const PeripheralOps *ops;
+    uint8_t pins;        // Pins it wants to hear about
+    uint8_t drive_mask;  // Pins it's driving, and to what
+    uint8_t drive_value;
+    uint8_t pull_mask;   // Pins it's weakly pulling, and which way
+    uint8_t pull_value;
+    uint64_t timer;      // Cycle its timer goes off, BENCH_NO_TIMER if it isn't set
+} Peripheral;
+
+typedef struct Bench {
+    CPU *cpu;
+    Peripheral *peripherals[BENCH_MAX_PERIPHERALS];
+    int num_peripherals;
+
+    uint8_t pins;          // Every pin's level as of the last update
+    uint8_t cpu_drive;     // Which pins the CPU was driving, and to what, as of the last update
+    uint8_t cpu_value;
+    uint8_t option;        // The CPU's OPTION as of the last update
+    uint64_t evaluations;  // Model calls, for seeing how little they get run
+    uint64_t contentions;  // Updates where models drove a pin both ways
+
+    // The CPU's own callbacks, ours go in their place and call them
+    void (*gpio_write_callback)(struct CPU *, uint8_t *);
+    void (*tris_write_callback)(struct CPU *, uint8_t *);
+    void (*option_write_callback)(struct CPU *, uint8_t *);
+} Bench;
+
+// -structors, attaching takes over the GPIO write, TRIS and OPTION callbacks (set them first)
+void bench_init(Bench *bench, CPU *cpu);
+void bench_deinit(Bench *bench); // Gives the CPU its callbacks back, the models are still the caller's
+int bench_attach(Bench *bench, Peripheral *p); // Pins and drives should already be set
+void bench_init_peripheral(Peripheral *p, const PeripheralOps *ops, uint8_t pins); // For model init functions
+
+// Like cpu_run_cycles(), with the models run in between, returns the STOP_*
+int bench_run(Bench *bench, uint64_t max_cycles);
+void bench_update(Bench *bench); // Re-resolves the pins, call after changing anything from outside a model
+
+// For models (or the host, followed by bench_update())
+uint64_t bench_now(const Bench *bench);
+void bench_drive(Peripheral *p, uint8_t mask, uint8_t value); // Drives mask's pins to value's bits
+void bench_release(Peripheral *p, uint8_t mask); // Stops driving them
+void bench_schedule(Peripheral *p, uint64_t cycle); // Sets its timer, replacing any earlier one, now or earlier fires right away
+void bench_cancel(Peripheral *p);
+
+const char *bench_strerror(int err);
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Boards: several CPUs with their GPIO pins wired together through nets
+// Every device runs a time quantum on its own (across threads if there are any), seeing the nets as they were at
+// the start of it. At the end of each quantum, with everything stopped at the same point in time, each net gets
+// resolved from whatever's on it:
+//   - Output pins (TRIS bit clear) drive their latch value. GP3 is always an input, as is GP2 while TOCS is set.
+//     If outputs disagree that's contention, low wins and it gets counted.
+//   - An external driver (board_drive()) counts as one more output
+//   - With nothing driving, a weak pull-up (GP0, GP1 or GP3 as an input with GPPU clear) pulls it high
+//   - Otherwise it's floating and keeps its last value
+// The resolved values go into the input pins through cpu_setgpio(), so pin change wakeups and MCLR work as usual.
+// Like on the real part, the latch bits of input pins end up holding what the pins read.
+//
+// Anything done within a quantum is only seen by the other devices at its end, so the quantum shrinks while nets
+// are toggling and grows back once they've been quiet for a while. Activity starting after a long quiet spell can
+// still be up to a max sized quantum late being seen. Since inputs only change between quanta, results are the same
+// no matter how many threads there are.
+
+#define BOARD_MAX_DEVICES 64
+#define BOARD_MAX_NETS    64
+#define BOARD_PINS        6
+
+#define BOARD_MIN_QUANTUM 16   // Default quantum bounds, in instruction cycles
+#define BOARD_MAX_QUANTUM 4096
+#define BOARD_GROW_AFTER  8    // Quiet quanta in a row before the quantum doubles
+
+#define BOARD_NO_NET -1
+
+// Error codes, negative like everywhere else
+#define BOARD_OK            0
+#define BOARD_ERR_FULL     -1 // Out of devices or nets
+#define BOARD_ERR_RANGE    -2 // No such device, net or pin
+#define BOARD_ERR_THREADS  -3 // Couldn't start the worker threads
+
+typedef struct Net {
+    uint8_t value;      // Resolved at the end of the last quantum
+    bool external;      // Driven from outside the board (board_drive())
+    uint8_t external_value;
+    uint64_t toggles;   // How many times the value's changed
+} Net;
+
+typedef struct Board {
+    CPU *devices[BOARD_MAX_DEVICES];
+    uint64_t start_cycles[BOARD_MAX_DEVICES]; // Device's inst_cycles at board time 0
+    int8_t pin_net[BOARD_MAX_DEVICES][BOARD_PINS]; // BOARD_NO_NET if unconnected
+    int num_devices;
+
+    Net nets[BOARD_MAX_NETS];
+    int num_nets;
+
+    uint64_t time;        // Board time in instruction cycles, every device not stopped early is this far along
+    uint64_t quantum;
+    uint64_t min_quantum;
+    uint64_t max_quantum;
+    uint64_t num_quanta;
+    int quiet_quanta;     // In a row, without any net changing
+    uint64_t contentions; // Nets with outputs fighting, counted once per quantum
+
+    // Set when a device stops for a breakpoint or watchpoint, board_run() then returns its STOP_*
+    int stop_device;
+
+    int num_threads;
+    struct BoardThreads *threads; // Worker pool, NULL with a single thread
+} Board;
+
+// -structors, num_threads includes the calling thread (1 runs everything inline)
+int board_init(Board *board, int num_threads);
+void board_deinit(Board *board); // Stops the workers, the CPUs are still the caller's
+
+// Wiring, these return the new device/net index or a BOARD_ERR_* code
+int board_add_device(Board *board, CPU *cpu); // Joins at the current board time
+int board_add_net(Board *board);
+int board_connect(Board *board, int net, int device, int pin); // pin is 0-5 for GP0-GP5
+
+// Outside stimulus, a driver on the net that wins over pull-ups but fights with outputs
+int board_drive(Board *board, int net, bool value);
+int board_release(Board *board, int net);
+
+// Runs every device for max_cycles more, or until one stops (see stop_device), returns the STOP_*
+int board_run(Board *board, uint64_t max_cycles);
+bool board_getnet(const Board *board, int net);
+
+const char *board_strerror(int err);
@@ -0,0 +1,121 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// The library interface (libc12f508.so / libc12f508.a, see `make lib`), for embedding from other languages
+// The simulator is an opaque handle and every call is meant to do a lot of work at once: run millions of cycles,
+// apply a whole array of input events, copy out the whole state or a whole trace buffer. Nothing here exposes CPU or
+// any other internal struct, so internals can change without breaking anything built against this.
+//
+// The ABI only grows: new functions and new constants get added, existing ones keep their layout and meaning, and
+// C12F508_ABI_VERSION goes up whenever something gets added. Check c12f508_abi_version() at load time.
+
+#define C12F508_ABI_VERSION 1
+
+#if defined(__GNUC__)
+#define C12F508_API __attribute__((visibility("default")))
+#else
+#define C12F508_API
+#endif
+
+// Why a run stopped
+#define C12F508_STOP_CYCLES     0 // Ran all the cycles asked for
+#define C12F508_STOP_BREAKPOINT 1
+#define C12F508_STOP_WATCHPOINT 2
+#define C12F508_STOP_TRACE_FULL 3 // The trace buffer filled up, read it and run again
+
+// Resets
+#define C12F508_RESET_POWER_ON 0 // Like a fresh chip with the program loaded
+#define C12F508_RESET_MCLR     1
+#define C12F508_RESET_WDT      2
+
+// Engines
+#define C12F508_ENGINE_FAST     0
+#define C12F508_ENGINE_PIPELINE 1
+
+// Error codes, negative
+#define C12F508_OK            0
+#define C12F508_ERR_ARG      -1 // Bad argument (address, engine, reset kind, NULL where there can't be one)
+#define C12F508_ERR_LOAD     -2 // Firmware didn't load, c12f508_error_detail() says why
+#define C12F508_ERR_MEMORY   -3
+#define C12F508_ERR_ORDER    -4 // Input events not in cycle order
+#define C12F508_ERR_SYNTAX   -5 // Breakpoint condition didn't compile
+
+typedef struct C12f508 C12f508;
+
+// A pin change, cycle is relative to the start of the c12f508_run_inputs() call it's in
+// Pins set in mask get the matching bits of value, other pins are left alone
+typedef struct C12f508Input {
+    uint64_t cycle;
+    uint8_t mask;
+    uint8_t value;
+    uint8_t reserved[6];
+} C12f508Input;
+
+// Fixed layout copy of the whole machine state
+typedef struct C12f508State {
+    uint64_t cycles;
+    uint16_t pc;
+    uint16_t config;
+    uint16_t stack[2];
+    uint8_t w;
+    uint8_t tris;
+    uint8_t option;
+    uint8_t asleep;
+    uint8_t skipnext;
+    uint8_t wdt;
+    uint8_t timer0_inhibit;
+    uint8_t reserved;
+    uint32_t prescaler;
+    uint8_t f[32];
+} C12f508State;
+
+// What the CPU did to its pins, one entry per GPIO or TRIS write
+typedef struct C12f508TraceEntry {
+    uint64_t cycle;
+    uint8_t gpio;   // GPIO after the write
+    uint8_t tris;
+    uint8_t driven; // Pins the CPU is actually driving
+    uint8_t reserved[5];
+} C12f508TraceEntry;
+
+C12F508_API unsigned c12f508_abi_version(void);
+
+// Handles, NULL if out of memory
+C12F508_API C12f508 *c12f508_new(void);
+C12F508_API void c12f508_free(C12f508 *sim);
+
+// Loading replaces the whole program (and config) then resets to power-on, anything the new one doesn't set is unprogrammed
+// Words past 512 are an error and config of -1 keeps the default (0xFFF)
+C12F508_API int c12f508_load_hex(C12f508 *sim, const char *path);
+C12F508_API int c12f508_load_hex_buffer(C12f508 *sim, const char *buf, size_t len);
+C12F508_API int c12f508_load_words(C12f508 *sim, const uint16_t *words, size_t num_words, int config);
+C12F508_API const char *c12f508_error_detail(const C12f508 *sim); // Why the last load failed
+
+C12F508_API int c12f508_reset(C12f508 *sim, int kind);
+C12F508_API int c12f508_set_engine(C12f508 *sim, int engine);
+C12F508_API int c12f508_add_breakpoint(C12f508 *sim, unsigned addr, const char *condition); // condition can be NULL
+C12F508_API void c12f508_remove_breakpoint(C12f508 *sim, unsigned addr);
+C12F508_API int c12f508_add_watchpoint(C12f508 *sim, unsigned reg);
+C12F508_API void c12f508_remove_watchpoint(C12f508 *sim, unsigned reg);
+
+// Running, these return a C12F508_STOP_* reason or a negative error
+C12F508_API int c12f508_run(C12f508 *sim, uint64_t cycles);
+// Runs cycles, applying the inputs (sorted by cycle) as it gets to them, pins the CPU is driving are left alone
+// num_applied (can be NULL) says how many got applied, after an early stop the rest can go in the next call
+// (with their cycles made relative to that call's start)
+C12F508_API int c12f508_run_inputs(C12f508 *sim, const C12f508Input *inputs, size_t num_inputs, uint64_t cycles,
+                                   size_t *num_applied);
+C12F508_API void c12f508_set_pins(C12f508 *sim, uint8_t mask, uint8_t value); // Right now, same rules as inputs
+
+// State
+C12F508_API void c12f508_get_state(C12f508 *sim, C12f508State *state);
+C12F508_API void c12f508_set_state(C12f508 *sim, const C12f508State *state);
+
+// Pin trace, off until given a capacity (0 turns it back off), runs stop with C12F508_STOP_TRACE_FULL when it fills up
+// and return it straight away, without running, until some of it has been read
+// Reading takes up to max entries off the front, oldest first, and returns how many it took
+C12F508_API int c12f508_trace_enable(C12f508 *sim, size_t capacity);
+C12F508_API size_t c12f508_trace_read(C12f508 *sim, C12f508TraceEntry *entries, size_t max);
+
+C12F508_API const char *c12f508_strerror(int err);
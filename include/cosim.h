@@ -0,0 +1,101 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Co-simulation: testbench routines written top to bottom as coroutines, instead of callbacks or step loops
+// Routines are stackless (protothread style, a switch on the line they last waited at), so there are no stacks,
+// no ucontext and no host context switches. Between waits the engine runs flat out, and it only stops to resume a
+// routine when what it's waiting on actually happens:
+//   - a cycle: the run just ends there
+//   - pin levels: GPIO writes that satisfy a waiter end the run after that instruction (cpu->yield)
+//   - PC reaching an address: a breakpoint that gets put in for the wait and taken out afterwards
+//
+// A routine looks like this, anything that has to survive a wait lives in the struct (locals don't):
+//   typedef struct Presser { CoRoutine co; int i; } Presser;
+//   static int presser(CoRoutine *co, Cosim *sim) {
+//       Presser *p = (Presser *)co;
+//       CO_BEGIN(co);
+//       for (p->i = 0; p->i < 10; p->i++) {
+//           CO_WAIT_CYCLES(co, sim, 1000);
+//           cpu_writepins(sim->cpu, GP0, false);
+//           CO_WAIT_PINS(co, sim, GP1, GP1);     // until GP1 goes high
+//           CO_WAIT_PC(co, sim, 0x10);           // until it gets to 0x10
+//           cpu_writepins(sim->cpu, GP0, true);
+//       }
+//       CO_END(co);
+//   }
+// Only one wait per source line (the line number is the resume point), and no waits inside a switch.
+// Pin waits are on levels, so one that already holds resumes straight away, PC waits need the CPU to get there again.
+// CO_TIMEOUT(co, cycles) before a wait gives up on it after that long, co->timed_out says whether it did.
+// Routines run in the order they were spawned, whenever more than one is ready at once.
+
+#define COSIM_MAX_ROUTINES 32
+
+// What a routine's body returns
+#define COSIM_WAITING 0
+#define COSIM_DONE    1
+
+// What a routine's waiting on
+#define COSIM_WAIT_NONE  0 // Hasn't started yet, runs as soon as possible
+#define COSIM_WAIT_CYCLE 1
+#define COSIM_WAIT_PINS  2
+#define COSIM_WAIT_PC    3
+#define COSIM_WAIT_DONE  4 // Finished
+
+// Error codes, negative like everywhere else
+#define COSIM_OK        0
+#define COSIM_ERR_FULL -1 // Out of routine slots
+
+struct Cosim;
+
+typedef struct CoRoutine {
+    int (*body)(struct CoRoutine *co, struct Cosim *sim);
+    int resume;         // Line to carry on from, 0 to start from the top
+    int wait;           // COSIM_WAIT_*
+    uint64_t cycle;     // COSIM_WAIT_CYCLE: when, COSIM_WAIT_PC: when it started waiting
+    uint8_t mask;       // COSIM_WAIT_PINS
+    uint8_t value;
+    uint16_t pc;        // COSIM_WAIT_PC
+    bool own_breakpoint; // We put the breakpoint in, so it comes out again afterwards
+    uint64_t timeout;   // For the next wait, 0 for none
+    uint64_t deadline;  // Of the current wait, UINT64_MAX for none
+    bool timed_out;     // The last wait ran out of time
+    void *user;
+} CoRoutine;
+
+typedef struct Cosim {
+    CPU *cpu;
+    CoRoutine *routines[COSIM_MAX_ROUTINES];
+    int num_routines;
+    int num_pin_waits;  // Routines waiting on pins, the write callback doesn't bother looking if there aren't any
+    uint64_t resumes;
+
+    // The host's callback, ours goes in its place
+    void (*gpio_write_callback)(struct CPU *, uint8_t *);
+} Cosim;
+
+void cosim_init(Cosim *sim, CPU *cpu);
+void cosim_deinit(Cosim *sim); // Gives back the callback and takes out any breakpoints it put in
+int cosim_spawn(Cosim *sim, CoRoutine *co, int (*body)(CoRoutine *co, Cosim *sim));
+
+// Runs until max_cycles go by, every routine's finished, or a breakpoint/watchpoint that isn't ours stops it
+// Returns a STOP_* reason like cpu_run_cycles()
+int cosim_run(Cosim *sim, uint64_t max_cycles);
+bool cosim_done(const Cosim *sim);
+uint64_t cosim_now(const Cosim *sim);
+
+// What the macros use to start waiting
+void cosim_wait_cycle(Cosim *sim, CoRoutine *co, uint64_t cycle);
+void cosim_wait_pins(Cosim *sim, CoRoutine *co, uint8_t mask, uint8_t value);
+void cosim_wait_pc(Cosim *sim, CoRoutine *co, uint16_t pc);
+
+#define CO_BEGIN(co)   switch ((co)->resume) { case 0:
+#define CO_END(co)     } (co)->wait = COSIM_WAIT_DONE; return COSIM_DONE
+#define CO_YIELD_(co)  (co)->resume = __LINE__; return COSIM_WAITING; case __LINE__:
+
+#define CO_TIMEOUT(co, cycles)            ((co)->timeout = (cycles))
+#define CO_WAIT_UNTIL(co, sim, when)      do { cosim_wait_cycle((sim), (co), (when)); CO_YIELD_(co); } while (0)
+#define CO_WAIT_CYCLES(co, sim, cycles)   CO_WAIT_UNTIL(co, sim, cosim_now(sim) + (cycles))
+#define CO_WAIT_PINS(co, sim, mask, value) do { cosim_wait_pins(sim, (co), (mask), (value)); CO_YIELD_(co); } while (0)
+#define CO_WAIT_PC(co, sim, addr)         do { cosim_wait_pc(sim, (co), (addr)); CO_YIELD_(co); } while (0)
@@ -1,6 +1,8 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "device.h"
 
 // Special Register Defines!
 #define INDF    0
@@ -42,21 +44,79 @@
 #define FOSC  0x03 // Oscillator Selection, not sure if I'll really use this or just let the user select their own speed
 
 // Reset Conditions
+#define RESET_NONE        0 // Only for cpu_reload_*(), keeps the current state
 #define RESET_MCLR_NORMAL 1
 #define RESET_MCLR_SLEEP  2
 #define RESET_WDT_SLEEP   3
 #define RESET_WDT_NORMAL  4
 #define RESET_WAKE_PIN    5
 
+// Why cpu_run_cycles() stopped
+#define STOP_CYCLES     0 // Used up the cycle budget
+#define STOP_BREAKPOINT 1 // PC reached the breakpoint
+#define STOP_WATCHPOINT 2 // A watched register got written (see cpu->watch_hit)
+#define STOP_YIELD      3 // A callback set cpu->yield
+
+// Watched registers that change without a write (flags, Timer0 ticks), see watch_mask
+#define WATCH_SIDE_EFFECTS ((1u << TMR0) | (1u << STATUS))
+
+// Breakpoint map flags (cpu->breakpoints)
+#define BREAK_SET       0x01 // Always stops
+#define BREAK_CONDITION 0x02 // Stops when the compiled condition in cpu->conditions is true
+
+// Execution engines
+#define ENGINE_FAST     0 // Whole instructions at a time (instruction_cycle())
+#define ENGINE_PIPELINE 1 // 2-stage pipeline with Q-cycles (pipeline.h), slower but sub-instruction accurate
+
 struct CPU;
+struct Pipeline;
+
+// A write to a watched register
+typedef struct WatchHit {
+    uint8_t reg;        // After resolving INDF
+    uint8_t old_value;
+    uint8_t new_value;  // What the register holds afterwards (so with STATUS's read-only bits and such applied)
+    uint16_t pc;        // The instruction doing the write
+    uint64_t cycle;
+} WatchHit;
+
+// Everything that changes as a program runs, for checkpoints and such (program memory and callbacks aren't included)
+// Only exact at instruction boundaries, which is the only place cpu_step()/cpu_run*() leave things anyways
+typedef struct CPUState {
+    uint16_t pc;
+    bool skipnext;
+    bool asleep;
+    uint64_t inst_cycles;
+    uint32_t inst_generation; // Which program memory this goes with
+    uint16_t stack[2];
+    uint8_t w;
+    uint8_t f[DEVICE_MAX_REGS];
+    uint8_t trisgpio;
+    uint8_t option;
+    uint16_t config;
+    uint32_t prescaler;
+    uint8_t timer0_inhibit;
+    uint8_t wdt;
+} CPUState;
+
 typedef struct CPU {
+    // Which part this is (device.h), fixed from cpu_init_device() on
+    const Device *device;
+    
     // Internal stuff
     bool verbose;
+    bool quiet; // No warnings on stdout either (illegal instructions), for harnesses running broken code on purpose
     int breakpoint;
+    uint8_t *breakpoints; // Per-address BREAK_* flags on top of the single one, NULL until cpu_addbreakpoint()
+    struct Expr **conditions; // Per-address conditions for BREAK_CONDITION, NULL until cpu_addcondbreakpoint()
+    uint8_t engine;
+    struct Pipeline *pipeline; // Only allocated for ENGINE_PIPELINE
     
     // Instruction stuff
     uint16_t pc;
-    uint16_t *inst;
+    uint16_t *inst; // DEVICE_MAX_WORDS long whatever the part, only the first device->program_words get used
+    bool inst_shared; // inst points into a shared (usually mmap'd, read-only) image rather than our own copy
+    uint32_t inst_generation; // Bumped every time a reload changes program memory
     bool skipnext;
     uint64_t inst_cycles;
     
@@ -65,7 +125,7 @@ typedef struct CPU {
     
     // Registers
     uint8_t w;
-    uint8_t *f;
+    uint8_t *f; // DEVICE_MAX_REGS long, bank 1 (where there is one) at 0x30-0x3F
     uint8_t trisgpio;
     uint8_t option;
     uint16_t config;
@@ -84,12 +144,46 @@ typedef struct CPU {
     bool do_callback; // Mainly to temporarily disable them in instructions where they'd usually not be called
     void (*gpio_read_callback)(struct CPU *, uint8_t *);
     void (*gpio_write_callback)(struct CPU *, uint8_t *);
+    void (*tris_write_callback)(struct CPU *, uint8_t *); // After a TRIS instruction, gets the new trisgpio
+    void (*option_write_callback)(struct CPU *, uint8_t *); // After an OPTION instruction or a reset, gets the new option
+    bool yield; // Set from a callback to end the run after the current instruction, so the host can react in between
+    
+    // Program memory change callback, for anything caching stuff per address (analyses, memoised routines, etc.)
+    // Gets a bitmap of the words a reload changed (bit addr&7 of byte addr>>3) and how many there were
+    void (*inst_change_callback)(struct CPU *, const uint8_t *changed, int num_changed);
+    
+    // Watchpoints, bit r of watch_mask watches writes to register r (direct, through INDF or from callbacks, in either bank)
+    // Flag updates to STATUS and Timer0 counting by itself count too, those get reported after the instruction with
+    // old_value from before it. Watching either takes the CPU off the fast engine (from the next run) to check for them
+    uint32_t watch_mask;
+    bool watch_stop; // Set by a hit that wants the run stopped, cpu_run_cycles() then returns STOP_WATCHPOINT
+    WatchHit watch_hit; // The latest hit
+    bool (*watch_callback)(struct CPU *, const WatchHit *hit); // Return true to stop, NULL stops on every hit
+    
+    // Set while a History (history.h) is recording this CPU, so its callbacks can find it
+    struct History *history;
+    
+    // Set while a Recording (recording.h) is recording or replaying this CPU's inputs
+    struct Recording *recording;
+    
+    // Set while a Bench (bench.h) has peripherals attached to this CPU's pins
+    struct Bench *bench;
+    
+    // Set while a Cosim (cosim.h) has testbench routines waiting on this CPU
+    struct Cosim *cosim;
+    
+    // Set while a Memo (memo.h) is caching pure subroutine calls, the fast engine hands it every CALL
+    struct Memo *memo;
 } CPU;
 
 // -structors
-void cpu_init(CPU *cpu);
+void cpu_init(CPU *cpu); // A PIC12F508
+void cpu_init_device(CPU *cpu, const Device *device);
 void cpu_reset(CPU *cpu, int reset_condition);
 void cpu_deinit(CPU *cpu);
+void cpu_set_engine(CPU *cpu, int engine);
+void cpu_save_state(const CPU *cpu, CPUState *state);
+void cpu_load_state(CPU *cpu, const CPUState *state);
 
 // Registers!
 uint8_t cpu_getreg(CPU *cpu, uint8_t r);
@@ -97,13 +191,49 @@ void cpu_setreg(CPU *cpu, uint8_t r, uint8_t value);
 void cpu_print_registers(CPU *cpu);
 
 // Execution
-void cpu_load_hex(CPU *cpu, const char *hex_path);
+// The loaders return HEX_OK (0) or a negative HEX_ERR_* code from hex.h, the CPU is left untouched on error
+struct HexImage;
+int cpu_load_hex(CPU *cpu, const char *hex_path);
+int cpu_load_hex_buffer(CPU *cpu, const char *buf, size_t len);
+int cpu_load_hex_image(CPU *cpu, const struct HexImage *image);
+
+// Hot reloading, only the words that differ get replaced and the rest of the state is kept
+// (or reset with one of the RESET_* conditions), returns the number of changed words or a negative error code
+struct FirmwareImage;
+int cpu_reload_hex(CPU *cpu, const char *hex_path, int reset_condition);
+int cpu_reload_image(CPU *cpu, const struct FirmwareImage *image, int reset_condition);
 void cpu_step(CPU *cpu);
+void cpu_write_inst(CPU *cpu, uint16_t addr, uint16_t word); // Patches a single word like a reload would
 
 // INFINITE EXECUTION
 void cpu_setbreakpoint(CPU *cpu, int pc_breakpoint);
 void cpu_clearbreakpoint(CPU *cpu);
-void cpu_run(CPU *cpu);
+void cpu_addbreakpoint(CPU *cpu, uint16_t addr); // As many as you like, these stay until removed
+void cpu_removebreakpoint(CPU *cpu, uint16_t addr);
+int cpu_addcondbreakpoint(CPU *cpu, uint16_t addr, const char *condition); // Returns EXPR_OK or an EXPR_ERR_* from expr.h
+void cpu_removecondbreakpoint(CPU *cpu, uint16_t addr);
+void cpu_addwatchpoint(CPU *cpu, uint8_t r);
+void cpu_removewatchpoint(CPU *cpu, uint8_t r);
+void cpu_run(CPU *cpu); // Until a breakpoint (clearing the single one) or watchpoint, forever if there aren't any
+int cpu_run_cycles(CPU *cpu, uint64_t max_cycles); // Runs at least max_cycles unless stopped, returns a STOP_* reason
+
+// Whether PC is sitting on any breakpoint, the engines check this after every instruction
+// Conditions only get evaluated at their own addresses, so they cost nothing anywhere else
+bool cpu_checkcondition(const CPU *cpu);
+// The engines compiled for one device pass its program memory mask as a constant
+static inline bool cpu_atbreakpoint_in(const CPU *cpu, uint16_t pc_mask)
+{
+    if (cpu->pc == cpu->breakpoint)
+        return true;
+    if (cpu->breakpoints == NULL)
+        return false;
+    uint8_t flags = cpu->breakpoints[cpu->pc & pc_mask];
+    return flags != 0 && ((flags & BREAK_SET) || cpu_checkcondition(cpu));
+}
+static inline bool cpu_atbreakpoint(const CPU *cpu)
+{
+    return cpu_atbreakpoint_in(cpu, cpu->device->program_words - 1);
+}
 
 // GPIO time
 uint8_t cpu_getgpio(CPU *cpu);
@@ -113,4 +243,6 @@ void cpu_setgpio(CPU *cpu, uint8_t newgpio);
 // You can just do one pin or many pins
 uint8_t cpu_readpins(CPU *cpu, uint8_t pin_mask); // Returns a mask of the set pins masked by your mask
 bool cpu_anypinsset(CPU *cpu, uint8_t pin_mask); // Returns a bool as to whether any of the masked pins are set
-void cpu_writepins(CPU *cpu, uint8_t pin_mask, bool set); // Writes a pin mask to the gpio, setting or clearing them based on the set bool
\ No newline at end of file
+void cpu_writepins(CPU *cpu, uint8_t pin_mask, bool set); // Writes a pin mask to the gpio, setting or clearing them based on the set bool
+uint8_t cpu_driven_pins(const CPU *cpu); // Pins the CPU is driving: TRIS clear, except GP3 (input only) and GP2 while TOCS is set
+uint8_t cpu_pullup_pins(const CPU *cpu); // Input pins with a weak pull-up on (GP0, GP1, GP3 with GPPU clear)
\ No newline at end of file
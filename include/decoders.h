@@ -0,0 +1,88 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bench.h"
+
+// Protocol decoders for bit-banged UART, SPI and I2C, as bench peripherals (bench.h)
+// They only see pin edges, and work out bits from the cycle counter, so decoding costs nothing per instruction.
+// Decoded bytes go into a buffer and/or to a callback, each with the cycle it finished on and any error flags.
+// Pins are GP* masks, call the init function then bench_attach() &decoder->decoder.base.
+
+// Flags on decoded bytes
+#define DECODE_FRAMING_ERROR 0x01 // UART: bad start/stop bit, SPI/I2C: frame ended partway through a byte
+#define DECODE_TIMING_ERROR  0x02 // UART: edge off the bit grid, SPI/I2C: data changed on the same cycle as the clock
+#define DECODE_START         0x04 // I2C: first byte after a (repeated) start, so the address
+#define DECODE_NACK          0x08 // I2C: nobody pulled SDA low on the 9th clock
+#define DECODE_STOP          0x10 // SPI/I2C: end of frame (chip select released or stop condition), no data
+
+#define UART_TIMING_TOLERANCE 0.25 // How far off the bit grid (in bits) an edge can be
+
+typedef struct DecodedByte {
+    uint64_t cycle;  // When it finished
+    uint8_t value;
+    uint8_t miso;    // SPI only, what came back
+    uint8_t flags;
+} DecodedByte;
+
+typedef struct Decoder {
+    Peripheral base;
+    // Optional buffer, bytes past capacity just get counted in dropped
+    DecodedByte *buffer;
+    size_t capacity;
+    size_t count;
+    uint64_t dropped;
+    // Optional callback, called for every byte
+    void (*callback)(struct Decoder *decoder, const DecodedByte *byte);
+    void *user;
+    uint64_t framing_errors;
+    uint64_t timing_errors;
+} Decoder;
+
+// Point a decoder's output at a buffer (and start it over)
+void decoder_set_buffer(Decoder *decoder, DecodedByte *buffer, size_t capacity);
+
+
+// UART, 8N1 idle high, LSB first
+typedef struct UartDecoder {
+    Decoder decoder;
+    uint8_t pin;
+    double cycles_per_bit;  // Instruction clock / baud rate, doesn't have to be whole
+    bool level;
+    bool in_frame;
+    uint64_t frame_start;
+    int filled;             // Bits of the frame (start, 8 data, stop) worked out so far
+    uint16_t bits;
+    uint8_t flags;
+} UartDecoder;
+
+void uart_decoder_init(UartDecoder *uart, uint8_t pin, double cycles_per_bit);
+
+
+// SPI, MSB first, cs of 0 means no chip select (always selected, and frames never end)
+typedef struct SpiDecoder {
+    Decoder decoder;
+    uint8_t sck, mosi, miso, cs;
+    int mode;               // 0-3, CPOL << 1 | CPHA
+    bool selected;
+    int bits;
+    int frame_bytes;
+    uint8_t mosi_byte, miso_byte;
+    uint8_t flags;
+} SpiDecoder;
+
+void spi_decoder_init(SpiDecoder *spi, uint8_t sck, uint8_t mosi, uint8_t miso, uint8_t cs, int mode);
+
+
+// I2C, 8 bits MSB first then the ack bit, clocked in on SCL rising
+typedef struct I2cDecoder {
+    Decoder decoder;
+    uint8_t scl, sda;
+    bool in_frame;
+    bool first_byte;
+    int bits;
+    uint8_t byte;
+    uint8_t flags;
+} I2cDecoder;
+
+void i2c_decoder_init(I2cDecoder *i2c, uint8_t scl, uint8_t sda);
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Device descriptors: what differs between the baseline parts we emulate, as data
+// Everything here has the same core (33 instructions, 2-level stack, Timer0, WDT, GPIO with GP3 input only and
+// MCLR on it), so a part comes down to:
+//   - program memory size, a power of two that PC wraps at, with the reset vector (MOVLW osccal) in the last word
+//     and GOTO/CALL taking their page from STATUS<6:5> like always
+//   - the register file: SFRs at 0x00-0x06, then general purpose registers. Parts with two banks have FSR<5>
+//     choosing which one 0x10-0x1F means (0x00-0x0F is the same in both), bank 1's registers live at f[0x30-0x3F]
+//     and the FSR bits that don't exist read as 1. Registers that don't exist read as 0 and ignore writes.
+//   - how many GPIO pins there are, and which config word bits exist
+// The fast engine gets compiled once per descriptor (see engine.h), so none of this costs a branch at run time.
+// Parts with a comparator or ADC (10F204/206, 12F510, 16F505...) aren't described, those have peripherals to add.
+
+#define DEVICE_MAX_WORDS 1024 // Program memory every CPU allocates, whatever its part
+#define DEVICE_MAX_REGS  64   // Register file, with room for a second bank
+
+// Config word bits, in the same place on every part here (see MCLRE/CP/WDTE in cpu.h)
+#define DEVICE_CONFIG_FOSC 0x003 // Oscillator selection, 12F50x only
+
+// Each part's numbers as macros, so the descriptors (device.c) and the engine variants compiled for them (engine.c)
+// come from the same place
+#define DEVICE_PIC12F508_WORDS         512
+#define DEVICE_PIC12F508_BANKS         1
+#define DEVICE_PIC12F508_UNIMPLEMENTED 0x00000000u // GPRs at 0x07-0x1F
+#define DEVICE_PIC12F508_PINS          0x3F        // GP0-GP5
+
+#define DEVICE_PIC12F509_WORDS         1024        // Two pages, STATUS<5> (PA0) picks one for GOTO/CALL
+#define DEVICE_PIC12F509_BANKS         2
+#define DEVICE_PIC12F509_UNIMPLEMENTED 0x00000000u // GPRs at 0x07-0x1F, plus 0x30-0x3F in bank 1
+#define DEVICE_PIC12F509_PINS          0x3F
+
+#define DEVICE_PIC10F200_WORDS         256
+#define DEVICE_PIC10F200_BANKS         1
+#define DEVICE_PIC10F200_UNIMPLEMENTED 0x0000FF80u // 0x07-0x0F, GPRs start at 0x10
+#define DEVICE_PIC10F200_PINS          0x0F        // GP0-GP3
+
+#define DEVICE_PIC10F202_WORDS         512
+#define DEVICE_PIC10F202_BANKS         1
+#define DEVICE_PIC10F202_UNIMPLEMENTED 0x00000080u // 0x07 (CMCON0 on the 10F204/206), GPRs at 0x08-0x1F
+#define DEVICE_PIC10F202_PINS          0x0F
+
+// Peripherals
+#define DEVICE_TMR0   0x01
+#define DEVICE_WDT    0x02
+#define DEVICE_OSCCAL 0x04 // Calibration register at 0x05, and a MOVLW of its value at the reset vector
+
+typedef struct Device {
+    const char *name;        // As on the chip, "PIC12F508"
+    int index;               // Position in device_list, the engine picks its run loops by this
+    uint16_t program_words;  // 256, 512 or 1024
+    uint16_t reset_vector;   // Always program_words - 1
+    uint8_t banks;           // 1, or 2 with FSR<5> selecting one
+    uint8_t fsr_fixed;       // FSR bits that always read as 1
+    uint32_t unimplemented;  // Bit r for each register in 0x07-0x1F that doesn't exist
+    uint8_t num_gpr;         // General purpose registers across all banks
+    uint8_t pins;            // GPIO (and TRIS) bits that exist
+    uint16_t config_mask;    // Config word bits that exist
+    uint8_t peripherals;     // DEVICE_* flags
+} Device;
+
+extern const Device device_pic12f508;
+extern const Device device_pic12f509;
+extern const Device device_pic10f200;
+extern const Device device_pic10f202;
+
+#define DEVICE_COUNT 4
+extern const Device *const device_list[DEVICE_COUNT];
+
+// By name, case doesn't matter and the "PIC" is optional ("12f509", "PIC10F200"), NULL if there's no such part
+const Device *device_find(const char *name);
+
+// Where register r (0x00-0x1F, as an instruction encodes it) really is in the register file, given FSR
+static inline uint8_t device_reg_addr(const Device *device, uint8_t fsr, uint8_t r)
+{
+    if (device->banks > 1 && r >= 0x10)
+        return r | (fsr & 0x20);
+    return r;
+}
+
+// A config word as the part reads it back, bits it doesn't have are 1 like unprogrammed ones
+static inline uint16_t device_config(const Device *device, uint16_t config)
+{
+    return (config | ~device->config_mask) & 0xFFF;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+#include "cpu.h"
+
+// Specialised run loops
+// The fast engine is generated (see src/engine_template.h) once per combination of the things that rarely change
+// at run time: WDT enabled (config word), prescaler assignment (PSA) and Timer0 clock source (TOCS).
+// The variant is picked whenever a run starts, and again whenever OPTION executes or something resets the CPU,
+// so the inner loop never looks at any of them. Verbose CPUs, the pipeline engine and CPUs watching STATUS or TMR0
+// (see WATCH_SIDE_EFFECTS) run through a generic loop.
+// Each set of those is compiled again per device (device.h), with its program memory size, banking, missing
+// registers and pins as constants, so the 12F508's loops are the same as ever and other parts cost it nothing.
+// Only the fast engine hands CALLs to an attached Memo (memo.h), the generic loop always runs them.
+
+void engine_init(void); // Builds the decode table once, cpu_init() calls this (safe from any thread)
+int engine_run(CPU *cpu, uint64_t end_cycle); // Runs until inst_cycles reaches end_cycle or something stops it, returns a STOP_* reason
+const char *engine_variant_name(CPU *cpu); // What engine_run() would pick right now
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Compiled condition expressions, mainly for conditional breakpoints (cpu_addcondbreakpoint())
+// C-like syntax, compiled once into a tiny stack machine so evaluating one is just a short loop over bytes:
+//   numbers       11, 0x0B, 0b1011
+//   state         pc, w, cycles, option, tris
+//   registers     f[0x09] (constant index, banked through FSR like instructions), or by name: indf tmr0 pcl status
+//                 fsr osccal gpio
+//   STATUS bits   c dc z pd to gpwuf (0 or 1)
+//   GPIO pins     gp0-gp5 (0 or 1)
+//   operators     ( ) ! ~ - * + - << >> < <= > >= == != & ^ | && || with C precedence, "and"/"or"/"not" work too
+// Names are case-insensitive, so "f[0x09] == 0 and W > 3" is fine. Registers are read without any callbacks.
+
+#define EXPR_MAX_CODE   96
+#define EXPR_MAX_CONSTS 8
+#define EXPR_MAX_STACK  16
+
+// Error codes, negative like everywhere else
+#define EXPR_OK            0
+#define EXPR_ERR_SYNTAX   -1 // Unexpected character or token
+#define EXPR_ERR_NAME     -2 // Unknown identifier
+#define EXPR_ERR_RANGE    -3 // f[] index that isn't a register
+#define EXPR_ERR_TOO_BIG  -4 // Ran out of code, constant or stack space
+
+typedef struct Expr {
+    uint8_t code[EXPR_MAX_CODE];
+    uint8_t code_len;
+    uint8_t num_consts;
+    int64_t consts[EXPR_MAX_CONSTS]; // Anything that doesn't fit in a byte
+    int error_pos; // Where compiling went wrong, for error messages
+} Expr;
+
+int expr_compile(Expr *expr, const char *src);
+int64_t expr_eval(const Expr *expr, const CPU *cpu);
+const char *expr_strerror(int err);
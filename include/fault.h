@@ -0,0 +1,109 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu.h"
+
+// Fault injection campaigns: single bit flips in the register file, W, the stack or program memory at chosen (or
+// random) cycles, each run classified against a fault-free golden run
+//
+// The golden run goes from the CPU's state when the campaign was set up until PC first reaches end_pc, taking
+// snapshots (cpu_save_state()) along the way. Each faulty run restores the last snapshot before its fault, runs up to
+// the fault's cycle, flips the bit and carries on until one of:
+//   - a WDT timeout while awake (cpu_reset(RESET_WDT_NORMAL)): FAULT_DETECTED
+//   - PC reaching end_pc with the observed registers the same as the golden run's: FAULT_MASKED
+//   - PC reaching end_pc with any of them different: FAULT_CORRUPTION
+//   - hang_cycles going by without either: FAULT_HANG
+// hang_cycles defaults to FAULT_HANG_FACTOR times the golden run plus FAULT_HANG_MARGIN, plus a whole WDT timeout
+// when the WDT is on, so a run stuck in a loop gets the chance to be caught by it. WDT wake-ups from SLEEP are
+// normal operation and don't count.
+//
+// Runs are shared out in chunks across threads, each with its own CPU and its own copy of program memory (flipped
+// words get put back after every run). Outcomes don't depend on the number of threads.
+//
+// Fault cycles count from the campaign's start, a flip happens at the first instruction boundary at or after it.
+// Flipping a PCL bit flips that bit of PC, since PCL reads come from PC. The CPUs are quiet (no illegal instruction
+// warnings), flipped program words make plenty of them.
+
+#define FAULT_CHECKPOINTS       1024 // Snapshots along the golden run, at most
+#define FAULT_HANG_FACTOR       4
+#define FAULT_HANG_MARGIN       1000
+#define FAULT_CHUNK             64   // Runs a thread takes at a time
+#define FAULT_OBSERVE_DEFAULT   0xFFFFFF80u // General purpose registers, 0x07-0x1F
+
+// What gets flipped, index is the register, stack slot or program address
+#define FAULT_TARGET_REG   0 // f[index], bits 0-7
+#define FAULT_TARGET_W     1 // Bits 0-7, index unused
+#define FAULT_TARGET_STACK 2 // stack[index], bits 0-8 (as many as the part's PC has)
+#define FAULT_TARGET_INST  3 // inst[index] up to the part's program size, bits 0-11
+#define FAULT_NUM_TARGETS  4
+#define FAULT_TARGETS_ALL  0x0F // Bit per FAULT_TARGET_*, for fault_add_random()
+
+// How a run ended up
+#define FAULT_NOT_RUN      0
+#define FAULT_MASKED       1
+#define FAULT_DETECTED     2
+#define FAULT_HANG         3
+#define FAULT_CORRUPTION   4
+#define FAULT_NUM_OUTCOMES 5
+
+// Error codes, negative like everywhere else
+#define FAULT_OK           0
+#define FAULT_ERR_ARG     -1 // Bad target, index or bit, or a cycle past the end of the golden run
+#define FAULT_ERR_GOLDEN  -2 // The golden run didn't get to end_pc, or the WDT timed out on the way
+#define FAULT_ERR_MEMORY  -3
+#define FAULT_ERR_THREADS -4 // Couldn't start the worker threads
+
+typedef struct Fault {
+    uint64_t cycle;
+    uint16_t index;
+    uint8_t target;      // FAULT_TARGET_*
+    uint8_t bit;
+    uint8_t outcome;     // FAULT_* once fault_run() has been
+    uint64_t cycles;     // How long the run went on for
+} Fault;
+
+typedef struct FaultCampaign {
+    // Setup
+    const Device *device; // The CPU's, the campaign runs on the same part
+    CPUState start;
+    uint16_t inst[DEVICE_MAX_WORDS];
+    uint16_t end_pc;
+    uint32_t observe;    // Bit r compares f[r] at end_pc, FAULT_OBSERVE_DEFAULT unless changed
+    bool observe_w;
+    uint64_t hang_cycles;
+
+    // The golden run
+    CPUState golden;     // As it got to end_pc
+    uint64_t golden_cycles;
+    CPUState *checkpoints;
+    int num_checkpoints;
+
+    Fault *faults;
+    size_t num_faults;
+    size_t capacity;
+
+    // Results of the last fault_run()
+    uint64_t counts[FAULT_NUM_OUTCOMES];
+    uint64_t by_target[FAULT_NUM_TARGETS][FAULT_NUM_OUTCOMES];
+    double seconds;
+} FaultCampaign;
+
+// Runs the golden run from the CPU's current state (up to max_cycles long), the CPU isn't needed after this
+int fault_init(FaultCampaign *c, const CPU *cpu, uint16_t end_pc, uint64_t max_cycles);
+void fault_deinit(FaultCampaign *c);
+
+int fault_add(FaultCampaign *c, uint64_t cycle, int target, uint16_t index, uint8_t bit);
+// count faults spread evenly over the targets in the mask (a bit per FAULT_TARGET_*), then uniformly over their
+// indices, bits and the golden run's cycles, the same seed always giving the same faults
+int fault_add_random(FaultCampaign *c, size_t count, unsigned targets, uint64_t seed);
+void fault_clear(FaultCampaign *c);
+
+// Runs every fault, num_threads includes the calling thread (1 runs everything inline)
+int fault_run(FaultCampaign *c, int num_threads);
+
+// Outcome totals, as a whole and per target
+void fault_print(const FaultCampaign *c, FILE *out);
+const char *fault_outcome_name(int outcome);
+const char *fault_target_name(int target);
+const char *fault_strerror(int err);
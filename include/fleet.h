@@ -0,0 +1,105 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "image.h"
+#include "stimulus.h"
+
+// Fleets: lots of instances (thousands to hundreds of thousands) of CPUs running side by side, each with its own
+// program image, state and input schedule, simulated with identical instances deduplicated
+//
+// Time goes by in epochs. At the start of each one the instances get grouped by everything that decides what they'll
+// do during it: their state, their program image and the inputs they're due during the epoch. Each group gets run
+// once (a scratch CPU attached to the image, the state loaded, the inputs applied with a Stimulus) and every member
+// gets the result. So instances that sit asleep, or idle in the same loop with the same registers, cost one run
+// between them, and an instance whose inputs are about to differ from the rest just gets a group of its own for that
+// epoch and joins back up with the others once their states match again. Nothing is approximated: every instance ends
+// up exactly where simulating it on its own would have.
+//
+// Input schedules are StimulusEvents (sets and expectations) with cycle being the instance's inst_cycles, sorted, and
+// they're used in place so lots of instances can share one. Every instance is on the fleet's clock (now), a CPU can
+// overshoot an epoch boundary by the second cycle of an instruction like in any run, which just carries over.
+// It's all on the calling thread, the point is not having to run most instances at all.
+
+#define FLEET_DEFAULT_EPOCH 10000
+
+// Error codes, negative like everywhere else
+#define FLEET_OK          0
+#define FLEET_ERR_MEMORY -1
+#define FLEET_ERR_ORDER  -2 // Input events not sorted by cycle
+#define FLEET_ERR_INDEX  -3 // No such instance
+
+typedef struct FleetInstance {
+    const FirmwareImage *image;
+    const StimulusEvent *events;
+    size_t num_events;
+    size_t next;          // First event not applied yet
+    int group;            // Index into the fleet's groups, whose state is this instance's
+
+    uint64_t expects;     // Same as a Stimulus's, across the whole run
+    uint64_t failures;
+    uint64_t contentions;
+    uint64_t failed_cycle; // First failed expectation, when there are failures
+} FleetInstance;
+
+typedef struct FleetGroup {
+    CPUState state;
+    const FirmwareImage *image;
+    const StimulusEvent *events; // The epoch's inputs, from one of the members (they're all the same)
+    size_t num_events;
+    int members;
+    uint64_t hash;        // Of state
+
+    // While grouping
+    uint64_t key;         // state, image and inputs
+    int source;           // The group from the epoch before that it started as a copy of
+
+    // What the epoch's expectations made of it
+    uint64_t expects;
+    uint64_t failures;
+    uint64_t contentions;
+    uint64_t failed_cycle;
+} FleetGroup;
+
+typedef struct Fleet {
+    FleetInstance *instances;
+    int num_instances;
+    int instances_capacity;
+    FleetGroup *groups;
+    int num_groups;
+
+    uint64_t epoch;       // FLEET_DEFAULT_EPOCH unless changed
+    uint64_t now;         // The epoch boundary everything's got to
+
+    // Statistics
+    uint64_t epochs;
+    uint64_t group_runs;  // Runs actually done, against epochs * instances without deduplication
+    uint64_t instance_runs;
+
+    // Scratch space
+    CPU cpu;
+    CPUState power_on;
+    StimulusEvent *window; // The current group's inputs made relative to its start
+    size_t window_capacity;
+    int *table;           // Hash table of group indices while grouping
+    size_t table_size;
+    FleetGroup *next_groups;
+} Fleet;
+
+void fleet_init(Fleet *fleet);
+void fleet_deinit(Fleet *fleet);
+
+// Adds an instance at power-on with the image loaded, returns its index or FLEET_ERR_MEMORY
+// The image must outlive the fleet, and a state given to fleet_set_state() gets its inst_cycles set to now
+int fleet_add(Fleet *fleet, const FirmwareImage *image);
+int fleet_set_state(Fleet *fleet, int instance, const CPUState *state);
+// events has to outlive the fleet (or the next fleet_set_inputs() on this instance), NULL for none
+int fleet_set_inputs(Fleet *fleet, int instance, const StimulusEvent *events, size_t num_events);
+
+// Runs every instance another cycles cycles, the last epoch gets cut short to fit
+int fleet_run(Fleet *fleet, uint64_t cycles);
+int fleet_get_state(const Fleet *fleet, int instance, CPUState *state);
+int fleet_num_groups(const Fleet *fleet); // Groups the last epoch ran, what the instances cost rather than instances
+
+const char *fleet_strerror(int err);
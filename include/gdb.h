@@ -0,0 +1,69 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// GDB remote serial protocol stub
+// Listens on a loopback TCP port or a Unix socket and lets any RSP client (gdb's `target remote`, IDEs, scripts)
+// poke at a CPU. Continue maps straight onto cpu_run_cycles() with Z0/Z1 breakpoints going into the CPU's
+// breakpoint map, so the firmware runs at full speed and the socket is only polled (for Ctrl-C) between chunks.
+//
+// Registers (g/G/p/P), in order, see the target.xml we hand out through qXfer:features:read:
+//   0      W                          8 bits
+//   1-32   f[0x00]-f[0x1F]            8 bits each, INDF reads through FSR and PCL is the low byte of PC
+//   33     PC                         16 bits, byte address like everything else code related (so word address * 2)
+//   34-35  STACK0, STACK1             16 bits, same again
+//   36     OPTION, 37 TRISGPIO        8 bits
+//   38     CYCLES (inst_cycles)       64 bits, read-only
+//
+// Memory (m/M), AVR style since gdb wants one address space:
+//   0x000000-0x0003FF  program memory, 2 bytes per word little endian (so word address * 2), the part's size
+//                      (0x0001FF on the 10F200, 0x0007FF on the 12F509)
+//   0x001FFE-0x001FFF  config word
+//   0x800000-0x80001F  register file as instructions see it (so banked through FSR on the 12F509), with no GPIO
+//                      callbacks on either reads or writes
+// Breakpoint addresses are program memory byte addresses too, write watchpoints (Z2) take register file addresses.
+//
+// With a History (history.h) attached, bs and bc step and continue backwards. Register/memory writes from the
+// debugger aren't part of the recording though, so travelling back past one undoes it.
+//
+// Monitor commands: "reset", "break <addr> <condition>" for a conditional breakpoint (see expr.h) and "delete <addr>".
+
+#define GDB_PACKET_SIZE 4096
+#define GDB_POLL_CYCLES 1000000 // How long continue runs between checks for Ctrl-C
+
+#define GDB_MEM_DATA 0x800000
+
+// What gdb_serve() ended with, negative on errors like the other modules
+#define GDB_DETACHED       0 // D packet, the CPU is left as is
+#define GDB_KILLED         1 // k packet
+#define GDB_ERR_SOCKET    -1 // Couldn't create/bind/listen/accept
+#define GDB_ERR_ADDRESS   -2 // Couldn't make sense of the address
+#define GDB_ERR_CLOSED    -3 // The client went away without detaching
+
+typedef struct GdbServer {
+    CPU *cpu;
+    int listen_fd;
+    int fd;
+    bool no_ack;    // QStartNoAckMode
+    bool verbose;   // Prints every packet
+    struct History *history; // Optional, runs go through it and reverse stepping/continuing (bs/bc) work
+    char packet[GDB_PACKET_SIZE + 1];
+    char reply[GDB_PACKET_SIZE + 1];
+
+    // Read buffer for the socket
+    char in[GDB_PACKET_SIZE];
+    int in_len;
+    int in_pos;
+} GdbServer;
+
+// Setting up, address is "port" or "host:port" for TCP (host defaults to 127.0.0.1), anything with a '/' is a Unix socket
+int gdb_listen(GdbServer *gdb, CPU *cpu, const char *address);
+int gdb_accept(GdbServer *gdb); // Waits for a client
+void gdb_attach_fd(GdbServer *gdb, CPU *cpu, int fd); // Uses an already connected socket instead (socketpair() etc.)
+void gdb_close(GdbServer *gdb);
+
+// Handles packets until the client detaches, kills or disconnects, returns a GDB_* code
+int gdb_serve(GdbServer *gdb);
+
+const char *gdb_strerror(int err);
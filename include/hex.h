@@ -0,0 +1,50 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Intel HEX (INHX8M/INHX32) parsing into a plain word image
+// Baseline PICs address program memory in 12-bit words, but the HEX file counts in bytes (2 per word, little endian)
+// Word 0xFFF (byte 0x1FFE) is where the config word lives, so an image covering 0x000-0xFFF holds everything we care about
+#define HEX_WORDS       0x1000
+#define HEX_CONFIG_ADDR 0xFFF
+
+// Error codes, all negative so "if (err < 0)" works
+#define HEX_OK            0
+#define HEX_ERR_IO       -1 // Couldn't open or read the file
+#define HEX_ERR_SYNTAX   -2 // Non-hex character or truncated record
+#define HEX_ERR_CHECKSUM -3 // Record checksum didn't add up
+#define HEX_ERR_RECORD   -4 // Unknown record type or malformed extended address record
+#define HEX_ERR_ADDRESS  -5 // Data outside of the word space (or outside program memory when loading into a CPU)
+#define HEX_ERR_NO_EOF   -6 // Ran out of buffer without seeing an EOF record
+#define HEX_ERR_MEMORY   -7 // malloc said no
+
+// Record types
+#define HEX_REC_DATA           0x00
+#define HEX_REC_EOF            0x01
+#define HEX_REC_EXT_SEGMENT    0x02
+#define HEX_REC_START_SEGMENT  0x03
+#define HEX_REC_EXT_LINEAR     0x04
+#define HEX_REC_START_LINEAR   0x05
+
+typedef struct HexImage {
+    uint16_t words[HEX_WORDS];
+    uint8_t present[HEX_WORDS / 8]; // Bitmap of which words were actually written by the file
+
+    // Bookkeeping
+    uint32_t num_records;
+    uint32_t error_line; // 1-based line of the offending record, 0 if no error
+} HexImage;
+
+// Parsing, all of these return HEX_OK or one of the HEX_ERR_* codes and never exit()
+void hex_image_clear(HexImage *image);
+int hex_parse(HexImage *image, const char *buf, size_t len);
+int hex_read_file(HexImage *image, const char *hex_path);
+int hex_validate(const HexImage *image, int num_words); // HEX_ERR_ADDRESS if anything lands outside a part with num_words of program memory
+
+// Helpers
+static inline bool hex_word_present(const HexImage *image, uint16_t addr)
+{
+    return (image->present[addr >> 3] >> (addr & 7)) & 1;
+}
+const char *hex_strerror(int err);
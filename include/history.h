@@ -0,0 +1,99 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Time travel: reverse stepping and reverse continue
+// Running through history_run() takes a CPUState checkpoint every so often and logs everything that isn't
+// deterministic (GPIO read callback results and cpu_setgpio()/history_setgpio() calls). Going back to an earlier cycle restores
+// the nearest checkpoint before it and replays from there, with the logged inputs instead of the callbacks,
+// so the replay ends up in exactly the same state. GPIO write callbacks are muted while replaying.
+//
+// Checkpoints are capped at max_checkpoints: when they run out every other one is dropped and the spacing doubles,
+// so going back costs at most one interval of replay.
+// Read results are run-length encoded, since they rarely change from one read to the next. Each input log holds up to
+// max_log entries, past that the oldest half of the checkpoints gets dropped along with the inputs only they needed,
+// so memory stays bounded for runs of any length (going back that far is then HISTORY_ERR_RANGE).
+// If a log can't grow at all (out of memory, or a single interval needing more than max_log entries) history starts
+// over from the next instruction boundary instead of replaying wrong.
+//
+// Running forward from the past replays history up to where it ended and then carries on live.
+// Changing an input in the past (history_setgpio()) throws away everything after it.
+// Reloading program memory invalidates the history, see history_reset().
+
+#define HISTORY_INTERVAL        100000 // Starting checkpoint spacing in cycles
+#define HISTORY_MAX_CHECKPOINTS 1024
+#define HISTORY_MAX_LOG         (1 << 20) // Entries per input log
+
+// Error codes, negative like everywhere else
+#define HISTORY_OK            0
+#define HISTORY_ERR_RANGE    -1 // Before the first checkpoint or past the end of history
+#define HISTORY_ERR_CHANGED  -2 // Program memory changed since the checkpoint was taken
+
+typedef struct Checkpoint {
+    CPUState state;
+    uint64_t read_seq;    // How many GPIO reads had happened
+    size_t event_index;   // How many cpu_setgpio() events had been applied
+} Checkpoint;
+
+typedef struct GpioEvent {
+    uint64_t cycle;
+    uint8_t value;
+} GpioEvent;
+
+// Reads first..(next run's first - 1) all returned value
+typedef struct ReadRun {
+    uint64_t first;
+    uint8_t value;
+} ReadRun;
+
+typedef struct History {
+    CPU *cpu;
+
+    Checkpoint *checkpoints;
+    int num_checkpoints;
+    int max_checkpoints;
+    uint64_t interval;     // Current spacing, doubles whenever the checkpoints get thinned out
+    size_t max_log;        // Entries either input log can hold, HISTORY_MAX_LOG unless changed after history_init()
+    bool applying;         // Feeding logged events back in, so cpu_setgpio() shouldn't log them again
+    bool lost;             // A log couldn't grow, so history starts over at the next instruction boundary
+
+    ReadRun *reads;
+    size_t num_runs;
+    size_t runs_capacity;
+    uint64_t num_reads;    // Reads logged in total
+    uint64_t read_seq;     // The next read, anything below num_reads gets replayed from the log
+
+    GpioEvent *events;
+    size_t num_events;
+    size_t events_capacity;
+    size_t next_event;
+
+    uint64_t end_cycle;    // How far history goes, past this everything is live
+
+    // The CPU's own callbacks, ours go in their place
+    void (*gpio_read_callback)(struct CPU *, uint8_t *);
+    void (*gpio_write_callback)(struct CPU *, uint8_t *);
+} History;
+
+// -structors, max_checkpoints of 0 means HISTORY_MAX_CHECKPOINTS
+// Attaching takes over the CPU's GPIO callbacks (set them first) and starts history at the current cycle
+void history_init(History *history, CPU *cpu, int max_checkpoints);
+void history_reset(History *history); // Forgets everything and starts over from the current cycle
+void history_deinit(History *history); // Gives the CPU its callbacks back
+
+// Going forward, same as cpu_run_cycles()/cpu_step()/cpu_setgpio() but recorded
+int history_run(History *history, uint64_t max_cycles);
+void history_step(History *history);
+void history_setgpio(History *history, uint8_t newgpio);
+
+// cpu_setgpio() calls this for us, so the host setting pins directly gets recorded too
+void history_log_set(History *history, uint8_t newgpio);
+
+// Going backward, these land on instruction boundaries and return HISTORY_OK or a HISTORY_ERR_* code
+int history_seek(History *history, uint64_t cycle); // The last instruction boundary at or before cycle
+int history_step_back(History *history); // The instruction before the current one
+int history_reverse_continue(History *history, int *reason); // Back to the latest breakpoint/watchpoint hit, reason gets the STOP_*
+
+size_t history_memory(const History *history); // Roughly how many bytes it's using
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include "cpu.h"
+#include "hex.h"
+
+// Precompiled firmware images
+// A flat, fixed-layout binary file that can be mmap'd and used as-is as the program memory of any number of CPUs,
+// so starting a simulation costs a page fault instead of parsing and decoding a HEX file.
+// Everything is stored in host byte order (little endian on anything we'd realistically run on).
+#define IMAGE_MAGIC   0x46323143 // "C12F"
+#define IMAGE_VERSION 1
+#define IMAGE_WORDS   512
+
+// Error codes, negative like the HEX ones
+#define IMAGE_OK            0
+#define IMAGE_ERR_IO       -1 // Couldn't open, read, write or map the file
+#define IMAGE_ERR_FORMAT   -2 // Wrong magic or size
+#define IMAGE_ERR_VERSION  -3 // Made by a different version of the format
+#define IMAGE_ERR_CHECKSUM -4 // Payload doesn't match the header checksum
+#define IMAGE_ERR_HEX      -5 // The source HEX file didn't fit the part (see hex.h for parse errors)
+#define IMAGE_ERR_DEVICE   -6 // The CPU's device doesn't have 512 words of program memory (a 12F509 or 10F200)
+
+// Per-word analysis flags
+#define IMAGE_WORD_PRESENT     0x01 // Programmed by the source file, rather than left erased
+#define IMAGE_WORD_JUMP_TARGET 0x02 // Some GOTO in the image lands here
+#define IMAGE_WORD_CALL_TARGET 0x04 // Some CALL in the image lands here
+#define IMAGE_WORD_SKIPPABLE   0x08 // Directly follows a skip instruction (DECFSZ, INCFSZ, BTFSC, BTFSS)
+
+typedef struct FirmwareImage {
+    // Header
+    uint32_t magic;     // IMAGE_MAGIC
+    uint16_t version;   // IMAGE_VERSION
+    uint16_t num_words; // Program memory size in words
+    uint32_t size;      // sizeof(FirmwareImage), catches truncated files
+    uint32_t checksum;  // FNV-1a over everything after the header
+
+    // Payload
+    uint16_t config;
+    uint8_t osccal;     // Also baked into inst[0x1FF] as MOVLW osccal
+    uint8_t reserved;
+    uint16_t inst[IMAGE_WORDS];
+    uint8_t ops[IMAGE_WORDS];        // instruction_decode() of every word
+    uint8_t word_flags[IMAGE_WORDS]; // IMAGE_WORD_* flags
+} FirmwareImage;
+
+// Building
+int image_from_hex(FirmwareImage *image, const HexImage *hex, uint8_t osccal);
+void image_finalise(FirmwareImage *image); // Recomputes ops, flags and checksum after inst[] has been changed
+uint32_t image_checksum(const FirmwareImage *image);
+
+// Files
+int image_write(const FirmwareImage *image, const char *path);
+int image_validate(const FirmwareImage *image, size_t size);
+const FirmwareImage *image_map(const char *path, int *err); // Read-only mapping, NULL on error (err gets the code)
+void image_unmap(const FirmwareImage *image);
+
+// Points a CPU's program memory straight at the image (no copy), any number of CPUs can share one image
+// The image must outlive the CPUs using it, and it's read-only, so don't poke cpu->inst afterwards
+// Only for devices with IMAGE_WORDS of program memory, returns IMAGE_ERR_DEVICE for anything else
+// Counts as a change to every word, bumps inst_generation and calls inst_change_callback like a reload
+int image_attach(CPU *cpu, const FirmwareImage *image);
+
+const char *image_strerror(int err);
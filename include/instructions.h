@@ -41,7 +41,70 @@
 #define TRIS  0x006 //0x0 // All 0 except first 3 bytes for f // Can only be 6 for the 12f508 anyways, since there's only one TRIS reg
 #define XORLW 0xF00 //0xF
 
-void instruction_cycle(CPU *cpu); // I'd like to make this actually cycle-accurate at somepoint
+// Decoded instruction kinds, what instruction_decode() spits out
+// Same order as the handlers below, OP_ILLEGAL is 0 so zeroed tables decode as illegal
+enum {
+    OP_ILLEGAL = 0,
+    // Byte-level
+    OP_ADDWF, OP_ANDWF, OP_CLRF, OP_CLRW, OP_COMF, OP_DECF, OP_DECFSZ, OP_INCF, OP_INCFSZ,
+    OP_IORWF, OP_MOVF, OP_MOVWF, OP_NOP, OP_RLF, OP_RRF, OP_SUBWF, OP_SWAPF, OP_XORWF,
+    // Bit-level
+    OP_BCF, OP_BSF, OP_BTFSC, OP_BTFSS,
+    // Literal & control
+    OP_ANDLW, OP_CALL, OP_CLRWDT, OP_GOTO, OP_IORLW, OP_MOVLW, OP_OPTION, OP_RETLW, OP_SLEEP, OP_TRIS, OP_XORLW,
+    OP_COUNT
+};
+
+void instruction_cycle(CPU *cpu); // Whole instruction at a time, see pipeline.h for the cycle-accurate one
+uint8_t instruction_execute(CPU *cpu, uint16_t instruction); // Just the decode + execute part, returns how many cycles it took (1 or 2)
+void instruction_tick(CPU *cpu); // One instruction cycle worth of prescaler/Timer0/WDT
+
+// The guts of instruction_tick(), inline so the specialised engines can pass constants and have the branches fold away
+// tmr0:    Timer0 counts the instruction clock (TOCS = 0), the T0CKI pin isn't emulated so it's frozen otherwise
+// psa_wdt: Prescaler assigned to the WDT (PSA = 1), Timer0 then counts 1:1
+// wdt:     Watchdog enabled in the config word
+// Returns true if the WDT reset the CPU
+static inline bool instruction_tick_with(CPU *cpu, bool tmr0, bool psa_wdt, bool wdt)
+{
+    // Prescale time!
+    cpu->prescaler++;
+    
+    // Timer0 doesn't run while asleep
+    if (tmr0 && !cpu->asleep) {
+        if (cpu->timer0_inhibit > 0) {
+            // Inhibit timer0 for 2 cycles after write
+            cpu->timer0_inhibit--;
+            if (!psa_wdt)
+                cpu->prescaler--; // Hack: Just decrement prescaler to pretend it didn't happen
+        }
+        else if (psa_wdt)
+            cpu->f[TMR0]++;
+        // Adding 1 since prescaler 000 means 1:2
+        else if (cpu->prescaler >= (1u << ((cpu->option & PS)+1))) {
+            cpu->prescaler = 0;
+            cpu->f[TMR0]++;
+        }
+    }
+    
+    // Same but for WDT (also we don't add 1 since prescaler 000 means 1:1)
+    if (psa_wdt && wdt) {
+        // 18,000 cycles per WDT timer increment (for a 1mhz instruction cycle rate)
+        // I'm not running a separate thread for the WDT so this is the best workaround I can think of
+        if (cpu->prescaler >= (1u << (cpu->option & PS))*18000) {
+            cpu->prescaler = 0;
+            cpu->wdt++;
+            
+            // WDT timeout handling
+            // Just checking for overflow, which it will be here if it's zero :)
+            if (cpu->wdt == 0) {
+                cpu_reset(cpu, cpu->asleep ? RESET_WDT_SLEEP : RESET_WDT_NORMAL);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+uint8_t instruction_decode(uint16_t instruction); // Returns one of the OP_* kinds, matching what instruction_cycle() would execute
 
 // Byte-level Instructions
 void inst_ADDWF(CPU *cpu, uint8_t f, uint8_t d);
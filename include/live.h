@@ -0,0 +1,90 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Live state export: running CPUs publish their registers into a POSIX shared memory segment (shm_open()), so viewers
+// in other processes (a GUI, tools/liveview.c) can show them as they go without any IPC calls or locks
+//
+// The segment is a LiveHeader followed by num_slots LiveSlots, one per CPU, each with its own writer. Slots are
+// seqlocked: the writer makes seq odd, copies the state in and makes it even again, a reader copies the state out and
+// only keeps it if seq was even and the same before and after. So the writer never waits for anyone and a reader
+// just retries on the rare torn copy. Slots are a cache line or two each so writers on different cores don't fight.
+//
+// Publishing is a ~100 byte copy, done every interval cycles by live_run_cycles() (or whenever live_publish() gets
+// called), which is nothing next to the cycles in between. At the default interval a viewer refreshing at 60 Hz sees
+// a fresh state every frame with the CPU running anywhere above 6 MHz.
+//
+// Everything's in host byte order, viewers are on the same machine anyways.
+
+#define LIVE_MAGIC            0x4556494C // "LIVE"
+#define LIVE_VERSION          1
+#define LIVE_SLOT_SIZE        128
+#define LIVE_MAX_SLOTS        4096
+#define LIVE_DEFAULT_INTERVAL 100000
+
+// Error codes, negative like everywhere else
+#define LIVE_OK          0
+#define LIVE_ERR_ARG    -1 // Bad name, slot count or slot
+#define LIVE_ERR_IO     -2 // Couldn't create, open, size or map the segment
+#define LIVE_ERR_FORMAT -3 // Not a live segment, or a different version of one
+
+// What gets published, a fixed layout
+typedef struct LiveState {
+    uint64_t cycles;
+    uint64_t wall_ns;     // CLOCK_MONOTONIC when it was published, for working out how fast it's going
+    uint64_t publishes;   // Counting this one
+    uint64_t memo_hits;   // From the CPU's Memo (memo.h), 0 without one
+    uint64_t memo_cycles_skipped;
+    uint16_t pc;          // Only the bits addressing program memory, PC creeps along while asleep
+    uint16_t stack[2];
+    uint16_t config;
+    uint8_t w;
+    uint8_t gpio;         // Same as f[GPIO]
+    uint8_t tris;
+    uint8_t option;
+    uint8_t asleep;
+    uint8_t reserved[3];
+    uint8_t f[32];
+} LiveState;
+
+typedef struct LiveSlot {
+    uint32_t seq;         // Odd while being written
+    uint32_t reserved;
+    LiveState state;
+    uint8_t padding[LIVE_SLOT_SIZE - 8 - sizeof(LiveState)];
+} LiveSlot;
+
+typedef struct LiveHeader {
+    uint32_t magic;       // LIVE_MAGIC
+    uint16_t version;     // LIVE_VERSION
+    uint16_t slot_size;   // LIVE_SLOT_SIZE
+    uint32_t num_slots;
+    uint32_t reserved;
+    uint64_t interval;    // What the writer's publishing at, in cycles
+    uint8_t padding[LIVE_SLOT_SIZE - 24];
+} LiveHeader;
+
+typedef struct Live {
+    char name[256];
+    LiveHeader *header;
+    LiveSlot *slots;
+    int num_slots;
+    uint64_t interval;    // LIVE_DEFAULT_INTERVAL unless changed
+    bool owner;           // Made it (unlinks it again), rather than attached to it
+} Live;
+
+// The writing side, name is a shm_open() one ("/something"), replacing any segment already called that
+int live_create(Live *live, const char *name, int num_slots, uint64_t interval);
+void live_destroy(Live *live); // Unmaps and unlinks it, viewers still attached keep their mapping
+void live_publish(Live *live, int slot, const CPU *cpu);
+// Runs like cpu_run_cycles(), publishing every interval cycles and once more at the end
+int live_run_cycles(Live *live, int slot, CPU *cpu, uint64_t max_cycles);
+
+// The viewing side, read-only
+int live_attach(Live *live, const char *name);
+void live_detach(Live *live);
+// A consistent copy of the slot's state, false if nothing's been published to it yet (or it never got a clean copy)
+bool live_read(const Live *live, int slot, LiveState *state);
+
+const char *live_strerror(int err);
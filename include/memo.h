@@ -0,0 +1,115 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "analysis.h"
+
+// Memoised subroutines: calls to routines that are pure functions of a few registers get skipped when the same
+// inputs have been seen before, with the recorded outputs and cycle count applied in one go
+//
+// A routine is pure if nothing it (or anything it calls) runs touches the outside world: no INDF, TMR0, PCL or GPIO,
+// no OPTION, TRIS, SLEEP or CLRWDT, and it always comes back through a RETLW. That gets worked out statically from
+// analysis.h's blocks, along with dataflow over them for exactly which registers matter:
+//   - inputs: registers (W and the C/DC/Z flags counting as registers) read before being written on some path,
+//     plus anything only written on some paths, since that one passes straight through on the others
+//   - outputs: anything it can write
+// A call records (inputs) -> (outputs, stack, cycles) the first time, every later call with the same inputs is a hit:
+// the outputs get written, the cycle counter jumps ahead and Timer0/the prescaler/the WDT get ticked for every cycle
+// skipped, so the state afterwards is exactly what running it would have given.
+//
+// Hits only happen in the fast engine, when the whole call fits before the end of the run, no breakpoint sits in the
+// routine, no watchpoint is on its outputs and the WDT can't time out part way through. Everything else runs it for
+// real. Routines are profiled as they go, ones that hardly ever hit (MEMO_PROFILE_CALLS calls in, fewer than one in
+// MEMO_MIN_HIT_RATIO hitting) stop being recorded, so they cost nothing after that.
+//
+// Program memory changes (cpu_reload_*(), cpu_write_inst()) reclassify everything and throw the results away,
+// call memo_refresh() after changing cpu->inst any other way.
+
+#define MEMO_MAX_ROUTINES    ANALYSIS_MAX_ROUTINES
+#define MEMO_DEFAULT_ENTRIES 16384 // Recorded calls kept, across all routines
+#define MEMO_PROFILE_CALLS   256
+#define MEMO_MIN_HIT_RATIO   8
+#define MEMO_MAX_REGS        40    // 32 registers, W, C, DC, Z
+
+// Why a routine isn't pure
+#define MEMO_PURE       0
+#define MEMO_IO         1 // Touches INDF, TMR0, PCL or GPIO, or runs OPTION/TRIS
+#define MEMO_SLEEPS     2 // SLEEP or CLRWDT
+#define MEMO_NO_RETURN  3 // Some way through it doesn't end in a RETLW, or goes somewhere the analysis couldn't follow
+#define MEMO_RECURSIVE  4
+
+// Pseudo registers past the 32 real ones, in the 64-bit sets
+#define MEMO_REG_W  32
+#define MEMO_REG_C  33
+#define MEMO_REG_DC 34
+#define MEMO_REG_Z  35
+// STATUS itself (register 3) stands for the rest of its bits
+
+#define MEMO_STACK_FROM 0x8000
+
+// Error codes, negative like everywhere else
+#define MEMO_OK          0
+#define MEMO_ERR_MEMORY -1
+#define MEMO_ERR_DEVICE -2 // Not a PIC12F508
+
+typedef struct MemoRoutine {
+    uint16_t entry;
+    int purity;          // MEMO_PURE or why not
+    uint64_t inputs;     // Bit n for register n, see above
+    uint64_t outputs;
+    uint64_t must_write; // Written on every way through
+    uint8_t words[ANALYSIS_WORDS / 8]; // Everything it runs, callees included, for spotting breakpoints
+    bool recording;      // Still worth recording calls to
+
+    uint8_t key[MEMO_MAX_REGS]; // inputs and outputs as lists of registers
+    int key_size;
+    uint8_t out[MEMO_MAX_REGS];
+    int out_size;
+
+    uint64_t calls;
+    uint64_t hits;
+    uint64_t recorded;
+} MemoRoutine;
+
+typedef struct MemoEntry {
+    uint8_t routine;     // Index + 1, 0 for an empty slot
+    uint16_t stack[2];   // What each stack slot holds afterwards: a return address pushed inside, or MEMO_STACK_FROM | 0/1
+                         // for what was in that slot before the call, MEMO_STACK_FROM | 2 for the call's return address
+    uint8_t key[MEMO_MAX_REGS];
+    uint8_t out[MEMO_MAX_REGS];
+    uint32_t cycles;     // From the CALL up to and including the RETLW
+} MemoEntry;
+
+typedef struct Memo {
+    CPU *cpu;
+    Analysis *analysis;
+    MemoRoutine routines[MEMO_MAX_ROUTINES];
+    int num_routines;
+    uint8_t routine_at[ANALYSIS_WORDS]; // Index + 1 of the routine starting at each address, 0 for none
+
+    MemoEntry *entries;  // Hash table, replaced on collision
+    size_t capacity;     // Power of two
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t cycles_skipped;
+
+    // The host's callback, ours goes in its place
+    void (*inst_change_callback)(struct CPU *, const uint8_t *changed, int num_changed);
+} Memo;
+
+// capacity 0 for MEMO_DEFAULT_ENTRIES, rounded up to a power of two
+int memo_init(Memo *memo, CPU *cpu, size_t capacity);
+void memo_deinit(Memo *memo);
+void memo_refresh(Memo *memo); // Reclassifies the routines and forgets every recorded call
+void memo_clear(Memo *memo);   // Just forgets the recorded calls
+
+// The fast engine calls this on every CALL while a Memo is attached, with PC on the CALL
+// Returns true if it took care of the call (applied a hit, or ran it while recording) and the engine should carry on
+// from wherever PC is now, false if the engine should execute the CALL itself
+bool memo_call(Memo *memo, uint64_t limit);
+
+const MemoRoutine *memo_routine(const Memo *memo, uint16_t entry); // NULL if nothing calls there
+const char *memo_purity_name(int purity);
+const char *memo_strerror(int err);
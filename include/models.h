@@ -0,0 +1,73 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "bench.h"
+
+// Stock peripheral models for benches (bench.h), pins are GP* masks
+// Call the init function, then bench_attach() the model's Peripheral (&model->base)
+
+// Push button, drives its pin while the contacts are closed and lets go otherwise (so wire up a pull)
+// Changing state bounces for a while: BUTTON_BOUNCES contact flips at pseudo-random points within bounce_cycles
+#define BUTTON_BOUNCES 6
+
+typedef struct Button {
+    Peripheral base;
+    uint8_t pin;
+    bool active_low;         // Closed pulls it low rather than high
+    uint32_t bounce_cycles;  // 0 for a perfect switch
+    bool pressed;            // Where it's headed
+    bool closed;             // Where the contacts actually are right now
+    int bounces_left;
+    uint32_t seed;           // For the bounce timing, so runs repeat exactly
+} Button;
+
+void button_init(Button *button, uint8_t pin, bool active_low, uint32_t bounce_cycles);
+void button_set(Button *button, Bench *bench, bool pressed);
+
+
+// LED, keeps track of how long it's been lit
+typedef struct Led {
+    Peripheral base;
+    uint8_t pin;
+    bool active_low;         // Lit when the pin's low (wired to VDD)
+    bool lit;
+    uint64_t changed_at;     // Cycle it last turned on or off
+    uint64_t lit_cycles;     // Up to changed_at, see led_lit_cycles()
+    uint64_t toggles;
+} Led;
+
+void led_init(Led *led, uint8_t pin, bool active_low);
+uint64_t led_lit_cycles(const Led *led, const Bench *bench); // Including the current stretch
+
+
+// 74HC595 style shift register, shifts data in on clock's rising edge and copies it to the outputs on latch's
+// serial_out is the last stage (Q7') driven back onto a pin, 0 to leave it unconnected
+typedef struct ShiftRegister {
+    Peripheral base;
+    uint8_t data, clock, latch, serial_out;
+    uint8_t shift;
+    uint8_t outputs;
+    uint64_t latches;        // Times it's been latched
+} ShiftRegister;
+
+void shift_register_init(ShiftRegister *sr, uint8_t data, uint8_t clock, uint8_t latch, uint8_t serial_out);
+
+
+// RC delay/filter between two pins: output follows input delay cycles after it last changed,
+// so pulses shorter than the delay get swallowed
+typedef struct RcDelay {
+    Peripheral base;
+    uint8_t input, output;
+    uint64_t delay;
+    bool target;             // Level output is headed for
+} RcDelay;
+
+void rc_delay_init(RcDelay *rc, uint8_t input, uint8_t output, uint64_t delay);
+
+
+// Pull resistors, for buttons and open-drain buses (anything driving a pin beats them, low wins between drivers)
+typedef struct Pull {
+    Peripheral base;
+} Pull;
+
+void pull_init(Pull *pull, uint8_t pins, bool high);
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Pipeline-accurate execution engine
+// Every instruction cycle is 4 Q-cycles (Q1-Q4) while the next instruction is fetched in parallel:
+//   Q1 - decode the instruction register, PC increments
+//   Q2 - read operands, this is where GPIO input is sampled (so the read callback runs here)
+//   Q3 - process
+//   Q4 - write results, GPIO output is driven here (write callback), the fetch latches into the instruction register
+// Anything that changes PC (GOTO, CALL, RETLW, writes to PCL) flushes the prefetched instruction,
+// so the next cycle executes a forced NOP while the target is fetched.
+// At instruction boundaries the state always matches what instruction_cycle() would have produced.
+typedef struct Pipeline {
+    // Latches
+    uint16_t ir;             // Instruction register, fetched last cycle, executed this one
+    uint16_t ir_addr;        // Where ir was fetched from
+    uint32_t ir_generation;  // cpu->inst_generation when it was fetched
+    bool ir_valid;
+    bool flush;              // Last cycle branched, so this one is a forced NOP
+
+    // Current cycle
+    uint8_t q;               // Next Q phase to run, 0-3 for Q1-Q4
+    uint8_t exec_cycles;     // What the executing instruction returned (2 means it branched)
+    bool gpio_written;       // GPIO got written in Q2, drive it at Q4
+    void (*gpio_write_callback)(struct CPU *, uint8_t *); // The real callback while writes are held
+
+    // Hooks
+    void (*q_callback)(struct CPU *, uint8_t q); // Called at the start of every Q phase with 1-4
+    uint64_t q_cycles;
+} Pipeline;
+
+void pipeline_init(Pipeline *pipe);
+
+// Stepping, at increasing granularity
+void pipeline_qstep(CPU *cpu); // One Q-cycle
+void pipeline_cycle(CPU *cpu); // To the end of the current instruction cycle
+void pipeline_step(CPU *cpu);  // To the next instruction boundary (so same as instruction_cycle())
@@ -0,0 +1,110 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu.h"
+
+// Input recordings, for reproducing a run bit for bit somewhere else (say from a field report)
+// Recording logs the starting state, then every input keyed by cycle:
+//   - GPIO read callback results, but only when they differ from the previous read. Reads happen at the same cycles
+//     on replay, so any read returns whatever the latest logged read at or before its cycle returned.
+//   - cpu_setgpio() calls (so cpu_writepins() too), in order, any number per cycle. These should come from the host
+//     between runs, ones made from inside a callback would get replayed at the start of that instruction instead.
+// Replaying restores the starting state and feeds everything back without calling the host's read callback.
+// Recordings made without a read callback replay without one too, reads just see the pins as they are.
+// Logged sets are applied between engine runs, so replays go at full engine speed, and the log is decoded
+// RECORDING_BATCH records at a time rather than per read.
+//
+// File format, host byte order like the firmware images:
+//   RecordingHeader, then records of varint((cycle delta << 2) | kind) followed by a value byte (except for the end)
+// Deltas are from the previous record, or from the header's state for the first one.
+
+#define RECORDING_MAGIC   0x52323143 // "C12R"
+#define RECORDING_VERSION 2
+#define RECORDING_BATCH   4096  // Records decoded at a time when replaying
+#define RECORDING_BUFFER  65536 // Bytes buffered before writing when recording
+
+// Record kinds
+#define RECORDING_READ 0 // GPIO read callback result
+#define RECORDING_SET  1 // cpu_setgpio()
+#define RECORDING_END  2 // Recording stopped here, no value
+
+// Header flags
+#define RECORDING_FLAG_READS 0x1 // There was a read callback, so reads come from the log
+
+// Modes
+#define RECORDING_OFF    0
+#define RECORDING_RECORD 1
+#define RECORDING_REPLAY 2
+
+// Error codes, negative like everywhere else
+#define RECORDING_OK            0
+#define RECORDING_ERR_IO       -1 // Couldn't open, read or write the file
+#define RECORDING_ERR_FORMAT   -2 // Wrong magic, size or a broken record
+#define RECORDING_ERR_VERSION  -3 // Made by a different version of the format
+#define RECORDING_ERR_PROGRAM  -4 // Recorded with different program memory, or on a different part
+
+typedef struct RecordingHeader {
+    uint32_t magic;            // RECORDING_MAGIC
+    uint16_t version;          // RECORDING_VERSION
+    uint16_t state_size;       // sizeof(CPUState), catches incompatible builds
+    uint32_t program_checksum; // FNV-1a over the part and its program memory
+    uint32_t flags;            // RECORDING_FLAG_*
+    CPUState state;            // Where it all started
+} RecordingHeader;
+
+// A decoded record
+typedef struct RecordingEvent {
+    uint64_t cycle;
+    uint8_t value;
+} RecordingEvent;
+
+// Reads and sets get consumed at different rates, so each kind has its own cursor through the log
+typedef struct RecordingStream {
+    int kind;             // RECORDING_READ or RECORDING_SET
+    size_t pos;           // Byte offset of the next undecoded record
+    uint64_t cycle;       // Of the last record decoded (any kind), for the deltas
+    RecordingEvent *events;
+    int num_events;
+    int next_event;
+    bool ended;           // Got to the end record (or the end of the data)
+} RecordingStream;
+
+typedef struct Recording {
+    CPU *cpu;
+    int mode;
+
+    // Recording
+    FILE *file;
+    uint8_t *buffer;
+    size_t buffer_len;
+    bool failed;          // A write went wrong somewhere, recording_stop() reports it
+    uint64_t last_cycle;  // Of the previous record, for the deltas
+    bool have_read;       // Whether last_read means anything yet
+    uint8_t last_read;
+    uint64_t num_records;
+    void (*gpio_read_callback)(struct CPU *, uint8_t *); // The host's, ours goes in its place
+
+    // Replaying, the whole log gets loaded up front and decoded a batch at a time
+    uint8_t *data;
+    size_t data_len;
+    RecordingStream reads;
+    RecordingStream sets;
+    uint8_t read_value;   // What reads return right now
+    uint64_t end_cycle;   // Where recording stopped, UINT64_MAX until the end record turns up
+} Recording;
+
+// Recording from the CPU's current state, the read callback has to be set first
+int recording_start(Recording *rec, CPU *cpu, const char *path);
+int recording_stop(Recording *rec); // Writes the end record, gives back the callback and closes the file
+
+// Replaying, the CPU needs the same program loaded (and gets its state overwritten)
+int recording_replay(Recording *rec, CPU *cpu, const char *path);
+int recording_run(Recording *rec, uint64_t max_cycles); // Like cpu_run_cycles() with the logged inputs applied
+bool recording_done(const Recording *rec); // Replayed up to where recording stopped
+void recording_close(Recording *rec); // Stops replaying
+
+// cpu_setgpio() calls this for us
+void recording_log_set(Recording *rec, uint8_t newgpio);
+
+const char *recording_strerror(int err);
@@ -0,0 +1,68 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Save-state files, for warm-starting long scenarios from a checkpoint instead of simulating the boot every time
+// A flat, fixed-layout binary file holding everything cpu_save_state() does (PC, skipnext, asleep, the cycle counter,
+// the stack, W, the registers, TRIS, OPTION, config, the prescaler, timer0_inhibit and the WDT), plus a hash of the
+// program memory it was saved with and which device (device.h) it was, so it never gets restored on top of different
+// firmware or a different part. Like images it gets
+// mmap'd and validated, then restoring is just a copy into the CPU.
+// Everything is stored in host byte order (little endian on anything we'd realistically run on).
+#define SAVESTATE_MAGIC   0x54533231 // "12ST"
+#define SAVESTATE_VERSION 2 // 2 added the device and the second register bank
+
+// Error codes, negative like the image ones
+#define SAVESTATE_OK            0
+#define SAVESTATE_ERR_IO       -1 // Couldn't open, read, write or map the file
+#define SAVESTATE_ERR_FORMAT   -2 // Wrong magic or size
+#define SAVESTATE_ERR_VERSION  -3 // Made by a different version of the format
+#define SAVESTATE_ERR_CHECKSUM -4 // Payload doesn't match the header checksum
+#define SAVESTATE_ERR_PROGRAM  -5 // Saved with different program memory than the CPU has
+#define SAVESTATE_ERR_DEVICE   -6 // Saved from a different part than the CPU is
+
+typedef struct SaveState {
+    // Header
+    uint32_t magic;        // SAVESTATE_MAGIC
+    uint16_t version;      // SAVESTATE_VERSION
+    uint16_t reserved;
+    uint32_t size;         // sizeof(SaveState), catches truncated files
+    uint32_t checksum;     // FNV-1a over everything after the header
+
+    // Payload, laid out so there's no padding anywhere
+    uint64_t program_hash; // savestate_program_hash() of the program memory
+    uint64_t inst_cycles;
+    uint32_t prescaler;
+    uint16_t pc;
+    uint16_t config;
+    uint16_t stack[2];
+    uint8_t w;
+    uint8_t trisgpio;
+    uint8_t option;
+    uint8_t timer0_inhibit;
+    uint8_t wdt;
+    uint8_t skipnext;
+    uint8_t asleep;
+    uint8_t device;        // Device.index
+    uint8_t padding[4];
+    uint8_t f[DEVICE_MAX_REGS];
+} SaveState;
+
+// Building, from a CPU at an instruction boundary (where cpu_step()/cpu_run*() leave it)
+void savestate_from_cpu(SaveState *save, const CPU *cpu);
+uint32_t savestate_checksum(const SaveState *save);
+uint64_t savestate_program_hash(const uint16_t *inst, int num_words); // Only the 12 bits that exist
+
+// Files
+int savestate_write(const CPU *cpu, const char *path);
+int savestate_validate(const SaveState *save, size_t size);
+const SaveState *savestate_map(const char *path, int *err); // Read-only mapping, NULL on error (err gets the code)
+void savestate_unmap(const SaveState *save);
+
+// Puts the saved state into the CPU (program memory has to be loaded already), the CPU is left untouched on error
+// Breakpoints, watchpoints, callbacks and the engine are the CPU's own and stay as they are
+int savestate_restore(CPU *cpu, const SaveState *save);
+int savestate_load(CPU *cpu, const char *path); // savestate_map(), savestate_restore(), savestate_unmap()
+
+const char *savestate_strerror(int err);
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Stimulus files, declarative input waveforms compiled into a sorted schedule when they're loaded
+// Running one applies each event with cpu_setgpio() between engine runs, so there's no read callback at all and the
+// engine only stops where something actually changes. Expectations make a file a self-checking scenario.
+//
+// One statement per line, # starts a comment, times are in instruction cycles from stimulus_start():
+//   seed 1234                                   seeds the jitter, can come anywhere and reseeds from there on
+//   run 100000                                  how long the scenario lasts (otherwise until the last event)
+//   set gp0 high at 500                         levels are 0/1/low/high, pins gp0-gp5
+//   pulse gp3 at 1000 width 20 [level low]      to the level (high by default) and back again
+//   clock gp2 at 0 period 100 count 50 [high 30]  rising edge every period, high for half of it by default
+//   pattern gp0 at 2000 bit 104 0_10010110_1    a level per bit time, underscores are just for reading
+//   expect gp1 low at 3000                      checked against the pin right before the instruction at that cycle
+//   repeat 10 every 20000 {                     times inside are from the start of each repetition, can nest
+//   }
+// Any of the timed ones can have "jitter <cycles>" on the end, which moves each edge by up to that much either way
+// (edges never swap places). Pins the CPU is driving at the time don't get overwritten, those count as contentions.
+
+#define STIMULUS_MAX_EVENTS (1 << 22)
+#define STIMULUS_MAX_DEPTH  8
+#define STIMULUS_MAX_TOKENS 16
+
+// Event kinds
+#define STIMULUS_SET    0
+#define STIMULUS_EXPECT 1
+
+// Error codes, negative like everywhere else
+#define STIMULUS_OK            0
+#define STIMULUS_ERR_IO       -1 // Couldn't open or read the file
+#define STIMULUS_ERR_SYNTAX   -2 // Unknown statement or option, missing or bad value
+#define STIMULUS_ERR_PIN      -3 // Not gp0-gp5
+#define STIMULUS_ERR_BLOCK    -4 // Unbalanced braces, or repeats nested too deep
+#define STIMULUS_ERR_TOO_BIG  -5 // More than STIMULUS_MAX_EVENTS edges
+#define STIMULUS_ERR_MEMORY   -6 // malloc said no
+
+typedef struct StimulusEvent {
+    uint64_t cycle;   // From the start
+    uint32_t line;    // Where it came from, for reporting failed expectations
+    uint8_t kind;     // STIMULUS_SET or STIMULUS_EXPECT
+    uint8_t mask;     // Pins involved, sets on the same cycle get merged into one event
+    uint8_t value;
+} StimulusEvent;
+
+typedef struct Stimulus {
+    StimulusEvent *events; // Sorted by cycle, file order within a cycle
+    size_t num_events;
+    uint64_t length;       // From "run", or the last event's cycle
+    int error_line;        // 1-based line that didn't load, 0 if none
+
+    // Running
+    CPU *cpu;
+    uint64_t start;        // inst_cycles at stimulus_start()
+    size_t next;
+    uint64_t expects;      // Checked so far
+    uint64_t failures;
+    uint64_t contentions;  // Sets that hit a pin the CPU was driving
+    uint32_t failed_line;  // First failed expectation, 0 if none
+    uint64_t failed_cycle;
+    uint8_t failed_pins;   // What the pins read then
+} Stimulus;
+
+// Loading, both return STIMULUS_OK or one of the errors with error_line set
+int stimulus_parse(Stimulus *stim, const char *text);
+int stimulus_load(Stimulus *stim, const char *path);
+void stimulus_free(Stimulus *stim);
+
+// Running, from the CPU's current cycle
+void stimulus_start(Stimulus *stim, CPU *cpu);
+int stimulus_run(Stimulus *stim, uint64_t max_cycles); // Like cpu_run_cycles(), but won't go past the end of the scenario
+bool stimulus_done(const Stimulus *stim);
+
+const char *stimulus_strerror(int err);
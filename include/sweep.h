@@ -0,0 +1,98 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "image.h"
+
+// Exhaustive input sweeps: runs a routine between two PCs for every combination of some input registers and checks
+// every result against a reference function in C, for verifying firmware maths before it ships
+//
+// Every case starts from the same snapshot (cpu_save_state() of the CPU given to sweep_init(), with PC moved to
+// start_pc), gets its inputs stored straight into the register file and runs until PC reaches end_pc. The outputs are
+// then read back (through cpu_getreg(), so GPIO and friends read like the firmware would see them) and compared with
+// what the reference says they should be. A case that doesn't get to end_pc within the budget is a timeout.
+//
+// The cases are shared out in chunks across threads, each with its own CPU, all of them running on one FirmwareImage
+// copy of program memory, so a case costs a cpu_load_state() and the run itself. Results don't depend on the number
+// of threads: the detailed mismatches kept are always the first ones in case order.
+//
+// Cases are numbered with the last input added counting fastest, so for inputs (numerator, denominator) case 1 is
+// numerator's first value over denominator's second. W is SWEEP_REG_W as an input or an output.
+
+#define SWEEP_MAX_INPUTS     3    // 16M cases at 8 bits each is plenty
+#define SWEEP_MAX_OUTPUTS    8
+#define SWEEP_MAX_MISMATCHES 16   // Kept in detail, the rest only get counted
+#define SWEEP_HISTOGRAM      4096 // Cycle counts below this get counted exactly, anything longer in the last bucket
+#define SWEEP_REG_W          32
+#define SWEEP_DEFAULT_BUDGET 1000000
+#define SWEEP_CHUNK          256  // Cases a thread takes at a time
+
+// Error codes, negative like everywhere else
+#define SWEEP_OK           0
+#define SWEEP_ERR_ARG     -1 // Too many inputs or outputs, a register past W, first > last, or no reference
+#define SWEEP_ERR_MEMORY  -2
+#define SWEEP_ERR_THREADS -3 // Couldn't start the worker threads
+#define SWEEP_ERR_DEVICE  -4 // Not a PIC12F508
+
+// Fills expected with what the outputs should be (in the order they were added) given the inputs (likewise)
+typedef void (*SweepReference)(const uint8_t *inputs, uint8_t *expected, void *ctx);
+
+typedef struct SweepInput {
+    uint8_t reg;
+    uint8_t first;
+    uint8_t last;        // Inclusive
+} SweepInput;
+
+typedef struct SweepMismatch {
+    uint64_t index;      // Case number
+    uint8_t inputs[SWEEP_MAX_INPUTS];
+    uint8_t got[SWEEP_MAX_OUTPUTS];
+    uint8_t expected[SWEEP_MAX_OUTPUTS];
+    uint64_t cycles;     // From start_pc to end_pc, or to giving up
+    bool timed_out;      // Never got to end_pc, got is wherever it was at the time
+} SweepMismatch;
+
+typedef struct Sweep {
+    // Setup
+    CPUState start;
+    FirmwareImage *image;
+    uint16_t end_pc;
+    SweepInput inputs[SWEEP_MAX_INPUTS];
+    int num_inputs;
+    uint8_t outputs[SWEEP_MAX_OUTPUTS];
+    int num_outputs;
+    SweepReference reference;
+    void *ctx;
+    uint64_t budget;     // Cycles a case gets to reach end_pc, SWEEP_DEFAULT_BUDGET unless changed
+
+    // Results of the last sweep_run()
+    uint64_t cases;
+    uint64_t passed;
+    uint64_t mismatches; // Got to end_pc with the wrong outputs
+    uint64_t timeouts;
+    uint64_t min_cycles; // Over the cases that got to end_pc
+    uint64_t max_cycles;
+    uint64_t total_cycles;
+    uint64_t histogram[SWEEP_HISTOGRAM + 1];
+    SweepMismatch failed[SWEEP_MAX_MISMATCHES]; // Mismatches and timeouts, first in case order
+    int num_failed;
+    double seconds;
+} Sweep;
+
+// Takes the snapshot and a copy of program memory, the CPU isn't needed after this
+int sweep_init(Sweep *sweep, const CPU *cpu, uint16_t start_pc, uint16_t end_pc);
+void sweep_deinit(Sweep *sweep);
+int sweep_add_input(Sweep *sweep, uint8_t reg, uint8_t first, uint8_t last);
+int sweep_add_output(Sweep *sweep, uint8_t reg);
+void sweep_set_reference(Sweep *sweep, SweepReference reference, void *ctx);
+
+// Runs every case, num_threads includes the calling thread (1 runs everything inline)
+// Returns SWEEP_OK even when cases fail, that's what the results are for
+int sweep_run(Sweep *sweep, int num_threads);
+uint64_t sweep_num_cases(const Sweep *sweep);
+void sweep_case_inputs(const Sweep *sweep, uint64_t index, uint8_t *inputs);
+
+// Summary, the first mismatches and the cycle count distribution
+void sweep_print(const Sweep *sweep, FILE *out);
+const char *sweep_strerror(int err);
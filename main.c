@@ -1,10 +1,572 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
-#include "include/cpu.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "cpu.h"
+#include "expr.h"
+#include "hex.h"
+#include "image.h"
+#include "live.h"
+#include "memo.h"
+#include "savestate.h"
+#include "stimulus.h"
 
-int main() {
+// Headless batch runner, every firmware gets run against every stimulus file (or just once without any) across all
+// the cores, then the results come out as JSON on stdout in the same order as the arguments
+// Exits with 1 if anything failed to load or an expectation didn't hold, so it can gate CI on its own
+
+#define MAX_BREAKPOINTS 64
+#define DEFAULT_CYCLES  10000000
+
+typedef struct Firmware {
+	const char *path;
+	FirmwareImage *image;       // Converted from HEX, or
+	const FirmwareImage *mapped; // mmap'd straight from a .img, or
+	HexImage *hex;              // Kept as HEX for parts images don't fit (see image_attach())
+} Firmware;
+
+typedef struct Breakpoint {
+	uint16_t addr;
+	const char *condition; // NULL for an unconditional one
+} Breakpoint;
+
+typedef struct Options {
+	const Device *device;
+	uint64_t cycles;
+	int engine;
+	int reset;
+	int config;            // -1 to keep the firmware's
+	bool no_wdt;
+	bool memo;
+	const char *live;      // Shared memory segment to publish to, NULL for none
+	uint64_t live_interval;
+	const SaveState *load_state; // Where every job starts from, NULL for power-on
+	const char *save_state;      // Where the (only) job's final state goes, NULL for nowhere
+	Breakpoint breakpoints[MAX_BREAKPOINTS];
+	int num_breakpoints;
+} Options;
+
+typedef struct Job {
+	const Firmware *firmware;
+	const Stimulus *stimulus; // Shared, each job runs its own copy
+	const char *stimulus_path;
+	int stop;
+	uint64_t cycles;
+	uint64_t start_cycles;    // Not 0 when starting from a save-state
+	double seconds;
+	CPUState state;
+	Stimulus result;          // The copy, for expectation counts
+	bool memoised;
+	uint64_t memo_hits;
+	uint64_t memo_cycles_skipped;
+	Live *live;               // Shared, each job has its own slot
+	int slot;
+	int save_err;
+} Job;
+
+typedef struct Runner {
+	const Options *options;
+	Job *jobs;
+	int num_jobs;
+	int next_job;
+	pthread_mutex_t lock;
+} Runner;
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [options] <firmware.HEX|firmware.img>...\n"
+	                "  -d, --device NAME       PIC12F508 (default), PIC12F509, PIC10F200 or PIC10F202\n"
+	                "  -n, --cycles N          cycle budget per run (default %d)\n"
+	                "  -s, --stimulus FILE     run against a stimulus file, repeat for more (every firmware gets every one)\n"
+	                "  -b, --break ADDR[:COND] stop at ADDR, optionally only when COND holds (see include/expr.h)\n"
+	                "  -e, --engine fast|pipeline\n"
+	                "  -r, --reset mclr|wdt    reset like that after loading, rather than starting from power-on\n"
+	                "  -c, --config WORD       override the firmware's config word\n"
+	                "      --no-wdt            turn the watchdog off\n"
+	                "  -L, --load-state FILE   start from a save-state file rather than power-on (see include/savestate.h)\n"
+	                "  -S, --save-state FILE   save the final state, for a single job only\n"
+	                "  -m, --memo              skip repeated calls to pure subroutines (see include/memo.h)\n"
+	                "  -l, --live NAME         publish every job's state to shared memory NAME as it runs, a slot per job\n"
+	                "                          in result order (see include/live.h, ./liveview NAME to watch)\n"
+	                "      --live-interval N   cycles between publishes (default %d)\n"
+	                "  -j, --jobs N            threads (default: one per core)\n", name, DEFAULT_CYCLES, LIVE_DEFAULT_INTERVAL);
+}
+
+// Already checked to fit the device when it got loaded
+static void load_program(CPU *cpu, const Firmware *firmware) {
+	if (firmware->hex)
+		cpu_load_hex_image(cpu, firmware->hex);
+	else
+		image_attach(cpu, firmware->mapped ? firmware->mapped : firmware->image);
+}
+
+static void run_job(const Options *options, Job *job) {
 	CPU cpu;
-	cpu_init(&cpu);
-	cpu.verbose = true;
-	
+	cpu_init_device(&cpu, options->device);
+	cpu_set_engine(&cpu, options->engine);
+	load_program(&cpu, job->firmware);
+	if (options->load_state)
+		savestate_restore(&cpu, options->load_state); // Already checked against every firmware
+	if (options->config >= 0)
+		cpu.config = device_config(cpu.device, options->config);
+	if (options->no_wdt)
+		cpu.config &= ~WDTE;
+	if (options->reset != RESET_NONE)
+		cpu_reset(&cpu, options->reset);
+	for (int i = 0; i < options->num_breakpoints; i++)
+	{
+		const Breakpoint *bp = &options->breakpoints[i];
+		if (bp->condition == NULL)
+			cpu_addbreakpoint(&cpu, bp->addr);
+		else
+			cpu_addcondbreakpoint(&cpu, bp->addr, bp->condition); // Already known to compile
+	}
+	// Too big for a worker's stack, and a run without it is still a run if there's no memory for one
+	Memo *memo = options->memo ? malloc(sizeof(Memo)) : NULL;
+	if (memo != NULL && memo_init(memo, &cpu, 0) != MEMO_OK) {
+		free(memo);
+		memo = NULL;
+	}
+
+	job->start_cycles = cpu.inst_cycles;
+	double start = now_seconds();
+	if (job->stimulus) {
+		// Until the scenario's over, the budget runs out or something stops it
+		job->result = *job->stimulus;
+		stimulus_start(&job->result, &cpu);
+		uint64_t end = cpu.inst_cycles + options->cycles;
+		uint64_t chunk = job->live ? job->live->interval : UINT64_MAX;
+		job->stop = STOP_CYCLES;
+		while (job->stop == STOP_CYCLES && !stimulus_done(&job->result) && cpu.inst_cycles < end)
+		{
+			uint64_t left = end - cpu.inst_cycles;
+			job->stop = stimulus_run(&job->result, left < chunk ? left : chunk);
+			if (job->live)
+				live_publish(job->live, job->slot, &cpu);
+		}
+	}
+	else if (job->live)
+		job->stop = live_run_cycles(job->live, job->slot, &cpu, options->cycles);
+	else
+		job->stop = cpu_run_cycles(&cpu, options->cycles);
+	job->seconds = now_seconds() - start;
+	cpu_save_state(&cpu, &job->state);
+	job->cycles = cpu.inst_cycles;
+	if (options->save_state)
+		job->save_err = savestate_write(&cpu, options->save_state);
+	if (memo != NULL) {
+		job->memoised = true;
+		job->memo_hits = memo->hits;
+		job->memo_cycles_skipped = memo->cycles_skipped;
+		memo_deinit(memo);
+		free(memo);
+	}
+	cpu_deinit(&cpu);
+}
+
+static void *worker(void *arg) {
+	Runner *runner = arg;
+	while (1)
+	{
+		pthread_mutex_lock(&runner->lock);
+		int index = runner->next_job++;
+		pthread_mutex_unlock(&runner->lock);
+		if (index >= runner->num_jobs)
+			return NULL;
+		run_job(runner->options, &runner->jobs[index]);
+	}
+}
+
+static void print_string(const char *s) {
+	putchar('"');
+	for (; *s != '\0'; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+static const char *stop_name(int stop) {
+	switch (stop)
+	{
+		case STOP_CYCLES:     return "cycles";
+		case STOP_BREAKPOINT: return "breakpoint";
+		case STOP_WATCHPOINT: return "watchpoint";
+		case STOP_YIELD:      return "yield";
+	}
+	return "unknown";
+}
+
+static void print_job(const Job *job, const Device *device) {
+	printf("    {\"firmware\": ");
+	print_string(job->firmware->path);
+	printf(", \"stimulus\": ");
+	if (job->stimulus_path)
+		print_string(job->stimulus_path);
+	else
+		printf("null");
+
+	const CPUState *s = &job->state;
+	double mhz = job->seconds > 0 ? (job->cycles - job->start_cycles) / job->seconds / 1e6 : 0;
+	printf(", \"stop\": \"%s\", \"cycles\": %llu, \"seconds\": %.6f, \"mhz\": %.2f,\n", stop_name(job->stop),
+	       (unsigned long long)job->cycles, job->seconds, mhz);
+	// PC keeps creeping along while asleep, only the bits that address program memory mean anything
+	printf("     \"pc\": %u, \"w\": %u, \"status\": %u, \"fsr\": %u, \"gpio\": %u, \"tris\": %u, \"option\": %u, \"config\": %u,"
+	       " \"asleep\": %s, \"stack\": [%u, %u],\n", s->pc & (device->program_words - 1), s->w, s->f[STATUS], s->f[FSR], s->f[GPIO], s->trisgpio, s->option,
+	       s->config, s->asleep ? "true" : "false", s->stack[0], s->stack[1]);
+	printf("     \"f\": [");
+	for (int r = 0; r < 32; r++)
+		printf(r ? ", %u" : "%u", s->f[r]);
+	printf("]");
+	if (device->banks > 1) {
+		printf(", \"f_bank1\": [");
+		for (int r = 0x30; r < 0x40; r++)
+			printf(r > 0x30 ? ", %u" : "%u", s->f[r]);
+		printf("]");
+	}
+	if (job->memoised)
+		printf(",\n     \"memo_hits\": %llu, \"memo_cycles_skipped\": %llu", (unsigned long long)job->memo_hits,
+		       (unsigned long long)job->memo_cycles_skipped);
+	if (job->stimulus) {
+		const Stimulus *stim = &job->result;
+		printf(",\n     \"expects\": %llu, \"failures\": %llu, \"contentions\": %llu, \"done\": %s",
+		       (unsigned long long)stim->expects, (unsigned long long)stim->failures, (unsigned long long)stim->contentions,
+		       job->cycles - stim->start >= stim->length ? "true" : "false");
+		if (stim->failures)
+			printf(", \"failed_line\": %u, \"failed_cycle\": %llu, \"failed_pins\": %u", stim->failed_line,
+			       (unsigned long long)stim->failed_cycle, stim->failed_pins);
+	}
+	printf("}");
+}
+
+static bool parse_number(const char *s, uint64_t *value) {
+	char *end;
+	*value = strtoull(s, &end, 0);
+	return end != s && *end == '\0' && s[0] != '-';
+}
+
+static int load_firmware(Firmware *firmware, const Device *device) {
+	size_t len = strlen(firmware->path);
+	if (len > 4 && strcmp(firmware->path + len - 4, ".img") == 0) {
+		int err = IMAGE_ERR_DEVICE;
+		if (device->program_words != IMAGE_WORDS) {
+			fprintf(stderr, "%s: %s\n", firmware->path, image_strerror(err));
+			return -1;
+		}
+		firmware->mapped = image_map(firmware->path, &err);
+		if (firmware->mapped == NULL)
+			fprintf(stderr, "%s: %s\n", firmware->path, image_strerror(err));
+		return firmware->mapped ? 0 : -1;
+	}
+
+	// HEX files get turned into an image once, then all the jobs share it
+	HexImage *hex = malloc(sizeof(HexImage));
+	firmware->image = malloc(sizeof(FirmwareImage));
+	if (hex == NULL || firmware->image == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	hex_image_clear(hex);
+	int err = hex_read_file(hex, firmware->path);
+	if (err != HEX_OK) {
+		fprintf(stderr, "%s:%u: %s\n", firmware->path, hex->error_line, hex_strerror(err));
+		free(hex);
+		return -1;
+	}
+	if (device->program_words != IMAGE_WORDS) {
+		// Loaded straight into each job's CPU instead
+		free(firmware->image);
+		firmware->image = NULL;
+		firmware->hex = hex;
+		err = hex_validate(hex, device->program_words);
+		if (err != HEX_OK)
+			fprintf(stderr, "%s: %s\n", firmware->path, hex_strerror(err));
+		return err == HEX_OK ? 0 : -1;
+	}
+	err = image_from_hex(firmware->image, hex, 0x00);
+	free(hex);
+	if (err != IMAGE_OK) {
+		fprintf(stderr, "%s: %s\n", firmware->path, image_strerror(err));
+		return -1;
+	}
 	return 0;
 }
+
+int main(int argc, char **argv) {
+	Options options = {.device = &device_pic12f508, .cycles = DEFAULT_CYCLES, .engine = ENGINE_FAST, .reset = RESET_NONE,
+	                   .config = -1, .live_interval = LIVE_DEFAULT_INTERVAL};
+	const char *load_state_path = NULL;
+	int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	Firmware *firmware = calloc(argc, sizeof(Firmware));
+	const char **stimulus_paths = calloc(argc, sizeof(char *));
+	int num_firmware = 0, num_stimuli = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		uint64_t number;
+		bool takes_value = true;
+		if (strcmp(arg, "--no-wdt") == 0) {
+			options.no_wdt = true;
+			takes_value = false;
+		}
+		else if (strcmp(arg, "-m") == 0 || strcmp(arg, "--memo") == 0) {
+			options.memo = true;
+			takes_value = false;
+		}
+		else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+			usage(argv[0]);
+			return 0;
+		}
+		else if (arg[0] != '-') {
+			firmware[num_firmware++].path = arg;
+			takes_value = false;
+		}
+		else if (value == NULL) {
+			usage(argv[0]);
+			return 2;
+		}
+		else if (strcmp(arg, "-d") == 0 || strcmp(arg, "--device") == 0) {
+			options.device = device_find(value);
+			if (options.device == NULL) {
+				fprintf(stderr, "Unknown device: %s, there's\n", value);
+				for (int d = 0; d < DEVICE_COUNT; d++)
+					fprintf(stderr, "  %s  %4u words, %2u bytes of RAM\n", device_list[d]->name,
+					        device_list[d]->program_words, device_list[d]->num_gpr);
+				return 2;
+			}
+		}
+		else if (strcmp(arg, "-n") == 0 || strcmp(arg, "--cycles") == 0) {
+			if (!parse_number(value, &options.cycles)) {
+				fprintf(stderr, "Bad cycle count: %s\n", value);
+				return 2;
+			}
+		}
+		else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--stimulus") == 0)
+			stimulus_paths[num_stimuli++] = value;
+		else if (strcmp(arg, "-b") == 0 || strcmp(arg, "--break") == 0) {
+			char *end;
+			unsigned long addr = strtoul(value, &end, 0);
+			if (end == value || (*end != '\0' && *end != ':') || addr >= DEVICE_MAX_WORDS || options.num_breakpoints == MAX_BREAKPOINTS) {
+				fprintf(stderr, "Bad breakpoint: %s\n", value);
+				return 2;
+			}
+			Breakpoint *bp = &options.breakpoints[options.num_breakpoints++];
+			bp->addr = addr;
+			bp->condition = *end == ':' ? end + 1 : NULL;
+			Expr expr;
+			int err = bp->condition ? expr_compile(&expr, bp->condition) : EXPR_OK;
+			if (err != EXPR_OK) {
+				fprintf(stderr, "%s\n%*s^ %s\n", bp->condition, expr.error_pos, "", expr_strerror(err));
+				return 2;
+			}
+		}
+		else if (strcmp(arg, "-e") == 0 || strcmp(arg, "--engine") == 0) {
+			if (strcmp(value, "fast") == 0)
+				options.engine = ENGINE_FAST;
+			else if (strcmp(value, "pipeline") == 0)
+				options.engine = ENGINE_PIPELINE;
+			else {
+				fprintf(stderr, "Unknown engine: %s\n", value);
+				return 2;
+			}
+		}
+		else if (strcmp(arg, "-r") == 0 || strcmp(arg, "--reset") == 0) {
+			if (strcmp(value, "mclr") == 0)
+				options.reset = RESET_MCLR_NORMAL;
+			else if (strcmp(value, "wdt") == 0)
+				options.reset = RESET_WDT_NORMAL;
+			else {
+				fprintf(stderr, "Unknown reset: %s\n", value);
+				return 2;
+			}
+		}
+		else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--config") == 0) {
+			if (!parse_number(value, &number) || number > 0xFFF) {
+				fprintf(stderr, "Bad config word: %s\n", value);
+				return 2;
+			}
+			options.config = (int)number;
+		}
+		else if (strcmp(arg, "-L") == 0 || strcmp(arg, "--load-state") == 0)
+			load_state_path = value;
+		else if (strcmp(arg, "-S") == 0 || strcmp(arg, "--save-state") == 0)
+			options.save_state = value;
+		else if (strcmp(arg, "-l") == 0 || strcmp(arg, "--live") == 0)
+			options.live = value;
+		else if (strcmp(arg, "--live-interval") == 0) {
+			if (!parse_number(value, &options.live_interval) || options.live_interval == 0) {
+				fprintf(stderr, "Bad live interval: %s\n", value);
+				return 2;
+			}
+		}
+		else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) {
+			if (!parse_number(value, &number) || number < 1 || number > 1024) {
+				fprintf(stderr, "Bad job count: %s\n", value);
+				return 2;
+			}
+			num_threads = (int)number;
+		}
+		else {
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			usage(argv[0]);
+			return 2;
+		}
+		if (takes_value)
+			i++;
+	}
+	if (num_firmware == 0) {
+		usage(argv[0]);
+		return 2;
+	}
+	// Only now that the device is known
+	for (int i = 0; i < options.num_breakpoints; i++)
+		if (options.breakpoints[i].addr >= options.device->program_words) {
+			fprintf(stderr, "Breakpoint 0x%03x is past the end of %s program memory\n", options.breakpoints[i].addr,
+			        options.device->name);
+			return 2;
+		}
+	if (options.memo && options.device != &device_pic12f508) {
+		fprintf(stderr, "%s\n", memo_strerror(MEMO_ERR_DEVICE));
+		return 2;
+	}
+
+	// Everything gets loaded once up front
+	for (int i = 0; i < num_firmware; i++)
+		if (load_firmware(&firmware[i], options.device) < 0)
+			return 1;
+	Stimulus *stimuli = calloc(num_stimuli, sizeof(Stimulus));
+	for (int i = 0; i < num_stimuli; i++)
+	{
+		int err = stimulus_load(&stimuli[i], stimulus_paths[i]);
+		if (err != STIMULUS_OK) {
+			fprintf(stderr, "%s:%d: %s\n", stimulus_paths[i], stimuli[i].error_line, stimulus_strerror(err));
+			return 1;
+		}
+	}
+
+	// The state gets mapped once and has to fit every firmware
+	if (load_state_path) {
+		int err;
+		options.load_state = savestate_map(load_state_path, &err);
+		if (options.load_state == NULL) {
+			fprintf(stderr, "%s: %s\n", load_state_path, savestate_strerror(err));
+			return 1;
+		}
+		if (options.load_state->device != options.device->index) {
+			fprintf(stderr, "%s: %s\n", load_state_path, savestate_strerror(SAVESTATE_ERR_DEVICE));
+			return 1;
+		}
+		for (int i = 0; i < num_firmware; i++)
+		{
+			CPU cpu;
+			cpu_init_device(&cpu, options.device);
+			load_program(&cpu, &firmware[i]);
+			uint64_t hash = savestate_program_hash(cpu.inst, options.device->program_words);
+			cpu_deinit(&cpu);
+			if (hash != options.load_state->program_hash) {
+				fprintf(stderr, "%s: %s (%s)\n", load_state_path, savestate_strerror(SAVESTATE_ERR_PROGRAM), firmware[i].path);
+				return 1;
+			}
+		}
+	}
+
+	int per_firmware = num_stimuli ? num_stimuli : 1;
+	if (options.save_state && num_firmware * per_firmware > 1) {
+		fprintf(stderr, "--save-state needs a single job, not %d\n", num_firmware * per_firmware);
+		return 2;
+	}
+	Runner runner = {.options = &options, .jobs = calloc(num_firmware * per_firmware, sizeof(Job)),
+	                 .num_jobs = num_firmware * per_firmware};
+	pthread_mutex_init(&runner.lock, NULL);
+	Live live;
+	if (options.live) {
+		int err = live_create(&live, options.live, runner.num_jobs, options.live_interval);
+		if (err != LIVE_OK) {
+			fprintf(stderr, "%s: %s\n", options.live, live_strerror(err));
+			return 1;
+		}
+	}
+	for (int i = 0; i < runner.num_jobs; i++)
+	{
+		Job *job = &runner.jobs[i];
+		job->firmware = &firmware[i / per_firmware];
+		if (options.live) {
+			job->live = &live;
+			job->slot = i;
+		}
+		if (num_stimuli) {
+			job->stimulus = &stimuli[i % per_firmware];
+			job->stimulus_path = stimulus_paths[i % per_firmware];
+		}
+	}
+
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > runner.num_jobs)
+		num_threads = runner.num_jobs;
+	pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+	double start = now_seconds();
+	int started = 0;
+	for (; started < num_threads - 1; started++)
+		if (pthread_create(&threads[started], NULL, worker, &runner) != 0)
+			break;
+	worker(&runner); // Fewer threads if some didn't start, never none
+	for (int t = 0; t < started; t++)
+		pthread_join(threads[t], NULL);
+	double seconds = now_seconds() - start;
+
+	uint64_t total_cycles = 0;
+	bool failed = false;
+	for (int i = 0; i < runner.num_jobs; i++)
+	{
+		if (runner.jobs[i].save_err != SAVESTATE_OK) {
+			fprintf(stderr, "%s: %s\n", options.save_state, savestate_strerror(runner.jobs[i].save_err));
+			failed = true;
+		}
+		total_cycles += runner.jobs[i].cycles - runner.jobs[i].start_cycles;
+		failed |= runner.jobs[i].result.failures != 0;
+	}
+	printf("{\"jobs\": %d, \"threads\": %d, \"seconds\": %.6f, \"cycles\": %llu, \"mhz\": %.2f, \"results\": [\n", runner.num_jobs,
+	       started + 1, seconds, (unsigned long long)total_cycles, seconds > 0 ? total_cycles / seconds / 1e6 : 0);
+	for (int i = 0; i < runner.num_jobs; i++)
+	{
+		print_job(&runner.jobs[i], options.device);
+		printf(i + 1 < runner.num_jobs ? ",\n" : "\n");
+	}
+	printf("]}\n");
+
+	pthread_mutex_destroy(&runner.lock);
+	savestate_unmap(options.load_state);
+	if (options.live)
+		live_destroy(&live);
+	free(threads);
+	free(runner.jobs);
+	for (int i = 0; i < num_stimuli; i++)
+		stimulus_free(&stimuli[i]);
+	free(stimuli);
+	for (int i = 0; i < num_firmware; i++)
+	{
+		free(firmware[i].image);
+		free(firmware[i].hex);
+		if (firmware[i].mapped)
+			image_unmap(firmware[i].mapped);
+	}
+	free(firmware);
+	free(stimulus_paths);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,937 @@
+#include <stdlib.h>
+#include <string.h>
+#include "analysis.h"
+#include "cpu.h"
+#include "instructions.h"
+
+#define _ANALYSIS_UNKNOWN 0xFFFD // Exit target for computed jumps that couldn't be followed
+#define _ANALYSIS_MAX_ARCS 258  // A full 256 entry jump table plus some
+
+// Routine states
+#define _ANALYSIS_NOT_DONE    0
+#define _ANALYSIS_IN_PROGRESS 1
+#define _ANALYSIS_DONE        2
+
+#define _ANALYSIS_HAS(set, addr) (((set)[(addr) >> 3] >> ((addr) & 7)) & 1)
+#define _ANALYSIS_ADD(set, addr) ((set)[(addr) >> 3] |= 1 << ((addr) & 7))
+
+// One way out of an instruction (or a collapsed loop), and what it costs to take
+typedef struct AnalysisArc {
+    uint16_t target;
+    uint64_t best;
+    uint64_t worst;
+} AnalysisArc;
+
+// Everything one routine needs while it's being analysed, CALLs analyse their callee part way through
+typedef struct AnalysisWork {
+    AnalysisRoutine *routine;
+    uint8_t members[ANALYSIS_WORDS / 8];
+    int loops[ANALYSIS_MAX_LOOPS]; // Indices into an->loops, innermost first once sorted
+    int num_loops;
+
+    // Region evaluation scratch
+    uint16_t order[ANALYSIS_WORDS];
+    uint8_t mark[ANALYSIS_WORDS];  // 0 unvisited, 1 on the DFS stack, 2 finished
+    uint8_t reached[ANALYSIS_WORDS];
+    uint64_t best[ANALYSIS_WORDS];
+    uint64_t worst[ANALYSIS_WORDS];
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+} AnalysisWork;
+
+// The result of running through a region (a loop body, or a whole routine) from its start
+typedef struct AnalysisRegion {
+    const uint8_t *nodes;
+    uint16_t start;
+    const AnalysisLoop *loop;  // NULL for a whole routine
+    bool round;                // Got back round to the loop header
+    uint64_t round_best;
+    uint64_t round_worst;
+    AnalysisExit exits[ANALYSIS_MAX_EXITS];
+    int num_exits;
+    bool unbounded;            // Something in it can go on forever
+} AnalysisRegion;
+
+static void _analysis_routine(Analysis *an, AnalysisRoutine *routine);
+
+// Saturating arithmetic, ANALYSIS_UNBOUNDED sticks
+static uint64_t _analysis_add(uint64_t a, uint64_t b)
+{
+    if (a == ANALYSIS_UNBOUNDED || b == ANALYSIS_UNBOUNDED || a + b < a)
+        return ANALYSIS_UNBOUNDED;
+    return a + b;
+}
+
+static uint64_t _analysis_mul(uint64_t a, uint64_t n)
+{
+    if (a == 0 || n == 0)
+        return 0;
+    if (a == ANALYSIS_UNBOUNDED || n == ANALYSIS_UNBOUNDED || a > ANALYSIS_UNBOUNDED / n)
+        return ANALYSIS_UNBOUNDED;
+    return a * n;
+}
+
+static void _analysis_error(Analysis *an, int err)
+{
+    if (an->error == ANALYSIS_OK)
+        an->error = err;
+}
+
+
+// Instruction properties
+
+static bool _analysis_is_skip(uint8_t op)
+{
+    return op == OP_BTFSC || op == OP_BTFSS || op == OP_DECFSZ || op == OP_INCFSZ;
+}
+
+// Register the instruction writes, -1 for none
+static int _analysis_writes(const Analysis *an, uint16_t addr)
+{
+    uint16_t word = an->inst[addr];
+    uint8_t f = word & 0x1F;
+    bool d = (word >> 5) & 1;
+    switch (an->ops[addr])
+    {
+        case OP_MOVWF: case OP_CLRF: case OP_BCF: case OP_BSF:
+            return f;
+        case OP_ADDWF: case OP_ANDWF: case OP_COMF: case OP_DECF: case OP_DECFSZ: case OP_INCF: case OP_INCFSZ:
+        case OP_IORWF: case OP_MOVF: case OP_RLF: case OP_RRF: case OP_SUBWF: case OP_SWAPF: case OP_XORWF:
+            return d ? f : -1;
+    }
+    return -1;
+}
+
+static bool _analysis_writes_w(const Analysis *an, uint16_t addr)
+{
+    bool d = (an->inst[addr] >> 5) & 1;
+    switch (an->ops[addr])
+    {
+        case OP_CLRW: case OP_ANDLW: case OP_IORLW: case OP_MOVLW: case OP_XORLW: case OP_RETLW: case OP_CALL:
+            return true;
+        case OP_ADDWF: case OP_ANDWF: case OP_COMF: case OP_DECF: case OP_DECFSZ: case OP_INCF: case OP_INCFSZ:
+        case OP_IORWF: case OP_MOVF: case OP_RLF: case OP_RRF: case OP_SUBWF: case OP_SWAPF: case OP_XORWF:
+            return !d;
+    }
+    return false;
+}
+
+static uint16_t _analysis_target(const Analysis *an, uint16_t addr)
+{
+    // CALL can only reach the first 256 words, its k is 8 bits and bit 8 of PC gets cleared
+    if (an->ops[addr] == OP_CALL)
+        return an->inst[addr] & 0xFF;
+    return an->inst[addr] & 0x1FF;
+}
+
+// Cycles for the instruction itself, CALLs not including the callee
+static int _analysis_cycles(const Analysis *an, uint16_t addr)
+{
+    switch (an->ops[addr])
+    {
+        case OP_CALL: case OP_GOTO: case OP_RETLW:
+            return 2;
+    }
+    return (an->flags[addr] & ANALYSIS_COMPUTED_JUMP) ? 2 : 1;
+}
+
+// Where control can go after addr within its routine (CALLs just go on to the next word)
+// Skips have the taken side second, with the NOP that replaces the skipped instruction as its extra cycle
+static int _analysis_successors(const Analysis *an, uint16_t addr, AnalysisArc *arcs)
+{
+    uint16_t next = (addr + 1) & 0x1FF;
+    uint8_t op = an->ops[addr];
+    if (op == OP_RETLW || op == OP_SLEEP)
+        return 0;
+    if (op == OP_GOTO) {
+        arcs[0] = (AnalysisArc){ _analysis_target(an, addr), 0, 0 };
+        return 1;
+    }
+    if (_analysis_is_skip(op)) {
+        arcs[0] = (AnalysisArc){ next, 0, 0 };
+        arcs[1] = (AnalysisArc){ (addr + 2) & 0x1FF, 1, 1 };
+        return 2;
+    }
+    if (an->flags[addr] & ANALYSIS_COMPUTED_JUMP) {
+        // A jump table, PCL + W lands somewhere in the run of RETLW/GOTO after it
+        // Writing PCL clears bit 8 of PC, so a table can't go past 0xFF
+        int n = 0;
+        for (uint16_t t = addr + 1; t < 0x100 && (an->ops[t] == OP_RETLW || an->ops[t] == OP_GOTO); t++)
+            arcs[n++] = (AnalysisArc){ t, 0, 0 };
+        return n;
+    }
+    arcs[0] = (AnalysisArc){ next, 0, 0 };
+    return 1;
+}
+
+
+// Routines
+
+static AnalysisRoutine *_analysis_find_routine(Analysis *an, uint16_t entry)
+{
+    for (int i = 0; i < an->num_routines; i++)
+        if (an->routines[i].entry == entry)
+            return &an->routines[i];
+    return NULL;
+}
+
+static void _analysis_members(const Analysis *an, uint16_t entry, uint8_t *members)
+{
+    uint16_t stack[ANALYSIS_WORDS];
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+    int top = 0;
+    memset(members, 0, ANALYSIS_WORDS / 8);
+    _ANALYSIS_ADD(members, entry);
+    stack[top++] = entry;
+    while (top > 0)
+    {
+        uint16_t addr = stack[--top];
+        int n = _analysis_successors(an, addr, arcs);
+        for (int i = 0; i < n; i++)
+        {
+            if (!_ANALYSIS_HAS(members, arcs[i].target)) {
+                _ANALYSIS_ADD(members, arcs[i].target);
+                stack[top++] = arcs[i].target;
+            }
+        }
+    }
+}
+
+// Whether running the routine (and whatever it calls) can write reg
+static bool _analysis_routine_writes(Analysis *an, uint16_t entry, int reg, uint8_t *seen)
+{
+    uint8_t members[ANALYSIS_WORDS / 8];
+    _analysis_members(an, entry, members);
+    _ANALYSIS_ADD(seen, entry);
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        if (!_ANALYSIS_HAS(members, addr))
+            continue;
+        int w = _analysis_writes(an, addr);
+        if (w == reg || w == INDF)
+            return true;
+        if (an->ops[addr] == OP_CALL) {
+            uint16_t callee = _analysis_target(an, addr);
+            if (!_ANALYSIS_HAS(seen, callee) && _analysis_routine_writes(an, callee, reg, seen))
+                return true;
+        }
+    }
+    return false;
+}
+
+static bool _analysis_call_writes(Analysis *an, uint16_t addr, int reg)
+{
+    uint8_t seen[ANALYSIS_WORDS / 8];
+    memset(seen, 0, sizeof(seen));
+    return _analysis_routine_writes(an, _analysis_target(an, addr), reg, seen);
+}
+
+// The instruction's own cost, CALLs with the callee's
+static void _analysis_cost(Analysis *an, AnalysisWork *work, uint16_t addr, uint64_t *best, uint64_t *worst)
+{
+    *best = *worst = _analysis_cycles(an, addr);
+    if (an->ops[addr] != OP_CALL)
+        return;
+
+    AnalysisRoutine *callee = _analysis_find_routine(an, _analysis_target(an, addr));
+    if (callee != NULL)
+        _analysis_routine(an, callee);
+    if (callee == NULL || callee->state != _ANALYSIS_DONE) {
+        // Calls back into something still being worked out, so no telling how deep it goes
+        work->routine->recursive = true;
+        *worst = ANALYSIS_UNBOUNDED;
+        return;
+    }
+    *best = _analysis_add(*best, callee->best);
+    *worst = _analysis_add(*worst, callee->worst);
+}
+
+
+// Loops
+
+static AnalysisLoop *_analysis_find_loop(Analysis *an, const AnalysisWork *work, uint16_t header)
+{
+    for (int i = 0; i < work->num_loops; i++)
+        if (an->loops[work->loops[i]].header == header)
+            return &an->loops[work->loops[i]];
+    return NULL;
+}
+
+// Back edges from a DFS of the routine, each one's target is a loop header
+static void _analysis_find_loops(Analysis *an, AnalysisWork *work)
+{
+    uint16_t stack[ANALYSIS_WORDS];
+    uint16_t next[ANALYSIS_WORDS]; // Successor to look at next, per stacked word
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+    int top = 0;
+    memset(work->mark, 0, sizeof(work->mark));
+
+    uint16_t entry = work->routine->entry;
+    stack[top] = entry;
+    next[top++] = 0;
+    work->mark[entry] = 1;
+    while (top > 0)
+    {
+        uint16_t addr = stack[top - 1];
+        int n = _analysis_successors(an, addr, arcs);
+        if (next[top - 1] == n) {
+            work->mark[addr] = 2;
+            top--;
+            continue;
+        }
+        uint16_t target = arcs[next[top - 1]++].target;
+        if (work->mark[target] == 0) {
+            work->mark[target] = 1;
+            stack[top] = target;
+            next[top++] = 0;
+        } else if (work->mark[target] == 1) {
+            AnalysisLoop *loop = _analysis_find_loop(an, work, target);
+            if (loop == NULL) {
+                if (an->num_loops == ANALYSIS_MAX_LOOPS) {
+                    _analysis_error(an, ANALYSIS_ERR_FULL);
+                    continue;
+                }
+                work->loops[work->num_loops++] = an->num_loops;
+                loop = &an->loops[an->num_loops++];
+                memset(loop, 0, sizeof(AnalysisLoop));
+                loop->header = target;
+                loop->routine = entry;
+                _ANALYSIS_ADD(loop->body, target);
+                an->flags[target] |= ANALYSIS_LOOP_HEADER;
+            }
+
+            // Natural loop: everything that gets to the back edge without going through the header
+            uint16_t pending[ANALYSIS_WORDS];
+            int num_pending = 0;
+            if (!_ANALYSIS_HAS(loop->body, addr)) {
+                _ANALYSIS_ADD(loop->body, addr);
+                pending[num_pending++] = addr;
+            }
+            while (num_pending > 0)
+            {
+                uint16_t node = pending[--num_pending];
+                for (uint16_t pred = 0; pred < ANALYSIS_WORDS; pred++)
+                {
+                    if (!_ANALYSIS_HAS(work->members, pred) || _ANALYSIS_HAS(loop->body, pred))
+                        continue;
+                    int m = _analysis_successors(an, pred, arcs);
+                    for (int i = 0; i < m; i++)
+                    {
+                        if (arcs[i].target == node) {
+                            _ANALYSIS_ADD(loop->body, pred);
+                            pending[num_pending++] = pred;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < work->num_loops; i++)
+    {
+        AnalysisLoop *loop = &an->loops[work->loops[i]];
+        for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+            loop->num_words += _ANALYSIS_HAS(loop->body, addr);
+    }
+
+    // Innermost first, an inner loop is always smaller than the one around it
+    for (int i = 1; i < work->num_loops; i++)
+    {
+        int index = work->loops[i];
+        int j = i;
+        for (; j > 0 && an->loops[work->loops[j - 1]].num_words > an->loops[index].num_words; j--)
+            work->loops[j] = work->loops[j - 1];
+        work->loops[j] = index;
+    }
+}
+
+// The only word coming into the loop from outside, or -1
+static int _analysis_loop_entry(const Analysis *an, const AnalysisWork *work, const AnalysisLoop *loop)
+{
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+    int entry = -1;
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        if (!_ANALYSIS_HAS(work->members, addr) || _ANALYSIS_HAS(loop->body, addr))
+            continue;
+        int n = _analysis_successors(an, addr, arcs);
+        for (int i = 0; i < n; i++)
+        {
+            if (arcs[i].target == loop->header) {
+                if (entry >= 0)
+                    return -1;
+                entry = addr;
+            }
+        }
+    }
+    return entry;
+}
+
+// Walks back through straight line code from addr to the last write of reg (-1 for W), addr itself included or not
+// Returns where it is, or -1 if there's a branch in the way or something else might have written it
+static int _analysis_last_write(Analysis *an, const AnalysisWork *work, int addr, int reg, bool inclusive)
+{
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+    for (int steps = 0; steps < 64 && addr >= 0; steps++)
+    {
+        if (steps > 0 || inclusive) {
+            if (reg < 0 ? _analysis_writes_w(an, addr) : _analysis_writes(an, addr) == reg)
+                return addr;
+            if (reg >= 0 && an->ops[addr] == OP_CALL && _analysis_call_writes(an, addr, reg))
+                return -1;
+            if (reg >= 0 && _analysis_writes(an, addr) == INDF)
+                return -1;
+        }
+
+        // Straight line means exactly one word leads here, and it leads nowhere else
+        int pred = -1;
+        for (uint16_t p = 0; p < ANALYSIS_WORDS; p++)
+        {
+            if (!_ANALYSIS_HAS(work->members, p))
+                continue;
+            int n = _analysis_successors(an, p, arcs);
+            for (int i = 0; i < n; i++)
+            {
+                if (arcs[i].target != addr)
+                    continue;
+                if (pred >= 0 || n != 1)
+                    return -1;
+                pred = p;
+            }
+        }
+        addr = pred;
+    }
+    return -1;
+}
+
+// DECFSZ/INCFSZ counting a literal-initialised register, see analysis.h for the rules
+static bool _analysis_counted(Analysis *an, AnalysisWork *work, AnalysisLoop *loop)
+{
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        uint8_t op = an->ops[addr];
+        int reg = _analysis_writes(an, addr);
+        if (!_ANALYSIS_HAS(loop->body, addr) || (op != OP_DECFSZ && op != OP_INCFSZ) || reg < 0 || reg == INDF || reg == PCL)
+            continue;
+        // Carries on round when it isn't zero, leaves when it is
+        if (!_ANALYSIS_HAS(loop->body, (addr + 1) & 0x1FF) || _ANALYSIS_HAS(loop->body, (addr + 2) & 0x1FF))
+            continue;
+
+        // Nothing else in the loop touches the counter
+        bool clean = true;
+        for (uint16_t other = 0; other < ANALYSIS_WORDS && clean; other++)
+        {
+            if (other == addr || !_ANALYSIS_HAS(loop->body, other))
+                continue;
+            int w = _analysis_writes(an, other);
+            if (w == reg || w == INDF || (an->ops[other] == OP_CALL && _analysis_call_writes(an, other, reg)))
+                clean = false;
+        }
+        if (!clean)
+            continue;
+
+        // Every way round goes through it: with it taken out, nothing gets back to the header
+        if (addr != loop->header) {
+            uint8_t seen[ANALYSIS_WORDS / 8];
+            uint16_t pending[ANALYSIS_WORDS];
+            int num_pending = 0;
+            bool round = false;
+            memset(seen, 0, sizeof(seen));
+            _ANALYSIS_ADD(seen, loop->header);
+            _ANALYSIS_ADD(seen, addr);
+            pending[num_pending++] = loop->header;
+            while (num_pending > 0 && !round)
+            {
+                int n = _analysis_successors(an, pending[--num_pending], arcs);
+                for (int i = 0; i < n; i++)
+                {
+                    uint16_t t = arcs[i].target;
+                    if (t == loop->header)
+                        round = true;
+                    if (_ANALYSIS_HAS(loop->body, t) && !_ANALYSIS_HAS(seen, t)) {
+                        _ANALYSIS_ADD(seen, t);
+                        pending[num_pending++] = t;
+                    }
+                }
+            }
+            if (round)
+                continue;
+        }
+
+        // And its starting value is a literal
+        int entry = _analysis_loop_entry(an, work, loop);
+        int init = entry >= 0 ? _analysis_last_write(an, work, entry, reg, true) : -1;
+        if (init < 0)
+            continue;
+        int k;
+        if (an->ops[init] == OP_CLRF) {
+            k = 0;
+        } else if (an->ops[init] == OP_MOVWF) {
+            int lit = _analysis_last_write(an, work, init, -1, false);
+            if (lit < 0 || an->ops[lit] != OP_MOVLW)
+                continue;
+            k = an->inst[lit] & 0xFF;
+        } else {
+            continue;
+        }
+
+        loop->bound = LOOP_COUNTED;
+        loop->counter = reg;
+        if (op == OP_DECFSZ)
+            loop->max_trips = k == 0 ? 256 : k;
+        else
+            loop->max_trips = 256 - k;
+        loop->min_trips = loop->max_trips;
+        return true;
+    }
+    return false;
+}
+
+
+// Region evaluation
+// Longest and shortest paths through a region with the loops inside it collapsed into single steps, which leaves a
+// DAG (when the code's reducible, anything else comes out unbounded)
+
+static bool _analysis_inside(const AnalysisRegion *region, uint16_t target)
+{
+    if (target >= ANALYSIS_WORDS || !_ANALYSIS_HAS(region->nodes, target))
+        return false;
+    return region->loop == NULL || target != region->loop->header;
+}
+
+// The ways out of addr in the region, costs include addr itself
+static int _analysis_arcs(Analysis *an, AnalysisWork *work, const AnalysisRegion *region, uint16_t addr,
+                          AnalysisArc *arcs, bool *unbounded)
+{
+    // A loop inside the region gets left through its exits, all the times round included
+    AnalysisLoop *inner = _analysis_find_loop(an, work, addr);
+    if (inner != NULL && inner != region->loop) {
+        if (inner->num_exits == 0)
+            *unbounded = true; // Never leaves
+        for (int i = 0; i < inner->num_exits; i++)
+            arcs[i] = (AnalysisArc){ inner->exits[i].target, inner->exits[i].best, inner->exits[i].worst };
+        return inner->num_exits;
+    }
+
+    uint64_t best, worst;
+    _analysis_cost(an, work, addr, &best, &worst);
+    if (an->ops[addr] == OP_RETLW || an->ops[addr] == OP_SLEEP) {
+        arcs[0] = (AnalysisArc){ an->ops[addr] == OP_RETLW ? ANALYSIS_RETURN : ANALYSIS_SLEEP, best, worst };
+        return 1;
+    }
+    if (an->flags[addr] & ANALYSIS_UNRESOLVED) {
+        arcs[0] = (AnalysisArc){ _ANALYSIS_UNKNOWN, best, ANALYSIS_UNBOUNDED };
+        return 1;
+    }
+    int n = _analysis_successors(an, addr, arcs);
+    for (int i = 0; i < n; i++)
+    {
+        arcs[i].best += best;
+        arcs[i].worst = _analysis_add(arcs[i].worst, worst);
+    }
+    return n;
+}
+
+static void _analysis_exit(Analysis *an, AnalysisRegion *region, uint16_t target, uint64_t best, uint64_t worst)
+{
+    for (int i = 0; i < region->num_exits; i++)
+    {
+        AnalysisExit *exit = &region->exits[i];
+        if (exit->target == target) {
+            if (best < exit->best)
+                exit->best = best;
+            if (worst > exit->worst)
+                exit->worst = worst;
+            return;
+        }
+    }
+    if (region->num_exits == ANALYSIS_MAX_EXITS) {
+        _analysis_error(an, ANALYSIS_ERR_FULL);
+        region->unbounded = true;
+        return;
+    }
+    region->exits[region->num_exits++] = (AnalysisExit){ target, best, worst };
+}
+
+static void _analysis_region(Analysis *an, AnalysisWork *work, AnalysisRegion *region)
+{
+    // Topological order, reverse postorder of a DFS over the collapsed graph
+    uint16_t stack[ANALYSIS_WORDS];
+    uint16_t next[ANALYSIS_WORDS];
+    int top = 0, num_order = 0;
+    memset(work->mark, 0, sizeof(work->mark));
+    stack[top] = region->start;
+    next[top++] = 0;
+    work->mark[region->start] = 1;
+    while (top > 0)
+    {
+        uint16_t addr = stack[top - 1];
+        int n = _analysis_arcs(an, work, region, addr, work->arcs, &region->unbounded);
+        if (next[top - 1] == n) {
+            work->mark[addr] = 2;
+            work->order[num_order++] = addr;
+            top--;
+            continue;
+        }
+        uint16_t target = work->arcs[next[top - 1]++].target;
+        if (!_analysis_inside(region, target))
+            continue;
+        if (work->mark[target] == 1) {
+            region->unbounded = true; // A cycle that isn't a loop we know about
+        } else if (work->mark[target] == 0) {
+            work->mark[target] = 1;
+            stack[top] = target;
+            next[top++] = 0;
+        }
+    }
+
+    memset(work->reached, 0, sizeof(work->reached));
+    work->reached[region->start] = 1;
+    work->best[region->start] = 0;
+    work->worst[region->start] = 0;
+    for (int i = num_order - 1; i >= 0; i--)
+    {
+        uint16_t addr = work->order[i];
+        if (!work->reached[addr])
+            continue;
+        int n = _analysis_arcs(an, work, region, addr, work->arcs, &region->unbounded);
+        for (int j = 0; j < n; j++)
+        {
+            uint16_t target = work->arcs[j].target;
+            uint64_t best = _analysis_add(work->best[addr], work->arcs[j].best);
+            uint64_t worst = _analysis_add(work->worst[addr], work->arcs[j].worst);
+            if (_analysis_inside(region, target)) {
+                if (!work->reached[target] || best < work->best[target])
+                    work->best[target] = best;
+                if (!work->reached[target] || worst > work->worst[target])
+                    work->worst[target] = worst;
+                work->reached[target] = 1;
+            } else if (region->loop != NULL && target == region->loop->header) {
+                if (!region->round || best < region->round_best)
+                    region->round_best = best;
+                if (!region->round || worst > region->round_worst)
+                    region->round_worst = worst;
+                region->round = true;
+            } else {
+                _analysis_exit(an, region, target, best, worst);
+            }
+        }
+    }
+}
+
+static void _analysis_loop(Analysis *an, AnalysisWork *work, AnalysisLoop *loop)
+{
+    loop->bound = LOOP_UNBOUNDED;
+    loop->min_trips = 1;
+    loop->max_trips = 0;
+    for (int i = 0; i < an->num_bounds; i++)
+    {
+        if (an->bounds[i].header == loop->header) {
+            loop->bound = LOOP_USER;
+            loop->min_trips = an->bounds[i].min_trips;
+            loop->max_trips = an->bounds[i].max_trips;
+        }
+    }
+    if (loop->bound == LOOP_UNBOUNDED)
+        _analysis_counted(an, work, loop);
+
+    AnalysisRegion region;
+    memset(&region, 0, sizeof(AnalysisRegion));
+    region.nodes = loop->body;
+    region.start = loop->header;
+    region.loop = loop;
+    _analysis_region(an, work, &region);
+
+    // A counted loop only goes the full count if the counter's the only way out
+    if (loop->bound == LOOP_COUNTED && region.num_exits > 1)
+        loop->min_trips = 1;
+
+    loop->trip_best = region.round_best;
+    loop->trip_worst = region.unbounded ? ANALYSIS_UNBOUNDED : region.round_worst;
+    uint64_t max_trips = loop->bound == LOOP_UNBOUNDED ? ANALYSIS_UNBOUNDED : loop->max_trips;
+    loop->num_exits = region.num_exits;
+    for (int i = 0; i < region.num_exits; i++)
+    {
+        AnalysisExit *exit = &loop->exits[i];
+        *exit = region.exits[i];
+        exit->best = _analysis_add(_analysis_mul(loop->trip_best, loop->min_trips - 1), exit->best);
+        if (max_trips == ANALYSIS_UNBOUNDED)
+            exit->worst = ANALYSIS_UNBOUNDED;
+        else
+            exit->worst = _analysis_add(_analysis_mul(loop->trip_worst, max_trips - 1), exit->worst);
+    }
+}
+
+static void _analysis_routine(Analysis *an, AnalysisRoutine *routine)
+{
+    if (routine->state != _ANALYSIS_NOT_DONE)
+        return;
+    routine->state = _ANALYSIS_IN_PROGRESS;
+
+    AnalysisWork *work = calloc(1, sizeof(AnalysisWork));
+    if (work == NULL) {
+        _analysis_error(an, ANALYSIS_ERR_MEMORY);
+        routine->best = routine->worst = ANALYSIS_UNBOUNDED;
+        routine->state = _ANALYSIS_DONE;
+        return;
+    }
+    work->routine = routine;
+    _analysis_members(an, routine->entry, work->members);
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+        routine->num_words += _ANALYSIS_HAS(work->members, addr);
+
+    _analysis_find_loops(an, work);
+    for (int i = 0; i < work->num_loops; i++)
+        _analysis_loop(an, work, &an->loops[work->loops[i]]);
+
+    AnalysisRegion region;
+    memset(&region, 0, sizeof(AnalysisRegion));
+    region.nodes = work->members;
+    region.start = routine->entry;
+    _analysis_region(an, work, &region);
+
+    // Every way it can finish, with routines that never finish at all unbounded both ways
+    routine->best = ANALYSIS_UNBOUNDED;
+    routine->worst = 0;
+    for (int i = 0; i < region.num_exits; i++)
+    {
+        AnalysisExit *exit = &region.exits[i];
+        routine->returns |= exit->target == ANALYSIS_RETURN;
+        routine->sleeps |= exit->target == ANALYSIS_SLEEP;
+        if (exit->best < routine->best)
+            routine->best = exit->best;
+        if (exit->worst > routine->worst)
+            routine->worst = exit->worst;
+    }
+    if (region.num_exits == 0 || region.unbounded)
+        routine->worst = ANALYSIS_UNBOUNDED;
+    if (routine->recursive)
+        routine->worst = ANALYSIS_UNBOUNDED;
+
+    free(work);
+    routine->state = _ANALYSIS_DONE;
+}
+
+
+// Blocks
+
+static bool _analysis_ends_block(const Analysis *an, uint16_t addr)
+{
+    uint8_t op = an->ops[addr];
+    return op == OP_GOTO || op == OP_CALL || op == OP_RETLW || op == OP_SLEEP || _analysis_is_skip(op)
+        || (an->flags[addr] & ANALYSIS_COMPUTED_JUMP);
+}
+
+static void _analysis_blocks(Analysis *an)
+{
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+
+    // Leaders: entries, anything jumped to, and whatever comes after something that doesn't just fall through
+    an->flags[0] |= ANALYSIS_BLOCK_START; // The reset vector runs into 0, but blocks don't wrap
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        if (!(an->flags[addr] & ANALYSIS_REACHABLE))
+            continue;
+        if (an->flags[addr] & ANALYSIS_ROUTINE_ENTRY)
+            an->flags[addr] |= ANALYSIS_BLOCK_START;
+        if (!_analysis_ends_block(an, addr))
+            continue;
+        int n = _analysis_successors(an, addr, arcs);
+        for (int i = 0; i < n; i++)
+            an->flags[arcs[i].target] |= ANALYSIS_BLOCK_START;
+        if (an->ops[addr] == OP_CALL)
+            an->flags[_analysis_target(an, addr)] |= ANALYSIS_BLOCK_START;
+        an->flags[(addr + 1) & 0x1FF] |= ANALYSIS_BLOCK_START;
+    }
+
+    an->num_blocks = 0;
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        if (!(an->flags[addr] & ANALYSIS_REACHABLE) || !(an->flags[addr] & ANALYSIS_BLOCK_START))
+            continue;
+        AnalysisBlock *block = &an->blocks[an->num_blocks++];
+        memset(block, 0, sizeof(AnalysisBlock));
+        block->start = addr;
+        uint16_t last = addr;
+        for (;;)
+        {
+            block->length++;
+            block->cycles += _analysis_cycles(an, last);
+            if (_analysis_ends_block(an, last) || last == ANALYSIS_WORDS - 1 ||
+                (an->flags[last + 1] & ANALYSIS_BLOCK_START) || !(an->flags[last + 1] & ANALYSIS_REACHABLE))
+                break;
+            last++;
+        }
+        block->calls = an->ops[last] == OP_CALL;
+        if (an->flags[last] & ANALYSIS_COMPUTED_JUMP)
+            continue;
+        int n = _analysis_successors(an, last, arcs);
+        for (int i = 0; i < n; i++)
+            block->succ[i] = arcs[i].target;
+        block->num_succ = n;
+    }
+}
+
+
+void analysis_init(Analysis *an)
+{
+    memset(an, 0, sizeof(Analysis));
+}
+
+int analysis_set_loop_bound(Analysis *an, uint16_t header, uint32_t min_trips, uint32_t max_trips)
+{
+    if (header >= ANALYSIS_WORDS)
+        return ANALYSIS_ERR_ADDRESS;
+    if (min_trips < 1)
+        min_trips = 1;
+    if (max_trips < min_trips)
+        max_trips = min_trips;
+    int i = 0;
+    while (i < an->num_bounds && an->bounds[i].header != header)
+        i++;
+    if (i == ANALYSIS_MAX_BOUNDS)
+        return ANALYSIS_ERR_FULL;
+    if (i == an->num_bounds)
+        an->num_bounds++;
+    an->bounds[i].header = header;
+    an->bounds[i].min_trips = min_trips;
+    an->bounds[i].max_trips = max_trips;
+    return ANALYSIS_OK;
+}
+
+int analysis_run(Analysis *an, const uint16_t *inst)
+{
+    AnalysisArc arcs[_ANALYSIS_MAX_ARCS];
+    an->num_blocks = 0;
+    an->num_routines = 0;
+    an->num_loops = 0;
+    an->error = ANALYSIS_OK;
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        an->inst[addr] = inst[addr] & 0xFFF;
+        an->ops[addr] = instruction_decode(an->inst[addr]);
+        an->flags[addr] = _analysis_writes(an, addr) == PCL && !_analysis_is_skip(an->ops[addr]) ? ANALYSIS_COMPUTED_JUMP : 0;
+    }
+
+    // Everything reachable from the reset vector, CALL targets become routines as they're found
+    uint16_t stack[ANALYSIS_WORDS];
+    uint16_t entries[ANALYSIS_WORDS];
+    int top = 0, num_entries = 0;
+    an->flags[ANALYSIS_RESET_VECTOR] |= ANALYSIS_REACHABLE | ANALYSIS_ROUTINE_ENTRY;
+    stack[top++] = ANALYSIS_RESET_VECTOR;
+    while (top > 0)
+    {
+        uint16_t addr = stack[--top];
+        int n = _analysis_successors(an, addr, arcs);
+        if (an->ops[addr] == OP_CALL) {
+            uint16_t callee = _analysis_target(an, addr);
+            if (!(an->flags[callee] & ANALYSIS_ROUTINE_ENTRY))
+                entries[num_entries++] = callee;
+            an->flags[callee] |= ANALYSIS_ROUTINE_ENTRY;
+            arcs[n++] = (AnalysisArc){ callee, 0, 0 };
+        }
+        if ((an->flags[addr] & ANALYSIS_COMPUTED_JUMP) && n == 0)
+            an->flags[addr] |= ANALYSIS_UNRESOLVED;
+        for (int i = 0; i < n; i++)
+        {
+            if (!(an->flags[arcs[i].target] & ANALYSIS_REACHABLE)) {
+                an->flags[arcs[i].target] |= ANALYSIS_REACHABLE;
+                stack[top++] = arcs[i].target;
+            }
+        }
+    }
+
+    an->routines[an->num_routines++] = (AnalysisRoutine){ .entry = ANALYSIS_RESET_VECTOR };
+    for (uint16_t addr = 0; addr < ANALYSIS_WORDS; addr++)
+    {
+        bool called = false;
+        for (int i = 0; i < num_entries; i++)
+            called |= entries[i] == addr;
+        if (!called)
+            continue;
+        if (an->num_routines == ANALYSIS_MAX_ROUTINES) {
+            _analysis_error(an, ANALYSIS_ERR_FULL);
+            break;
+        }
+        an->routines[an->num_routines++] = (AnalysisRoutine){ .entry = addr };
+    }
+
+    _analysis_blocks(an);
+    for (int i = 0; i < an->num_routines; i++)
+        _analysis_routine(an, &an->routines[i]);
+    return an->error;
+}
+
+
+const AnalysisRoutine *analysis_routine(const Analysis *an, uint16_t entry)
+{
+    for (int i = 0; i < an->num_routines; i++)
+        if (an->routines[i].entry == entry)
+            return &an->routines[i];
+    return NULL;
+}
+
+const AnalysisLoop *analysis_loop(const Analysis *an, uint16_t header)
+{
+    for (int i = 0; i < an->num_loops; i++)
+        if (an->loops[i].header == header)
+            return &an->loops[i];
+    return NULL;
+}
+
+const AnalysisBlock *analysis_block(const Analysis *an, uint16_t addr)
+{
+    for (int i = 0; i < an->num_blocks; i++)
+        if (addr >= an->blocks[i].start && addr < an->blocks[i].start + an->blocks[i].length)
+            return &an->blocks[i];
+    return NULL;
+}
+
+static void _analysis_print_cycles(FILE *out, uint64_t cycles)
+{
+    if (cycles == ANALYSIS_UNBOUNDED)
+        fprintf(out, "unbounded");
+    else
+        fprintf(out, "%llu", (unsigned long long)cycles);
+}
+
+void analysis_print(const Analysis *an, FILE *out)
+{
+    static const char *bounds[] = { "unbounded", "counted", "given" };
+    fprintf(out, "%d blocks, %d routines, %d loops\n", an->num_blocks, an->num_routines, an->num_loops);
+    for (int i = 0; i < an->num_routines; i++)
+    {
+        const AnalysisRoutine *routine = &an->routines[i];
+        fprintf(out, "routine 0x%03X: %d words, best ", routine->entry, routine->num_words);
+        _analysis_print_cycles(out, routine->best);
+        fprintf(out, ", worst ");
+        _analysis_print_cycles(out, routine->worst);
+        fprintf(out, "%s%s%s\n", routine->returns ? ", returns" : "", routine->sleeps ? ", sleeps" : "",
+                routine->recursive ? ", recursive" : "");
+    }
+    for (int i = 0; i < an->num_loops; i++)
+    {
+        const AnalysisLoop *loop = &an->loops[i];
+        fprintf(out, "loop 0x%03X in 0x%03X: %d words, %s", loop->header, loop->routine, loop->num_words, bounds[loop->bound]);
+        if (loop->bound == LOOP_COUNTED)
+            fprintf(out, " by 0x%02X", loop->counter);
+        if (loop->bound != LOOP_UNBOUNDED)
+            fprintf(out, " %u-%u times", loop->min_trips, loop->max_trips);
+        fprintf(out, ", %llu-", (unsigned long long)loop->trip_best);
+        _analysis_print_cycles(out, loop->trip_worst);
+        fprintf(out, " cycles round\n");
+    }
+}
+
+const char *analysis_strerror(int err)
+{
+    switch (err)
+    {
+        case ANALYSIS_OK:          return "OK";
+        case ANALYSIS_ERR_FULL:    return "Too many routines, loops or bounds";
+        case ANALYSIS_ERR_ADDRESS: return "Address out of range";
+        case ANALYSIS_ERR_MEMORY:  return "Out of memory";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+
+// Stops the run if the CPU's started driving something different, the models get to see it straight after
+// Writes also land in the input pins' latch bits, those need the resolved levels put back before the next read
+static void _bench_check_outputs(Bench *bench)
+{
+    CPU *cpu = bench->cpu;
+    uint8_t drive = cpu_driven_pins(cpu);
+    if (drive != bench->cpu_drive || (cpu->f[GPIO] & drive) != bench->cpu_value
+        || ((cpu->f[GPIO] ^ bench->pins) & ~drive & cpu->device->pins))
+        cpu->yield = true;
+}
+
+static void _bench_gpio_write(CPU *cpu, uint8_t *gpio)
+{
+    Bench *bench = cpu->bench;
+    if (bench->gpio_write_callback)
+        bench->gpio_write_callback(cpu, gpio);
+    _bench_check_outputs(bench);
+}
+
+static void _bench_tris_write(CPU *cpu, uint8_t *tris)
+{
+    Bench *bench = cpu->bench;
+    if (bench->tris_write_callback)
+        bench->tris_write_callback(cpu, tris);
+    _bench_check_outputs(bench);
+}
+
+static void _bench_option_write(CPU *cpu, uint8_t *option)
+{
+    // Pull-ups and T0CS taking GP2 both change how the pins resolve
+    Bench *bench = cpu->bench;
+    if (bench->option_write_callback)
+        bench->option_write_callback(cpu, option);
+    if (*option != bench->option)
+        cpu->yield = true;
+    _bench_check_outputs(bench);
+}
+
+// Fires every timer that's due, earliest first
+static void _bench_fire_timers(Bench *bench)
+{
+    uint64_t now = bench->cpu->inst_cycles;
+    while (1)
+    {
+        Peripheral *due = NULL;
+        for (int i = 0; i < bench->num_peripherals; i++)
+        {
+            Peripheral *p = bench->peripherals[i];
+            if (p->timer <= now && (due == NULL || p->timer < due->timer))
+                due = p;
+        }
+        if (due == NULL)
+            return;
+        due->timer = BENCH_NO_TIMER;
+        bench->evaluations++;
+        if (due->ops->timer)
+            due->ops->timer(due, bench);
+    }
+}
+
+static uint64_t _bench_next_timer(const Bench *bench)
+{
+    uint64_t next = BENCH_NO_TIMER;
+    for (int i = 0; i < bench->num_peripherals; i++)
+        if (bench->peripherals[i]->timer < next)
+            next = bench->peripherals[i]->timer;
+    return next;
+}
+
+
+void bench_init(Bench *bench, CPU *cpu)
+{
+    memset(bench, 0, sizeof(Bench));
+    bench->cpu = cpu;
+    bench->pins = cpu->f[GPIO] & cpu->device->pins;
+    bench->cpu_drive = cpu_driven_pins(cpu);
+    bench->cpu_value = cpu->f[GPIO] & bench->cpu_drive;
+    bench->option = cpu->option;
+
+    cpu->bench = bench;
+    bench->gpio_write_callback = cpu->gpio_write_callback;
+    bench->tris_write_callback = cpu->tris_write_callback;
+    bench->option_write_callback = cpu->option_write_callback;
+    cpu->gpio_write_callback = _bench_gpio_write;
+    cpu->tris_write_callback = _bench_tris_write;
+    cpu->option_write_callback = _bench_option_write;
+}
+
+void bench_deinit(Bench *bench)
+{
+    CPU *cpu = bench->cpu;
+    cpu->gpio_write_callback = bench->gpio_write_callback;
+    cpu->tris_write_callback = bench->tris_write_callback;
+    cpu->option_write_callback = bench->option_write_callback;
+    cpu->bench = NULL;
+}
+
+int bench_attach(Bench *bench, Peripheral *p)
+{
+    if (bench->num_peripherals == BENCH_MAX_PERIPHERALS)
+        return BENCH_ERR_FULL;
+    bench->peripherals[bench->num_peripherals++] = p;
+    if (p->ops->pins_changed) {
+        bench->evaluations++;
+        p->ops->pins_changed(p, bench, bench->pins, 0);
+    }
+    bench_update(bench);
+    return BENCH_OK;
+}
+
+void bench_init_peripheral(Peripheral *p, const PeripheralOps *ops, uint8_t pins)
+{
+    memset(p, 0, sizeof(Peripheral));
+    p->ops = ops;
+    p->pins = pins;
+    p->timer = BENCH_NO_TIMER;
+}
+
+
+void bench_update(Bench *bench)
+{
+    CPU *cpu = bench->cpu;
+    for (int round = 0; round < BENCH_MAX_SETTLE; round++)
+    {
+        uint8_t high = 0, low = 0, pull_high = 0, pull_low = 0;
+        for (int i = 0; i < bench->num_peripherals; i++)
+        {
+            const Peripheral *p = bench->peripherals[i];
+            high |= p->drive_mask & p->drive_value;
+            low |= p->drive_mask & ~p->drive_value;
+            pull_high |= p->pull_mask & p->pull_value;
+            pull_low |= p->pull_mask & ~p->pull_value;
+        }
+        uint8_t cpu_drive = cpu_driven_pins(cpu);
+        uint8_t cpu_value = cpu->f[GPIO] & cpu_drive;
+        if (high & low & ~cpu_drive)
+            bench->contentions++;
+
+        // Weakest first, each one overriding the last
+        uint8_t pins = bench->pins;
+        pins |= pull_high | cpu_pullup_pins(cpu);
+        pins &= ~pull_low;
+        pins = (pins | high) & ~low;
+        pins = ((pins & ~cpu_drive) | cpu_value) & cpu->device->pins;
+
+        uint8_t changed = pins ^ bench->pins;
+        bench->pins = pins;
+        bench->cpu_drive = cpu_drive;
+        bench->cpu_value = cpu_value;
+        bench->option = cpu->option;
+        for (int i = 0; i < bench->num_peripherals && changed; i++)
+        {
+            Peripheral *p = bench->peripherals[i];
+            if ((p->pins & changed) && p->ops->pins_changed) {
+                bench->evaluations++;
+                p->ops->pins_changed(p, bench, pins, p->pins & changed);
+            }
+        }
+
+        // Then into the CPU's inputs, which can reset it and change what it's driving
+        uint8_t gpio = cpu->f[GPIO] & cpu->device->pins;
+        uint8_t newgpio = (gpio & cpu_drive) | (pins & ~cpu_drive);
+        if (newgpio != gpio)
+            cpu_setgpio(cpu, newgpio);
+        else if (!changed)
+            return;
+    }
+}
+
+int bench_run(Bench *bench, uint64_t max_cycles)
+{
+    CPU *cpu = bench->cpu;
+    uint64_t end = cpu->inst_cycles + max_cycles;
+    if (end < cpu->inst_cycles)
+        end = UINT64_MAX;
+
+    while (1)
+    {
+        _bench_fire_timers(bench);
+        bench_update(bench);
+        if (cpu->inst_cycles >= end)
+            return STOP_CYCLES;
+
+        // A model reacting to the update can schedule for now (or earlier), that's due straight away
+        uint64_t until = _bench_next_timer(bench);
+        if (until <= cpu->inst_cycles)
+            continue;
+        if (until > end)
+            until = end;
+        int reason = cpu_run_cycles(cpu, until - cpu->inst_cycles);
+        if (reason != STOP_CYCLES && reason != STOP_YIELD) {
+            bench_update(bench);
+            return reason;
+        }
+    }
+}
+
+
+uint64_t bench_now(const Bench *bench)
+{
+    return bench->cpu->inst_cycles;
+}
+
+void bench_drive(Peripheral *p, uint8_t mask, uint8_t value)
+{
+    p->drive_mask |= mask;
+    p->drive_value = (p->drive_value & ~mask) | (value & mask);
+}
+
+void bench_release(Peripheral *p, uint8_t mask)
+{
+    p->drive_mask &= ~mask;
+}
+
+void bench_schedule(Peripheral *p, uint64_t cycle)
+{
+    p->timer = cycle;
+}
+
+void bench_cancel(Peripheral *p)
+{
+    p->timer = BENCH_NO_TIMER;
+}
+
+
+const char *bench_strerror(int err)
+{
+    switch (err)
+    {
+        case BENCH_OK:       return "OK";
+        case BENCH_ERR_FULL: return "Too many peripherals";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "board.h"
+
+typedef struct BoardWorker {
+    struct Board *board;
+    int index;
+    pthread_t thread;
+} BoardWorker;
+
+typedef struct BoardThreads {
+    BoardWorker workers[BOARD_MAX_DEVICES];
+    int num_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t go;       // Broadcast when the next quantum's set up
+    pthread_cond_t finished; // Signalled by the last worker to finish it
+    uint64_t generation;     // Bumped for every quantum
+    int pending;             // Workers still running the current one
+    bool quit;
+
+    // The current quantum
+    uint64_t target;
+    int *reasons;
+} BoardThreads;
+
+
+// Pins
+// Works out every net's value from what's on it, true if any changed
+static bool _board_resolve(Board *board)
+{
+    bool high[BOARD_MAX_NETS] = {false}, low[BOARD_MAX_NETS] = {false}, pulled[BOARD_MAX_NETS] = {false};
+    for (int i = 0; i < board->num_devices; i++)
+    {
+        const CPU *cpu = board->devices[i];
+        uint8_t outputs = cpu_driven_pins(cpu);
+        uint8_t pullups = cpu_pullup_pins(cpu);
+        for (int pin = 0; pin < BOARD_PINS; pin++)
+        {
+            int net = board->pin_net[i][pin];
+            uint8_t bit = 1 << pin;
+            if (net == BOARD_NO_NET)
+                continue;
+            if (outputs & bit) {
+                if (cpu->f[GPIO] & bit)
+                    high[net] = true;
+                else
+                    low[net] = true;
+            }
+            else if (pullups & bit)
+                pulled[net] = true;
+        }
+    }
+
+    bool changed = false;
+    for (int n = 0; n < board->num_nets; n++)
+    {
+        Net *net = &board->nets[n];
+        if (net->external) {
+            if (net->external_value)
+                high[n] = true;
+            else
+                low[n] = true;
+        }
+
+        uint8_t value = net->value;
+        if (high[n] && low[n]) {
+            board->contentions++;
+            value = 0;
+        }
+        else if (high[n] || low[n])
+            value = high[n];
+        else if (pulled[n])
+            value = 1;
+
+        if (value != net->value) {
+            net->value = value;
+            net->toggles++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Feeds the nets into every device's input pins
+static void _board_apply(Board *board)
+{
+    for (int i = 0; i < board->num_devices; i++)
+    {
+        CPU *cpu = board->devices[i];
+        uint8_t outputs = cpu_driven_pins(cpu);
+        uint8_t gpio = cpu->f[GPIO] & cpu->device->pins;
+        uint8_t newgpio = gpio;
+        for (int pin = 0; pin < BOARD_PINS; pin++)
+        {
+            int net = board->pin_net[i][pin];
+            uint8_t bit = 1 << pin;
+            if (net == BOARD_NO_NET || (outputs & bit))
+                continue;
+            if (board->nets[net].value)
+                newgpio |= bit;
+            else
+                newgpio &= ~bit;
+        }
+        if (newgpio != gpio)
+            cpu_setgpio(cpu, newgpio);
+    }
+}
+
+
+// Running
+static int _board_run_device(Board *board, int i, uint64_t target)
+{
+    CPU *cpu = board->devices[i];
+    uint64_t end = board->start_cycles[i] + target;
+    while (cpu->inst_cycles < end)
+    {
+        int reason = cpu_run_cycles(cpu, end - cpu->inst_cycles);
+        if (reason != STOP_CYCLES)
+            return reason;
+    }
+    return STOP_CYCLES;
+}
+
+// Thread index's share of the devices, every num_threads'th one
+static void _board_run_share(Board *board, int index, uint64_t target, int *reasons)
+{
+    for (int i = index; i < board->num_devices; i += board->num_threads)
+        reasons[i] = _board_run_device(board, i, target);
+}
+
+static void *_board_worker(void *arg)
+{
+    BoardWorker *worker = arg;
+    Board *board = worker->board;
+    BoardThreads *threads = board->threads;
+    uint64_t seen = 0;
+    while (1)
+    {
+        pthread_mutex_lock(&threads->lock);
+        while (threads->generation == seen && !threads->quit)
+            pthread_cond_wait(&threads->go, &threads->lock);
+        if (threads->quit) {
+            pthread_mutex_unlock(&threads->lock);
+            return NULL;
+        }
+        seen = threads->generation;
+        pthread_mutex_unlock(&threads->lock);
+
+        _board_run_share(board, worker->index, threads->target, threads->reasons);
+
+        pthread_mutex_lock(&threads->lock);
+        if (--threads->pending == 0)
+            pthread_cond_signal(&threads->finished);
+        pthread_mutex_unlock(&threads->lock);
+    }
+}
+
+static void _board_quantum(Board *board, uint64_t target, int *reasons)
+{
+    BoardThreads *threads = board->threads;
+    if (threads == NULL) {
+        _board_run_share(board, 0, target, reasons);
+        return;
+    }
+
+    // The lock takes care of making each side's writes visible to the other
+    pthread_mutex_lock(&threads->lock);
+    threads->target = target;
+    threads->reasons = reasons;
+    threads->pending = threads->num_workers;
+    threads->generation++;
+    pthread_cond_broadcast(&threads->go);
+    pthread_mutex_unlock(&threads->lock);
+
+    _board_run_share(board, 0, target, reasons);
+
+    pthread_mutex_lock(&threads->lock);
+    while (threads->pending > 0)
+        pthread_cond_wait(&threads->finished, &threads->lock);
+    pthread_mutex_unlock(&threads->lock);
+}
+
+
+int board_init(Board *board, int num_threads)
+{
+    memset(board, 0, sizeof(Board));
+    board->min_quantum = BOARD_MIN_QUANTUM;
+    board->max_quantum = BOARD_MAX_QUANTUM;
+    board->quantum = BOARD_MIN_QUANTUM; // Grows soon enough if nothing's happening
+    board->stop_device = -1;
+
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > BOARD_MAX_DEVICES)
+        num_threads = BOARD_MAX_DEVICES;
+    board->num_threads = num_threads;
+    if (num_threads == 1)
+        return BOARD_OK;
+
+    BoardThreads *threads = calloc(1, sizeof(BoardThreads));
+    pthread_mutex_init(&threads->lock, NULL);
+    pthread_cond_init(&threads->go, NULL);
+    pthread_cond_init(&threads->finished, NULL);
+    board->threads = threads;
+    for (int t = 1; t < num_threads; t++)
+    {
+        BoardWorker *worker = &threads->workers[threads->num_workers];
+        worker->board = board;
+        worker->index = t;
+        if (pthread_create(&worker->thread, NULL, _board_worker, worker) != 0) {
+            board_deinit(board);
+            return BOARD_ERR_THREADS;
+        }
+        threads->num_workers++;
+    }
+    return BOARD_OK;
+}
+
+void board_deinit(Board *board)
+{
+    BoardThreads *threads = board->threads;
+    if (threads == NULL)
+        return;
+
+    pthread_mutex_lock(&threads->lock);
+    threads->quit = true;
+    pthread_cond_broadcast(&threads->go);
+    pthread_mutex_unlock(&threads->lock);
+    for (int t = 0; t < threads->num_workers; t++)
+        pthread_join(threads->workers[t].thread, NULL);
+
+    pthread_mutex_destroy(&threads->lock);
+    pthread_cond_destroy(&threads->go);
+    pthread_cond_destroy(&threads->finished);
+    free(threads);
+    board->threads = NULL;
+}
+
+
+int board_add_device(Board *board, CPU *cpu)
+{
+    if (board->num_devices == BOARD_MAX_DEVICES)
+        return BOARD_ERR_FULL;
+    int i = board->num_devices++;
+    board->devices[i] = cpu;
+    board->start_cycles[i] = cpu->inst_cycles - board->time;
+    for (int pin = 0; pin < BOARD_PINS; pin++)
+        board->pin_net[i][pin] = BOARD_NO_NET;
+    return i;
+}
+
+int board_add_net(Board *board)
+{
+    if (board->num_nets == BOARD_MAX_NETS)
+        return BOARD_ERR_FULL;
+    int n = board->num_nets++;
+    memset(&board->nets[n], 0, sizeof(Net));
+    return n;
+}
+
+int board_connect(Board *board, int net, int device, int pin)
+{
+    if (net < 0 || net >= board->num_nets || device < 0 || device >= board->num_devices || pin < 0 || pin >= BOARD_PINS)
+        return BOARD_ERR_RANGE;
+    board->pin_net[device][pin] = net;
+    _board_resolve(board);
+    _board_apply(board);
+    return BOARD_OK;
+}
+
+int board_drive(Board *board, int net, bool value)
+{
+    if (net < 0 || net >= board->num_nets)
+        return BOARD_ERR_RANGE;
+    board->nets[net].external = true;
+    board->nets[net].external_value = value;
+    _board_resolve(board);
+    _board_apply(board);
+    return BOARD_OK;
+}
+
+int board_release(Board *board, int net)
+{
+    if (net < 0 || net >= board->num_nets)
+        return BOARD_ERR_RANGE;
+    board->nets[net].external = false;
+    _board_resolve(board);
+    _board_apply(board);
+    return BOARD_OK;
+}
+
+
+int board_run(Board *board, uint64_t max_cycles)
+{
+    uint64_t end = board->time + max_cycles;
+    if (end < board->time)
+        end = UINT64_MAX;
+    board->stop_device = -1;
+
+    while (board->time < end)
+    {
+        uint64_t target = board->time + board->quantum;
+        if (target > end || target < board->time)
+            target = end;
+
+        int reasons[BOARD_MAX_DEVICES];
+        _board_quantum(board, target, reasons);
+        board->time = target;
+        board->num_quanta++;
+
+        // Toggling means someone's waiting on someone else, so tighten up until things settle
+        // Growing back takes a while of quiet, so a net toggling every so often keeps quanta well under its period
+        // (two toggles in one quantum would look like none)
+        if (_board_resolve(board)) {
+            board->quiet_quanta = 0;
+            board->quantum /= 2;
+            if (board->quantum < board->min_quantum)
+                board->quantum = board->min_quantum;
+        }
+        else if (++board->quiet_quanta >= BOARD_GROW_AFTER) {
+            board->quiet_quanta = 0;
+            board->quantum *= 2;
+            if (board->quantum > board->max_quantum)
+                board->quantum = board->max_quantum;
+        }
+        _board_apply(board);
+
+        for (int i = 0; i < board->num_devices; i++)
+            if (reasons[i] != STOP_CYCLES) {
+                board->stop_device = i;
+                return reasons[i];
+            }
+    }
+    return STOP_CYCLES;
+}
+
+bool board_getnet(const Board *board, int net)
+{
+    return net >= 0 && net < board->num_nets && board->nets[net].value;
+}
+
+
+const char *board_strerror(int err)
+{
+    switch (err)
+    {
+        case BOARD_OK:          return "OK";
+        case BOARD_ERR_FULL:    return "Too many devices or nets";
+        case BOARD_ERR_RANGE:   return "No such device, net or pin";
+        case BOARD_ERR_THREADS: return "Failed to start board threads";
+    }
+    return "Unknown error";
+}
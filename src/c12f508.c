@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "c12f508.h"
+#include "cpu.h"
+#include "expr.h"
+#include "hex.h"
+#include "instructions.h"
+#include "stimulus.h"
+
+// The handle's just a CPU with some extras, the CPU goes first so callbacks can get back to the handle from it
+struct C12f508 {
+    CPU cpu;
+    CPUState power_on;      // What a power-on reset goes back to, config included
+    int load_error;         // HEX_ERR_* from the last load
+
+    // Input events converted for the stimulus runner, kept around between calls
+    StimulusEvent *events;
+    size_t events_capacity;
+
+    // Trace ring buffer
+    C12f508TraceEntry *trace;
+    size_t trace_capacity;
+    size_t trace_head;
+    size_t trace_count;
+};
+
+static void _c12f508_trace(CPU *cpu)
+{
+    C12f508 *sim = (C12f508 *)cpu;
+    if (sim->trace_count == sim->trace_capacity) {
+        cpu->yield = true; // Dropped, but the run stops right after this instruction
+        return;
+    }
+    C12f508TraceEntry *entry = &sim->trace[(sim->trace_head + sim->trace_count++) % sim->trace_capacity];
+    memset(entry, 0, sizeof(C12f508TraceEntry));
+    entry->cycle = cpu->inst_cycles;
+    entry->gpio = cpu->f[GPIO];
+    entry->tris = cpu->trisgpio;
+    entry->driven = cpu_driven_pins(cpu);
+    if (sim->trace_count == sim->trace_capacity)
+        cpu->yield = true;
+}
+
+static void _c12f508_gpio_write(CPU *cpu, uint8_t *gpio)
+{
+    (void)gpio; // Already in f[GPIO]
+    _c12f508_trace(cpu);
+}
+
+static void _c12f508_tris_write(CPU *cpu, uint8_t *tris)
+{
+    (void)tris; // Already in trisgpio
+    _c12f508_trace(cpu);
+}
+
+static int _c12f508_stop(int reason)
+{
+    return reason == STOP_YIELD ? C12F508_STOP_TRACE_FULL : reason;
+}
+
+// Loads replace the whole program, anything the new one doesn't set goes back to unprogrammed
+static void _c12f508_erase(C12f508 *sim)
+{
+    CPU *cpu = &sim->cpu;
+    int reset_vector = cpu->device->peripherals & DEVICE_OSCCAL ? cpu->device->reset_vector : -1;
+    for (int addr = 0; addr < cpu->device->program_words; addr++)
+        cpu_write_inst(cpu, addr, addr == reset_vector ? MOVLW | (cpu->inst[addr] & 0xFF) : 0xFFF);
+    cpu->config = 0xFFF;
+}
+
+// Validated before erasing, so a bad file leaves the old program alone
+static int _c12f508_load_image(C12f508 *sim, HexImage *image, int err)
+{
+    if (err == HEX_OK)
+        err = hex_validate(image, sim->cpu.device->program_words);
+    if (err == HEX_OK) {
+        _c12f508_erase(sim);
+        err = cpu_load_hex_image(&sim->cpu, image);
+    }
+    free(image);
+    sim->load_error = err;
+    return err;
+}
+
+// Power-on state with whatever config the program came with
+static void _c12f508_loaded(C12f508 *sim)
+{
+    sim->power_on.config = sim->cpu.config;
+    sim->power_on.inst_generation = sim->cpu.inst_generation;
+    cpu_load_state(&sim->cpu, &sim->power_on);
+}
+
+
+unsigned c12f508_abi_version(void)
+{
+    return C12F508_ABI_VERSION;
+}
+
+C12f508 *c12f508_new(void)
+{
+    C12f508 *sim = calloc(1, sizeof(C12f508));
+    if (sim == NULL)
+        return NULL;
+    cpu_init(&sim->cpu);
+    cpu_save_state(&sim->cpu, &sim->power_on);
+    return sim;
+}
+
+void c12f508_free(C12f508 *sim)
+{
+    if (sim == NULL)
+        return;
+    cpu_deinit(&sim->cpu);
+    free(sim->events);
+    free(sim->trace);
+    free(sim);
+}
+
+int c12f508_load_hex(C12f508 *sim, const char *path)
+{
+    HexImage *image = malloc(sizeof(HexImage));
+    sim->load_error = HEX_ERR_MEMORY;
+    if (image == NULL)
+        return C12F508_ERR_LOAD;
+    hex_image_clear(image);
+    if (_c12f508_load_image(sim, image, hex_read_file(image, path)) != HEX_OK)
+        return C12F508_ERR_LOAD;
+    _c12f508_loaded(sim);
+    return C12F508_OK;
+}
+
+int c12f508_load_hex_buffer(C12f508 *sim, const char *buf, size_t len)
+{
+    HexImage *image = malloc(sizeof(HexImage));
+    sim->load_error = HEX_ERR_MEMORY;
+    if (image == NULL)
+        return C12F508_ERR_LOAD;
+    hex_image_clear(image);
+    if (_c12f508_load_image(sim, image, hex_parse(image, buf, len)) != HEX_OK)
+        return C12F508_ERR_LOAD;
+    _c12f508_loaded(sim);
+    return C12F508_OK;
+}
+
+int c12f508_load_words(C12f508 *sim, const uint16_t *words, size_t num_words, int config)
+{
+    sim->load_error = HEX_ERR_ADDRESS;
+    if (num_words > sim->cpu.device->program_words || config > 0xFFF || (words == NULL && num_words > 0))
+        return C12F508_ERR_LOAD;
+    sim->load_error = HEX_OK;
+    _c12f508_erase(sim);
+    for (size_t addr = 0; addr < num_words; addr++)
+        cpu_write_inst(&sim->cpu, addr, words[addr] & 0xFFF);
+    sim->cpu.config = device_config(sim->cpu.device, config >= 0 ? config : 0xFFF);
+    _c12f508_loaded(sim);
+    return C12F508_OK;
+}
+
+const char *c12f508_error_detail(const C12f508 *sim)
+{
+    return hex_strerror(sim->load_error);
+}
+
+int c12f508_reset(C12f508 *sim, int kind)
+{
+    switch (kind)
+    {
+        case C12F508_RESET_POWER_ON: cpu_load_state(&sim->cpu, &sim->power_on); break;
+        case C12F508_RESET_MCLR:     cpu_reset(&sim->cpu, sim->cpu.asleep ? RESET_MCLR_SLEEP : RESET_MCLR_NORMAL); break;
+        case C12F508_RESET_WDT:      cpu_reset(&sim->cpu, sim->cpu.asleep ? RESET_WDT_SLEEP : RESET_WDT_NORMAL); break;
+        default:                     return C12F508_ERR_ARG;
+    }
+    return C12F508_OK;
+}
+
+int c12f508_set_engine(C12f508 *sim, int engine)
+{
+    if (engine != C12F508_ENGINE_FAST && engine != C12F508_ENGINE_PIPELINE)
+        return C12F508_ERR_ARG;
+    cpu_set_engine(&sim->cpu, engine == C12F508_ENGINE_FAST ? ENGINE_FAST : ENGINE_PIPELINE);
+    return C12F508_OK;
+}
+
+int c12f508_add_breakpoint(C12f508 *sim, unsigned addr, const char *condition)
+{
+    if (addr >= sim->cpu.device->program_words)
+        return C12F508_ERR_ARG;
+    if (condition == NULL) {
+        cpu_addbreakpoint(&sim->cpu, addr);
+        return C12F508_OK;
+    }
+    return cpu_addcondbreakpoint(&sim->cpu, addr, condition) == EXPR_OK ? C12F508_OK : C12F508_ERR_SYNTAX;
+}
+
+void c12f508_remove_breakpoint(C12f508 *sim, unsigned addr)
+{
+    if (addr >= sim->cpu.device->program_words)
+        return;
+    cpu_removebreakpoint(&sim->cpu, addr);
+    cpu_removecondbreakpoint(&sim->cpu, addr);
+}
+
+int c12f508_add_watchpoint(C12f508 *sim, unsigned reg)
+{
+    if (reg >= 32)
+        return C12F508_ERR_ARG;
+    cpu_addwatchpoint(&sim->cpu, reg);
+    return C12F508_OK;
+}
+
+void c12f508_remove_watchpoint(C12f508 *sim, unsigned reg)
+{
+    if (reg < 32)
+        cpu_removewatchpoint(&sim->cpu, reg);
+}
+
+
+// A buffer the caller hasn't drained yet stops runs before they start, rather than losing writes
+static bool _c12f508_trace_full(const C12f508 *sim)
+{
+    return sim->trace_capacity > 0 && sim->trace_count == sim->trace_capacity;
+}
+
+int c12f508_run(C12f508 *sim, uint64_t cycles)
+{
+    if (_c12f508_trace_full(sim))
+        return C12F508_STOP_TRACE_FULL;
+    return _c12f508_stop(cpu_run_cycles(&sim->cpu, cycles));
+}
+
+int c12f508_run_inputs(C12f508 *sim, const C12f508Input *inputs, size_t num_inputs, uint64_t cycles,
+                       size_t *num_applied)
+{
+    if (num_applied)
+        *num_applied = 0;
+    if (inputs == NULL && num_inputs > 0)
+        return C12F508_ERR_ARG;
+    if (num_inputs > sim->events_capacity) {
+        StimulusEvent *events = realloc(sim->events, num_inputs * sizeof(StimulusEvent));
+        if (events == NULL)
+            return C12F508_ERR_MEMORY;
+        sim->events = events;
+        sim->events_capacity = num_inputs;
+    }
+    uint8_t pins = sim->cpu.device->pins;
+    for (size_t i = 0; i < num_inputs; i++)
+    {
+        if (i > 0 && inputs[i].cycle < inputs[i - 1].cycle)
+            return C12F508_ERR_ORDER;
+        StimulusEvent *event = &sim->events[i];
+        event->cycle = inputs[i].cycle;
+        event->line = 0;
+        event->kind = STIMULUS_SET;
+        event->mask = inputs[i].mask & pins;
+        event->value = inputs[i].value & inputs[i].mask & pins;
+    }
+    if (_c12f508_trace_full(sim))
+        return C12F508_STOP_TRACE_FULL;
+
+    // The stimulus runner already does exactly this, with the events as a schedule as long as the run
+    Stimulus stim;
+    memset(&stim, 0, sizeof(Stimulus));
+    stim.events = sim->events;
+    stim.num_events = num_inputs;
+    stim.length = cycles;
+    stimulus_start(&stim, &sim->cpu);
+    int reason = stimulus_run(&stim, cycles);
+    if (num_applied)
+        *num_applied = stim.next;
+    return _c12f508_stop(reason);
+}
+
+void c12f508_set_pins(C12f508 *sim, uint8_t mask, uint8_t value)
+{
+    CPU *cpu = &sim->cpu;
+    mask &= cpu->device->pins & ~cpu_driven_pins(cpu);
+    uint8_t gpio = cpu_getgpio(cpu);
+    uint8_t newgpio = (gpio & ~mask) | (value & mask);
+    if (newgpio != gpio)
+        cpu_setgpio(cpu, newgpio);
+}
+
+
+void c12f508_get_state(C12f508 *sim, C12f508State *state)
+{
+    CPU *cpu = &sim->cpu;
+    memset(state, 0, sizeof(C12f508State));
+    state->cycles = cpu->inst_cycles;
+    state->pc = cpu->pc & (cpu->device->program_words - 1);
+    state->config = cpu->config;
+    state->stack[0] = cpu->stack[0];
+    state->stack[1] = cpu->stack[1];
+    state->w = cpu->w;
+    state->tris = cpu->trisgpio;
+    state->option = cpu->option;
+    state->asleep = cpu->asleep;
+    state->skipnext = cpu->skipnext;
+    state->wdt = cpu->wdt;
+    state->timer0_inhibit = cpu->timer0_inhibit;
+    state->prescaler = cpu->prescaler;
+    memcpy(state->f, cpu->f, 32);
+}
+
+void c12f508_set_state(C12f508 *sim, const C12f508State *state)
+{
+    const Device *device = sim->cpu.device;
+    uint16_t pc_mask = device->program_words - 1;
+    CPUState s;
+    cpu_save_state(&sim->cpu, &s);
+    s.inst_cycles = state->cycles;
+    s.pc = state->pc & pc_mask;
+    s.config = device_config(device, state->config);
+    s.stack[0] = state->stack[0] & pc_mask;
+    s.stack[1] = state->stack[1] & pc_mask;
+    s.w = state->w;
+    s.trisgpio = state->tris & device->pins;
+    s.option = state->option;
+    s.asleep = state->asleep != 0;
+    s.skipnext = state->skipnext != 0;
+    s.wdt = state->wdt;
+    s.timer0_inhibit = state->timer0_inhibit;
+    s.prescaler = state->prescaler;
+    memcpy(s.f, state->f, 32);
+    cpu_load_state(&sim->cpu, &s);
+}
+
+
+int c12f508_trace_enable(C12f508 *sim, size_t capacity)
+{
+    CPU *cpu = &sim->cpu;
+    free(sim->trace);
+    sim->trace = NULL;
+    sim->trace_capacity = 0;
+    sim->trace_head = 0;
+    sim->trace_count = 0;
+    cpu->gpio_write_callback = NULL;
+    cpu->tris_write_callback = NULL;
+    if (capacity == 0)
+        return C12F508_OK;
+
+    sim->trace = malloc(capacity * sizeof(C12f508TraceEntry));
+    if (sim->trace == NULL)
+        return C12F508_ERR_MEMORY;
+    sim->trace_capacity = capacity;
+    cpu->gpio_write_callback = _c12f508_gpio_write;
+    cpu->tris_write_callback = _c12f508_tris_write;
+    return C12F508_OK;
+}
+
+size_t c12f508_trace_read(C12f508 *sim, C12f508TraceEntry *entries, size_t max)
+{
+    size_t n = max < sim->trace_count ? max : sim->trace_count;
+    for (size_t i = 0; i < n; i++)
+        entries[i] = sim->trace[(sim->trace_head + i) % sim->trace_capacity];
+    if (n > 0) {
+        sim->trace_head = (sim->trace_head + n) % sim->trace_capacity;
+        sim->trace_count -= n;
+    }
+    return n;
+}
+
+const char *c12f508_strerror(int err)
+{
+    switch (err)
+    {
+        case C12F508_OK:         return "OK";
+        case C12F508_ERR_ARG:    return "Bad argument";
+        case C12F508_ERR_LOAD:   return "Firmware didn't load";
+        case C12F508_ERR_MEMORY: return "Out of memory";
+        case C12F508_ERR_ORDER:  return "Input events out of order";
+        case C12F508_ERR_SYNTAX: return "Breakpoint condition didn't compile";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "cosim.h"
+
+static bool _cosim_pins_match(CPU *cpu, const CoRoutine *co)
+{
+    return (cpu->f[GPIO] & co->mask) == co->value;
+}
+
+// Ends the run after this instruction if it just gave some routine the pin levels it wants
+static void _cosim_gpio_write(CPU *cpu, uint8_t *gpio)
+{
+    Cosim *sim = cpu->cosim;
+    if (sim->gpio_write_callback)
+        sim->gpio_write_callback(cpu, gpio);
+    if (sim->num_pin_waits == 0)
+        return;
+    for (int i = 0; i < sim->num_routines; i++)
+    {
+        CoRoutine *co = sim->routines[i];
+        if (co->wait == COSIM_WAIT_PINS && _cosim_pins_match(cpu, co)) {
+            cpu->yield = true;
+            return;
+        }
+    }
+}
+
+static void _cosim_start_wait(CoRoutine *co, int wait, uint64_t now)
+{
+    co->wait = wait;
+    co->timed_out = false;
+    co->deadline = co->timeout ? now + co->timeout : UINT64_MAX;
+    if (co->deadline < now)
+        co->deadline = UINT64_MAX;
+    co->timeout = 0;
+}
+
+// Whatever the wait set up gets undone, a breakpoint we put in stays if another routine's still waiting there
+static void _cosim_end_wait(Cosim *sim, CoRoutine *co)
+{
+    if (co->wait == COSIM_WAIT_PINS)
+        sim->num_pin_waits--;
+    if (co->wait == COSIM_WAIT_PC && co->own_breakpoint) {
+        co->own_breakpoint = false;
+        CoRoutine *heir = NULL;
+        for (int i = 0; i < sim->num_routines && heir == NULL; i++)
+            if (sim->routines[i] != co && sim->routines[i]->wait == COSIM_WAIT_PC && sim->routines[i]->pc == co->pc)
+                heir = sim->routines[i];
+        if (heir)
+            heir->own_breakpoint = true;
+        else
+            cpu_removebreakpoint(sim->cpu, co->pc);
+    }
+    co->wait = COSIM_WAIT_NONE;
+}
+
+static bool _cosim_ready(Cosim *sim, CoRoutine *co)
+{
+    CPU *cpu = sim->cpu;
+    uint64_t now = cpu->inst_cycles;
+    switch (co->wait)
+    {
+        case COSIM_WAIT_NONE:
+            return true;
+        case COSIM_WAIT_CYCLE:
+            if (now >= co->cycle)
+                return true;
+            break;
+        case COSIM_WAIT_PINS:
+            if (_cosim_pins_match(cpu, co))
+                return true;
+            break;
+        case COSIM_WAIT_PC:
+            if ((cpu->pc & (cpu->device->program_words - 1)) == co->pc && now > co->cycle)
+                return true;
+            break;
+        default:
+            return false;
+    }
+    if (now >= co->deadline) {
+        co->timed_out = true;
+        return true;
+    }
+    return false;
+}
+
+// Keeps going until nobody's ready, since resuming one can make another ready at the same cycle
+static void _cosim_resume_ready(Cosim *sim)
+{
+    bool resumed = true;
+    while (resumed)
+    {
+        resumed = false;
+        for (int i = 0; i < sim->num_routines; i++)
+        {
+            CoRoutine *co = sim->routines[i];
+            if (!_cosim_ready(sim, co))
+                continue;
+            _cosim_end_wait(sim, co);
+            sim->resumes++;
+            if (co->body(co, sim) == COSIM_DONE)
+                co->wait = COSIM_WAIT_DONE;
+            resumed = true;
+        }
+    }
+}
+
+
+void cosim_init(Cosim *sim, CPU *cpu)
+{
+    memset(sim, 0, sizeof(Cosim));
+    sim->cpu = cpu;
+    cpu->cosim = sim;
+    sim->gpio_write_callback = cpu->gpio_write_callback;
+    cpu->gpio_write_callback = _cosim_gpio_write;
+}
+
+void cosim_deinit(Cosim *sim)
+{
+    for (int i = 0; i < sim->num_routines; i++)
+        if (sim->routines[i]->wait != COSIM_WAIT_DONE)
+            _cosim_end_wait(sim, sim->routines[i]);
+    sim->cpu->gpio_write_callback = sim->gpio_write_callback;
+    sim->cpu->cosim = NULL;
+}
+
+int cosim_spawn(Cosim *sim, CoRoutine *co, int (*body)(CoRoutine *co, Cosim *sim))
+{
+    if (sim->num_routines == COSIM_MAX_ROUTINES)
+        return COSIM_ERR_FULL;
+    co->body = body;
+    co->resume = 0;
+    co->wait = COSIM_WAIT_NONE;
+    co->own_breakpoint = false;
+    co->timeout = 0;
+    co->deadline = UINT64_MAX;
+    co->timed_out = false;
+    sim->routines[sim->num_routines++] = co;
+    return COSIM_OK;
+}
+
+int cosim_run(Cosim *sim, uint64_t max_cycles)
+{
+    CPU *cpu = sim->cpu;
+    uint64_t end = cpu->inst_cycles + max_cycles;
+    if (end < cpu->inst_cycles)
+        end = UINT64_MAX;
+
+    while (1)
+    {
+        _cosim_resume_ready(sim);
+        if (cosim_done(sim) || cpu->inst_cycles >= end)
+            return STOP_CYCLES;
+
+        uint64_t until = end;
+        for (int i = 0; i < sim->num_routines; i++)
+        {
+            const CoRoutine *co = sim->routines[i];
+            if (co->wait == COSIM_WAIT_CYCLE && co->cycle < until)
+                until = co->cycle;
+            if (co->wait != COSIM_WAIT_DONE && co->deadline < until)
+                until = co->deadline;
+        }
+
+        int reason = cpu_run_cycles(cpu, until - cpu->inst_cycles);
+        if (reason == STOP_BREAKPOINT) {
+            // Ours if a routine put it in for waiting on this address, otherwise it goes back to the host
+            // (after the routines waiting there get their turn)
+            bool ours = false;
+            uint16_t pc = cpu->pc & (cpu->device->program_words - 1);
+            for (int i = 0; i < sim->num_routines; i++)
+                if (sim->routines[i]->wait == COSIM_WAIT_PC && sim->routines[i]->pc == pc && sim->routines[i]->own_breakpoint)
+                    ours = true;
+            if (!ours) {
+                _cosim_resume_ready(sim);
+                return reason;
+            }
+        }
+        else if (reason != STOP_CYCLES && reason != STOP_YIELD)
+            return reason;
+    }
+}
+
+bool cosim_done(const Cosim *sim)
+{
+    for (int i = 0; i < sim->num_routines; i++)
+        if (sim->routines[i]->wait != COSIM_WAIT_DONE)
+            return false;
+    return sim->num_routines > 0;
+}
+
+uint64_t cosim_now(const Cosim *sim)
+{
+    return sim->cpu->inst_cycles;
+}
+
+
+void cosim_wait_cycle(Cosim *sim, CoRoutine *co, uint64_t cycle)
+{
+    _cosim_start_wait(co, COSIM_WAIT_CYCLE, sim->cpu->inst_cycles);
+    co->cycle = cycle;
+}
+
+void cosim_wait_pins(Cosim *sim, CoRoutine *co, uint8_t mask, uint8_t value)
+{
+    _cosim_start_wait(co, COSIM_WAIT_PINS, sim->cpu->inst_cycles);
+    co->mask = mask;
+    co->value = value & mask;
+    sim->num_pin_waits++;
+}
+
+void cosim_wait_pc(Cosim *sim, CoRoutine *co, uint16_t pc)
+{
+    CPU *cpu = sim->cpu;
+    _cosim_start_wait(co, COSIM_WAIT_PC, cpu->inst_cycles);
+    co->pc = pc & (cpu->device->program_words - 1);
+    co->cycle = cpu->inst_cycles;
+    co->own_breakpoint = false;
+    bool set = cpu->breakpoint == co->pc || (cpu->breakpoints != NULL && (cpu->breakpoints[co->pc] & BREAK_SET));
+    if (!set) {
+        cpu_addbreakpoint(cpu, co->pc);
+        co->own_breakpoint = true;
+    }
+}
@@ -1,30 +1,53 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "cpu.h"
 #include "instructions.h"
+#include "hex.h"
+#include "image.h"
+#include "pipeline.h"
+#include "engine.h"
+#include "expr.h"
+#include "history.h"
+#include "recording.h"
 
 void cpu_init(CPU *cpu)
 {
+    cpu_init_device(cpu, &device_pic12f508);
+}
+
+void cpu_init_device(CPU *cpu, const Device *device)
+{
+    engine_init();
+    
+    cpu->device = device;
     cpu->verbose = false;
+    cpu->quiet = false;
     cpu->breakpoint = -1;
+    cpu->breakpoints = NULL;
+    cpu->conditions = NULL;
+    cpu->engine = ENGINE_FAST;
+    cpu->pipeline = NULL;
     
-    cpu->pc = 0x1FF;
-    cpu->inst = malloc(sizeof(uint16_t) * 512);
+    cpu->pc = device->reset_vector;
+    cpu->inst = malloc(sizeof(uint16_t) * DEVICE_MAX_WORDS);
+    cpu->inst_shared = false;
+    cpu->inst_generation = 0;
     cpu->skipnext = false;
     cpu->inst_cycles = 0;
     
-    cpu->stack = malloc(sizeof(uint16_t) * 2);
+    cpu->stack = calloc(2, sizeof(uint16_t));
     
     cpu->w = 0;
-    cpu->f = malloc(sizeof(uint16_t) * 32);
+    cpu->f = calloc(DEVICE_MAX_REGS, sizeof(uint8_t)); // Zeroed so runs are reproducible (the datasheet says GPRs are unknown on POR)
     
     // Special registers    Value on POR
     cpu->f[PCL] =    0xFF; // 1111 1111
     cpu->f[STATUS] = 0x18; // 0-01 1xxx
-    cpu->f[FSR] =    0xE0; // 111x xxxx
-    cpu->f[OSCCAL] = 0xFE; // 1111 111-
+    cpu->f[FSR] =    device->fsr_fixed; // 111x xxxx (11xx xxxx with two banks)
+    cpu->f[OSCCAL] = device->peripherals & DEVICE_OSCCAL ? 0xFE : 0; // 1111 111-
     cpu->f[GPIO] =   0x00; // --xx xxxx
-    cpu->trisgpio =  0x3F; // --11 1111
+    cpu->trisgpio =  device->pins; // --11 1111 (---- 1111 on the 10F20x)
     cpu->option =    0xFF; // 1111 1111
     cpu->config =   0xFFF; // ---- ---1 1111
     
@@ -37,11 +60,29 @@ void cpu_init(CPU *cpu)
     cpu->do_callback = true;
     cpu->gpio_read_callback = NULL;
     cpu->gpio_write_callback = NULL;
+    cpu->tris_write_callback = NULL;
+    cpu->option_write_callback = NULL;
+    cpu->yield = false;
+    cpu->inst_change_callback = NULL;
+    
+    cpu->watch_mask = 0;
+    cpu->watch_stop = false;
+    cpu->watch_callback = NULL;
+    cpu->history = NULL;
+    cpu->recording = NULL;
+    cpu->bench = NULL;
+    cpu->cosim = NULL;
+    cpu->memo = NULL;
     
-    // The final instruction (0x1FF) is always MOVLW oscillator_calibration
+    // Unprogrammed flash reads as all ones (XORLW 0xFF)
+    for (int i = 0; i < DEVICE_MAX_WORDS; i++)
+        cpu->inst[i] = 0xFFF;
+    
+    // The final instruction (0x1FF on the 12F508) is always MOVLW oscillator_calibration
     // But since we're an emulator, that can just be a static value I guess
     // The datasheet says 0x00 is the middle value so I'm just gonna use it
-    cpu->inst[0x1FF] = MOVLW; // MOVLW 0x00
+    if (device->peripherals & DEVICE_OSCCAL)
+        cpu->inst[device->reset_vector] = MOVLW; // MOVLW 0x00
 }
 
 void cpu_reset(CPU *cpu, int reset_condition)
@@ -51,11 +92,11 @@ void cpu_reset(CPU *cpu, int reset_condition)
         printf("  RESET: %s\n", reset_conditions[reset_condition]);
     }
     
-    cpu->pc = 0x1FF;
+    cpu->pc = cpu->device->reset_vector;
     cpu->f[PCL] = 0xFF;
-    cpu->f[FSR] |= 0xE0;
+    cpu->f[FSR] |= cpu->device->fsr_fixed;
     cpu->option = 0xFF;
-    cpu->trisgpio = 0x3F;
+    cpu->trisgpio = cpu->device->pins;
     
     cpu->prescaler = 0;
     cpu->timer0_inhibit = 0;
@@ -83,28 +124,100 @@ void cpu_reset(CPU *cpu, int reset_condition)
             break;
     }
     cpu->f[STATUS] = new_status;
+    
+    // OPTION and TRIS both went back to all 1s
+    if (cpu->do_callback && cpu->option_write_callback)
+        cpu->option_write_callback(cpu, &cpu->option);
 }
 
 void cpu_deinit(CPU *cpu)
 {
-    free(cpu->inst);
+    if (!cpu->inst_shared)
+        free(cpu->inst);
     free(cpu->stack);
     free(cpu->f);
+    free(cpu->pipeline);
+    free(cpu->breakpoints);
+    if (cpu->conditions != NULL)
+        for (int i = 0; i < DEVICE_MAX_WORDS; i++)
+            free(cpu->conditions[i]);
+    free(cpu->conditions);
+}
+
+void cpu_set_engine(CPU *cpu, int engine)
+{
+    // Switching is only exact at instruction boundaries, which is the only place cpu_step()/cpu_run() leave things
+    if (engine == ENGINE_PIPELINE && cpu->pipeline == NULL) {
+        cpu->pipeline = malloc(sizeof(Pipeline));
+        pipeline_init(cpu->pipeline);
+    } else if (engine == ENGINE_FAST) {
+        free(cpu->pipeline);
+        cpu->pipeline = NULL;
+    }
+    cpu->engine = engine;
+}
+
+void cpu_save_state(const CPU *cpu, CPUState *state)
+{
+    state->pc = cpu->pc;
+    state->skipnext = cpu->skipnext;
+    state->asleep = cpu->asleep;
+    state->inst_cycles = cpu->inst_cycles;
+    state->inst_generation = cpu->inst_generation;
+    memcpy(state->stack, cpu->stack, sizeof(state->stack));
+    state->w = cpu->w;
+    memcpy(state->f, cpu->f, sizeof(state->f));
+    state->trisgpio = cpu->trisgpio;
+    state->option = cpu->option;
+    state->config = cpu->config;
+    state->prescaler = cpu->prescaler;
+    state->timer0_inhibit = cpu->timer0_inhibit;
+    state->wdt = cpu->wdt;
+}
+
+void cpu_load_state(CPU *cpu, const CPUState *state)
+{
+    cpu->pc = state->pc;
+    cpu->skipnext = state->skipnext;
+    cpu->asleep = state->asleep;
+    cpu->inst_cycles = state->inst_cycles;
+    memcpy(cpu->stack, state->stack, sizeof(state->stack));
+    cpu->w = state->w;
+    memcpy(cpu->f, state->f, sizeof(state->f));
+    cpu->trisgpio = state->trisgpio;
+    cpu->option = state->option;
+    cpu->config = state->config;
+    cpu->prescaler = state->prescaler;
+    cpu->timer0_inhibit = state->timer0_inhibit;
+    cpu->wdt = state->wdt;
+    
+    // Whatever the pipeline had latched belongs to some other point in time
+    if (cpu->pipeline != NULL) {
+        cpu->pipeline->ir_valid = false;
+        cpu->pipeline->flush = false;
+        cpu->pipeline->q = 0;
+    }
 }
 
 
+// Where INDF points, bits <0:4> of FSR plus the bank bit on parts that have one
+static inline uint8_t _cpu_indirect(const CPU *cpu)
+{
+    return device_reg_addr(cpu->device, cpu->f[FSR], cpu->f[FSR] & 0x1F);
+}
+
 uint8_t cpu_getreg(CPU *cpu, uint8_t r)
 {
     // Not-so regular cases
     switch (r) {
-        case INDF: // Pointer shenanigans, INDF's value is the memory at the address stored in FSR (well bits <0:4> of it)
-            return cpu->f[cpu->f[FSR] & 0x1F];
-        case PCL: // The low bytes of the pc
-            return cpu->pc & 0xFF;
-        case FSR: // Bits <7:5> are unimplemented and read as 1
-            return cpu->f[FSR] | 0xE0;
-        case GPIO: // Bits <7:6> are unimplemented and read as 0
-            uint8_t gpio = cpu->f[GPIO] & 0x3F;
+        case INDF: // Pointer shenanigans, INDF's value is the memory at the address stored in FSR
+            return cpu->f[_cpu_indirect(cpu)];
+        case PCL: // The low bytes of the pc, which has already moved on to the next instruction on real hardware
+            return (cpu->pc + 1) & 0xFF;
+        case FSR: // Bits <7:5> (<7:6> with two banks) are unimplemented and read as 1
+            return cpu->f[FSR] | cpu->device->fsr_fixed;
+        case GPIO: // Bits <7:6> (<7:4> on the 10F20x) are unimplemented and read as 0
+            uint8_t gpio = cpu->f[GPIO] & cpu->device->pins;
             if (cpu->do_callback && cpu->gpio_read_callback) {
                 if (cpu->verbose)
                     printf("  Calling GPIO read callback...\n");
@@ -113,22 +226,23 @@ uint8_t cpu_getreg(CPU *cpu, uint8_t r)
             return gpio;
     }
     
-    // Regular cases
-    return cpu->f[r];
+    // Regular cases, unimplemented registers never get written so they stay 0
+    return cpu->f[device_reg_addr(cpu->device, cpu->f[FSR], r)];
 }
 
-void cpu_setreg(CPU *cpu, uint8_t r, uint8_t value)
+// r is a register file address here, with the bank already applied
+static void _cpu_store(CPU *cpu, uint8_t r, uint8_t value)
 {
     switch (r) {
-        case TMR0: // If prescaler assigned to timer0, stalls the timer for the next 2 cycles, also clears the prescaler timer
-            if ((cpu->option & PSA) == 0) {
+        case TMR0: // Stalls the timer for the next 2 cycles, also clears the prescaler timer if it's assigned to timer0
+            if ((cpu->option & (1 << PSA)) == 0)
                 cpu->prescaler = 0;
-                cpu->timer0_inhibit = 2;
-            }
+            cpu->timer0_inhibit = 2;
             cpu->f[TMR0] = value;
             return;
         case PCL: // Instructions that write to the PC set the 9th bit to 0 (except GOTO)
-            cpu->pc = value;
+            // PC<10:9> = STATUS<6:5> like CALL, and one short since the engine increments PC after the instruction
+            cpu->pc = (((cpu->f[STATUS] & 0x60) << 4) | value) - 1;
             return;
         case STATUS: // Bits <4:3> are not writable, so preserve them
             cpu->f[STATUS] = (cpu->f[STATUS] & 0x18) | (value & 0xE7);
@@ -143,8 +257,46 @@ void cpu_setreg(CPU *cpu, uint8_t r, uint8_t value)
             return;
     }
     
-    // Easy defaults 'ey?
-    cpu->f[r] = value;
+    // Easy defaults 'ey? (registers the part doesn't have ignore writes)
+    if ((cpu->device->unimplemented & (1u << (r & 0x1F))) == 0)
+        cpu->f[r] = value;
+}
+
+static void _cpu_watch_hit(CPU *cpu, uint8_t r, uint8_t old_value, uint16_t pc)
+{
+    WatchHit *hit = &cpu->watch_hit;
+    hit->reg = r;
+    hit->old_value = old_value;
+    hit->new_value = r == PCL ? (cpu->pc + 1) & 0xFF : cpu->f[r]; // PC lands one short, see _cpu_store()
+    hit->pc = pc;
+    hit->cycle = cpu->inst_cycles;
+    
+    if (cpu->verbose)
+        printf("  WATCH: f[0x%02x] 0x%02x -> 0x%02x at pc=%d\n", r, old_value, hit->new_value, pc);
+    if (cpu->watch_callback == NULL || cpu->watch_callback(cpu, hit))
+        cpu->watch_stop = true;
+}
+
+void cpu_setreg(CPU *cpu, uint8_t r, uint8_t value)
+{
+    // Indirect writes land wherever FSR points, and writing INDF through itself does nothing
+    if (r == INDF) {
+        r = _cpu_indirect(cpu);
+        if (r == INDF)
+            return;
+    } else {
+        r = device_reg_addr(cpu->device, cpu->f[FSR], r);
+    }
+    
+    // The one test unwatched CPUs pay for
+    if (cpu->watch_mask & (1u << (r & 0x1F))) {
+        uint16_t pc = cpu->pc & (cpu->device->program_words - 1);
+        uint8_t old_value = r == PCL ? (cpu->pc + 1) & 0xFF : cpu->f[r];
+        _cpu_store(cpu, r, value);
+        _cpu_watch_hit(cpu, r, old_value, pc);
+        return;
+    }
+    _cpu_store(cpu, r, value);
 }
 
 void cpu_print_registers(CPU *cpu)
@@ -161,82 +313,213 @@ void cpu_print_registers(CPU *cpu)
 }
 
 
-static uint8_t _read_next_nibble(FILE *file_ptr)
+// Copy-on-write for CPUs running off a shared image, since that's read-only
+static void _cpu_own_inst(CPU *cpu)
 {
-    char high = fgetc(file_ptr) - '0';
-    char low  = fgetc(file_ptr) - '0';
-    
-    // Offset in case of letter
-    // No need to worry about lowercase, I don't think they're valid
-    if (high > 9) high -= 7;
-    if (low  > 9) low  -= 7;
-    
-    return (high << 4) | low;
+    if (!cpu->inst_shared)
+        return;
+    // Images only hold 512 words, past that it's still unprogrammed
+    uint16_t *inst = malloc(sizeof(uint16_t) * DEVICE_MAX_WORDS);
+    memcpy(inst, cpu->inst, sizeof(uint16_t) * IMAGE_WORDS);
+    for (int i = IMAGE_WORDS; i < DEVICE_MAX_WORDS; i++)
+        inst[i] = 0xFFF;
+    cpu->inst = inst;
+    cpu->inst_shared = false;
 }
 
-void cpu_load_hex(CPU *cpu, const char *hex_path)
+int cpu_load_hex_image(CPU *cpu, const HexImage *image)
 {
-    // Note I'm not gonna be handling any record types but 0x00 and 0x01
-    // The 12f508 doesn't really seem to use the others, so why bother?
+    // Validate first so a bad file doesn't leave us half loaded
+    int err = hex_validate(image, cpu->device->program_words);
+    if (err != HEX_OK)
+        return err;
     
-    FILE *file = fopen(hex_path, "r");
-    if (file == NULL) 
+    _cpu_own_inst(cpu);
+    int num_words = 0;
+    for (int addr = 0; addr < cpu->device->program_words; addr++)
     {
-        perror("Failed to open HEX file");
-        exit(1);
+        if (!hex_word_present(image, addr))
+            continue;
+        cpu->inst[addr] = image->words[addr] & 0xFFF;
+        num_words++;
     }
+    if (hex_word_present(image, HEX_CONFIG_ADDR))
+        cpu->config = device_config(cpu->device, image->words[HEX_CONFIG_ADDR]);
+    
+    if (cpu->verbose)
+        printf("Loaded %d words from %u records, config=0x%03x\n", num_words, image->num_records, cpu->config);
+    return HEX_OK;
+}
+
+int cpu_load_hex_buffer(CPU *cpu, const char *buf, size_t len)
+{
+    HexImage *image = malloc(sizeof(HexImage));
+    if (image == NULL)
+        return HEX_ERR_MEMORY;
+    hex_image_clear(image);
+    
+    int err = hex_parse(image, buf, len);
+    if (err == HEX_OK)
+        err = cpu_load_hex_image(cpu, image);
+    else if (cpu->verbose)
+        printf("HEX error on line %u: %s\n", image->error_line, hex_strerror(err));
+    
+    free(image);
+    return err;
+}
+
+int cpu_load_hex(CPU *cpu, const char *hex_path)
+{
+    HexImage *image = malloc(sizeof(HexImage));
+    if (image == NULL)
+        return HEX_ERR_MEMORY;
+    hex_image_clear(image);
+    
+    int err = hex_read_file(image, hex_path);
+    if (err == HEX_OK)
+        err = cpu_load_hex_image(cpu, image);
+    else if (cpu->verbose)
+        printf("%s: %s (line %u)\n", hex_path, hex_strerror(err), image->error_line);
     
-    // Reading time!
-    while (1)
+    free(image);
+    return err;
+}
+
+// Both reloads end up here, words covers the device's whole program memory
+static int _cpu_reload_words(CPU *cpu, const uint16_t *words, uint16_t config, int reset_condition)
+{
+    // Diff first, most edits only touch a handful of words
+    int program_words = cpu->device->program_words;
+    uint8_t changed[DEVICE_MAX_WORDS / 8] = {0};
+    int num_changed = 0;
+    for (int addr = 0; addr < program_words; addr++)
     {
-        // Ignore non-: lines
-        if (fgetc(file) != ':')
-            continue;
-        
-        // Glean the initial info
-        uint8_t num_bytes = _read_next_nibble(file);
-        if (cpu->verbose) printf("Num bytes: %02x\n", num_bytes);
-        uint16_t address = ((_read_next_nibble(file) << 8) | _read_next_nibble(file)) / 2;
-        if (cpu->verbose) printf("Address: %04x\n", address);
-        uint8_t record_type = _read_next_nibble(file);
-        if (cpu->verbose) printf("Record type: %02x\n", record_type);
-        
-        if (record_type == 0x01) // EOF
-            break;
-        if (record_type != 0x00) // Non-data (we no want)
-            continue;
-        
-        // Specific addresses - Config word
-        if (address == 0x1FFE)
-        {
-            uint16_t config_word = _read_next_nibble(file) | (_read_next_nibble(file) << 8);
-            cpu->config = config_word;
-            _read_next_nibble(file);
-            continue;
-        }
-        
-        // Actually read the data now
-        for (int i = 0; i < num_bytes/2; i++)
-        {
-            uint16_t instruction = _read_next_nibble(file) | (_read_next_nibble(file) << 8);
-            if (cpu->verbose) printf("Instruction %d: %04x\n", address+i, instruction);
-            cpu->inst[address+i] = instruction;
+        if (cpu->inst[addr] != words[addr]) {
+            changed[addr >> 3] |= 1 << (addr & 7);
+            num_changed++;
         }
+    }
+    
+    if (num_changed > 0) {
+        _cpu_own_inst(cpu);
+        for (int addr = 0; addr < program_words; addr++)
+            if (changed[addr >> 3] & (1 << (addr & 7)))
+                cpu->inst[addr] = words[addr];
+        cpu->inst_generation++;
         
-        // Checksum! We don't care about the checksum, just use a good file!
-        _read_next_nibble(file);
+        if (cpu->inst_change_callback)
+            cpu->inst_change_callback(cpu, changed, num_changed);
+    }
+    cpu->config = device_config(cpu->device, config);
+    
+    if (cpu->verbose)
+        printf("Reload: %d word(s) changed, generation %u\n", num_changed, cpu->inst_generation);
+    
+    if (reset_condition != RESET_NONE)
+        cpu_reset(cpu, reset_condition);
+    return num_changed;
+}
+
+int cpu_reload_image(CPU *cpu, const FirmwareImage *image, int reset_condition)
+{
+    // Images are always 512 words, which only fits some parts
+    if (cpu->device->program_words != IMAGE_WORDS)
+        return IMAGE_ERR_DEVICE;
+    return _cpu_reload_words(cpu, image->inst, image->config, reset_condition);
+}
+
+int cpu_reload_hex(CPU *cpu, const char *hex_path, int reset_condition)
+{
+    const Device *device = cpu->device;
+    HexImage *hex = malloc(sizeof(HexImage));
+    int result = HEX_ERR_MEMORY;
+    if (hex == NULL)
+        goto reload_end;
+    hex_image_clear(hex);
+    
+    result = hex_read_file(hex, hex_path);
+    if (result == HEX_OK)
+        result = hex_validate(hex, device->program_words);
+    if (result != HEX_OK) {
+        if (cpu->verbose)
+            printf("%s: %s (line %u)\n", hex_path, hex_strerror(result), hex->error_line);
+        goto reload_end;
+    }
+    
+    // Same as image_from_hex(), sized for the part: unprogrammed words are all ones, and keep whatever calibration
+    // value the reset vector currently has if the new build doesn't set it
+    uint16_t words[DEVICE_MAX_WORDS];
+    for (int addr = 0; addr < device->program_words; addr++)
+        words[addr] = hex_word_present(hex, addr) ? hex->words[addr] & 0xFFF : 0xFFF;
+    if (!hex_word_present(hex, device->reset_vector) && (device->peripherals & DEVICE_OSCCAL))
+        words[device->reset_vector] = MOVLW | (cpu->inst[device->reset_vector] & 0xFF);
+    uint16_t config = hex_word_present(hex, HEX_CONFIG_ADDR) ? hex->words[HEX_CONFIG_ADDR] : 0xFFF;
+    result = _cpu_reload_words(cpu, words, config, reset_condition);
+    
+reload_end:
+    free(hex);
+    return result;
+}
+
+void cpu_write_inst(CPU *cpu, uint16_t addr, uint16_t word)
+{
+    addr &= cpu->device->program_words - 1;
+    word &= 0xFFF;
+    if (cpu->inst[addr] == word)
+        return;
+    
+    _cpu_own_inst(cpu);
+    cpu->inst[addr] = word;
+    cpu->inst_generation++;
+    
+    if (cpu->inst_change_callback) {
+        uint8_t changed[DEVICE_MAX_WORDS / 8] = {0};
+        changed[addr >> 3] = 1 << (addr & 7);
+        cpu->inst_change_callback(cpu, changed, 1);
     }
+}
+
+static void _cpu_step_engine(CPU *cpu)
+{
+    if (cpu->engine == ENGINE_PIPELINE)
+        pipeline_step(cpu);
+    else
+        instruction_cycle(cpu);
+}
+
+// Flag updates and Timer0 ticks don't go through cpu_setreg(), so watched ones get caught by comparing afterwards
+static void _cpu_step_watched(CPU *cpu)
+{
+    const uint8_t regs[2] = {TMR0, STATUS};
+    uint8_t before[2] = {cpu->f[TMR0], cpu->f[STATUS]};
+    uint16_t pc = cpu->pc & (cpu->device->program_words - 1);
     
-    if (fclose(file))
+    // An instruction writes at most one register directly, the sentinel tells us whether it reported one
+    WatchHit last = cpu->watch_hit;
+    cpu->watch_hit.cycle = UINT64_MAX;
+    _cpu_step_engine(cpu);
+    bool direct = cpu->watch_hit.cycle != UINT64_MAX;
+    if (!direct)
+        cpu->watch_hit = last;
+    
+    for (int i = 0; i < 2; i++)
     {
-        perror("Failed to close file");
-        exit(1);
+        uint8_t r = regs[i];
+        if ((cpu->watch_mask & (1u << r)) == 0)
+            continue;
+        // After a direct write only whatever changed it since counts (ADDWF STATUS,f sets flags on top)
+        uint8_t expected = direct && cpu->watch_hit.reg == r ? cpu->watch_hit.new_value : before[i];
+        if (cpu->f[r] != expected)
+            _cpu_watch_hit(cpu, r, expected, pc);
     }
 }
 
 void cpu_step(CPU *cpu)
 {
-    instruction_cycle(cpu);
+    if (cpu->watch_mask & WATCH_SIDE_EFFECTS)
+        _cpu_step_watched(cpu);
+    else
+        _cpu_step_engine(cpu);
 }
 
 
@@ -250,19 +533,89 @@ void cpu_clearbreakpoint(CPU *cpu)
     cpu->breakpoint = -1;
 }
 
+void cpu_addbreakpoint(CPU *cpu, uint16_t addr)
+{
+    if (cpu->breakpoints == NULL)
+        cpu->breakpoints = calloc(DEVICE_MAX_WORDS, sizeof(uint8_t));
+    cpu->breakpoints[addr & (cpu->device->program_words - 1)] |= BREAK_SET;
+}
+
+void cpu_removebreakpoint(CPU *cpu, uint16_t addr)
+{
+    if (cpu->breakpoints != NULL)
+        cpu->breakpoints[addr & (cpu->device->program_words - 1)] &= ~BREAK_SET;
+}
+
+int cpu_addcondbreakpoint(CPU *cpu, uint16_t addr, const char *condition)
+{
+    // Compile first so a typo doesn't leave a half set breakpoint
+    Expr *expr = malloc(sizeof(Expr));
+    int err = expr_compile(expr, condition);
+    if (err != EXPR_OK) {
+        if (cpu->verbose)
+            printf("Condition \"%s\": %s at column %d\n", condition, expr_strerror(err), expr->error_pos + 1);
+        free(expr);
+        return err;
+    }
+    
+    addr &= cpu->device->program_words - 1;
+    if (cpu->breakpoints == NULL)
+        cpu->breakpoints = calloc(DEVICE_MAX_WORDS, sizeof(uint8_t));
+    if (cpu->conditions == NULL)
+        cpu->conditions = calloc(DEVICE_MAX_WORDS, sizeof(Expr *));
+    free(cpu->conditions[addr]); // One condition per address, the new one replaces it
+    cpu->conditions[addr] = expr;
+    cpu->breakpoints[addr] |= BREAK_CONDITION;
+    return EXPR_OK;
+}
+
+void cpu_removecondbreakpoint(CPU *cpu, uint16_t addr)
+{
+    addr &= cpu->device->program_words - 1;
+    if (cpu->conditions == NULL)
+        return;
+    free(cpu->conditions[addr]);
+    cpu->conditions[addr] = NULL;
+    cpu->breakpoints[addr] &= ~BREAK_CONDITION;
+}
+
+bool cpu_checkcondition(const CPU *cpu)
+{
+    const Expr *expr = cpu->conditions != NULL ? cpu->conditions[cpu->pc & (cpu->device->program_words - 1)] : NULL;
+    return expr != NULL && expr_eval(expr, cpu) != 0;
+}
+
+void cpu_addwatchpoint(CPU *cpu, uint8_t r)
+{
+    cpu->watch_mask |= 1u << (r & 0x1F);
+}
+
+void cpu_removewatchpoint(CPU *cpu, uint8_t r)
+{
+    cpu->watch_mask &= ~(1u << (r & 0x1F));
+}
+
 void cpu_run(CPU *cpu)
 {
-    while (true)
-    {
-        if (cpu->pc == cpu->breakpoint)
-        {
-            if (cpu->verbose) printf("Breakpoint reached at pc=%d!\n", cpu->pc);
-            cpu_clearbreakpoint(cpu);
-            break;
-        }
-        
-        cpu_step(cpu);
+    // The engine only checks the breakpoint after each instruction, so catch one we're already sitting on
+    int reason = STOP_BREAKPOINT;
+    if (cpu->pc != cpu->breakpoint)
+        while ((reason = cpu_run_cycles(cpu, UINT64_MAX)) == STOP_CYCLES);
+    
+    if (reason == STOP_WATCHPOINT) {
+        if (cpu->verbose) printf("Watchpoint hit at pc=%d!\n", cpu->watch_hit.pc);
+        return;
     }
+    if (cpu->verbose) printf("Breakpoint reached at pc=%d!\n", cpu->pc);
+    cpu_clearbreakpoint(cpu);
+}
+
+int cpu_run_cycles(CPU *cpu, uint64_t max_cycles)
+{
+    uint64_t end_cycle = cpu->inst_cycles + max_cycles;
+    if (end_cycle < cpu->inst_cycles)
+        end_cycle = UINT64_MAX;
+    return engine_run(cpu, end_cycle);
 }
 
 
@@ -277,6 +630,10 @@ uint8_t cpu_getgpio(CPU *cpu)
 void cpu_setgpio(CPU *cpu, uint8_t newgpio)
 {
     // I'd like a mutex someday :)
+    if (cpu->recording != NULL)
+        recording_log_set(cpu->recording, newgpio);
+    if (cpu->history != NULL)
+        history_log_set(cpu->history, newgpio);
     uint8_t oldgpio = cpu_getgpio(cpu);
     cpu->do_callback = false;
     cpu_setreg(cpu, GPIO, newgpio);
@@ -291,8 +648,8 @@ void cpu_setgpio(CPU *cpu, uint8_t newgpio)
             cpu_reset(cpu, RESET_MCLR_SLEEP);
             return;
         }
-    // Handle pin wakeups
-    if ((cpu->option & GPWU) == 0 && (oldgpio & (GP0 | GP1 | GP3)) != (newgpio & (GP0 | GP1 | GP3))) {
+    // Handle pin wakeups (only from sleep)
+    if (cpu->asleep && (cpu->option & (1 << GPWU)) == 0 && (oldgpio & (GP0 | GP1 | GP3)) != (newgpio & (GP0 | GP1 | GP3))) {
         cpu_reset(cpu, RESET_WAKE_PIN);
         return;
     }
@@ -317,4 +674,20 @@ void cpu_writepins(CPU *cpu, uint8_t pin_mask, bool set)
     else
         gpio &= ~pin_mask;
     cpu_setgpio(cpu, gpio);
-}
\ No newline at end of file
+}
+
+uint8_t cpu_driven_pins(const CPU *cpu)
+{
+    // GP3 is input only, and GP2 is T0CKI while Timer0 is counting it
+    uint8_t driven = ~cpu->trisgpio & cpu->device->pins & ~GP3;
+    if (cpu->option & (1 << TOCS))
+        driven &= ~GP2;
+    return driven;
+}
+
+uint8_t cpu_pullup_pins(const CPU *cpu)
+{
+    if (cpu->option & (1 << GPPU))
+        return 0;
+    return (GP0 | GP1 | GP3) & ~cpu_driven_pins(cpu);
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "decoders.h"
+
+static void _decoder_init(Decoder *decoder, const PeripheralOps *ops, uint8_t pins)
+{
+    memset(decoder, 0, sizeof(Decoder));
+    bench_init_peripheral(&decoder->base, ops, pins);
+}
+
+static void _decoder_emit(Decoder *decoder, Bench *bench, uint8_t value, uint8_t miso, uint8_t flags)
+{
+    DecodedByte byte = {bench_now(bench), value, miso, flags};
+    if (flags & DECODE_FRAMING_ERROR)
+        decoder->framing_errors++;
+    if (flags & DECODE_TIMING_ERROR)
+        decoder->timing_errors++;
+    if (decoder->buffer) {
+        if (decoder->count < decoder->capacity)
+            decoder->buffer[decoder->count++] = byte;
+        else
+            decoder->dropped++;
+    }
+    if (decoder->callback)
+        decoder->callback(decoder, &byte);
+}
+
+void decoder_set_buffer(Decoder *decoder, DecodedByte *buffer, size_t capacity)
+{
+    decoder->buffer = buffer;
+    decoder->capacity = capacity;
+    decoder->count = 0;
+    decoder->dropped = 0;
+}
+
+
+// UART
+// Bits get filled in from edge times, every bit before an edge had the level from before it
+// The only timer is halfway through the stop bit, to finish the frame
+static void _uart_fill(UartDecoder *uart, int upto, bool level)
+{
+    if (upto > 10)
+        upto = 10;
+    for (; uart->filled < upto; uart->filled++)
+        if (level)
+            uart->bits |= 1 << uart->filled;
+}
+
+static void _uart_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed)
+{
+    UartDecoder *uart = (UartDecoder *)p;
+    bool level = (pins & uart->pin) != 0;
+    bool previous = uart->level;
+    uart->level = level;
+    if (changed == 0)
+        return;
+
+    uint64_t now = bench_now(bench);
+    if (!uart->in_frame) {
+        if (previous && !level) {
+            uart->in_frame = true;
+            uart->frame_start = now;
+            uart->filled = 0;
+            uart->bits = 0;
+            uart->flags = 0;
+            bench_schedule(p, now + (uint64_t)(9.5 * uart->cycles_per_bit + 0.5));
+        }
+        return;
+    }
+
+    double position = (now - uart->frame_start) / uart->cycles_per_bit;
+    int boundary = (int)(position + 0.5);
+    double offset = position > boundary ? position - boundary : boundary - position;
+    if (offset > UART_TIMING_TOLERANCE || boundary <= uart->filled)
+        uart->flags |= DECODE_TIMING_ERROR;
+    _uart_fill(uart, boundary, previous);
+}
+
+static void _uart_timer(Peripheral *p, Bench *bench)
+{
+    UartDecoder *uart = (UartDecoder *)p;
+    _uart_fill(uart, 10, uart->level);
+    if ((uart->bits & 0x001) || !(uart->bits & 0x200))
+        uart->flags |= DECODE_FRAMING_ERROR;
+    _decoder_emit(&uart->decoder, bench, (uart->bits >> 1) & 0xFF, 0, uart->flags);
+    uart->in_frame = false; // If the line's still low the next frame waits for it to go high and back again
+}
+
+static const PeripheralOps uart_ops = {"uart decoder", _uart_pins_changed, _uart_timer};
+
+void uart_decoder_init(UartDecoder *uart, uint8_t pin, double cycles_per_bit)
+{
+    _decoder_init(&uart->decoder, &uart_ops, pin);
+    uart->pin = pin;
+    uart->cycles_per_bit = cycles_per_bit;
+    uart->level = true;
+    uart->in_frame = false;
+}
+
+
+// SPI
+static void _spi_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed)
+{
+    SpiDecoder *spi = (SpiDecoder *)p;
+    if (changed == 0) {
+        spi->selected = spi->cs == 0 || !(pins & spi->cs);
+        return;
+    }
+
+    if (changed & spi->cs) {
+        bool selected = !(pins & spi->cs);
+        if (selected && !spi->selected) {
+            spi->bits = 0;
+            spi->frame_bytes = 0;
+            spi->flags = 0;
+        }
+        else if (!selected && spi->selected) {
+            // Selecting and deselecting without any clocks in between isn't worth a frame
+            if (spi->bits != 0)
+                _decoder_emit(&spi->decoder, bench, spi->mosi_byte, spi->miso_byte, spi->flags | DECODE_FRAMING_ERROR);
+            if (spi->bits != 0 || spi->frame_bytes != 0)
+                _decoder_emit(&spi->decoder, bench, 0, 0, DECODE_STOP);
+            spi->bits = 0;
+        }
+        spi->selected = selected;
+    }
+
+    // Modes 0 and 3 sample on the rising edge, 1 and 2 on the falling one
+    if (!spi->selected || !(changed & spi->sck))
+        return;
+    bool rising = (pins & spi->sck) != 0;
+    if (rising != (spi->mode == 0 || spi->mode == 3))
+        return;
+    if (changed & spi->mosi)
+        spi->flags |= DECODE_TIMING_ERROR;
+    if (spi->bits == 0) {
+        spi->mosi_byte = 0;
+        spi->miso_byte = 0;
+    }
+    spi->mosi_byte = (spi->mosi_byte << 1) | ((pins & spi->mosi) != 0);
+    spi->miso_byte = (spi->miso_byte << 1) | ((pins & spi->miso) != 0);
+    if (++spi->bits == 8) {
+        _decoder_emit(&spi->decoder, bench, spi->mosi_byte, spi->miso_byte, spi->flags);
+        spi->frame_bytes++;
+        spi->bits = 0;
+        spi->flags = 0;
+    }
+}
+
+static const PeripheralOps spi_ops = {"spi decoder", _spi_pins_changed, NULL};
+
+void spi_decoder_init(SpiDecoder *spi, uint8_t sck, uint8_t mosi, uint8_t miso, uint8_t cs, int mode)
+{
+    _decoder_init(&spi->decoder, &spi_ops, sck | mosi | cs); // MISO only matters on a clock edge
+    spi->sck = sck;
+    spi->mosi = mosi;
+    spi->miso = miso;
+    spi->cs = cs;
+    spi->mode = mode & 3;
+    spi->selected = cs == 0;
+    spi->bits = 0;
+    spi->frame_bytes = 0;
+    spi->flags = 0;
+}
+
+
+// I2C
+static void _i2c_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed)
+{
+    I2cDecoder *i2c = (I2cDecoder *)p;
+    if (changed == 0)
+        return;
+    bool scl = (pins & i2c->scl) != 0;
+    bool sda = (pins & i2c->sda) != 0;
+    if ((changed & i2c->scl) && (changed & i2c->sda))
+        i2c->flags |= DECODE_TIMING_ERROR;
+
+    // SDA moving while SCL's high is a start or stop
+    // The SCL rise just before it always clocks in one bit, any more and a byte got cut short
+    if ((changed & i2c->sda) && !(changed & i2c->scl) && scl) {
+        if (i2c->in_frame && i2c->bits > 1)
+            _decoder_emit(&i2c->decoder, bench, i2c->byte, 0, i2c->flags | DECODE_FRAMING_ERROR);
+        i2c->bits = 0;
+        i2c->byte = 0;
+        i2c->flags = 0;
+        if (!sda) {
+            i2c->in_frame = true;
+            i2c->first_byte = true;
+        }
+        else if (i2c->in_frame) {
+            i2c->in_frame = false;
+            _decoder_emit(&i2c->decoder, bench, 0, 0, DECODE_STOP);
+        }
+        return;
+    }
+
+    if (!i2c->in_frame || !(changed & i2c->scl) || !scl)
+        return;
+    if (i2c->bits < 8) {
+        i2c->byte = (i2c->byte << 1) | sda;
+        i2c->bits++;
+        return;
+    }
+    uint8_t flags = i2c->flags | (i2c->first_byte ? DECODE_START : 0) | (sda ? DECODE_NACK : 0);
+    _decoder_emit(&i2c->decoder, bench, i2c->byte, 0, flags);
+    i2c->first_byte = false;
+    i2c->bits = 0;
+    i2c->byte = 0;
+    i2c->flags = 0;
+}
+
+static const PeripheralOps i2c_ops = {"i2c decoder", _i2c_pins_changed, NULL};
+
+void i2c_decoder_init(I2cDecoder *i2c, uint8_t scl, uint8_t sda)
+{
+    _decoder_init(&i2c->decoder, &i2c_ops, scl | sda);
+    i2c->scl = scl;
+    i2c->sda = sda;
+    i2c->in_frame = false;
+    i2c->first_byte = false;
+    i2c->bits = 0;
+    i2c->byte = 0;
+    i2c->flags = 0;
+}
@@ -0,0 +1,92 @@
+#include <stddef.h>
+#include "device.h"
+
+// Register values straight from the datasheets' memory maps
+
+const Device device_pic12f508 = {
+    .name = "PIC12F508",
+    .index = 0,
+    .program_words = DEVICE_PIC12F508_WORDS,
+    .reset_vector = DEVICE_PIC12F508_WORDS - 1,
+    .banks = DEVICE_PIC12F508_BANKS,
+    .fsr_fixed = 0xE0,     // 111x xxxx
+    .unimplemented = DEVICE_PIC12F508_UNIMPLEMENTED,
+    .num_gpr = 25,
+    .pins = DEVICE_PIC12F508_PINS,
+    .config_mask = 0x01F,  // MCLRE, CP, WDTE, FOSC<1:0>
+    .peripherals = DEVICE_TMR0 | DEVICE_WDT | DEVICE_OSCCAL,
+};
+
+const Device device_pic12f509 = {
+    .name = "PIC12F509",
+    .index = 1,
+    .program_words = DEVICE_PIC12F509_WORDS,
+    .reset_vector = DEVICE_PIC12F509_WORDS - 1,
+    .banks = DEVICE_PIC12F509_BANKS,
+    .fsr_fixed = 0xC0,     // 11xx xxxx, FSR<5> is the bank
+    .unimplemented = DEVICE_PIC12F509_UNIMPLEMENTED,
+    .num_gpr = 41,
+    .pins = DEVICE_PIC12F509_PINS,
+    .config_mask = 0x01F,
+    .peripherals = DEVICE_TMR0 | DEVICE_WDT | DEVICE_OSCCAL,
+};
+
+const Device device_pic10f200 = {
+    .name = "PIC10F200",
+    .index = 2,
+    .program_words = DEVICE_PIC10F200_WORDS,
+    .reset_vector = DEVICE_PIC10F200_WORDS - 1,
+    .banks = DEVICE_PIC10F200_BANKS,
+    .fsr_fixed = 0xE0,
+    .unimplemented = DEVICE_PIC10F200_UNIMPLEMENTED,
+    .num_gpr = 16,
+    .pins = DEVICE_PIC10F200_PINS,
+    .config_mask = 0x01C,  // MCLRE, CP, WDTE, the oscillator is always internal
+    .peripherals = DEVICE_TMR0 | DEVICE_WDT | DEVICE_OSCCAL,
+};
+
+const Device device_pic10f202 = {
+    .name = "PIC10F202",
+    .index = 3,
+    .program_words = DEVICE_PIC10F202_WORDS,
+    .reset_vector = DEVICE_PIC10F202_WORDS - 1,
+    .banks = DEVICE_PIC10F202_BANKS,
+    .fsr_fixed = 0xE0,
+    .unimplemented = DEVICE_PIC10F202_UNIMPLEMENTED,
+    .num_gpr = 24,
+    .pins = DEVICE_PIC10F202_PINS,
+    .config_mask = 0x01C,
+    .peripherals = DEVICE_TMR0 | DEVICE_WDT | DEVICE_OSCCAL,
+};
+
+const Device *const device_list[DEVICE_COUNT] = {
+    &device_pic12f508, &device_pic12f509, &device_pic10f200, &device_pic10f202,
+};
+
+static char _device_lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+const Device *device_find(const char *name)
+{
+    if (name == NULL)
+        return NULL;
+    for (int i = 0; i < DEVICE_COUNT; i++)
+    {
+        // Compared against the name with and without its "PIC"
+        const char *full = device_list[i]->name;
+        for (int skip = 0; skip <= 3; skip += 3)
+        {
+            const char *a = name, *b = full + skip;
+            while (*a != '\0' && _device_lower(*a) == _device_lower(*b))
+            {
+                a++;
+                b++;
+            }
+            if (*a == '\0' && *b == '\0')
+                return device_list[i];
+        }
+    }
+    return NULL;
+}
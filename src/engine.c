@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <pthread.h>
+#include "engine.h"
+#include "instructions.h"
+#include "memo.h"
+#include "pipeline.h"
+
+// Internal stop reason, the variant no longer matches the CPU's configuration
+#define STOP_RESELECT -1
+
+typedef int (*EngineRun)(CPU *, uint64_t);
+
+// instruction_decode() of every possible 12-bit word
+static uint8_t engine_decode[4096];
+static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+
+static void _engine_build_decode(void)
+{
+    for (int i = 0; i < 4096; i++)
+        engine_decode[i] = instruction_decode(i);
+}
+
+void engine_init(void)
+{
+    // CPUs get set up from several threads at once (main.c's workers, fleets, sweeps...)
+    pthread_once(&engine_once, _engine_build_decode);
+}
+
+// How many cycles of sleep until PC creeps onto a breakpoint (it keeps incrementing while asleep)
+static uint64_t _engine_breakpoint_distance(CPU *cpu, uint16_t pc_mask)
+{
+    uint64_t distance = UINT64_MAX;
+    if (cpu->breakpoint >= 0) {
+        distance = (uint16_t)(cpu->breakpoint - cpu->pc);
+        if (distance == 0)
+            distance = 0x10000;
+    }
+    if (cpu->breakpoints != NULL) {
+        // The map is indexed by pc & pc_mask, so anything set is at most a program memory's worth of cycles away
+        for (uint64_t i = 1; i <= (uint64_t)pc_mask + 1 && i < distance; i++)
+            if (cpu->breakpoints[(cpu->pc + i) & pc_mask]) {
+                distance = i;
+                break;
+            }
+    }
+    return distance;
+}
+
+
+// The variants, one set of 8 per device (see engine_device.h), from the same DEVICE_* values as device.c
+#define ENGINE_DEVICE        pic12f508
+#define ENGINE_PC_MASK       (DEVICE_PIC12F508_WORDS - 1)
+#define ENGINE_BANKED        (DEVICE_PIC12F508_BANKS > 1)
+#define ENGINE_UNIMPLEMENTED DEVICE_PIC12F508_UNIMPLEMENTED
+#define ENGINE_PINS          DEVICE_PIC12F508_PINS
+#include "engine_device.h"
+
+#define ENGINE_DEVICE        pic12f509
+#define ENGINE_PC_MASK       (DEVICE_PIC12F509_WORDS - 1)
+#define ENGINE_BANKED        (DEVICE_PIC12F509_BANKS > 1)
+#define ENGINE_UNIMPLEMENTED DEVICE_PIC12F509_UNIMPLEMENTED
+#define ENGINE_PINS          DEVICE_PIC12F509_PINS
+#include "engine_device.h"
+
+#define ENGINE_DEVICE        pic10f200
+#define ENGINE_PC_MASK       (DEVICE_PIC10F200_WORDS - 1)
+#define ENGINE_BANKED        (DEVICE_PIC10F200_BANKS > 1)
+#define ENGINE_UNIMPLEMENTED DEVICE_PIC10F200_UNIMPLEMENTED
+#define ENGINE_PINS          DEVICE_PIC10F200_PINS
+#include "engine_device.h"
+
+#define ENGINE_DEVICE        pic10f202
+#define ENGINE_PC_MASK       (DEVICE_PIC10F202_WORDS - 1)
+#define ENGINE_BANKED        (DEVICE_PIC10F202_BANKS > 1)
+#define ENGINE_UNIMPLEMENTED DEVICE_PIC10F202_UNIMPLEMENTED
+#define ENGINE_PINS          DEVICE_PIC10F202_PINS
+#include "engine_device.h"
+
+// Indexed by Device.index, in device_list order
+static const EngineRun *const engine_variants[DEVICE_COUNT] = {
+    _engine_variants_pic12f508, _engine_variants_pic12f509, _engine_variants_pic10f200, _engine_variants_pic10f202,
+};
+static const char *const engine_variant_names[8] = {
+    "plain", "wdt", "psa", "psa_wdt", "tmr0", "tmr0_wdt", "tmr0_psa", "tmr0_psa_wdt",
+};
+
+// Verbose CPUs and the pipeline engine, everything gets checked every step anyways
+static int _engine_run_generic(CPU *cpu, uint64_t end_cycle)
+{
+    while (cpu->inst_cycles < end_cycle)
+    {
+        cpu_step(cpu);
+
+        if (cpu_atbreakpoint(cpu))
+            return STOP_BREAKPOINT;
+        if (cpu->watch_stop || cpu->yield)
+            return STOP_RESELECT;
+    }
+    return STOP_CYCLES;
+}
+
+static int _engine_variant(CPU *cpu)
+{
+    if (cpu->verbose || cpu->engine != ENGINE_FAST || (cpu->watch_mask & WATCH_SIDE_EFFECTS))
+        return -1;
+    int tmr0 = (cpu->option & (1 << TOCS)) == 0;
+    int psa_wdt = (cpu->option & (1 << PSA)) != 0;
+    int wdt = (cpu->config & WDTE) != 0;
+    return (tmr0 << 2) | (psa_wdt << 1) | wdt;
+}
+
+int engine_run(CPU *cpu, uint64_t end_cycle)
+{
+    cpu->watch_stop = false; // Anything left over from cpu_step() and such is old news
+    cpu->yield = false;
+    while (1)
+    {
+        int variant = _engine_variant(cpu);
+        int reason = variant < 0 ? _engine_run_generic(cpu, end_cycle) : engine_variants[cpu->device->index][variant](cpu, end_cycle);
+
+        // Watchpoints end the run at the end of the instruction that hit them
+        if (cpu->watch_stop) {
+            cpu->watch_stop = false;
+            return STOP_WATCHPOINT;
+        }
+        if (cpu->yield) {
+            cpu->yield = false;
+            return STOP_YIELD;
+        }
+        if (reason != STOP_RESELECT)
+            return reason;
+    }
+}
+
+const char *engine_variant_name(CPU *cpu)
+{
+    int variant = _engine_variant(cpu);
+    if (variant < 0 && cpu->engine == ENGINE_PIPELINE)
+        return "pipeline";
+    if (variant < 0)
+        return cpu->verbose ? "verbose" : "watched";
+    return engine_variant_names[variant];
+}
@@ -0,0 +1,72 @@
+// Per-device fast engines, included by engine.c once per device (no include guard on purpose)
+// Expects these to be defined, and undefines them again at the end:
+//   ENGINE_DEVICE        - suffix for the generated names, pic12f508 gives _engine_run_pic12f508_plain and so on,
+//                          plus the _engine_variants_pic12f508 table
+//   ENGINE_PC_MASK, ENGINE_BANKED, ENGINE_UNIMPLEMENTED, ENGINE_PINS - the device's constants, see engine_template.h
+// They come from the DEVICE_* macros in device.h like the Device in device.c does, engine_run() picks the table by Device.index
+
+#ifndef ENGINE_CAT
+#define ENGINE_CAT_(a, b) a##b
+#define ENGINE_CAT(a, b) ENGINE_CAT_(a, b)
+#define ENGINE_RUN(variant) ENGINE_CAT(ENGINE_CAT(_engine_run_, ENGINE_DEVICE), variant)
+#endif
+
+#define ENGINE_NAME    ENGINE_RUN(_plain)
+#define ENGINE_TMR0    0
+#define ENGINE_PSA_WDT 0
+#define ENGINE_WDT     0
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_wdt)
+#define ENGINE_TMR0    0
+#define ENGINE_PSA_WDT 0
+#define ENGINE_WDT     1
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_psa)
+#define ENGINE_TMR0    0
+#define ENGINE_PSA_WDT 1
+#define ENGINE_WDT     0
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_psa_wdt)
+#define ENGINE_TMR0    0
+#define ENGINE_PSA_WDT 1
+#define ENGINE_WDT     1
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_tmr0)
+#define ENGINE_TMR0    1
+#define ENGINE_PSA_WDT 0
+#define ENGINE_WDT     0
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_tmr0_wdt)
+#define ENGINE_TMR0    1
+#define ENGINE_PSA_WDT 0
+#define ENGINE_WDT     1
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_tmr0_psa)
+#define ENGINE_TMR0    1
+#define ENGINE_PSA_WDT 1
+#define ENGINE_WDT     0
+#include "engine_template.h"
+
+#define ENGINE_NAME    ENGINE_RUN(_tmr0_psa_wdt)
+#define ENGINE_TMR0    1
+#define ENGINE_PSA_WDT 1
+#define ENGINE_WDT     1
+#include "engine_template.h"
+
+// Indexed by tmr0 << 2 | psa_wdt << 1 | wdt
+static const EngineRun ENGINE_CAT(_engine_variants_, ENGINE_DEVICE)[8] = {
+    ENGINE_RUN(_plain), ENGINE_RUN(_wdt), ENGINE_RUN(_psa), ENGINE_RUN(_psa_wdt),
+    ENGINE_RUN(_tmr0), ENGINE_RUN(_tmr0_wdt), ENGINE_RUN(_tmr0_psa), ENGINE_RUN(_tmr0_psa_wdt),
+};
+
+#undef ENGINE_DEVICE
+#undef ENGINE_PC_MASK
+#undef ENGINE_BANKED
+#undef ENGINE_UNIMPLEMENTED
+#undef ENGINE_PINS
@@ -0,0 +1,321 @@
+// Fast engine template, included by engine.c once per variant (no include guard on purpose)
+// Expects these to be defined, and undefines them again at the end:
+//   ENGINE_NAME    - name of the generated run function
+//   ENGINE_TMR0    - Timer0 counts the instruction clock (TOCS = 0)
+//   ENGINE_PSA_WDT - prescaler assigned to the WDT (PSA = 1)
+//   ENGINE_WDT     - WDT enabled in the config word
+// and, for the whole device (engine_device.h sets these up and undefines them after all 8 variants):
+//   ENGINE_PC_MASK       - program memory size - 1
+//   ENGINE_BANKED        - FSR<5> banks registers 0x10-0x1F
+//   ENGINE_UNIMPLEMENTED - Device.unimplemented, writes to these go through cpu_setreg() which drops them
+//   ENGINE_PINS          - GPIO/TRIS bits that exist
+// The handlers here are the non-verbose twins of the inst_* ones in instructions.c, keep them in sync!
+
+// Registers past GPIO are plain memory, everything else (and watched registers) goes through cpu_getreg()/cpu_setreg()
+// With two banks 0x10-0x1F move up to 0x30-0x3F when FSR<5> is set, constant folded away for parts without
+#if ENGINE_BANKED
+#define ENGINE_ADDR(reg) ((reg) | (f[FSR] & (((reg) & 0x10) << 1)))
+#else
+#define ENGINE_ADDR(reg) (reg)
+#endif
+// Callbacks in there can reset the CPU (MCLR, pin wake-up), which changes OPTION, so drop out and reselect if that happens,
+// same for a watchpoint or a callback asking to stop
+#define ENGINE_READ(v, reg) do { \
+        if ((reg) > GPIO) (v) = f[ENGINE_ADDR(reg)]; \
+        else { (v) = cpu_getreg(cpu, reg); if (cpu->option != entry_option || cpu->watch_stop || cpu->yield) limit = 0; } \
+    } while (0)
+#define ENGINE_WRITE(reg, v) do { \
+        if ((reg) > GPIO && ((cpu->watch_mask | ENGINE_UNIMPLEMENTED) & (1u << (reg))) == 0) f[ENGINE_ADDR(reg)] = (v); \
+        else { cpu_setreg(cpu, reg, v); if ((reg) == PCL) cycles = 2; if (cpu->option != entry_option || cpu->watch_stop || cpu->yield) limit = 0; } \
+    } while (0)
+#define ENGINE_STORE(v) do { if (d) ENGINE_WRITE(r, v); else cpu->w = (v); } while (0)
+#define ENGINE_SET_Z(v) f[STATUS] = (f[STATUS] & ~Z) | ((v) == 0 ? Z : 0)
+#define ENGINE_TICK() instruction_tick_with(cpu, ENGINE_TMR0, ENGINE_PSA_WDT, ENGINE_WDT)
+
+static int ENGINE_NAME(CPU *cpu, uint64_t end_cycle)
+{
+    uint8_t *f = cpu->f;
+    uint16_t *stack = cpu->stack;
+    const uint8_t entry_option = cpu->option;
+    uint64_t limit = end_cycle; // Dropped to 0 when this variant stops applying, which ends the loop
+#if ENGINE_PSA_WDT && ENGINE_WDT
+    const uint32_t wdt_rate = (1u << (entry_option & PS)) * 18000;
+#endif
+
+    while (cpu->inst_cycles < limit)
+    {
+        uint8_t cycles = 1;
+
+        // Nothing executes while asleep, so skip ahead in bulk up until anything observable could happen
+        if (cpu->asleep) {
+            uint64_t n = limit - cpu->inst_cycles;
+            uint64_t distance = _engine_breakpoint_distance(cpu, ENGINE_PC_MASK);
+            if (distance < n)
+                n = distance;
+#if ENGINE_PSA_WDT && ENGINE_WDT
+            // The tick that increments the WDT goes through the normal path
+            uint64_t until_wdt = cpu->prescaler < wdt_rate ? wdt_rate - 1 - cpu->prescaler : 0;
+            if (until_wdt < n)
+                n = until_wdt;
+#endif
+            if (n == 0)
+                goto execute_end;
+            cpu->pc += n;
+            cpu->inst_cycles += n;
+            cpu->prescaler += n;
+            goto breakpoint_check;
+        }
+
+        // Fetch
+        cpu->pc &= ENGINE_PC_MASK;
+        uint16_t instruction = cpu->inst[cpu->pc] & 0xFFF;
+        if (cpu->skipnext) {
+            cpu->skipnext = false;
+            goto execute_end;
+        }
+
+        // Decode
+        uint8_t r = instruction & 0x1F;
+        uint8_t d = (instruction >> 5) & 0x01;
+        uint8_t k = instruction & 0xFF;
+        uint8_t bit = 1 << ((instruction >> 5) & 0x07);
+        uint8_t value, result;
+
+        // Execute
+        switch (engine_decode[instruction]) {
+            // Byte-level
+            case OP_ADDWF:
+                ENGINE_READ(value, r);
+                result = cpu->w + value;
+                f[STATUS] &= ~(C | DC | Z);
+                if (result < cpu->w || result < value) f[STATUS] |= C;
+                if ((cpu->w & 0x0F) + (value & 0x0F) > 0x0F) f[STATUS] |= DC;
+                if (result == 0) f[STATUS] |= Z;
+                ENGINE_STORE(result);
+                break;
+            case OP_ANDWF:
+                ENGINE_READ(value, r);
+                result = cpu->w & value;
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+            case OP_CLRF:
+                ENGINE_WRITE(r, 0);
+                f[STATUS] |= Z;
+                break;
+            case OP_CLRW:
+                cpu->w = 0;
+                f[STATUS] |= Z;
+                break;
+            case OP_COMF:
+                ENGINE_READ(value, r);
+                result = ~value;
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+            case OP_DECF:
+                ENGINE_READ(value, r);
+                result = value - 1;
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+            case OP_DECFSZ:
+                ENGINE_READ(value, r);
+                result = value - 1;
+                ENGINE_STORE(result);
+                if (result == 0) cpu->skipnext = true;
+                break;
+            case OP_INCF:
+                ENGINE_READ(value, r);
+                result = value + 1;
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+            case OP_INCFSZ:
+                ENGINE_READ(value, r);
+                result = value + 1;
+                ENGINE_STORE(result);
+                if (result == 0) cpu->skipnext = true;
+                break;
+            case OP_IORWF:
+                ENGINE_READ(value, r);
+                result = cpu->w | value;
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+            case OP_MOVF:
+                ENGINE_READ(result, r);
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+            case OP_MOVWF:
+                ENGINE_WRITE(r, cpu->w);
+                break;
+            case OP_NOP:
+                break;
+            case OP_RLF:
+                ENGINE_READ(value, r);
+                result = (value << 1) | (f[STATUS] & C);
+                f[STATUS] = (f[STATUS] & ~C) | (value >> 7);
+                ENGINE_STORE(result);
+                break;
+            case OP_RRF:
+                ENGINE_READ(value, r);
+                result = (value >> 1) | ((f[STATUS] & C) << 7);
+                f[STATUS] = (f[STATUS] & ~C) | (value & 0x01);
+                ENGINE_STORE(result);
+                break;
+            case OP_SUBWF:
+                ENGINE_READ(value, r);
+                result = value - cpu->w;
+                f[STATUS] &= ~(C | DC | Z);
+                if (value >= cpu->w) f[STATUS] |= C;
+                if ((value & 0x0F) >= (cpu->w & 0x0F)) f[STATUS] |= DC;
+                if (result == 0) f[STATUS] |= Z;
+                ENGINE_STORE(result);
+                break;
+            case OP_SWAPF:
+                ENGINE_READ(value, r);
+                result = (value << 4) | (value >> 4);
+                ENGINE_STORE(result);
+                break;
+            case OP_XORWF:
+                ENGINE_READ(value, r);
+                result = cpu->w ^ value;
+                ENGINE_SET_Z(result);
+                ENGINE_STORE(result);
+                break;
+
+            // Bit-level, BCF/BSF read-modify-write without calling the read callback
+            case OP_BCF:
+            case OP_BSF:
+                if (r > GPIO) {
+                    value = f[ENGINE_ADDR(r)];
+                } else {
+                    cpu->do_callback = false;
+                    value = cpu_getreg(cpu, r);
+                    cpu->do_callback = true;
+                }
+                result = engine_decode[instruction] == OP_BCF ? (value & ~bit) : (value | bit);
+                ENGINE_WRITE(r, result);
+                break;
+            case OP_BTFSC:
+                ENGINE_READ(value, r);
+                if ((value & bit) == 0) cpu->skipnext = true;
+                break;
+            case OP_BTFSS:
+                ENGINE_READ(value, r);
+                if ((value & bit) != 0) cpu->skipnext = true;
+                break;
+
+            // Literal & control, the jumps land one short since PC is incremented below
+            case OP_ANDLW:
+                cpu->w &= k;
+                ENGINE_SET_Z(cpu->w);
+                break;
+            case OP_CALL:
+                if (cpu->memo != NULL && memo_call(cpu->memo, limit)) {
+                    // Done already, hit or run for real, with the cycles counted and the timers ticked
+                    if (cpu->option != entry_option || cpu->watch_stop || cpu->yield)
+                        limit = 0;
+                    goto breakpoint_check;
+                }
+                stack[1] = stack[0];
+                stack[0] = cpu->pc + 1;
+                cpu->pc = (((f[STATUS] & 0x60) << 4) | k) - 1;
+                cycles = 2;
+                break;
+            case OP_CLRWDT:
+                cpu->wdt = 0;
+#if ENGINE_PSA_WDT && ENGINE_WDT
+                cpu->prescaler = 0;
+#endif
+                f[STATUS] |= TO | PD;
+                break;
+            case OP_GOTO:
+                cpu->pc = (((f[STATUS] & 0x60) << 4) | (instruction & 0x1FF)) - 1;
+                cycles = 2;
+                break;
+            case OP_IORLW:
+                cpu->w |= k;
+                ENGINE_SET_Z(cpu->w);
+                break;
+            case OP_MOVLW:
+                cpu->w = k;
+                break;
+            case OP_OPTION:
+                cpu->option = cpu->w;
+                cpu->prescaler = 0;
+                if (cpu->do_callback && cpu->option_write_callback)
+                    cpu->option_write_callback(cpu, &cpu->option);
+                limit = 0; // Prescaler/Timer0 setup might have changed
+                break;
+            case OP_RETLW:
+                cpu->w = k;
+                cpu->pc = stack[0] - 1;
+                stack[0] = stack[1];
+                cycles = 2;
+                break;
+            case OP_SLEEP:
+                cpu->asleep = true;
+                f[STATUS] = (f[STATUS] | TO) & ~PD;
+                cpu->wdt = 0;
+#if ENGINE_PSA_WDT && ENGINE_WDT
+                cpu->prescaler = 0;
+#endif
+                break;
+            case OP_TRIS:
+                cpu->trisgpio = cpu->w & ENGINE_PINS;
+                if (cpu->do_callback && cpu->tris_write_callback) {
+                    cpu->tris_write_callback(cpu, &cpu->trisgpio);
+                    if (cpu->option != entry_option || cpu->yield)
+                        limit = 0;
+                }
+                break;
+            case OP_XORLW:
+                cpu->w ^= k;
+                ENGINE_SET_Z(cpu->w);
+                break;
+            default:
+                if (!cpu->quiet)
+                    printf("[WARN] Illegal Instruction!\n");
+                break;
+        }
+
+    execute_end:
+        cpu->pc++;
+        cpu->inst_cycles += cycles;
+        if (limit != 0) {
+            // A WDT reset puts OPTION back to 0xFF, so anything after it has to go through the generic tick
+            if (ENGINE_TICK()) {
+                limit = 0;
+                if (cycles == 2)
+                    instruction_tick(cpu);
+            }
+            else if (cycles == 2 && ENGINE_TICK())
+                limit = 0;
+        } else {
+            // OPTION executed or a callback reset us, so this variant's idea of the timers is already stale
+            instruction_tick(cpu);
+            if (cycles == 2)
+                instruction_tick(cpu);
+        }
+
+    breakpoint_check:
+        if (cpu_atbreakpoint_in(cpu, ENGINE_PC_MASK))
+            return STOP_BREAKPOINT;
+    }
+
+    return cpu->inst_cycles >= end_cycle ? STOP_CYCLES : STOP_RESELECT;
+}
+
+#undef ENGINE_ADDR
+#undef ENGINE_READ
+#undef ENGINE_WRITE
+#undef ENGINE_STORE
+#undef ENGINE_SET_Z
+#undef ENGINE_TICK
+#undef ENGINE_NAME
+#undef ENGINE_TMR0
+#undef ENGINE_PSA_WDT
+#undef ENGINE_WDT
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "expr.h"
+
+// Opcodes, operands follow inline
+enum {
+    EXPR_END,
+    EXPR_BYTE,        // imm8
+    EXPR_CONST,       // index into consts
+    EXPR_PC,
+    EXPR_W,
+    EXPR_CYCLES,
+    EXPR_OPTION,
+    EXPR_TRIS,
+    EXPR_REG,         // r
+    EXPR_STATUS_BIT,  // mask
+    EXPR_GPIO_BIT,    // mask
+
+    // Unary
+    EXPR_NOT,
+    EXPR_INV,
+    EXPR_NEG,
+
+    // Binary
+    EXPR_MUL, EXPR_DIV, EXPR_MOD,
+    EXPR_ADD, EXPR_SUB,
+    EXPR_SHL, EXPR_SHR,
+    EXPR_LT, EXPR_LE, EXPR_GT, EXPR_GE,
+    EXPR_EQ, EXPR_NE,
+    EXPR_AND,
+    EXPR_XOR,
+    EXPR_OR,
+    EXPR_LAND,
+    EXPR_LOR,
+};
+
+// Binary operators, longest first so "<=" isn't read as "<", higher level binds tighter
+typedef struct ExprOperator {
+    const char *token;
+    uint8_t op;
+    uint8_t level;
+} ExprOperator;
+
+static const ExprOperator expr_operators[] = {
+    {"||", EXPR_LOR, 1}, {"&&", EXPR_LAND, 2},
+    {"==", EXPR_EQ, 6}, {"!=", EXPR_NE, 6},
+    {"<=", EXPR_LE, 7}, {">=", EXPR_GE, 7},
+    {"<<", EXPR_SHL, 8}, {">>", EXPR_SHR, 8},
+    {"<", EXPR_LT, 7}, {">", EXPR_GT, 7},
+    {"|", EXPR_OR, 3}, {"^", EXPR_XOR, 4}, {"&", EXPR_AND, 5},
+    {"+", EXPR_ADD, 9}, {"-", EXPR_SUB, 9},
+    {"*", EXPR_MUL, 10}, {"/", EXPR_DIV, 10}, {"%", EXPR_MOD, 10},
+};
+#define EXPR_NUM_OPERATORS (int)(sizeof(expr_operators) / sizeof(expr_operators[0]))
+
+// Case-insensitive word versions
+static const ExprOperator expr_word_operators[] = {
+    {"or", EXPR_LOR, 1}, {"and", EXPR_LAND, 2},
+};
+
+// Names that compile to a single load
+typedef struct ExprName {
+    const char *name;
+    uint8_t op;
+    uint8_t operand; // Only for the ones that take one
+} ExprName;
+
+static const ExprName expr_names[] = {
+    {"pc", EXPR_PC, 0}, {"w", EXPR_W, 0}, {"cycles", EXPR_CYCLES, 0}, {"option", EXPR_OPTION, 0},
+    {"tris", EXPR_TRIS, 0}, {"trisgpio", EXPR_TRIS, 0},
+    {"indf", EXPR_REG, INDF}, {"tmr0", EXPR_REG, TMR0}, {"pcl", EXPR_REG, PCL}, {"status", EXPR_REG, STATUS},
+    {"fsr", EXPR_REG, FSR}, {"osccal", EXPR_REG, OSCCAL}, {"gpio", EXPR_REG, GPIO},
+    {"c", EXPR_STATUS_BIT, C}, {"dc", EXPR_STATUS_BIT, DC}, {"z", EXPR_STATUS_BIT, Z},
+    {"pd", EXPR_STATUS_BIT, PD}, {"to", EXPR_STATUS_BIT, TO}, {"gpwuf", EXPR_STATUS_BIT, GPWUF},
+    {"gp0", EXPR_GPIO_BIT, GP0}, {"gp1", EXPR_GPIO_BIT, GP1}, {"gp2", EXPR_GPIO_BIT, GP2},
+    {"gp3", EXPR_GPIO_BIT, GP3}, {"gp4", EXPR_GPIO_BIT, GP4}, {"gp5", EXPR_GPIO_BIT, GP5},
+};
+#define EXPR_NUM_NAMES (int)(sizeof(expr_names) / sizeof(expr_names[0]))
+
+typedef struct ExprParser {
+    Expr *expr;
+    const char *src;
+    const char *p;
+    int err;
+    int depth; // Of the stack at run time, so we know it fits
+} ExprParser;
+
+
+// Compiling
+static void _expr_fail(ExprParser *ps, int err)
+{
+    if (ps->err == EXPR_OK) {
+        ps->err = err;
+        ps->expr->error_pos = ps->p - ps->src;
+    }
+}
+
+static void _expr_skip_space(ExprParser *ps)
+{
+    while (isspace((unsigned char)*ps->p))
+        ps->p++;
+}
+
+static bool _expr_is_ident(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static void _expr_emit(ExprParser *ps, uint8_t byte)
+{
+    if (ps->expr->code_len >= EXPR_MAX_CODE)
+        _expr_fail(ps, EXPR_ERR_TOO_BIG);
+    else
+        ps->expr->code[ps->expr->code_len++] = byte;
+}
+
+static void _expr_push(ExprParser *ps)
+{
+    if (++ps->depth > EXPR_MAX_STACK)
+        _expr_fail(ps, EXPR_ERR_TOO_BIG);
+}
+
+static void _expr_emit_value(ExprParser *ps, int64_t value)
+{
+    Expr *expr = ps->expr;
+    if (value >= 0 && value <= 0xFF) {
+        _expr_emit(ps, EXPR_BYTE);
+        _expr_emit(ps, value);
+    } else if (expr->num_consts < EXPR_MAX_CONSTS) {
+        expr->consts[expr->num_consts] = value;
+        _expr_emit(ps, EXPR_CONST);
+        _expr_emit(ps, expr->num_consts++);
+    } else {
+        _expr_fail(ps, EXPR_ERR_TOO_BIG);
+    }
+    _expr_push(ps);
+}
+
+static bool _expr_parse_number(ExprParser *ps, int64_t *value)
+{
+    const char *p = ps->p;
+    int base = 10;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    } else if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+        base = 2;
+        p += 2;
+    }
+
+    int64_t n = 0;
+    int digits = 0;
+    while (_expr_is_ident(*p))
+    {
+        char c = tolower((unsigned char)*p);
+        int digit = isdigit((unsigned char)c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 99;
+        if (digit >= base)
+            return false;
+        n = n * base + digit;
+        digits++;
+        p++;
+    }
+    if (digits == 0)
+        return false;
+    ps->p = p;
+    *value = n;
+    return true;
+}
+
+// Case-insensitive keyword match that doesn't run into the rest of an identifier
+static bool _expr_match_word(ExprParser *ps, const char *word)
+{
+    size_t len = strlen(word);
+    for (size_t i = 0; i < len; i++)
+        if (tolower((unsigned char)ps->p[i]) != word[i])
+            return false;
+    if (_expr_is_ident(word[0]) && _expr_is_ident(ps->p[len]))
+        return false;
+    ps->p += len;
+    return true;
+}
+
+static void _expr_parse_binary(ExprParser *ps, int min_level);
+
+static void _expr_parse_primary(ExprParser *ps)
+{
+    _expr_skip_space(ps);
+    int64_t value;
+
+    if (*ps->p == '(') {
+        ps->p++;
+        _expr_parse_binary(ps, 1);
+        _expr_skip_space(ps);
+        if (*ps->p != ')') {
+            _expr_fail(ps, EXPR_ERR_SYNTAX);
+            return;
+        }
+        ps->p++;
+    } else if (isdigit((unsigned char)*ps->p)) {
+        if (!_expr_parse_number(ps, &value)) {
+            _expr_fail(ps, EXPR_ERR_SYNTAX);
+            return;
+        }
+        _expr_emit_value(ps, value);
+    } else if (_expr_match_word(ps, "f")) {
+        // f[constant]
+        _expr_skip_space(ps);
+        if (*ps->p != '[') {
+            _expr_fail(ps, EXPR_ERR_SYNTAX);
+            return;
+        }
+        ps->p++;
+        _expr_skip_space(ps);
+        if (!_expr_parse_number(ps, &value)) {
+            _expr_fail(ps, EXPR_ERR_SYNTAX);
+            return;
+        }
+        if (value > 0x1F) {
+            _expr_fail(ps, EXPR_ERR_RANGE);
+            return;
+        }
+        _expr_skip_space(ps);
+        if (*ps->p != ']') {
+            _expr_fail(ps, EXPR_ERR_SYNTAX);
+            return;
+        }
+        ps->p++;
+        _expr_emit(ps, EXPR_REG);
+        _expr_emit(ps, value);
+        _expr_push(ps);
+    } else if (_expr_is_ident(*ps->p)) {
+        for (int i = 0; i < EXPR_NUM_NAMES; i++)
+        {
+            if (!_expr_match_word(ps, expr_names[i].name))
+                continue;
+            _expr_emit(ps, expr_names[i].op);
+            if (expr_names[i].op >= EXPR_REG)
+                _expr_emit(ps, expr_names[i].operand);
+            _expr_push(ps);
+            return;
+        }
+        _expr_fail(ps, EXPR_ERR_NAME);
+    } else {
+        _expr_fail(ps, EXPR_ERR_SYNTAX);
+    }
+}
+
+static void _expr_parse_unary(ExprParser *ps)
+{
+    _expr_skip_space(ps);
+    uint8_t op;
+    if (*ps->p == '!') {
+        ps->p++;
+        op = EXPR_NOT;
+    } else if (_expr_match_word(ps, "not")) {
+        op = EXPR_NOT;
+    } else if (*ps->p == '~') {
+        ps->p++;
+        op = EXPR_INV;
+    } else if (*ps->p == '-') {
+        ps->p++;
+        op = EXPR_NEG;
+    } else {
+        _expr_parse_primary(ps);
+        return;
+    }
+    _expr_parse_unary(ps);
+    _expr_emit(ps, op);
+}
+
+// Precedence climbing, anything at min_level or tighter
+static void _expr_parse_binary(ExprParser *ps, int min_level)
+{
+    _expr_parse_unary(ps);
+    while (ps->err == EXPR_OK)
+    {
+        _expr_skip_space(ps);
+        const ExprOperator *found = NULL;
+        for (int i = 0; i < EXPR_NUM_OPERATORS && found == NULL; i++)
+        {
+            const ExprOperator *op = &expr_operators[i];
+            size_t len = strlen(op->token);
+            if (op->level < min_level || strncmp(ps->p, op->token, len) != 0)
+                continue;
+            // & and | aren't the start of && and || (which might just be too loose to take here)
+            if ((op->op == EXPR_AND || op->op == EXPR_OR) && ps->p[1] == ps->p[0])
+                continue;
+            found = op;
+            ps->p += len;
+        }
+        for (int i = 0; i < 2 && found == NULL; i++)
+            if (expr_word_operators[i].level >= min_level && _expr_match_word(ps, expr_word_operators[i].token))
+                found = &expr_word_operators[i];
+        if (found == NULL)
+            return;
+
+        _expr_parse_binary(ps, found->level + 1);
+        _expr_emit(ps, found->op);
+        ps->depth--;
+    }
+}
+
+int expr_compile(Expr *expr, const char *src)
+{
+    ExprParser ps = {expr, src, src, EXPR_OK, 0};
+    expr->code_len = 0;
+    expr->num_consts = 0;
+    expr->error_pos = 0;
+
+    _expr_parse_binary(&ps, 1);
+    _expr_skip_space(&ps);
+    if (ps.err == EXPR_OK && *ps.p != '\0')
+        _expr_fail(&ps, EXPR_ERR_SYNTAX);
+    _expr_emit(&ps, EXPR_END);
+    return ps.err;
+}
+
+
+// Evaluating
+// Like cpu_getreg() without the callbacks (or the need for a non-const CPU)
+static uint8_t _expr_reg(const CPU *cpu, uint8_t r)
+{
+    if (r == INDF) {
+        r = cpu->f[FSR] & 0x1F;
+        if (r == INDF)
+            return 0;
+    }
+    switch (r) {
+        case PCL:  return (cpu->pc + 1) & 0xFF; // Already moved on, same as the program reading it
+        case FSR:  return cpu->f[FSR] | cpu->device->fsr_fixed;
+        case GPIO: return cpu->f[GPIO] & cpu->device->pins;
+    }
+    return cpu->f[device_reg_addr(cpu->device, cpu->f[FSR], r)];
+}
+
+int64_t expr_eval(const Expr *expr, const CPU *cpu)
+{
+    int64_t stack[EXPR_MAX_STACK];
+    int sp = 0;
+    const uint8_t *code = expr->code;
+
+    while (1)
+    {
+        int64_t a, b;
+        switch (*code++) {
+            case EXPR_END:        return sp > 0 ? stack[0] : 0;
+            case EXPR_BYTE:       stack[sp++] = *code++; break;
+            case EXPR_CONST:      stack[sp++] = expr->consts[*code++]; break;
+            case EXPR_PC:         stack[sp++] = cpu->pc & (cpu->device->program_words - 1); break;
+            case EXPR_W:          stack[sp++] = cpu->w; break;
+            case EXPR_CYCLES:     stack[sp++] = cpu->inst_cycles; break;
+            case EXPR_OPTION:     stack[sp++] = cpu->option; break;
+            case EXPR_TRIS:       stack[sp++] = cpu->trisgpio; break;
+            case EXPR_REG:        stack[sp++] = _expr_reg(cpu, *code++); break;
+            case EXPR_STATUS_BIT: stack[sp++] = (cpu->f[STATUS] & *code++) != 0; break;
+            case EXPR_GPIO_BIT:   stack[sp++] = (cpu->f[GPIO] & *code++) != 0; break;
+
+            case EXPR_NOT: stack[sp - 1] = !stack[sp - 1]; break;
+            case EXPR_INV: stack[sp - 1] = ~stack[sp - 1]; break;
+            case EXPR_NEG: stack[sp - 1] = -stack[sp - 1]; break;
+
+            default:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                switch (code[-1]) {
+                    case EXPR_MUL:  a *= b; break;
+                    case EXPR_DIV:  a = b != 0 ? a / b : 0; break;
+                    case EXPR_MOD:  a = b != 0 ? a % b : 0; break;
+                    case EXPR_ADD:  a += b; break;
+                    case EXPR_SUB:  a -= b; break;
+                    case EXPR_SHL:  a = b >= 0 && b < 64 ? (int64_t)((uint64_t)a << b) : 0; break;
+                    case EXPR_SHR:  a = b >= 0 && b < 64 ? a >> b : 0; break;
+                    case EXPR_LT:   a = a < b; break;
+                    case EXPR_LE:   a = a <= b; break;
+                    case EXPR_GT:   a = a > b; break;
+                    case EXPR_GE:   a = a >= b; break;
+                    case EXPR_EQ:   a = a == b; break;
+                    case EXPR_NE:   a = a != b; break;
+                    case EXPR_AND:  a &= b; break;
+                    case EXPR_XOR:  a ^= b; break;
+                    case EXPR_OR:   a |= b; break;
+                    case EXPR_LAND: a = a && b; break;
+                    case EXPR_LOR:  a = a || b; break;
+                }
+                stack[sp - 1] = a;
+                break;
+        }
+    }
+}
+
+const char *expr_strerror(int err)
+{
+    switch (err) {
+        case EXPR_OK:          return "OK";
+        case EXPR_ERR_SYNTAX:  return "syntax error";
+        case EXPR_ERR_NAME:    return "unknown name";
+        case EXPR_ERR_RANGE:   return "register out of range";
+        case EXPR_ERR_TOO_BIG: return "expression too big";
+        default:               return "unknown error";
+    }
+}
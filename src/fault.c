@@ -0,0 +1,380 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "fault.h"
+#include "cpu.h"
+
+// How _fault_advance() stopped
+#define _FAULT_TIME 0 // Got to the cycle it was asked to
+#define _FAULT_END  1 // PC got to end_pc
+#define _FAULT_WDT  2 // The WDT timed out while awake
+
+typedef struct FaultShared {
+    pthread_mutex_t lock;
+    size_t next_fault;
+} FaultShared;
+
+typedef struct FaultWorker {
+    FaultCampaign *c;
+    FaultShared *shared;
+    pthread_t thread;
+    uint64_t by_target[FAULT_NUM_TARGETS][FAULT_NUM_OUTCOMES];
+} FaultWorker;
+
+static double _fault_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs until inst_cycles gets to until, PC gets to end_pc or the WDT times out (PC at the reset vector with TO clear
+// and PD still set, a wake-up from SLEEP clears PD), there are breakpoints on both end_pc and the reset vector
+// PC keeps creeping along while asleep, so it doesn't count as getting anywhere then
+static int _fault_advance(CPU *cpu, uint16_t end_pc, uint64_t until)
+{
+    while (cpu->inst_cycles < until)
+    {
+        if (cpu_run_cycles(cpu, until - cpu->inst_cycles) != STOP_BREAKPOINT || cpu->asleep)
+            continue;
+        uint16_t pc = cpu->pc & (cpu->device->program_words - 1);
+        if (pc == end_pc)
+            return _FAULT_END;
+        if (pc == cpu->device->reset_vector && (cpu->f[STATUS] & (TO | PD)) == PD)
+            return _FAULT_WDT;
+    }
+    return _FAULT_TIME;
+}
+
+static void _fault_cpu_init(CPU *cpu, const FaultCampaign *c)
+{
+    cpu_init_device(cpu, c->device);
+    cpu->quiet = true; // Flipped program words make plenty of illegal instructions
+    memcpy(cpu->inst, c->inst, sizeof(uint16_t) * c->device->program_words);
+    cpu_addbreakpoint(cpu, c->end_pc);
+    cpu_addbreakpoint(cpu, c->device->reset_vector);
+}
+
+static uint64_t _fault_random(uint64_t *state)
+{
+    // splitmix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static int _fault_bits(const FaultCampaign *c, int target)
+{
+    int pc_bits = 0;
+    switch (target)
+    {
+        case FAULT_TARGET_STACK:
+            while ((1 << pc_bits) < c->device->program_words)
+                pc_bits++;
+            return pc_bits;
+        case FAULT_TARGET_INST:  return 12;
+    }
+    return 8;
+}
+
+static int _fault_indices(const FaultCampaign *c, int target)
+{
+    switch (target)
+    {
+        case FAULT_TARGET_REG:   return 32;
+        case FAULT_TARGET_STACK: return 2;
+        case FAULT_TARGET_INST:  return c->device->program_words;
+    }
+    return 1;
+}
+
+// One faulty run, from the snapshot before it to its outcome
+static void _fault_one(FaultCampaign *c, CPU *cpu, Fault *fault)
+{
+    // Last checkpoint at or before the fault
+    int low = 0, high = c->num_checkpoints - 1;
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (c->checkpoints[mid].inst_cycles - c->start.inst_cycles <= fault->cycle)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    cpu_load_state(cpu, &c->checkpoints[low]);
+    _fault_advance(cpu, c->end_pc, c->start.inst_cycles + fault->cycle);
+
+    uint16_t mask = 1u << fault->bit;
+    switch (fault->target)
+    {
+        case FAULT_TARGET_REG:
+            if (fault->index == PCL)
+                cpu->pc ^= mask;
+            else
+                cpu->f[fault->index] ^= mask;
+            break;
+        case FAULT_TARGET_W:
+            cpu->w ^= mask;
+            break;
+        case FAULT_TARGET_STACK:
+            cpu->stack[fault->index] ^= mask;
+            break;
+        case FAULT_TARGET_INST:
+            cpu->inst[fault->index] ^= mask;
+            break;
+    }
+
+    int stop = _fault_advance(cpu, c->end_pc, c->start.inst_cycles + c->hang_cycles);
+    if (fault->target == FAULT_TARGET_INST)
+        cpu->inst[fault->index] = c->inst[fault->index];
+    fault->cycles = cpu->inst_cycles - c->start.inst_cycles;
+
+    if (stop == _FAULT_WDT)
+        fault->outcome = FAULT_DETECTED;
+    else if (stop == _FAULT_TIME)
+        fault->outcome = FAULT_HANG;
+    else {
+        bool same = !c->observe_w || cpu->w == c->golden.w;
+        for (int r = 0; r < 32 && same; r++)
+            if (((c->observe >> r) & 1) && cpu->f[r] != c->golden.f[r])
+                same = false;
+        fault->outcome = same ? FAULT_MASKED : FAULT_CORRUPTION;
+    }
+}
+
+static void *_fault_worker(void *arg)
+{
+    FaultWorker *worker = arg;
+    FaultCampaign *c = worker->c;
+    CPU cpu;
+    _fault_cpu_init(&cpu, c);
+    while (1)
+    {
+        pthread_mutex_lock(&worker->shared->lock);
+        size_t first = worker->shared->next_fault;
+        worker->shared->next_fault += FAULT_CHUNK;
+        pthread_mutex_unlock(&worker->shared->lock);
+        if (first >= c->num_faults)
+            break;
+        size_t last = first + FAULT_CHUNK < c->num_faults ? first + FAULT_CHUNK : c->num_faults;
+        for (size_t i = first; i < last; i++)
+        {
+            Fault *fault = &c->faults[i];
+            _fault_one(c, &cpu, fault);
+            worker->by_target[fault->target][fault->outcome]++;
+        }
+    }
+    cpu_deinit(&cpu);
+    return NULL;
+}
+
+
+int fault_init(FaultCampaign *c, const CPU *cpu, uint16_t end_pc, uint64_t max_cycles)
+{
+    memset(c, 0, sizeof(FaultCampaign));
+    c->device = cpu->device;
+    cpu_save_state(cpu, &c->start);
+    memcpy(c->inst, cpu->inst, sizeof(uint16_t) * cpu->device->program_words);
+    c->end_pc = end_pc & (cpu->device->program_words - 1);
+    c->observe = FAULT_OBSERVE_DEFAULT;
+    c->checkpoints = malloc(FAULT_CHECKPOINTS * sizeof(CPUState));
+    if (c->checkpoints == NULL)
+        return FAULT_ERR_MEMORY;
+
+    // Once to find out how long it is, then again to take snapshots evenly along it
+    CPU golden;
+    _fault_cpu_init(&golden, c);
+    cpu_load_state(&golden, &c->start);
+    int stop = _fault_advance(&golden, c->end_pc, c->start.inst_cycles + max_cycles);
+    c->golden_cycles = golden.inst_cycles - c->start.inst_cycles;
+    cpu_save_state(&golden, &c->golden);
+    if (stop != _FAULT_END) {
+        cpu_deinit(&golden);
+        return FAULT_ERR_GOLDEN;
+    }
+
+    uint64_t interval = c->golden_cycles / FAULT_CHECKPOINTS + 1;
+    cpu_load_state(&golden, &c->start);
+    while (c->num_checkpoints < FAULT_CHECKPOINTS)
+    {
+        cpu_save_state(&golden, &c->checkpoints[c->num_checkpoints++]);
+        uint64_t next = c->start.inst_cycles + c->num_checkpoints * interval;
+        if (next >= c->start.inst_cycles + c->golden_cycles
+            || _fault_advance(&golden, c->end_pc, next) != _FAULT_TIME)
+            break;
+    }
+    cpu_deinit(&golden);
+
+    c->hang_cycles = c->golden_cycles * FAULT_HANG_FACTOR + FAULT_HANG_MARGIN;
+    // The WDT only counts with the prescaler assigned to it
+    if ((c->golden.config & WDTE) && (c->golden.option & (1 << PSA)))
+        c->hang_cycles += 256ull * 18000 * (1u << (c->golden.option & PS));
+    return FAULT_OK;
+}
+
+void fault_deinit(FaultCampaign *c)
+{
+    free(c->checkpoints);
+    free(c->faults);
+    c->checkpoints = NULL;
+    c->faults = NULL;
+    c->num_checkpoints = 0;
+    c->num_faults = c->capacity = 0;
+}
+
+int fault_add(FaultCampaign *c, uint64_t cycle, int target, uint16_t index, uint8_t bit)
+{
+    if (target < 0 || target >= FAULT_NUM_TARGETS || index >= _fault_indices(c, target) || bit >= _fault_bits(c, target)
+        || cycle >= c->golden_cycles)
+        return FAULT_ERR_ARG;
+    if (c->num_faults == c->capacity) {
+        size_t capacity = c->capacity ? c->capacity * 2 : 256;
+        Fault *faults = realloc(c->faults, capacity * sizeof(Fault));
+        if (faults == NULL)
+            return FAULT_ERR_MEMORY;
+        c->faults = faults;
+        c->capacity = capacity;
+    }
+    Fault *fault = &c->faults[c->num_faults++];
+    fault->cycle = cycle;
+    fault->index = index;
+    fault->target = target;
+    fault->bit = bit;
+    fault->outcome = FAULT_NOT_RUN;
+    fault->cycles = 0;
+    return FAULT_OK;
+}
+
+int fault_add_random(FaultCampaign *c, size_t count, unsigned targets, uint64_t seed)
+{
+    int kinds[FAULT_NUM_TARGETS], num_kinds = 0;
+    for (int target = 0; target < FAULT_NUM_TARGETS; target++)
+        if ((targets >> target) & 1)
+            kinds[num_kinds++] = target;
+    if (num_kinds == 0 || c->golden_cycles == 0)
+        return FAULT_ERR_ARG;
+
+    uint64_t state = seed;
+    for (size_t i = 0; i < count; i++)
+    {
+        int target = kinds[i % num_kinds];
+        uint64_t cycle = _fault_random(&state) % c->golden_cycles;
+        uint16_t index = _fault_random(&state) % _fault_indices(c, target);
+        uint8_t bit = _fault_random(&state) % _fault_bits(c, target);
+        int err = fault_add(c, cycle, target, index, bit);
+        if (err != FAULT_OK)
+            return err;
+    }
+    return FAULT_OK;
+}
+
+void fault_clear(FaultCampaign *c)
+{
+    c->num_faults = 0;
+}
+
+int fault_run(FaultCampaign *c, int num_threads)
+{
+    if (num_threads < 1)
+        num_threads = 1;
+    FaultWorker *workers = calloc(num_threads, sizeof(FaultWorker));
+    if (workers == NULL)
+        return FAULT_ERR_MEMORY;
+
+    double start = _fault_now();
+    FaultShared shared = { .next_fault = 0 };
+    pthread_mutex_init(&shared.lock, NULL);
+    for (int t = 0; t < num_threads; t++)
+    {
+        workers[t].c = c;
+        workers[t].shared = &shared;
+    }
+    int started = 1;
+    for (; started < num_threads; started++)
+        if (pthread_create(&workers[started].thread, NULL, _fault_worker, &workers[started]) != 0)
+            break;
+    // The calling thread is worker 0, whatever did start still gets through everything between them
+    _fault_worker(&workers[0]);
+    for (int t = 1; t < started; t++)
+        pthread_join(workers[t].thread, NULL);
+    pthread_mutex_destroy(&shared.lock);
+
+    memset(c->counts, 0, sizeof(c->counts));
+    memset(c->by_target, 0, sizeof(c->by_target));
+    for (int t = 0; t < started; t++)
+        for (int target = 0; target < FAULT_NUM_TARGETS; target++)
+            for (int outcome = 0; outcome < FAULT_NUM_OUTCOMES; outcome++)
+            {
+                c->by_target[target][outcome] += workers[t].by_target[target][outcome];
+                c->counts[outcome] += workers[t].by_target[target][outcome];
+            }
+    c->seconds = _fault_now() - start;
+    free(workers);
+    return started == num_threads ? FAULT_OK : FAULT_ERR_THREADS;
+}
+
+void fault_print(const FaultCampaign *c, FILE *out)
+{
+    fprintf(out, "%zu faults in %.3fs, golden run %llu cycles to 0x%03X, hang after %llu\n", c->num_faults, c->seconds,
+            (unsigned long long)c->golden_cycles, c->end_pc, (unsigned long long)c->hang_cycles);
+    fprintf(out, "%-8s", "");
+    for (int outcome = FAULT_MASKED; outcome < FAULT_NUM_OUTCOMES; outcome++)
+        fprintf(out, " %20s", fault_outcome_name(outcome));
+    fprintf(out, "\n");
+
+    for (int target = -1; target < FAULT_NUM_TARGETS; target++)
+    {
+        const uint64_t *counts = target < 0 ? c->counts : c->by_target[target];
+        uint64_t total = 0;
+        for (int outcome = FAULT_MASKED; outcome < FAULT_NUM_OUTCOMES; outcome++)
+            total += counts[outcome];
+        if (total == 0 && target >= 0)
+            continue;
+        fprintf(out, "%-8s", target < 0 ? "total" : fault_target_name(target));
+        for (int outcome = FAULT_MASKED; outcome < FAULT_NUM_OUTCOMES; outcome++)
+            fprintf(out, " %11llu (%5.1f%%)", (unsigned long long)counts[outcome],
+                    total ? 100.0 * counts[outcome] / total : 0.0);
+        fprintf(out, "\n");
+    }
+}
+
+const char *fault_outcome_name(int outcome)
+{
+    switch (outcome)
+    {
+        case FAULT_NOT_RUN:    return "not run";
+        case FAULT_MASKED:     return "masked";
+        case FAULT_DETECTED:   return "detected";
+        case FAULT_HANG:       return "hang";
+        case FAULT_CORRUPTION: return "corruption";
+    }
+    return "unknown";
+}
+
+const char *fault_target_name(int target)
+{
+    switch (target)
+    {
+        case FAULT_TARGET_REG:   return "register";
+        case FAULT_TARGET_W:     return "W";
+        case FAULT_TARGET_STACK: return "stack";
+        case FAULT_TARGET_INST:  return "program";
+    }
+    return "unknown";
+}
+
+const char *fault_strerror(int err)
+{
+    switch (err)
+    {
+        case FAULT_OK:          return "OK";
+        case FAULT_ERR_ARG:     return "Bad target, index, bit or cycle";
+        case FAULT_ERR_GOLDEN:  return "Golden run didn't reach the end address cleanly";
+        case FAULT_ERR_MEMORY:  return "Out of memory";
+        case FAULT_ERR_THREADS: return "Couldn't start the worker threads";
+    }
+    return "Unknown error";
+}
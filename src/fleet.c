@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fleet.h"
+#include "cpu.h"
+#include "image.h"
+#include "stimulus.h"
+
+#define _FLEET_EMPTY -1
+
+static uint64_t _fleet_hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// cpu_save_state() into a zeroed struct, so padding never makes equal states compare or hash differently
+static void _fleet_save(const CPU *cpu, CPUState *state)
+{
+    memset(state, 0, sizeof(CPUState));
+    cpu_save_state(cpu, state);
+}
+
+static uint64_t _fleet_state_hash(const CPUState *state)
+{
+    return _fleet_hash(0xCBF29CE484222325ull, state, sizeof(CPUState));
+}
+
+// Only what running them does, not where they came from
+static bool _fleet_same_events(const StimulusEvent *a, const StimulusEvent *b, size_t n)
+{
+    if (a == b)
+        return true;
+    for (size_t i = 0; i < n; i++)
+        if (a[i].cycle != b[i].cycle || a[i].kind != b[i].kind || a[i].mask != b[i].mask || a[i].value != b[i].value)
+            return false;
+    return true;
+}
+
+static int _fleet_reserve(Fleet *fleet, int count)
+{
+    if (count <= fleet->instances_capacity)
+        return FLEET_OK;
+    int capacity = fleet->instances_capacity ? fleet->instances_capacity * 2 : 64;
+    while (capacity < count)
+        capacity *= 2;
+    FleetInstance *instances = realloc(fleet->instances, capacity * sizeof(FleetInstance));
+    if (instances == NULL)
+        return FLEET_ERR_MEMORY;
+    fleet->instances = instances;
+    // There's never more groups than instances
+    FleetGroup *groups = realloc(fleet->groups, capacity * sizeof(FleetGroup));
+    if (groups == NULL)
+        return FLEET_ERR_MEMORY;
+    fleet->groups = groups;
+    FleetGroup *next_groups = realloc(fleet->next_groups, capacity * sizeof(FleetGroup));
+    if (next_groups == NULL)
+        return FLEET_ERR_MEMORY;
+    fleet->next_groups = next_groups;
+    fleet->instances_capacity = capacity;
+    return FLEET_OK;
+}
+
+// Sorts every instance into a group for the epoch ending at end
+static int _fleet_group(Fleet *fleet, uint64_t end)
+{
+    size_t size = 1;
+    while (size < 2 * (size_t)fleet->num_instances)
+        size *= 2;
+    if (size > fleet->table_size) {
+        int *table = realloc(fleet->table, size * sizeof(int));
+        if (table == NULL)
+            return FLEET_ERR_MEMORY;
+        fleet->table = table;
+        fleet->table_size = size;
+    }
+    for (size_t i = 0; i < size; i++)
+        fleet->table[i] = _FLEET_EMPTY;
+
+    int num_next = 0;
+    for (int i = 0; i < fleet->num_instances; i++)
+    {
+        FleetInstance *inst = &fleet->instances[i];
+        const FleetGroup *old = &fleet->groups[inst->group];
+        const StimulusEvent *events = inst->events + inst->next;
+        size_t n = 0;
+        while (inst->next + n < inst->num_events && events[n].cycle < end)
+            n++;
+
+        uint64_t key = _fleet_hash(old->hash, &inst->image, sizeof(inst->image));
+        for (size_t e = 0; e < n; e++)
+        {
+            key = _fleet_hash(key, &events[e].cycle, sizeof(events[e].cycle));
+            uint8_t what[3] = { events[e].kind, events[e].mask, events[e].value };
+            key = _fleet_hash(key, what, sizeof(what));
+        }
+
+        // Old groups' states are all different already, only ones from different old groups need comparing
+        size_t slot = key & (size - 1);
+        int found = _FLEET_EMPTY;
+        while (fleet->table[slot] != _FLEET_EMPTY)
+        {
+            FleetGroup *g = &fleet->next_groups[fleet->table[slot]];
+            if (g->key == key && g->image == inst->image && g->num_events == n
+                && _fleet_same_events(g->events, events, n)
+                && (g->source == inst->group || memcmp(&g->state, &old->state, sizeof(CPUState)) == 0)) {
+                found = fleet->table[slot];
+                break;
+            }
+            slot = (slot + 1) & (size - 1);
+        }
+        if (found == _FLEET_EMPTY) {
+            found = num_next++;
+            FleetGroup *g = &fleet->next_groups[found];
+            memset(g, 0, sizeof(FleetGroup));
+            g->state = old->state;
+            g->image = inst->image;
+            g->events = events;
+            g->num_events = n;
+            g->key = key;
+            g->source = inst->group;
+            fleet->table[slot] = found;
+        }
+        fleet->next_groups[found].members++;
+        inst->group = found;
+    }
+
+    FleetGroup *groups = fleet->groups;
+    fleet->groups = fleet->next_groups;
+    fleet->next_groups = groups;
+    fleet->num_groups = num_next;
+    return FLEET_OK;
+}
+
+// One group through to end, with its inputs applied exactly when running alone would
+static int _fleet_run_group(Fleet *fleet, FleetGroup *g, uint64_t end)
+{
+    CPU *cpu = &fleet->cpu;
+    image_attach(cpu, g->image);
+    cpu_load_state(cpu, &g->state);
+    // The scratch CPU swaps images all the time, the state keeps the generation the instance's own CPU would have
+    cpu->inst_generation = g->state.inst_generation;
+    uint64_t start = cpu->inst_cycles;
+
+    if (g->num_events > fleet->window_capacity) {
+        StimulusEvent *window = realloc(fleet->window, g->num_events * sizeof(StimulusEvent));
+        if (window == NULL)
+            return FLEET_ERR_MEMORY;
+        fleet->window = window;
+        fleet->window_capacity = g->num_events;
+    }
+    // Anything due before where it got to (the last epoch can overshoot by a cycle) goes in straight away
+    for (size_t i = 0; i < g->num_events; i++)
+    {
+        fleet->window[i] = g->events[i];
+        fleet->window[i].cycle = g->events[i].cycle > start ? g->events[i].cycle - start : 0;
+    }
+
+    Stimulus stim;
+    memset(&stim, 0, sizeof(Stimulus));
+    stim.events = fleet->window;
+    stim.num_events = g->num_events;
+    stim.length = end > start ? end - start : 0;
+    stimulus_start(&stim, cpu);
+    do
+        stimulus_run(&stim, UINT64_MAX);
+    while (!stimulus_done(&stim));
+
+    _fleet_save(cpu, &g->state);
+    g->hash = _fleet_state_hash(&g->state);
+    g->expects = stim.expects;
+    g->failures = stim.failures;
+    g->contentions = stim.contentions;
+    g->failed_cycle = stim.start + stim.failed_cycle;
+    fleet->group_runs++;
+    return FLEET_OK;
+}
+
+
+void fleet_init(Fleet *fleet)
+{
+    memset(fleet, 0, sizeof(Fleet));
+    fleet->epoch = FLEET_DEFAULT_EPOCH;
+    cpu_init(&fleet->cpu);
+    _fleet_save(&fleet->cpu, &fleet->power_on);
+}
+
+void fleet_deinit(Fleet *fleet)
+{
+    cpu_deinit(&fleet->cpu);
+    free(fleet->instances);
+    free(fleet->groups);
+    free(fleet->next_groups);
+    free(fleet->window);
+    free(fleet->table);
+    fleet->instances = NULL;
+    fleet->groups = fleet->next_groups = NULL;
+    fleet->window = NULL;
+    fleet->table = NULL;
+    fleet->num_instances = fleet->num_groups = fleet->instances_capacity = 0;
+}
+
+int fleet_add(Fleet *fleet, const FirmwareImage *image)
+{
+    if (_fleet_reserve(fleet, fleet->num_instances + 1) != FLEET_OK)
+        return FLEET_ERR_MEMORY;
+
+    // A group of its own until the next epoch sorts things out
+    FleetGroup *g = &fleet->groups[fleet->num_groups++];
+    memset(g, 0, sizeof(FleetGroup));
+    g->state = fleet->power_on;
+    g->state.config = image->config;
+    g->state.inst_cycles = fleet->now;
+    g->state.inst_generation++; // Attached to its image once
+    g->hash = _fleet_state_hash(&g->state);
+    g->image = image;
+    g->members = 1;
+
+    int index = fleet->num_instances++;
+    FleetInstance *inst = &fleet->instances[index];
+    memset(inst, 0, sizeof(FleetInstance));
+    inst->image = image;
+    inst->group = fleet->num_groups - 1;
+    return index;
+}
+
+int fleet_set_state(Fleet *fleet, int instance, const CPUState *state)
+{
+    if (instance < 0 || instance >= fleet->num_instances)
+        return FLEET_ERR_INDEX;
+    FleetInstance *inst = &fleet->instances[instance];
+    FleetGroup *old = &fleet->groups[inst->group];
+    if (old->members > 1) {
+        // Leaves its group behind
+        old->members--;
+        FleetGroup *g = &fleet->groups[fleet->num_groups];
+        memset(g, 0, sizeof(FleetGroup));
+        g->image = inst->image;
+        g->members = 1;
+        inst->group = fleet->num_groups++;
+    }
+
+    // Through a CPU, to get rid of whatever's in the padding
+    FleetGroup *g = &fleet->groups[inst->group];
+    cpu_load_state(&fleet->cpu, state);
+    fleet->cpu.inst_cycles = fleet->now;
+    fleet->cpu.inst_generation = state->inst_generation;
+    _fleet_save(&fleet->cpu, &g->state);
+    g->hash = _fleet_state_hash(&g->state);
+    return FLEET_OK;
+}
+
+int fleet_set_inputs(Fleet *fleet, int instance, const StimulusEvent *events, size_t num_events)
+{
+    if (instance < 0 || instance >= fleet->num_instances)
+        return FLEET_ERR_INDEX;
+    for (size_t i = 1; i < num_events; i++)
+        if (events[i].cycle < events[i - 1].cycle)
+            return FLEET_ERR_ORDER;
+    FleetInstance *inst = &fleet->instances[instance];
+    inst->events = events;
+    inst->num_events = num_events;
+    inst->next = 0;
+    while (inst->next < num_events && events[inst->next].cycle < fleet->now)
+        inst->next++; // Already in the past
+    return FLEET_OK;
+}
+
+int fleet_run(Fleet *fleet, uint64_t cycles)
+{
+    uint64_t target = fleet->now + cycles;
+    while (fleet->now < target)
+    {
+        uint64_t end = fleet->now + fleet->epoch < target ? fleet->now + fleet->epoch : target;
+        int err = _fleet_group(fleet, end);
+        for (int g = 0; g < fleet->num_groups && err == FLEET_OK; g++)
+            err = _fleet_run_group(fleet, &fleet->groups[g], end);
+        if (err != FLEET_OK)
+            return err;
+
+        for (int i = 0; i < fleet->num_instances; i++)
+        {
+            FleetInstance *inst = &fleet->instances[i];
+            const FleetGroup *g = &fleet->groups[inst->group];
+            inst->next += g->num_events;
+            if (g->failures && inst->failures == 0)
+                inst->failed_cycle = g->failed_cycle;
+            inst->expects += g->expects;
+            inst->failures += g->failures;
+            inst->contentions += g->contentions;
+        }
+        fleet->now = end;
+        fleet->epochs++;
+        fleet->instance_runs += fleet->num_instances;
+    }
+    return FLEET_OK;
+}
+
+int fleet_get_state(const Fleet *fleet, int instance, CPUState *state)
+{
+    if (instance < 0 || instance >= fleet->num_instances)
+        return FLEET_ERR_INDEX;
+    *state = fleet->groups[fleet->instances[instance].group].state;
+    return FLEET_OK;
+}
+
+int fleet_num_groups(const Fleet *fleet)
+{
+    return fleet->num_groups;
+}
+
+const char *fleet_strerror(int err)
+{
+    switch (err)
+    {
+        case FLEET_OK:         return "OK";
+        case FLEET_ERR_MEMORY: return "Out of memory";
+        case FLEET_ERR_ORDER:  return "Input events not in cycle order";
+        case FLEET_ERR_INDEX:  return "No such instance";
+    }
+    return "Unknown error";
+}
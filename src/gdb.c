@@ -0,0 +1,749 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gdb.h"
+#include "expr.h"
+#include "history.h"
+
+#define GDB_NUM_REGS 39
+#define GDB_REG_PC   33
+
+// Internal _gdb_handle() results on top of the GDB_* ones
+#define GDB_SERVING        2
+#define GDB_SERVING_NO_ACK 3 // Reply still gets acked, then no-ack mode starts
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Sizes in bytes of each register, see the table in gdb.h
+static int _gdb_reg_size(int n)
+{
+    if (n == 38)
+        return 8;
+    if (n >= GDB_REG_PC && n <= 35)
+        return 2;
+    return 1;
+}
+
+static int _gdb_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses hex digits up until anything that isn't one, leaving p there
+static uint64_t _gdb_parse_hex(const char **p)
+{
+    uint64_t value = 0;
+    int digit;
+    while ((digit = _gdb_hex(**p)) >= 0)
+    {
+        value = (value << 4) | digit;
+        (*p)++;
+    }
+    return value;
+}
+
+// Little endian, which is what gdb expects for registers
+static char *_gdb_put_le(char *out, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        *out++ = hex_digits[(value >> 4) & 0xF];
+        *out++ = hex_digits[value & 0xF];
+        value >>= 8;
+    }
+    *out = '\0';
+    return out;
+}
+
+static bool _gdb_get_le(const char **p, int size, uint64_t *value)
+{
+    *value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        int hi = _gdb_hex((*p)[0]), lo = hi < 0 ? -1 : _gdb_hex((*p)[1]);
+        if (lo < 0)
+            return false;
+        *value |= (uint64_t)((hi << 4) | lo) << (8 * i);
+        *p += 2;
+    }
+    return true;
+}
+
+
+// Socket plumbing
+static int _gdb_getc(GdbServer *gdb)
+{
+    if (gdb->in_pos >= gdb->in_len) {
+        ssize_t n = read(gdb->fd, gdb->in, sizeof(gdb->in));
+        if (n <= 0)
+            return -1;
+        gdb->in_len = n;
+        gdb->in_pos = 0;
+    }
+    return (uint8_t)gdb->in[gdb->in_pos++];
+}
+
+static bool _gdb_write(GdbServer *gdb, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(gdb->fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Checks for a Ctrl-C without blocking, a dead connection counts as one too so continue stops
+static bool _gdb_interrupted(GdbServer *gdb)
+{
+    if (gdb->in_pos >= gdb->in_len) {
+        struct pollfd pfd = {gdb->fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) <= 0)
+            return false;
+        ssize_t n = read(gdb->fd, gdb->in, sizeof(gdb->in));
+        if (n <= 0)
+            return true;
+        gdb->in_len = n;
+        gdb->in_pos = 0;
+    }
+    if (gdb->in[gdb->in_pos] == 0x03) {
+        gdb->in_pos++;
+        return true;
+    }
+    return false;
+}
+
+static bool _gdb_send(GdbServer *gdb, const char *data)
+{
+    if (gdb->verbose)
+        printf("gdb -> %s\n", data);
+
+    size_t len = strlen(data);
+    char *frame = malloc(len + 5);
+    if (frame == NULL)
+        return false;
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < len; i++)
+        checksum += (uint8_t)data[i];
+    frame[0] = '$';
+    memcpy(frame + 1, data, len);
+    frame[len + 1] = '#';
+    frame[len + 2] = hex_digits[checksum >> 4];
+    frame[len + 3] = hex_digits[checksum & 0xF];
+
+    // Resend until it gets acked, a few tries is plenty on a local socket
+    bool ok = false;
+    for (int tries = 0; tries < 8 && !ok; tries++)
+    {
+        if (!_gdb_write(gdb, frame, len + 4))
+            break;
+        if (gdb->no_ack) {
+            ok = true;
+            break;
+        }
+        int c;
+        do c = _gdb_getc(gdb); while (c != '+' && c != '-' && c >= 0);
+        if (c < 0)
+            break;
+        ok = c == '+';
+    }
+    free(frame);
+    return ok;
+}
+
+// Reads the next packet into gdb->packet, false if the connection died
+static bool _gdb_read_packet(GdbServer *gdb)
+{
+    while (1)
+    {
+        int c;
+        do c = _gdb_getc(gdb); while (c != '$' && c >= 0); // Stray acks and Ctrl-Cs while stopped get dropped
+        if (c < 0)
+            return false;
+
+        int len = 0;
+        uint8_t checksum = 0;
+        bool overflow = false;
+        while ((c = _gdb_getc(gdb)) >= 0 && c != '#')
+        {
+            checksum += c;
+            if (c == '}') { // Escaped byte
+                if ((c = _gdb_getc(gdb)) < 0)
+                    return false;
+                checksum += c;
+                c ^= 0x20;
+            }
+            if (len < GDB_PACKET_SIZE)
+                gdb->packet[len++] = c;
+            else
+                overflow = true;
+        }
+        int hi = _gdb_getc(gdb), lo = _gdb_getc(gdb);
+        if (c < 0 || hi < 0 || lo < 0)
+            return false;
+        gdb->packet[len] = '\0';
+
+        bool valid = !overflow && _gdb_hex(hi) >= 0 && _gdb_hex(lo) >= 0 && ((_gdb_hex(hi) << 4) | _gdb_hex(lo)) == checksum;
+        if (!gdb->no_ack && !_gdb_write(gdb, valid ? "+" : "-", 1))
+            return false;
+        if (valid) {
+            if (gdb->verbose)
+                printf("gdb <- %s\n", gdb->packet);
+            return true;
+        }
+    }
+}
+
+
+// Registers and memory
+static uint64_t _gdb_read_reg(CPU *cpu, int n)
+{
+    if (n == 0)
+        return cpu->w;
+    if (n - 1 == PCL)
+        return cpu->pc & 0xFF; // Where we're stopped, cpu_getreg() gives what the instruction there would read
+    if (n <= 32) {
+        cpu->do_callback = false;
+        uint8_t value = cpu_getreg(cpu, n - 1);
+        cpu->do_callback = true;
+        return value;
+    }
+    uint16_t pc_mask = cpu->device->program_words - 1;
+    switch (n) {
+        case GDB_REG_PC: return (cpu->pc & pc_mask) * 2;
+        case 34:         return (cpu->stack[0] & pc_mask) * 2;
+        case 35:         return (cpu->stack[1] & pc_mask) * 2;
+        case 36:         return cpu->option;
+        case 37:         return cpu->trisgpio;
+        default:         return cpu->inst_cycles;
+    }
+}
+
+static void _gdb_write_file_reg(CPU *cpu, uint8_t r, uint8_t value)
+{
+    // Straight into the register file, no callbacks or timer side effects, the debugger knows what it's doing
+    // Still only where the part has a register, banked through FSR like cpu_setreg()
+    const Device *device = cpu->device;
+    if (r == PCL) {
+        cpu->pc = (cpu->pc & (device->program_words - 1) & ~0xFF) | value;
+        cpu->f[PCL] = value;
+        return;
+    }
+    if (r == INDF && (r = cpu->f[FSR] & 0x1F) == INDF)
+        return;
+    if (device->unimplemented & (1u << r))
+        return;
+    cpu->f[device_reg_addr(device, cpu->f[FSR], r)] = value;
+}
+
+static void _gdb_write_reg(CPU *cpu, int n, uint64_t value)
+{
+    if (n == 0)
+        cpu->w = value;
+    else if (n <= 32)
+        _gdb_write_file_reg(cpu, n - 1, value);
+    else if (n == GDB_REG_PC)
+        cpu->pc = (value / 2) & (cpu->device->program_words - 1);
+    else if (n == 34 || n == 35)
+        cpu->stack[n - 34] = (value / 2) & (cpu->device->program_words - 1);
+    else if (n == 36)
+        cpu->option = value;
+    else if (n == 37)
+        cpu->trisgpio = value & cpu->device->pins;
+    // The cycle counter is read-only
+}
+
+static bool _gdb_read_mem(CPU *cpu, uint32_t addr, uint8_t *value)
+{
+    if (addr < cpu->device->program_words * 2u)
+        *value = cpu->inst[addr >> 1] >> ((addr & 1) * 8);
+    else if (addr == 0x1FFE || addr == 0x1FFF)
+        *value = cpu->config >> ((addr & 1) * 8);
+    else if (addr >= GDB_MEM_DATA && addr < GDB_MEM_DATA + 32)
+        *value = _gdb_read_reg(cpu, addr - GDB_MEM_DATA + 1);
+    else
+        return false;
+    return true;
+}
+
+static bool _gdb_write_mem(CPU *cpu, uint32_t addr, uint8_t value)
+{
+    int shift = (addr & 1) * 8;
+    if (addr < cpu->device->program_words * 2u)
+        cpu_write_inst(cpu, addr >> 1, (cpu->inst[addr >> 1] & ~(0xFF << shift)) | (value << shift));
+    else if (addr == 0x1FFE || addr == 0x1FFF)
+        cpu->config = device_config(cpu->device, (cpu->config & ~(0xFF << shift)) | (value << shift));
+    else if (addr >= GDB_MEM_DATA && addr < GDB_MEM_DATA + 32)
+        _gdb_write_file_reg(cpu, addr - GDB_MEM_DATA, value);
+    else
+        return false;
+    return true;
+}
+
+
+// Made once, it never changes
+static const char *_gdb_target_xml(void)
+{
+    static char xml[4096];
+    if (xml[0] != '\0')
+        return xml;
+
+    const char *special_regs[] = {"indf", "tmr0", "pcl", "status", "fsr", "osccal", "gpio"};
+    int len = sprintf(xml, "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                           "<target version=\"1.0\">\n<feature name=\"org.c12f508.core\">\n"
+                           "<reg name=\"w\" bitsize=\"8\" type=\"uint8\" regnum=\"0\"/>\n");
+    for (int r = 0; r < 32; r++)
+    {
+        if (r < 7)
+            len += sprintf(xml + len, "<reg name=\"%s\" bitsize=\"8\" type=\"uint8\"/>\n", special_regs[r]);
+        else
+            len += sprintf(xml + len, "<reg name=\"r%02x\" bitsize=\"8\" type=\"uint8\"/>\n", r);
+    }
+    sprintf(xml + len, "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+                       "<reg name=\"stack0\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+                       "<reg name=\"stack1\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+                       "<reg name=\"option\" bitsize=\"8\" type=\"uint8\"/>\n"
+                       "<reg name=\"trisgpio\" bitsize=\"8\" type=\"uint8\"/>\n"
+                       "<reg name=\"cycles\" bitsize=\"64\" type=\"uint64\"/>\n"
+                       "</feature>\n</target>\n");
+    return xml;
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void _gdb_xfer_features(GdbServer *gdb, const char *args)
+{
+    if (strncmp(args, "target.xml:", 11) != 0) {
+        strcpy(gdb->reply, "E00");
+        return;
+    }
+    const char *p = args + 11;
+    uint64_t offset = _gdb_parse_hex(&p);
+    p++;
+    uint64_t length = _gdb_parse_hex(&p);
+    if (length > GDB_PACKET_SIZE - 1)
+        length = GDB_PACKET_SIZE - 1;
+
+    const char *xml = _gdb_target_xml();
+    uint64_t xml_len = strlen(xml);
+    if (offset >= xml_len) {
+        strcpy(gdb->reply, "l");
+        return;
+    }
+    uint64_t n = xml_len - offset < length ? xml_len - offset : length;
+    gdb->reply[0] = offset + n >= xml_len ? 'l' : 'm';
+    memcpy(gdb->reply + 1, xml + offset, n); // The XML doesn't have anything that needs escaping
+    gdb->reply[n + 1] = '\0';
+}
+
+
+// Execution, a dead connection shows up as an interrupt and then fails the reply
+static void _gdb_stop_reply(GdbServer *gdb, int reason)
+{
+    if (reason == STOP_WATCHPOINT)
+        sprintf(gdb->reply, "T05watch:%x;", GDB_MEM_DATA + gdb->cpu->watch_hit.reg);
+    else
+        strcpy(gdb->reply, "S05");
+}
+
+static void _gdb_continue(GdbServer *gdb)
+{
+    while (1)
+    {
+        int reason = gdb->history ? history_run(gdb->history, GDB_POLL_CYCLES) : cpu_run_cycles(gdb->cpu, GDB_POLL_CYCLES);
+        if (reason != STOP_CYCLES) {
+            _gdb_stop_reply(gdb, reason);
+            return;
+        }
+        if (_gdb_interrupted(gdb)) {
+            strcpy(gdb->reply, "S02");
+            return;
+        }
+    }
+}
+
+static void _gdb_resume(GdbServer *gdb, char action, const char *args)
+{
+    // c/s take an optional address to resume from, C/S a signal first that we don't care about
+    if ((action == 'c' || action == 's') && _gdb_hex(*args) >= 0)
+        gdb->cpu->pc = (_gdb_parse_hex(&args) / 2) & (gdb->cpu->device->program_words - 1);
+
+    if (action == 's' || action == 'S') {
+        gdb->cpu->watch_stop = false;
+        if (gdb->history)
+            history_step(gdb->history);
+        else
+            cpu_step(gdb->cpu);
+        _gdb_stop_reply(gdb, gdb->cpu->watch_stop ? STOP_WATCHPOINT : STOP_BREAKPOINT);
+    } else {
+        _gdb_continue(gdb);
+    }
+}
+
+// bs/bc, running out of history is reported the way gdb expects
+static void _gdb_reverse(GdbServer *gdb, char action)
+{
+    int reason = STOP_BREAKPOINT;
+    int err = action == 's' ? history_step_back(gdb->history) : history_reverse_continue(gdb->history, &reason);
+    if (err != HISTORY_OK || reason == STOP_CYCLES)
+        strcpy(gdb->reply, "T05replaylog:begin;");
+    else
+        _gdb_stop_reply(gdb, reason);
+}
+
+static void _gdb_monitor(GdbServer *gdb, const char *hex)
+{
+    char command[256];
+    int len = 0;
+    while (len < (int)sizeof(command) - 1 && _gdb_hex(hex[0]) >= 0 && _gdb_hex(hex[1]) >= 0)
+    {
+        command[len++] = (_gdb_hex(hex[0]) << 4) | _gdb_hex(hex[1]);
+        hex += 2;
+    }
+    command[len] = '\0';
+
+    // monitor break <addr> <condition> / monitor delete <addr>, byte addresses like gdb's own breakpoints
+    char *end;
+    if (strcmp(command, "reset") == 0) {
+        cpu_reset(gdb->cpu, RESET_MCLR_NORMAL);
+        strcpy(gdb->reply, "OK");
+    } else if (strncmp(command, "break ", 6) == 0) {
+        unsigned long addr = strtoul(command + 6, &end, 0);
+        if (end == command + 6 || addr >= gdb->cpu->device->program_words * 2u || cpu_addcondbreakpoint(gdb->cpu, addr / 2, end) != EXPR_OK)
+            strcpy(gdb->reply, "E02");
+        else
+            strcpy(gdb->reply, "OK");
+    } else if (strncmp(command, "delete ", 7) == 0) {
+        unsigned long addr = strtoul(command + 7, &end, 0);
+        if (end == command + 7 || addr >= gdb->cpu->device->program_words * 2u) {
+            strcpy(gdb->reply, "E02");
+        } else {
+            cpu_removecondbreakpoint(gdb->cpu, addr / 2);
+            strcpy(gdb->reply, "OK");
+        }
+    } else {
+        strcpy(gdb->reply, "E01");
+    }
+}
+
+// Fills in gdb->reply, returns GDB_DETACHED/GDB_KILLED to stop serving or GDB_SERVING(_NO_ACK) to keep going
+static int _gdb_handle(GdbServer *gdb)
+{
+    CPU *cpu = gdb->cpu;
+    const char *p = gdb->packet + 1;
+    char *out = gdb->reply;
+    *out = '\0'; // Empty reply means unsupported
+
+    switch (gdb->packet[0]) {
+        case '?':
+            strcpy(out, "S05");
+            break;
+        case 'g':
+            for (int n = 0; n < GDB_NUM_REGS; n++)
+                out = _gdb_put_le(out, _gdb_read_reg(cpu, n), _gdb_reg_size(n));
+            break;
+        case 'G':
+            for (int n = 0; n < GDB_NUM_REGS; n++)
+            {
+                uint64_t value;
+                if (!_gdb_get_le(&p, _gdb_reg_size(n), &value))
+                    break;
+                _gdb_write_reg(cpu, n, value);
+            }
+            strcpy(out, "OK");
+            break;
+        case 'p': {
+            int n = _gdb_parse_hex(&p);
+            if (n < GDB_NUM_REGS)
+                _gdb_put_le(out, _gdb_read_reg(cpu, n), _gdb_reg_size(n));
+            else
+                strcpy(out, "E01");
+            break;
+        }
+        case 'P': {
+            int n = _gdb_parse_hex(&p);
+            uint64_t value;
+            if (n < GDB_NUM_REGS && *p++ == '=' && _gdb_get_le(&p, _gdb_reg_size(n), &value)) {
+                _gdb_write_reg(cpu, n, value);
+                strcpy(out, "OK");
+            } else {
+                strcpy(out, "E01");
+            }
+            break;
+        }
+        case 'm': {
+            uint32_t addr = _gdb_parse_hex(&p);
+            p++;
+            uint32_t len = _gdb_parse_hex(&p);
+            if (len > (GDB_PACKET_SIZE - 1) / 2)
+                len = (GDB_PACKET_SIZE - 1) / 2;
+            // Partial reads are fine, gdb only wants an error if nothing could be read
+            for (uint32_t i = 0; i < len; i++)
+            {
+                uint8_t value;
+                if (!_gdb_read_mem(cpu, addr + i, &value))
+                    break;
+                out = _gdb_put_le(out, value, 1);
+            }
+            if (out == gdb->reply)
+                strcpy(out, "E01");
+            break;
+        }
+        case 'M': {
+            uint32_t addr = _gdb_parse_hex(&p);
+            p++;
+            uint32_t len = _gdb_parse_hex(&p);
+            p++;
+            strcpy(out, "OK");
+            for (uint32_t i = 0; i < len; i++)
+            {
+                uint64_t value;
+                if (!_gdb_get_le(&p, 1, &value) || !_gdb_write_mem(cpu, addr + i, value)) {
+                    strcpy(out, "E01");
+                    break;
+                }
+            }
+            break;
+        }
+        case 'Z':
+        case 'z': {
+            // Software and hardware breakpoints are the same thing to us, and only write watchpoints are supported
+            char type = *p;
+            if (type != '0' && type != '1' && type != '2')
+                break;
+            p += 2;
+            uint32_t addr = _gdb_parse_hex(&p);
+            p++;
+            uint32_t len = _gdb_parse_hex(&p);
+            if (type == '2') {
+                if (addr < GDB_MEM_DATA || len == 0 || addr + len > GDB_MEM_DATA + 32) {
+                    strcpy(out, "E01");
+                    break;
+                }
+                for (uint32_t r = addr - GDB_MEM_DATA; r < addr - GDB_MEM_DATA + len; r++)
+                {
+                    if (gdb->packet[0] == 'Z')
+                        cpu_addwatchpoint(cpu, r);
+                    else
+                        cpu_removewatchpoint(cpu, r);
+                }
+            } else {
+                if (addr >= cpu->device->program_words * 2u) {
+                    strcpy(out, "E01");
+                    break;
+                }
+                if (gdb->packet[0] == 'Z')
+                    cpu_addbreakpoint(cpu, addr / 2);
+                else
+                    cpu_removebreakpoint(cpu, addr / 2);
+            }
+            strcpy(out, "OK");
+            break;
+        }
+        case 'c':
+        case 'C':
+        case 's':
+        case 'S':
+            if (gdb->packet[0] == 'C' || gdb->packet[0] == 'S') {
+                // Skip the signal, then the optional ;addr
+                _gdb_parse_hex(&p);
+                if (*p == ';')
+                    p++;
+                else
+                    p = "";
+            }
+            _gdb_resume(gdb, gdb->packet[0], p);
+            break;
+        case 'v':
+            if (strcmp(gdb->packet, "vCont?") == 0) {
+                strcpy(out, "vCont;c;C;s;S");
+            } else if (strncmp(gdb->packet, "vCont;", 6) == 0) {
+                // Single threaded, so the first action is the only one that matters
+                char action = gdb->packet[6];
+                if (action == 'c' || action == 'C' || action == 's' || action == 'S')
+                    _gdb_resume(gdb, action, "");
+            }
+            break;
+        case 'b':
+            if (gdb->history != NULL && (gdb->packet[1] == 's' || gdb->packet[1] == 'c'))
+                _gdb_reverse(gdb, gdb->packet[1]);
+            break;
+        case 'H':
+        case 'T':
+            strcpy(out, "OK");
+            break;
+        case 'q':
+            if (strncmp(gdb->packet, "qSupported", 10) == 0)
+                sprintf(out, "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+%s", GDB_PACKET_SIZE,
+                        gdb->history ? ";ReverseStep+;ReverseContinue+" : "");
+            else if (strncmp(gdb->packet, "qXfer:features:read:", 20) == 0)
+                _gdb_xfer_features(gdb, gdb->packet + 20);
+            else if (strcmp(gdb->packet, "qAttached") == 0)
+                strcpy(out, "1");
+            else if (strcmp(gdb->packet, "qC") == 0)
+                strcpy(out, "QC1");
+            else if (strcmp(gdb->packet, "qfThreadInfo") == 0)
+                strcpy(out, "m1");
+            else if (strcmp(gdb->packet, "qsThreadInfo") == 0)
+                strcpy(out, "l");
+            else if (strncmp(gdb->packet, "qRcmd,", 6) == 0)
+                _gdb_monitor(gdb, gdb->packet + 6);
+            break;
+        case 'Q':
+            if (strcmp(gdb->packet, "QStartNoAckMode") == 0) {
+                strcpy(out, "OK");
+                return GDB_SERVING_NO_ACK;
+            }
+            break;
+        case 'D':
+            strcpy(out, "OK");
+            return GDB_DETACHED;
+        case 'k':
+            return GDB_KILLED;
+    }
+    return GDB_SERVING;
+}
+
+
+int gdb_listen(GdbServer *gdb, CPU *cpu, const char *address)
+{
+    gdb_attach_fd(gdb, cpu, -1);
+
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un addr;
+        if (strlen(address) >= sizeof(addr.sun_path))
+            return GDB_ERR_ADDRESS;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, address);
+
+        // Clean up after a previous run, but only if it's actually a socket
+        struct stat st;
+        if (stat(address, &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(address);
+
+        gdb->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (gdb->listen_fd < 0 || bind(gdb->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+            goto listen_error;
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+
+        char host[64] = "127.0.0.1";
+        const char *port = strrchr(address, ':');
+        if (port != NULL) {
+            if (port != address) {
+                if ((size_t)(port - address) >= sizeof(host))
+                    return GDB_ERR_ADDRESS;
+                memcpy(host, address, port - address);
+                host[port - address] = '\0';
+            }
+            port++;
+        } else {
+            port = address;
+        }
+        char *end;
+        long port_num = strtol(port, &end, 10);
+        if (*port == '\0' || *end != '\0' || port_num < 0 || port_num > 65535 || inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+            return GDB_ERR_ADDRESS;
+        addr.sin_port = htons(port_num);
+
+        gdb->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (gdb->listen_fd < 0 || setsockopt(gdb->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+            || bind(gdb->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+            goto listen_error;
+    }
+
+    if (listen(gdb->listen_fd, 1) != 0)
+        goto listen_error;
+    return 0;
+
+listen_error:
+    gdb_close(gdb);
+    return GDB_ERR_SOCKET;
+}
+
+int gdb_accept(GdbServer *gdb)
+{
+    int fd = accept(gdb->listen_fd, NULL, NULL);
+    if (fd < 0)
+        return GDB_ERR_SOCKET;
+
+    // Packets are tiny and latency is everything when single stepping
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on Unix sockets
+
+    if (gdb->fd >= 0)
+        close(gdb->fd);
+    gdb->fd = fd;
+    gdb->no_ack = false;
+    gdb->in_len = gdb->in_pos = 0;
+    return 0;
+}
+
+void gdb_attach_fd(GdbServer *gdb, CPU *cpu, int fd)
+{
+    gdb->cpu = cpu;
+    gdb->listen_fd = -1;
+    gdb->fd = fd;
+    gdb->no_ack = false;
+    gdb->verbose = false;
+    gdb->history = NULL;
+    gdb->in_len = 0;
+    gdb->in_pos = 0;
+}
+
+void gdb_close(GdbServer *gdb)
+{
+    if (gdb->fd >= 0)
+        close(gdb->fd);
+    if (gdb->listen_fd >= 0)
+        close(gdb->listen_fd);
+    gdb->fd = -1;
+    gdb->listen_fd = -1;
+}
+
+int gdb_serve(GdbServer *gdb)
+{
+    while (_gdb_read_packet(gdb))
+    {
+        int result = _gdb_handle(gdb);
+        if (result == GDB_KILLED)
+            return result;
+        if (!_gdb_send(gdb, gdb->reply))
+            break;
+        if (result == GDB_DETACHED)
+            return result;
+        if (result == GDB_SERVING_NO_ACK)
+            gdb->no_ack = true;
+    }
+    return GDB_ERR_CLOSED;
+}
+
+const char *gdb_strerror(int err)
+{
+    switch (err) {
+        case GDB_DETACHED:    return "detached";
+        case GDB_KILLED:      return "killed";
+        case GDB_ERR_SOCKET:  return "socket error";
+        case GDB_ERR_ADDRESS: return "bad address";
+        case GDB_ERR_CLOSED:  return "connection closed";
+        default:              return "unknown error";
+    }
+}
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "hex.h"
+
+// Longest possible record is 255 data bytes + length, address (2), type and checksum
+#define HEX_MAX_RECORD 260
+
+void hex_image_clear(HexImage *image)
+{
+    memset(image->words, 0, sizeof(image->words));
+    memset(image->present, 0, sizeof(image->present));
+    image->num_records = 0;
+    image->error_line = 0;
+}
+
+
+// Branch-free digit handling so the decode loop below can be vectorised
+// '0'-'9' are 0x30-0x39 and 'A'-'F'/'a'-'f' are 0x41-0x46/0x61-0x66, so the low nibble plus 9 for letters does it
+static inline uint8_t _hex_nibble(uint8_t c)
+{
+    return (c & 0x0F) + 9 * (c >> 6);
+}
+
+static inline uint8_t _hex_invalid(uint8_t c)
+{
+    uint8_t digit = (uint8_t)(c - '0') < 10;
+    uint8_t alpha = (uint8_t)((c | 0x20) - 'a') < 6; // Lowercase is fine too
+    return !(digit | alpha);
+}
+
+// Decodes num_bytes bytes from 2*num_bytes characters, returns non-zero if any character wasn't a hex digit
+static uint8_t _hex_decode(uint8_t *out, const char *in, size_t num_bytes)
+{
+    uint8_t bad = 0;
+    for (size_t i = 0; i < num_bytes; i++)
+    {
+        uint8_t high = in[2*i];
+        uint8_t low  = in[2*i + 1];
+        bad |= _hex_invalid(high) | _hex_invalid(low);
+        out[i] = (_hex_nibble(high) << 4) | _hex_nibble(low);
+    }
+    return bad;
+}
+
+static uint32_t _count_lines(const char *start, const char *end)
+{
+    uint32_t lines = 0;
+    for (const char *p = start; p < end; p++)
+        lines += (*p == '\n');
+    return lines;
+}
+
+int hex_parse(HexImage *image, const char *buf, size_t len)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    uint32_t line = 1;
+    uint32_t base = 0; // Upper address bits from the extended address records
+    uint8_t record[HEX_MAX_RECORD];
+
+    while (1)
+    {
+        // Skip to the next record, anything between them (CR/LF, whitespace) gets ignored
+        const char *colon = memchr(p, ':', end - p);
+        if (colon == NULL) {
+            image->error_line = line + _count_lines(p, end);
+            return HEX_ERR_NO_EOF;
+        }
+        line += _count_lines(p, colon);
+        p = colon + 1;
+        image->error_line = line; // Pre-emptively, cleared again on success
+
+        // Length first so we know how much to decode
+        if (end - p < 2 || _hex_decode(record, p, 1))
+            return HEX_ERR_SYNTAX;
+        size_t num_bytes = record[0];
+        size_t record_len = num_bytes + 5;
+        if ((size_t)(end - p) < record_len * 2)
+            return HEX_ERR_SYNTAX;
+
+        // Then the whole record in one go
+        if (_hex_decode(record, p, record_len))
+            return HEX_ERR_SYNTAX;
+        p += record_len * 2;
+
+        // All bytes including the checksum should sum to zero
+        uint8_t sum = 0;
+        for (size_t i = 0; i < record_len; i++)
+            sum += record[i];
+        if (sum != 0)
+            return HEX_ERR_CHECKSUM;
+
+        uint16_t offset = (record[1] << 8) | record[2];
+        uint8_t record_type = record[3];
+        const uint8_t *data = &record[4];
+        image->num_records++;
+
+        switch (record_type)
+        {
+            case HEX_REC_DATA:
+                for (size_t i = 0; i < num_bytes; i++)
+                {
+                    uint32_t byte_addr = base + offset + i;
+                    uint32_t addr = byte_addr >> 1;
+                    if (addr >= HEX_WORDS)
+                        return HEX_ERR_ADDRESS;
+
+                    // Little endian, low byte at the even address
+                    if (byte_addr & 1)
+                        image->words[addr] = (image->words[addr] & 0x00FF) | (data[i] << 8);
+                    else
+                        image->words[addr] = (image->words[addr] & 0xFF00) | data[i];
+                    image->present[addr >> 3] |= 1 << (addr & 7);
+                }
+                break;
+            case HEX_REC_EOF:
+                image->error_line = 0;
+                return HEX_OK;
+            case HEX_REC_EXT_SEGMENT:
+                if (num_bytes != 2)
+                    return HEX_ERR_RECORD;
+                base = ((uint32_t)((data[0] << 8) | data[1])) << 4;
+                break;
+            case HEX_REC_EXT_LINEAR:
+                if (num_bytes != 2)
+                    return HEX_ERR_RECORD;
+                base = ((uint32_t)((data[0] << 8) | data[1])) << 16;
+                break;
+            case HEX_REC_START_SEGMENT:
+            case HEX_REC_START_LINEAR:
+                // Start addresses mean nothing to a PIC, it always starts at the reset vector
+                if (num_bytes != 4)
+                    return HEX_ERR_RECORD;
+                break;
+            default:
+                return HEX_ERR_RECORD;
+        }
+    }
+}
+
+int hex_read_file(HexImage *image, const char *hex_path)
+{
+    // Read the whole thing in one go, HEX files for these parts are tiny anyways
+    FILE *file = fopen(hex_path, "rb");
+    if (file == NULL)
+        return HEX_ERR_IO;
+
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return HEX_ERR_IO;
+    }
+
+    char *buf = malloc(size > 0 ? size : 1);
+    if (buf == NULL) {
+        fclose(file);
+        return HEX_ERR_MEMORY;
+    }
+    size_t got = fread(buf, 1, size, file);
+    fclose(file);
+    if (got != (size_t)size) {
+        free(buf);
+        return HEX_ERR_IO;
+    }
+
+    int err = hex_parse(image, buf, got);
+    free(buf);
+    return err;
+}
+
+int hex_validate(const HexImage *image, int num_words)
+{
+    for (int addr = 0; addr < HEX_WORDS; addr++)
+    {
+        if (!hex_word_present(image, addr))
+            continue;
+        // Program memory, the user ID locations + backup OSCCAL (just past program memory) and the config word are all fine
+        if (addr >= num_words + 5 && addr != HEX_CONFIG_ADDR)
+            return HEX_ERR_ADDRESS;
+    }
+    return HEX_OK;
+}
+
+const char *hex_strerror(int err)
+{
+    switch (err)
+    {
+        case HEX_OK:           return "OK";
+        case HEX_ERR_IO:       return "Failed to read HEX file";
+        case HEX_ERR_SYNTAX:   return "Invalid character or truncated record";
+        case HEX_ERR_CHECKSUM: return "Record checksum mismatch";
+        case HEX_ERR_RECORD:   return "Unsupported or malformed record";
+        case HEX_ERR_ADDRESS:  return "Data outside of program memory";
+        case HEX_ERR_NO_EOF:   return "Missing EOF record";
+        case HEX_ERR_MEMORY:   return "Out of memory";
+    }
+    return "Unknown error";
+}
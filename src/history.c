@@ -0,0 +1,400 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "history.h"
+
+// Last read run starting at or before seq
+static size_t _history_find_run(const History *history, uint64_t seq)
+{
+    size_t lo = 0, hi = history->num_runs;
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (history->reads[mid].first <= seq)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Drops the older half of the checkpoints and whatever inputs only they needed, for when the logs are full
+// Only happens while logging, so the CPU's always past the checkpoint that becomes the first
+static void _history_trim(History *history)
+{
+    int keep = history->num_checkpoints / 2;
+    if (keep == 0)
+        return;
+    const Checkpoint *first = &history->checkpoints[keep];
+
+    // Reads keep the run the first checkpoint starts in, their sequence numbers don't change
+    // (Both logs can still be NULL with nothing in them, so no memmove unless something actually goes)
+    if (history->num_runs > 0) {
+        size_t run = _history_find_run(history, first->read_seq);
+        if (run > 0) {
+            memmove(history->reads, history->reads + run, (history->num_runs - run) * sizeof(ReadRun));
+            history->num_runs -= run;
+        }
+    }
+
+    // Events are by index though
+    size_t dropped = first->event_index;
+    if (dropped > 0) {
+        memmove(history->events, history->events + dropped, (history->num_events - dropped) * sizeof(GpioEvent));
+        history->num_events -= dropped;
+        history->next_event -= dropped;
+        for (int i = keep; i < history->num_checkpoints; i++)
+            history->checkpoints[i].event_index -= dropped;
+    }
+
+    memmove(history->checkpoints, first, (history->num_checkpoints - keep) * sizeof(Checkpoint));
+    history->num_checkpoints -= keep;
+}
+
+// Makes room for one more entry in a full log: growing it up to max_log entries, then dropping old history
+// The caller checks whether that worked, if it didn't history gets marked lost
+static void *_history_grow(History *history, void *log, size_t *capacity, size_t size, size_t initial)
+{
+    if (*capacity < history->max_log) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : initial;
+        if (grown_capacity > history->max_log)
+            grown_capacity = history->max_log;
+        void *grown = realloc(log, grown_capacity * size);
+        if (grown != NULL) {
+            *capacity = grown_capacity;
+            return grown;
+        }
+    }
+    _history_trim(history);
+    return log;
+}
+
+// Input logging
+static void _history_log_read(History *history, uint8_t value)
+{
+    if (history->num_runs == 0 || history->reads[history->num_runs - 1].value != value) {
+        if (history->num_runs == history->runs_capacity)
+            history->reads = _history_grow(history, history->reads, &history->runs_capacity, sizeof(ReadRun), 256);
+        if (history->num_runs == history->runs_capacity) {
+            history->lost = true;
+        } else {
+            history->reads[history->num_runs].first = history->num_reads;
+            history->reads[history->num_runs++].value = value;
+        }
+    }
+    history->num_reads++;
+}
+
+static uint8_t _history_logged_read(const History *history, uint64_t seq)
+{
+    return history->reads[_history_find_run(history, seq)].value;
+}
+
+static void _history_read(CPU *cpu, uint8_t *gpio)
+{
+    History *history = cpu->history;
+    if (history->read_seq < history->num_reads) {
+        *gpio = _history_logged_read(history, history->read_seq++);
+        return;
+    }
+    history->gpio_read_callback(cpu, gpio);
+    _history_log_read(history, *gpio);
+    history->read_seq++;
+}
+
+static void _history_write(CPU *cpu, uint8_t *gpio)
+{
+    // The outside world already saw these the first time around
+    History *history = cpu->history;
+    if (cpu->inst_cycles >= history->end_cycle)
+        history->gpio_write_callback(cpu, gpio);
+}
+
+static void _history_apply_events(History *history)
+{
+    CPU *cpu = history->cpu;
+    history->applying = true;
+    while (history->next_event < history->num_events && history->events[history->next_event].cycle <= cpu->inst_cycles)
+        cpu_setgpio(cpu, history->events[history->next_event++].value);
+    history->applying = false;
+}
+
+// Everything after the current point is gone, for when the past gets changed
+static void _history_truncate(History *history)
+{
+    CPU *cpu = history->cpu;
+    history->num_reads = history->read_seq;
+    while (history->num_runs > 0 && history->reads[history->num_runs - 1].first >= history->num_reads)
+        history->num_runs--;
+    history->num_events = history->next_event;
+    while (history->num_checkpoints > 1 && history->checkpoints[history->num_checkpoints - 1].state.inst_cycles > cpu->inst_cycles)
+        history->num_checkpoints--;
+    history->end_cycle = cpu->inst_cycles;
+}
+
+
+// Checkpoints
+// Starts over if a log couldn't keep up, only ever called on instruction boundaries
+static void _history_recover(History *history)
+{
+    if (history->lost)
+        history_reset(history);
+}
+
+static void _history_checkpoint(History *history)
+{
+    // Out of room, so keep every other one and space them out twice as much from now on
+    if (history->num_checkpoints == history->max_checkpoints) {
+        int n = 0;
+        for (int i = 0; i < history->num_checkpoints; i += 2)
+            history->checkpoints[n++] = history->checkpoints[i];
+        history->num_checkpoints = n;
+        history->interval *= 2;
+    }
+
+    Checkpoint *checkpoint = &history->checkpoints[history->num_checkpoints++];
+    cpu_save_state(history->cpu, &checkpoint->state);
+    checkpoint->read_seq = history->read_seq;
+    checkpoint->event_index = history->next_event;
+}
+
+// Latest checkpoint at or before cycle, there's always one at the start
+static int _history_find(const History *history, uint64_t cycle)
+{
+    int lo = 0, hi = history->num_checkpoints;
+    while (hi - lo > 1)
+    {
+        int mid = (lo + hi) / 2;
+        if (history->checkpoints[mid].state.inst_cycles <= cycle)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int _history_restore(History *history, int index)
+{
+    const Checkpoint *checkpoint = &history->checkpoints[index];
+    if (checkpoint->state.inst_generation != history->cpu->inst_generation)
+        return HISTORY_ERR_CHANGED;
+    cpu_load_state(history->cpu, &checkpoint->state);
+    history->read_seq = checkpoint->read_seq;
+    history->next_event = checkpoint->event_index;
+    return HISTORY_OK;
+}
+
+// Runs until at least end, feeding logged events back in and checkpointing once past the end of history
+// With stop set, breakpoints and watchpoints end it early and their STOP_* gets returned
+static int _history_advance(History *history, uint64_t end, bool stop)
+{
+    CPU *cpu = history->cpu;
+    while (1)
+    {
+        _history_recover(history);
+        _history_apply_events(history);
+        if (cpu->inst_cycles >= end)
+            return STOP_CYCLES;
+
+        // Stop where the next event goes in, and where the next checkpoint is due (that one's always live)
+        uint64_t until = end;
+        if (history->next_event < history->num_events && history->events[history->next_event].cycle < until)
+            until = history->events[history->next_event].cycle;
+        uint64_t next_checkpoint = history->checkpoints[history->num_checkpoints - 1].state.inst_cycles + history->interval;
+        if (next_checkpoint > cpu->inst_cycles && next_checkpoint < until)
+            until = next_checkpoint;
+
+        int reason = cpu_run_cycles(cpu, until - cpu->inst_cycles);
+        if (cpu->inst_cycles > history->end_cycle)
+            history->end_cycle = cpu->inst_cycles;
+        if (cpu->inst_cycles >= next_checkpoint)
+            _history_checkpoint(history);
+
+        if (stop && reason != STOP_CYCLES)
+            return reason;
+    }
+}
+
+
+void history_init(History *history, CPU *cpu, int max_checkpoints)
+{
+    history->cpu = cpu;
+    history->max_checkpoints = max_checkpoints > 1 ? max_checkpoints : HISTORY_MAX_CHECKPOINTS;
+    history->checkpoints = malloc(sizeof(Checkpoint) * history->max_checkpoints);
+    history->reads = NULL;
+    history->runs_capacity = 0;
+    history->events = NULL;
+    history->events_capacity = 0;
+    history->max_log = HISTORY_MAX_LOG;
+    history->applying = false;
+
+    // Only callbacks we know about need their results logged, everything else is deterministic anyways
+    cpu->history = history;
+    history->gpio_read_callback = cpu->gpio_read_callback;
+    history->gpio_write_callback = cpu->gpio_write_callback;
+    if (cpu->gpio_read_callback)
+        cpu->gpio_read_callback = _history_read;
+    if (cpu->gpio_write_callback)
+        cpu->gpio_write_callback = _history_write;
+
+    history_reset(history);
+}
+
+void history_reset(History *history)
+{
+    history->num_checkpoints = 0;
+    history->interval = HISTORY_INTERVAL;
+    history->num_runs = 0;
+    history->num_reads = 0;
+    history->read_seq = 0;
+    history->num_events = 0;
+    history->next_event = 0;
+    history->lost = false;
+    history->end_cycle = history->cpu->inst_cycles;
+    _history_checkpoint(history);
+}
+
+void history_deinit(History *history)
+{
+    CPU *cpu = history->cpu;
+    cpu->gpio_read_callback = history->gpio_read_callback;
+    cpu->gpio_write_callback = history->gpio_write_callback;
+    cpu->history = NULL;
+    free(history->checkpoints);
+    free(history->reads);
+    free(history->events);
+}
+
+
+int history_run(History *history, uint64_t max_cycles)
+{
+    uint64_t end = history->cpu->inst_cycles + max_cycles;
+    if (end < history->cpu->inst_cycles)
+        end = UINT64_MAX;
+    return _history_advance(history, end, true);
+}
+
+void history_step(History *history)
+{
+    _history_advance(history, history->cpu->inst_cycles + 1, false);
+}
+
+void history_setgpio(History *history, uint8_t newgpio)
+{
+    cpu_setgpio(history->cpu, newgpio);
+}
+
+void history_log_set(History *history, uint8_t newgpio)
+{
+    if (history->applying)
+        return;
+
+    // Changing the past, so the old future doesn't apply anymore
+    if (history->cpu->inst_cycles < history->end_cycle || history->next_event < history->num_events || history->read_seq < history->num_reads)
+        _history_truncate(history);
+
+    // cpu_setgpio() applies it straight after this, so it's already used up
+    if (history->num_events == history->events_capacity)
+        history->events = _history_grow(history, history->events, &history->events_capacity, sizeof(GpioEvent), 64);
+    if (history->num_events == history->events_capacity) {
+        history->lost = true;
+        return;
+    }
+    history->events[history->num_events].cycle = history->cpu->inst_cycles;
+    history->events[history->num_events++].value = newgpio;
+    history->next_event = history->num_events;
+}
+
+
+int history_seek(History *history, uint64_t cycle)
+{
+    CPU *cpu = history->cpu;
+    _history_recover(history);
+    if (cycle < history->checkpoints[0].state.inst_cycles || cycle > history->end_cycle)
+        return HISTORY_ERR_RANGE;
+
+    // Only go back to a checkpoint if it's actually closer than where we are
+    int index = _history_find(history, cycle);
+    if (cycle < cpu->inst_cycles || history->checkpoints[index].state.inst_cycles > cpu->inst_cycles) {
+        int err = _history_restore(history, index);
+        if (err != HISTORY_OK)
+            return err;
+    }
+
+    // Most of the way at full speed, stopping 1 short means even a 2 cycle instruction can't overshoot
+    if (cycle >= cpu->inst_cycles + 2)
+        _history_advance(history, cycle - 1, false);
+
+    // Then an instruction at a time, backing out of one that would go past
+    while (cpu->inst_cycles < cycle)
+    {
+        _history_apply_events(history);
+        CPUState before;
+        uint64_t read_seq = history->read_seq;
+        cpu_save_state(cpu, &before);
+        cpu_step(cpu);
+        if (cpu->inst_cycles > cycle) {
+            cpu_load_state(cpu, &before);
+            history->read_seq = read_seq;
+            break;
+        }
+    }
+    _history_apply_events(history);
+    return HISTORY_OK;
+}
+
+int history_step_back(History *history)
+{
+    _history_recover(history);
+    uint64_t now = history->cpu->inst_cycles;
+    if (now <= history->checkpoints[0].state.inst_cycles)
+        return HISTORY_ERR_RANGE;
+    return history_seek(history, now - 1);
+}
+
+int history_reverse_continue(History *history, int *reason)
+{
+    CPU *cpu = history->cpu;
+    _history_recover(history);
+    uint64_t now = cpu->inst_cycles;
+    *reason = STOP_CYCLES;
+    if (now <= history->checkpoints[0].state.inst_cycles || now > history->end_cycle)
+        return HISTORY_ERR_RANGE;
+
+    // Replay each interval going backwards, the last hit in the latest interval that has one is the one we want
+    int index = _history_find(history, now - 1);
+    for (; index >= 0; index--)
+    {
+        uint64_t segment_end = now;
+        if (index + 1 < history->num_checkpoints && history->checkpoints[index + 1].state.inst_cycles < now)
+            segment_end = history->checkpoints[index + 1].state.inst_cycles;
+
+        int err = _history_restore(history, index);
+        if (err != HISTORY_OK)
+            return err;
+
+        uint64_t hit = 0;
+        int hit_reason = STOP_CYCLES;
+        while (cpu->inst_cycles < segment_end)
+        {
+            int stop = _history_advance(history, segment_end, true);
+            if (stop != STOP_CYCLES && cpu->inst_cycles < now) {
+                hit = cpu->inst_cycles;
+                hit_reason = stop;
+            }
+        }
+        if (hit_reason != STOP_CYCLES) {
+            *reason = hit_reason;
+            return history_seek(history, hit);
+        }
+    }
+
+    // Nothing, so all the way back to the start
+    return history_seek(history, history->checkpoints[0].state.inst_cycles);
+}
+
+size_t history_memory(const History *history)
+{
+    return sizeof(History) + history->max_checkpoints * sizeof(Checkpoint)
+         + history->runs_capacity * sizeof(ReadRun) + history->events_capacity * sizeof(GpioEvent);
+}
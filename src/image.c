@@ -0,0 +1,202 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "instructions.h"
+
+// Everything after the header is covered by the checksum
+#define IMAGE_PAYLOAD_OFFSET offsetof(FirmwareImage, config)
+
+uint32_t image_checksum(const FirmwareImage *image)
+{
+    // FNV-1a, plenty for catching corruption and stale files
+    const uint8_t *bytes = (const uint8_t *)image + IMAGE_PAYLOAD_OFFSET;
+    size_t len = sizeof(FirmwareImage) - IMAGE_PAYLOAD_OFFSET;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void image_finalise(FirmwareImage *image)
+{
+    // Predecode everything and work out where control flow can land
+    for (int addr = 0; addr < IMAGE_WORDS; addr++)
+    {
+        image->ops[addr] = instruction_decode(image->inst[addr]);
+        image->word_flags[addr] &= IMAGE_WORD_PRESENT;
+    }
+    for (int addr = 0; addr < IMAGE_WORDS; addr++)
+    {
+        // Only page 0 exists on the 12f508, so the STATUS page bits don't matter here
+        uint16_t word = image->inst[addr];
+        switch (image->ops[addr]) {
+            case OP_GOTO:
+                image->word_flags[word & 0x1FF] |= IMAGE_WORD_JUMP_TARGET;
+                break;
+            case OP_CALL:
+                image->word_flags[word & 0xFF] |= IMAGE_WORD_CALL_TARGET;
+                break;
+            case OP_DECFSZ:
+            case OP_INCFSZ:
+            case OP_BTFSC:
+            case OP_BTFSS:
+                image->word_flags[(addr + 1) % IMAGE_WORDS] |= IMAGE_WORD_SKIPPABLE;
+                break;
+        }
+    }
+
+    image->checksum = image_checksum(image);
+}
+
+int image_from_hex(FirmwareImage *image, const HexImage *hex, uint8_t osccal)
+{
+    if (hex_validate(hex, IMAGE_WORDS) != HEX_OK)
+        return IMAGE_ERR_HEX;
+
+    memset(image, 0, sizeof(FirmwareImage));
+    image->magic = IMAGE_MAGIC;
+    image->version = IMAGE_VERSION;
+    image->num_words = IMAGE_WORDS;
+    image->size = sizeof(FirmwareImage);
+
+    // Unprogrammed flash reads as all ones, except the calibration MOVLW at the reset vector
+    image->osccal = osccal;
+    for (int addr = 0; addr < IMAGE_WORDS; addr++)
+    {
+        if (hex_word_present(hex, addr)) {
+            image->inst[addr] = hex->words[addr] & 0xFFF;
+            image->word_flags[addr] = IMAGE_WORD_PRESENT;
+        } else {
+            image->inst[addr] = 0xFFF;
+        }
+    }
+    if (!hex_word_present(hex, 0x1FF))
+        image->inst[0x1FF] = MOVLW | osccal;
+
+    // Same default as cpu_init() when the file doesn't set it
+    image->config = hex_word_present(hex, HEX_CONFIG_ADDR) ? hex->words[HEX_CONFIG_ADDR] : 0xFFF;
+
+    image_finalise(image);
+    return IMAGE_OK;
+}
+
+
+int image_write(const FirmwareImage *image, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return IMAGE_ERR_IO;
+
+    size_t written = fwrite(image, 1, sizeof(FirmwareImage), file);
+    if (fclose(file) != 0 || written != sizeof(FirmwareImage))
+        return IMAGE_ERR_IO;
+    return IMAGE_OK;
+}
+
+int image_validate(const FirmwareImage *image, size_t size)
+{
+    if (size < IMAGE_PAYLOAD_OFFSET || image->magic != IMAGE_MAGIC)
+        return IMAGE_ERR_FORMAT;
+    if (image->version != IMAGE_VERSION)
+        return IMAGE_ERR_VERSION;
+    if (size != sizeof(FirmwareImage) || image->size != sizeof(FirmwareImage) || image->num_words != IMAGE_WORDS)
+        return IMAGE_ERR_FORMAT;
+    if (image->checksum != image_checksum(image))
+        return IMAGE_ERR_CHECKSUM;
+    return IMAGE_OK;
+}
+
+const FirmwareImage *image_map(const char *path, int *err)
+{
+    int dummy;
+    if (err == NULL)
+        err = &dummy;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *err = IMAGE_ERR_IO;
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        *err = IMAGE_ERR_IO;
+        return NULL;
+    }
+    if ((size_t)st.st_size != sizeof(FirmwareImage)) {
+        close(fd);
+        *err = IMAGE_ERR_FORMAT;
+        return NULL;
+    }
+
+    // The mapping stays valid after the fd is closed
+    void *mapping = mmap(NULL, sizeof(FirmwareImage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        *err = IMAGE_ERR_IO;
+        return NULL;
+    }
+
+    const FirmwareImage *image = mapping;
+    *err = image_validate(image, st.st_size);
+    if (*err != IMAGE_OK) {
+        munmap(mapping, sizeof(FirmwareImage));
+        return NULL;
+    }
+    return image;
+}
+
+void image_unmap(const FirmwareImage *image)
+{
+    if (image != NULL)
+        munmap((void *)image, sizeof(FirmwareImage));
+}
+
+
+int image_attach(CPU *cpu, const FirmwareImage *image)
+{
+    if (cpu->device->program_words != IMAGE_WORDS)
+        return IMAGE_ERR_DEVICE;
+    if (!cpu->inst_shared)
+        free(cpu->inst);
+
+    // Casting away const, the CPU never writes to program memory itself
+    cpu->inst = (uint16_t *)image->inst;
+    cpu->inst_shared = true;
+    cpu->config = device_config(cpu->device, image->config);
+    
+    // It's a whole new program memory, so anything fetched or cached from the old one is stale
+    cpu->inst_generation++;
+    if (cpu->inst_change_callback) {
+        uint8_t changed[IMAGE_WORDS / 8];
+        memset(changed, 0xFF, sizeof(changed));
+        cpu->inst_change_callback(cpu, changed, IMAGE_WORDS);
+    }
+    return IMAGE_OK;
+}
+
+const char *image_strerror(int err)
+{
+    switch (err)
+    {
+        case IMAGE_OK:           return "OK";
+        case IMAGE_ERR_IO:       return "Failed to access image file";
+        case IMAGE_ERR_FORMAT:   return "Not a firmware image";
+        case IMAGE_ERR_VERSION:  return "Unsupported image version";
+        case IMAGE_ERR_CHECKSUM: return "Image checksum mismatch";
+        case IMAGE_ERR_HEX:      return "HEX data outside of program memory";
+        case IMAGE_ERR_DEVICE:   return "Image doesn't fit the device's program memory";
+    }
+    return "Unknown error";
+}
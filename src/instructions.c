@@ -3,7 +3,8 @@
 
 void instruction_cycle(CPU *cpu)
 {
-    // TODO: I might split this up into the actual 4 cycle / 2 stage pipeline
+    // The pipeline-accurate version of this lives in pipeline.c, this one does a whole instruction in one go
+    uint8_t cycles = 1;
     
     // Sleep handling
     if (cpu->asleep) {
@@ -13,7 +14,7 @@ void instruction_cycle(CPU *cpu)
     }
     
     // Fetch
-    cpu->pc &= 0x1FF;
+    cpu->pc &= cpu->device->program_words - 1;
     uint16_t instruction = cpu->inst[cpu->pc] & 0xFFF;
     
     // Skip if skip
@@ -26,6 +27,24 @@ void instruction_cycle(CPU *cpu)
         goto execute_end;
     }
     
+    // Decode + Execute
+    cycles = instruction_execute(cpu, instruction);
+
+// Dispatch exit point
+// Using goto so I don't have to have a mess of nested switch statements or an extra variable keeping track and such
+// Also goto is a C quirk, I like those :)
+execute_end:
+    cpu->pc++;
+    cpu->inst_cycles += cycles; // Counting cycles, Chekhov's Gun (I can't remember why I wrote this)
+    
+    // Timer0 and the WDT run off the instruction clock, so 2-cycle instructions tick them twice
+    instruction_tick(cpu);
+    if (cycles == 2)
+        instruction_tick(cpu);
+}
+
+uint8_t instruction_execute(CPU *cpu, uint16_t instruction)
+{
     // Decode opcodes
     uint16_t byte_opcode = instruction & 0xFC0;
     uint16_t blit_opcode = instruction & 0xF00; // Also for non-GOTO literals
@@ -48,164 +67,184 @@ void instruction_cycle(CPU *cpu)
     switch (instruction) {
         case CLRW:
             inst_CLRW(cpu);
-            goto execute_end;
+            return 1;
         case NOP:
             inst_NOP(cpu);
-            goto execute_end;
+            return 1;
         case CLRWDT:
             inst_CLRWDT(cpu);
-            goto execute_end;
+            return 1;
         case OPTION:
             inst_OPTION(cpu);
-            goto execute_end;
+            return 1;
         case SLEEP:
             inst_SLEEP(cpu);
-            goto execute_end;
+            return 1;
         case TRIS:
             inst_TRIS(cpu,6);
-            goto execute_end;
+            return 1;
     }
     // Byte level instructions next
     switch (byte_opcode) {
         case ADDWF:
             inst_ADDWF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case ANDWF:
             inst_ANDWF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case CLRF:
             if (d != 1) break; // d must be 1 for this
             inst_CLRF(cpu,f);
-            goto execute_end;
+            goto file_end;
         case COMF:
             inst_COMF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case DECF:
             inst_DECF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case DECFSZ:
             inst_DECFSZ(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case INCF:
             inst_INCF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case INCFSZ:
             inst_INCFSZ(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case IORWF:
             inst_IORWF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case MOVF:
             inst_MOVF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case MOVWF:
             if (d != 1) break; // d must be 1 for this
             inst_MOVWF(cpu,f);
-            goto execute_end;
+            goto file_end;
         case RLF:
             inst_RLF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case RRF:
             inst_RRF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case SUBWF:
             inst_SUBWF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case SWAPF:
             inst_SWAPF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
         case XORWF:
             inst_XORWF(cpu,f,d);
-            goto execute_end;
+            goto file_end;
     }
     // Bit level instructions now
     switch (blit_opcode) {
         case BCF:
             inst_BCF(cpu,f,b);
-            goto execute_end;
+            d = 1; // Always writes back
+            goto file_end;
         case BSF:
             inst_BSF(cpu,f,b);
-            goto execute_end;
+            d = 1;
+            goto file_end;
         case BTFSC:
             inst_BTFSC(cpu,f,b);
-            goto execute_end;
+            return 1;
         case BTFSS:
             inst_BTFSS(cpu,f,b);
-            goto execute_end;
+            return 1;
     }
     // Literal and control instructions finally
     switch (blit_opcode) {
         case ANDLW:
             inst_ANDLW(cpu,k);
-            goto execute_end;
+            return 1;
         case CALL:
             inst_CALL(cpu,k);
-            cpu->inst_cycles++; // CALL takes 2 cycles
-            goto execute_end;
+            return 2; // CALL takes 2 cycles
         case IORLW:
             inst_IORLW(cpu,k);
-            goto execute_end;
+            return 1;
         case MOVLW:
             inst_MOVLW(cpu,k);
-            goto execute_end;
+            return 1;
         case RETLW:
             inst_RETLW(cpu,k);
-            goto execute_end;
+            return 2; // So does RETLW
         case XORLW:
             inst_XORLW(cpu,k);
-            goto execute_end;
+            return 1;
     }
     // And goto with it's 3-bit length opcode
     if (goto_opcode == GOTO) {
         inst_GOTO(cpu,goto_k);
-        cpu->inst_cycles++; // GOTO also takes 2 cycles
-        goto execute_end;
+        return 2; // GOTO also takes 2 cycles
     }
     // If this is reached, we have an ILLEGAL INSTRUCTION!!!
-    printf("[WARN] Illegal Instruction!\n");
+    if (!cpu->quiet)
+        printf("[WARN] Illegal Instruction!\n");
+    return 1;
 
-// Dispatch exit point
-// Using goto so I don't have to have a mess of nested switch statements or an extra variable keeping track and such
-// Also goto is a C quirk, I like those :)
-execute_end:
-    cpu->pc++;
-    cpu->inst_cycles++; // Counting cycles, Chekhov's Gun (I can't remember why I wrote this)
-    
-    // Prescale time!
-    cpu->prescaler++;
-    
-    // Timer0 incrementing based on prescaler, adding 1 since prescaler 000 means 1:2
-    if ((cpu->option & PSA) == 0 && !cpu->asleep) {
-        if (cpu->timer0_inhibit > 0 && cpu->prescaler >= (1 << ((cpu->option & PS)+1))) {
-            cpu->prescaler = 0;
-            cpu->f[TMR0]++;
-        }
-        
-        // Inhibit timer0 for 2 cycles after write
-        if (cpu->timer0_inhibit > 0) {
-            cpu->timer0_inhibit--;
-            cpu->prescaler--; // Hack: Just decrement prescaler to pretend it didn't happen
-        }
+// Writing to PCL is a jump too, so it takes 2 cycles to refill the pipeline like GOTO
+file_end:
+    return (d == 1 && f == PCL) ? 2 : 1;
+}
+
+void instruction_tick(CPU *cpu)
+{
+    // Shared with the specialised engines in engine.c, which pass constants instead
+    instruction_tick_with(cpu, (cpu->option & (1 << TOCS)) == 0, (cpu->option & (1 << PSA)) != 0, (cpu->config & WDTE) != 0);
+}
+
+uint8_t instruction_decode(uint16_t instruction)
+{
+    // Same matching order as the dispatch in instruction_cycle(), so the two can never disagree
+    instruction &= 0xFFF;
+    switch (instruction) {
+        case CLRW:   return OP_CLRW;
+        case NOP:    return OP_NOP;
+        case CLRWDT: return OP_CLRWDT;
+        case OPTION: return OP_OPTION;
+        case SLEEP:  return OP_SLEEP;
+        case TRIS:   return OP_TRIS;
     }
-    // Same but for WDT (also we don't add 1 since prescaler 000 means 1:1)
-    else if ((cpu->option & PSA) != 0 && (cpu->config & WDTE) != 0) {
-        // 18,000 cycles per WDT timer increment (for a 1mhz instruction cycle rate)
-        // I'm not running a separate thread for the WDT so this is the best workaround I can think of
-        if (cpu->prescaler >= (1 << (cpu->option & PS))*18000) {
-            cpu->prescaler = 0;
-            cpu->wdt++;
-            
-            // WDT timeout handling
-            // Just checking for overflow, which it will be here if it's zero :)
-            if (cpu->wdt == 0)
-                if (!cpu->asleep)
-                    cpu_reset(cpu, RESET_WDT_NORMAL);
-                else
-                    cpu_reset(cpu, RESET_WDT_SLEEP);
-        }
+    
+    uint8_t d = (instruction >> 5) & 0x01;
+    switch (instruction & 0xFC0) {
+        case ADDWF:  return OP_ADDWF;
+        case ANDWF:  return OP_ANDWF;
+        case CLRF:   if (d == 1) return OP_CLRF; break;
+        case COMF:   return OP_COMF;
+        case DECF:   return OP_DECF;
+        case DECFSZ: return OP_DECFSZ;
+        case INCF:   return OP_INCF;
+        case INCFSZ: return OP_INCFSZ;
+        case IORWF:  return OP_IORWF;
+        case MOVF:   return OP_MOVF;
+        case MOVWF:  if (d == 1) return OP_MOVWF; break;
+        case RLF:    return OP_RLF;
+        case RRF:    return OP_RRF;
+        case SUBWF:  return OP_SUBWF;
+        case SWAPF:  return OP_SWAPF;
+        case XORWF:  return OP_XORWF;
+    }
+    
+    switch (instruction & 0xF00) {
+        case BCF:   return OP_BCF;
+        case BSF:   return OP_BSF;
+        case BTFSC: return OP_BTFSC;
+        case BTFSS: return OP_BTFSS;
+        case ANDLW: return OP_ANDLW;
+        case CALL:  return OP_CALL;
+        case IORLW: return OP_IORLW;
+        case MOVLW: return OP_MOVLW;
+        case RETLW: return OP_RETLW;
+        case XORLW: return OP_XORLW;
     }
     
-    return;
+    if ((instruction & 0xE00) == GOTO)
+        return OP_GOTO;
+    return OP_ILLEGAL;
 }
 
 // Byte-level Instructions
@@ -439,12 +478,11 @@ void inst_NOP(CPU *cpu)
 
 void inst_RLF(CPU *cpu, uint8_t f, uint8_t d)
 {
-    // Compute + set carry bit
+    // Compute + set carry bit, rotating through carry so the old carry ends up in bit 0
     uint8_t f_val = cpu_getreg(cpu,f);
-    uint8_t result = f_val;
+    uint8_t result = (f_val << 1) | (cpu->f[STATUS] & C);
     cpu->f[STATUS] &= ~C;
-    if (result >> 7 == 1) cpu->f[STATUS] |= C;
-    result <<= 1;
+    if (f_val >> 7 == 1) cpu->f[STATUS] |= C;
     
     // Verbosity!
     if (cpu->verbose)
@@ -458,12 +496,11 @@ void inst_RLF(CPU *cpu, uint8_t f, uint8_t d)
 
 void inst_RRF(CPU *cpu, uint8_t f, uint8_t d)
 {
-    // Compute + set carry bit
+    // Compute + set carry bit, the old carry goes into bit 7
     uint8_t f_val = cpu_getreg(cpu,f);
-    uint8_t result = f_val;
+    uint8_t result = (f_val >> 1) | ((cpu->f[STATUS] & C) << 7);
     cpu->f[STATUS] &= ~C;
-    if (result & 0x01 == 1) cpu->f[STATUS] |= C;
-    result >>= 1;
+    if ((f_val & 0x01) == 1) cpu->f[STATUS] |= C;
     
     // Verbosity!
     if (cpu->verbose)
@@ -584,7 +621,7 @@ void inst_BTFSC(CPU *cpu, uint8_t f, uint8_t b)
                 cpu->pc, f, f_val, b);
     
     // Test bit (skip if clear)!
-    if (f_val & (1 << b) == 0)
+    if ((f_val & (1 << b)) == 0)
         cpu->skipnext = true;
 }
 
@@ -598,7 +635,7 @@ void inst_BTFSS(CPU *cpu, uint8_t f, uint8_t b)
                 cpu->pc, f, f_val, b);
     
     // Test bit (skip if set)!
-    if (f_val & (1 << b) != 0)
+    if ((f_val & (1 << b)) != 0)
         cpu->skipnext = true;
 }
 
@@ -636,7 +673,7 @@ void inst_CALL(CPU *cpu, uint8_t k) // Two-Cycle
     // Call
     // PC<10:9> = STATUS<6:5>, PC<8> = 0, PC<7:0> = k
     cpu->pc = ((cpu->f[STATUS] & 0x60) << 4) | k;
-    cpu->pc--; // ONLY because PC is auto incremented later, will probably remove once cycle accuracy is done
+    cpu->pc--; // Both engines increment PC after executing, so land one short of the target
 }
 
 void inst_CLRWDT(CPU *cpu)
@@ -650,11 +687,11 @@ void inst_CLRWDT(CPU *cpu)
     cpu->wdt = 0;
     
     // And prescaler if assigned to it
-    if ((cpu->option & PSA) != 0 && (cpu->config & WDTE) != 0)
+    if ((cpu->option & (1 << PSA)) != 0 && (cpu->config & WDTE) != 0)
         cpu->prescaler = 0;
     
     // Status bits
-    cpu->f[STATUS] |= TO & PD;
+    cpu->f[STATUS] |= TO | PD;
 }
 
 void inst_GOTO(CPU *cpu, uint16_t k) // Two-Cycle
@@ -668,7 +705,7 @@ void inst_GOTO(CPU *cpu, uint16_t k) // Two-Cycle
     cpu->pc = ((cpu->f[STATUS] & 0x60) << 4) | (k & 0x1FF);
     
     // Take it back now y'all
-    cpu->pc--; // ONLY because PC is auto incremented later, will probably remove once cycle accuracy is done
+    cpu->pc--; // Both engines increment PC after executing, so land one short of the target
 }
 
 void inst_IORLW(CPU *cpu, uint8_t k)
@@ -713,6 +750,8 @@ void inst_OPTION(CPU *cpu)
     // Stuff that changes
     // Namely, reset the prescaler just in case
     cpu->prescaler = 0;
+    if (cpu->do_callback && cpu->option_write_callback)
+        cpu->option_write_callback(cpu, &cpu->option);
 }
 
 void inst_RETLW(CPU *cpu, uint8_t k)
@@ -726,7 +765,7 @@ void inst_RETLW(CPU *cpu, uint8_t k)
     cpu->w = k;
     
     // Pop off stack
-    cpu->pc = cpu->stack[0] - 1; // ONLY because PC is auto incremented later, will probably remove once cycle accuracy is done
+    cpu->pc = cpu->stack[0] - 1; // One short again, the engine increments it
     cpu->stack[0] = cpu->stack[1];
 }
 
@@ -748,12 +787,13 @@ void inst_SLEEP(CPU *cpu)
     
     // Snoozin' time!
     cpu->asleep = true;
+    cpu->f[STATUS] = (cpu->f[STATUS] | TO) & ~PD;
     
     // Clear watchdog timer
     cpu->wdt = 0;
     
     // And prescaler if assigned to it
-    if ((cpu->option & PSA) != 0 && (cpu->config & WDTE) != 0)
+    if ((cpu->option & (1 << PSA)) != 0 && (cpu->config & WDTE) != 0)
         cpu->prescaler = 0;
 }
 
@@ -764,9 +804,12 @@ void inst_TRIS(CPU *cpu, uint8_t k)
         printf("[%03u] TRIS: k=%u\n", 
                 cpu->pc, k);
     
-    // Do the thing
-    if (k == TRIS)
-        cpu->trisgpio = k;
+    // Do the thing, GPIO is the only port with a TRIS register
+    if (k == GPIO) {
+        cpu->trisgpio = cpu->w & cpu->device->pins;
+        if (cpu->do_callback && cpu->tris_write_callback)
+            cpu->tris_write_callback(cpu, &cpu->trisgpio);
+    }
 }
 
 void inst_XORLW(CPU *cpu, uint8_t k)
@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "live.h"
+#include "cpu.h"
+#include "memo.h"
+
+// Tries before live_read() gives up on a slot that's being written nonstop
+#define _LIVE_READ_TRIES 1000
+
+static size_t _live_size(int num_slots)
+{
+    return sizeof(LiveHeader) + (size_t)num_slots * sizeof(LiveSlot);
+}
+
+static uint64_t _live_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _live_unmap(Live *live)
+{
+    if (live->header != NULL)
+        munmap(live->header, _live_size(live->num_slots));
+    live->header = NULL;
+    live->slots = NULL;
+    live->num_slots = 0;
+}
+
+
+int live_create(Live *live, const char *name, int num_slots, uint64_t interval)
+{
+    memset(live, 0, sizeof(Live));
+    if (name == NULL || name[0] != '/' || strlen(name) >= sizeof(live->name) || num_slots < 1 || num_slots > LIVE_MAX_SLOTS)
+        return LIVE_ERR_ARG;
+
+    // A fresh one every time, anyone attached to an old one keeps that
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return LIVE_ERR_IO;
+    size_t size = _live_size(num_slots);
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return LIVE_ERR_IO;
+    }
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name);
+        return LIVE_ERR_IO;
+    }
+
+    // ftruncate() zeroes it, so every slot starts at seq 0 with nothing published
+    strcpy(live->name, name);
+    live->header = mapping;
+    live->slots = (LiveSlot *)(live->header + 1);
+    live->num_slots = num_slots;
+    live->interval = interval ? interval : LIVE_DEFAULT_INTERVAL;
+    live->owner = true;
+    live->header->version = LIVE_VERSION;
+    live->header->slot_size = LIVE_SLOT_SIZE;
+    live->header->num_slots = num_slots;
+    live->header->interval = live->interval;
+    // Last, a viewer attaching before this sees a bad magic and tries again later
+    __atomic_store_n(&live->header->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+    return LIVE_OK;
+}
+
+void live_destroy(Live *live)
+{
+    _live_unmap(live);
+    if (live->owner)
+        shm_unlink(live->name);
+    live->owner = false;
+}
+
+void live_publish(Live *live, int slot, const CPU *cpu)
+{
+    if (live->header == NULL || slot < 0 || slot >= live->num_slots)
+        return;
+    LiveSlot *s = &live->slots[slot];
+
+    // Only this thread ever writes the slot, so it's free to read it back
+    LiveState state;
+    memset(&state, 0, sizeof(LiveState));
+    state.cycles = cpu->inst_cycles;
+    state.wall_ns = _live_now_ns();
+    state.publishes = s->state.publishes + 1;
+    if (cpu->memo != NULL) {
+        state.memo_hits = cpu->memo->hits;
+        state.memo_cycles_skipped = cpu->memo->cycles_skipped;
+    }
+    state.pc = cpu->pc & (cpu->device->program_words - 1);
+    state.stack[0] = cpu->stack[0];
+    state.stack[1] = cpu->stack[1];
+    state.config = cpu->config;
+    state.w = cpu->w;
+    state.gpio = cpu->f[GPIO];
+    state.tris = cpu->trisgpio;
+    state.option = cpu->option;
+    state.asleep = cpu->asleep;
+    memcpy(state.f, cpu->f, sizeof(state.f));
+
+    // Odd, then the state, then even again, the fences keep the state's stores in between
+    uint32_t seq = s->seq;
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&s->state, &state, sizeof(LiveState));
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int live_run_cycles(Live *live, int slot, CPU *cpu, uint64_t max_cycles)
+{
+    uint64_t end = cpu->inst_cycles + max_cycles;
+    if (end < cpu->inst_cycles)
+        end = UINT64_MAX;
+    uint64_t interval = live->interval ? live->interval : LIVE_DEFAULT_INTERVAL;
+
+    // Stopping at the end of every chunk comes out the same as one long run, breakpoints get checked either way
+    int stop = STOP_CYCLES;
+    while (stop == STOP_CYCLES && cpu->inst_cycles < end)
+    {
+        stop = cpu_run_cycles(cpu, end - cpu->inst_cycles < interval ? end - cpu->inst_cycles : interval);
+        live_publish(live, slot, cpu);
+    }
+    if (max_cycles == 0)
+        live_publish(live, slot, cpu);
+    return stop;
+}
+
+
+int live_attach(Live *live, const char *name)
+{
+    memset(live, 0, sizeof(Live));
+    if (name == NULL || strlen(name) >= sizeof(live->name))
+        return LIVE_ERR_ARG;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return LIVE_ERR_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return LIVE_ERR_IO;
+    }
+    if ((size_t)st.st_size < sizeof(LiveHeader)) {
+        close(fd);
+        return LIVE_ERR_FORMAT;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return LIVE_ERR_IO;
+
+    // live_create() sizes it exactly, so anything else isn't one of ours
+    const LiveHeader *header = mapping;
+    int num_slots = header->num_slots;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != LIVE_MAGIC || header->version != LIVE_VERSION
+        || header->slot_size != LIVE_SLOT_SIZE || num_slots < 1 || num_slots > LIVE_MAX_SLOTS
+        || _live_size(num_slots) != (size_t)st.st_size) {
+        munmap(mapping, st.st_size);
+        return LIVE_ERR_FORMAT;
+    }
+
+    strcpy(live->name, name);
+    live->header = mapping;
+    live->slots = (LiveSlot *)(live->header + 1);
+    live->num_slots = num_slots;
+    live->interval = live->header->interval;
+    return LIVE_OK;
+}
+
+void live_detach(Live *live)
+{
+    _live_unmap(live);
+}
+
+bool live_read(const Live *live, int slot, LiveState *state)
+{
+    if (live->header == NULL || slot < 0 || slot >= live->num_slots)
+        return false;
+    const LiveSlot *s = &live->slots[slot];
+    for (int tries = 0; tries < _LIVE_READ_TRIES; tries++)
+    {
+        uint32_t before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue; // Mid-write
+        memcpy(state, &s->state, sizeof(LiveState));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == before)
+            return before != 0;
+    }
+    return false;
+}
+
+const char *live_strerror(int err)
+{
+    switch (err)
+    {
+        case LIVE_OK:         return "OK";
+        case LIVE_ERR_ARG:    return "Bad segment name, slot count or slot";
+        case LIVE_ERR_IO:     return "Failed to create, open or map the shared memory segment";
+        case LIVE_ERR_FORMAT: return "Not a live state segment";
+    }
+    return "Unknown error";
+}
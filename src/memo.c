@@ -0,0 +1,605 @@
+#include <stdlib.h>
+#include <string.h>
+#include "memo.h"
+#include "instructions.h"
+
+// Classification states
+#define _MEMO_NOT_DONE    0
+#define _MEMO_IN_PROGRESS 1
+#define _MEMO_DONE        2
+
+#define _MEMO_BIT(reg) ((uint64_t)1 << (reg))
+#define _MEMO_FLAGS    (_MEMO_BIT(MEMO_REG_C) | _MEMO_BIT(MEMO_REG_DC) | _MEMO_BIT(MEMO_REG_Z))
+
+#define _MEMO_HAS(set, addr) (((set)[(addr) >> 3] >> ((addr) & 7)) & 1)
+#define _MEMO_ADD(set, addr) ((set)[(addr) >> 3] |= 1 << ((addr) & 7))
+
+
+// Register access, with W and the flags as registers of their own
+
+static uint8_t _memo_get(const CPU *cpu, uint8_t reg)
+{
+    switch (reg)
+    {
+        case MEMO_REG_W:  return cpu->w;
+        case MEMO_REG_C:  return cpu->f[STATUS] & C;
+        case MEMO_REG_DC: return cpu->f[STATUS] & DC;
+        case MEMO_REG_Z:  return cpu->f[STATUS] & Z;
+        case STATUS:      return cpu->f[STATUS] & ~(C | DC | Z);
+    }
+    return cpu->f[reg];
+}
+
+static void _memo_set(CPU *cpu, uint8_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+        case MEMO_REG_W:  cpu->w = value; return;
+        case MEMO_REG_C:  cpu->f[STATUS] = (cpu->f[STATUS] & ~C) | value; return;
+        case MEMO_REG_DC: cpu->f[STATUS] = (cpu->f[STATUS] & ~DC) | value; return;
+        case MEMO_REG_Z:  cpu->f[STATUS] = (cpu->f[STATUS] & ~Z) | value; return;
+        case STATUS:      cpu->f[STATUS] = (cpu->f[STATUS] & (C | DC | Z)) | value; return;
+    }
+    cpu->f[reg] = value; // Only ever plain memory, FSR or OSCCAL, so the stored value goes straight back
+}
+
+
+// Classification
+
+// A whole register, STATUS being its flags plus the rest
+static uint64_t _memo_file(uint8_t f)
+{
+    if (f == STATUS)
+        return _MEMO_BIT(STATUS) | _MEMO_FLAGS;
+    return _MEMO_BIT(f);
+}
+
+// A single bit for BCF/BSF/BTFSC/BTFSS, which on STATUS only touches that one
+static uint64_t _memo_bit(uint8_t f, uint8_t b)
+{
+    if (f != STATUS)
+        return _MEMO_BIT(f);
+    switch (b)
+    {
+        case 0: return _MEMO_BIT(MEMO_REG_C);
+        case 1: return _MEMO_BIT(MEMO_REG_DC);
+        case 2: return _MEMO_BIT(MEMO_REG_Z);
+    }
+    return _MEMO_BIT(STATUS);
+}
+
+// What an instruction reads and writes, or why it makes a routine impure
+static int _memo_effects(uint8_t op, uint16_t word, uint64_t *reads, uint64_t *writes)
+{
+    uint8_t f = word & 0x1F;
+    uint8_t b = (word >> 5) & 0x07;
+    bool d = (word >> 5) & 1;
+    uint64_t file = _memo_file(f);
+    uint64_t dest = d ? file : _MEMO_BIT(MEMO_REG_W);
+    uint64_t w = _MEMO_BIT(MEMO_REG_W), z = _MEMO_BIT(MEMO_REG_Z), c = _MEMO_BIT(MEMO_REG_C);
+    *reads = *writes = 0;
+
+    switch (op)
+    {
+        case OP_ADDWF: case OP_ANDWF: case OP_CLRF: case OP_COMF: case OP_DECF: case OP_DECFSZ: case OP_INCF:
+        case OP_INCFSZ: case OP_IORWF: case OP_MOVF: case OP_MOVWF: case OP_RLF: case OP_RRF: case OP_SUBWF:
+        case OP_SWAPF: case OP_XORWF: case OP_BCF: case OP_BSF: case OP_BTFSC: case OP_BTFSS:
+            if (f == INDF || f == TMR0 || f == PCL || f == GPIO)
+                return MEMO_IO;
+    }
+
+    switch (op)
+    {
+        case OP_ADDWF: case OP_SUBWF:
+            *reads = w | file;
+            *writes = _MEMO_FLAGS | dest;
+            break;
+        case OP_ANDWF: case OP_IORWF: case OP_XORWF:
+            *reads = w | file;
+            *writes = z | dest;
+            break;
+        case OP_CLRF:
+            *writes = file | z;
+            break;
+        case OP_CLRW:
+            *writes = w | z;
+            break;
+        case OP_COMF: case OP_DECF: case OP_INCF: case OP_MOVF:
+            *reads = file;
+            *writes = z | dest;
+            break;
+        case OP_DECFSZ: case OP_INCFSZ: case OP_SWAPF:
+            *reads = file;
+            *writes = dest;
+            break;
+        case OP_MOVWF:
+            *reads = w;
+            *writes = file;
+            break;
+        case OP_RLF: case OP_RRF:
+            *reads = file | c;
+            *writes = c | dest;
+            break;
+        case OP_BCF: case OP_BSF:
+            // Anywhere but STATUS the other bits pass through, so it's a read too
+            *reads = f == STATUS ? 0 : file;
+            *writes = _memo_bit(f, b);
+            break;
+        case OP_BTFSC: case OP_BTFSS:
+            *reads = _memo_bit(f, b);
+            break;
+        case OP_ANDLW: case OP_IORLW: case OP_XORLW:
+            *reads = w;
+            *writes = w | z;
+            break;
+        case OP_MOVLW: case OP_RETLW:
+            *writes = w;
+            break;
+        case OP_NOP: case OP_GOTO: case OP_CALL:
+            break;
+        case OP_SLEEP: case OP_CLRWDT:
+            return MEMO_SLEEPS;
+        default:
+            return MEMO_IO; // OPTION, TRIS and illegal instructions (which print a warning)
+    }
+    return MEMO_PURE;
+}
+
+static int _memo_block_index(const Analysis *an, uint16_t start)
+{
+    for (int i = 0; i < an->num_blocks; i++)
+        if (an->blocks[i].start == start)
+            return i;
+    return -1;
+}
+
+// Per-block dataflow for one routine, blocks[] in the order they were found (the entry first)
+typedef struct MemoWork {
+    int blocks[ANALYSIS_WORDS];   // Index into an->blocks
+    int local[ANALYSIS_WORDS];    // an->blocks index -> position in blocks[], -1 if not in it
+    int succ[ANALYSIS_WORDS][2];
+    int num_succ[ANALYSIS_WORDS];
+    bool returns[ANALYSIS_WORDS]; // Ends in the RETLW
+    uint64_t use[ANALYSIS_WORDS]; // Read before being written
+    uint64_t def[ANALYSIS_WORDS]; // Always written
+    uint64_t may[ANALYSIS_WORDS]; // Maybe written (through a call)
+    uint64_t live[ANALYSIS_WORDS];
+    uint64_t must[ANALYSIS_WORDS];
+    uint64_t in[ANALYSIS_WORDS];
+} MemoWork;
+
+// Purity and dataflow for one routine, callees first
+static int _memo_classify(Memo *memo, int index, uint8_t *state)
+{
+    MemoRoutine *r = &memo->routines[index];
+    if (state[index] == _MEMO_DONE)
+        return r->purity;
+    if (state[index] == _MEMO_IN_PROGRESS)
+        return MEMO_RECURSIVE;
+    state[index] = _MEMO_IN_PROGRESS;
+
+    const Analysis *an = memo->analysis;
+    MemoWork *work = malloc(sizeof(MemoWork)); // Too big for the stack with callees nesting
+    int num_blocks = 0;
+    int purity = MEMO_PURE;
+    if (work == NULL) {
+        purity = MEMO_NO_RETURN;
+        goto classify_end;
+    }
+    int *blocks = work->blocks, *local = work->local, *num_succ = work->num_succ;
+    int (*succ)[2] = work->succ;
+    uint64_t *use = work->use, *def = work->def, *may = work->may, *live = work->live, *must = work->must;
+    bool *returns = work->returns;
+    for (int i = 0; i < an->num_blocks; i++)
+        local[i] = -1;
+
+    int first = _memo_block_index(an, r->entry);
+    if (first < 0) {
+        purity = MEMO_NO_RETURN;
+        goto classify_end;
+    }
+    blocks[num_blocks] = first;
+    local[first] = num_blocks++;
+
+    for (int i = 0; i < num_blocks && purity == MEMO_PURE; i++)
+    {
+        const AnalysisBlock *block = &an->blocks[blocks[i]];
+        use[i] = def[i] = may[i] = 0;
+        returns[i] = false;
+        for (uint16_t addr = block->start; addr < block->start + block->length && purity == MEMO_PURE; addr++)
+        {
+            uint64_t reads, writes;
+            _MEMO_ADD(r->words, addr);
+            purity = _memo_effects(an->ops[addr], an->inst[addr], &reads, &writes);
+            use[i] |= reads & ~def[i];
+            def[i] |= writes;
+            returns[i] = an->ops[addr] == OP_RETLW;
+            if (an->flags[addr] & ANALYSIS_COMPUTED_JUMP)
+                purity = MEMO_IO;
+        }
+        if (purity != MEMO_PURE)
+            break;
+        may[i] = def[i];
+
+        // A call is the callee's effects on top of the block's
+        if (block->calls) {
+            uint16_t last = block->start + block->length - 1;
+            int callee = memo->routine_at[an->inst[last] & 0xFF] - 1;
+            if (callee < 0) {
+                purity = MEMO_NO_RETURN;
+                break;
+            }
+            purity = _memo_classify(memo, callee, state);
+            if (purity != MEMO_PURE)
+                break;
+            const MemoRoutine *c = &memo->routines[callee];
+            use[i] |= c->inputs & ~def[i];
+            def[i] |= c->must_write;
+            may[i] |= c->outputs;
+            for (int byte = 0; byte < ANALYSIS_WORDS / 8; byte++)
+                r->words[byte] |= c->words[byte];
+        }
+
+        if (block->num_succ == 0 && !returns[i]) {
+            purity = MEMO_NO_RETURN; // SLEEP's already out, so this is a computed jump
+            break;
+        }
+        num_succ[i] = block->num_succ;
+        for (int j = 0; j < block->num_succ; j++)
+        {
+            int next = _memo_block_index(an, block->succ[j]);
+            if (next < 0) {
+                purity = MEMO_NO_RETURN;
+                break;
+            }
+            if (local[next] < 0) {
+                blocks[num_blocks] = next;
+                local[next] = num_blocks++;
+            }
+            succ[i][j] = local[next];
+        }
+    }
+    if (purity != MEMO_PURE)
+        goto classify_end;
+
+    // Live registers, backwards to a fixed point
+    bool changed = true;
+    for (int i = 0; i < num_blocks; i++)
+        live[i] = use[i];
+    while (changed)
+    {
+        changed = false;
+        for (int i = num_blocks - 1; i >= 0; i--)
+        {
+            uint64_t out = 0;
+            for (int j = 0; j < num_succ[i]; j++)
+                out |= live[succ[i][j]];
+            uint64_t in = use[i] | (out & ~def[i]);
+            if (in != live[i]) {
+                live[i] = in;
+                changed = true;
+            }
+        }
+    }
+
+    // Registers written on every way to each block's end, forwards
+    changed = true;
+    for (int i = 0; i < num_blocks; i++)
+        must[i] = ~(uint64_t)0;
+    while (changed)
+    {
+        changed = false;
+        uint64_t *in = work->in;
+        for (int i = 0; i < num_blocks; i++)
+            in[i] = ~(uint64_t)0;
+        in[0] = 0;
+        for (int i = 0; i < num_blocks; i++)
+            for (int j = 0; j < num_succ[i]; j++)
+                in[succ[i][j]] &= must[i];
+        in[0] = 0;
+        for (int i = 0; i < num_blocks; i++)
+        {
+            uint64_t out = in[i] | def[i];
+            if (out != must[i]) {
+                must[i] = out;
+                changed = true;
+            }
+        }
+    }
+
+    r->inputs = live[0];
+    r->outputs = 0;
+    r->must_write = ~(uint64_t)0;
+    for (int i = 0; i < num_blocks; i++)
+    {
+        r->outputs |= may[i];
+        if (returns[i])
+            r->must_write &= must[i];
+    }
+    r->must_write &= r->outputs;
+
+    // Anything only written on some paths passes through on the others, so it has to be part of the key
+    uint64_t key = r->inputs | (r->outputs & ~r->must_write);
+    r->key_size = r->out_size = 0;
+    for (int reg = 0; reg < MEMO_MAX_REGS; reg++)
+    {
+        if (key & _MEMO_BIT(reg))
+            r->key[r->key_size++] = reg;
+        if (r->outputs & _MEMO_BIT(reg))
+            r->out[r->out_size++] = reg;
+    }
+
+classify_end:
+    free(work);
+    r->purity = purity;
+    r->recording = purity == MEMO_PURE;
+    state[index] = _MEMO_DONE;
+    return purity;
+}
+
+
+// Running
+
+// Ticks that can go by before the WDT would reset the CPU (it only counts with the prescaler assigned to it)
+static uint64_t _memo_wdt_room(const CPU *cpu)
+{
+    if ((cpu->config & WDTE) == 0 || (cpu->option & (1 << PSA)) == 0)
+        return UINT64_MAX;
+    uint64_t period = (1u << (cpu->option & PS)) * 18000;
+    uint64_t first = cpu->prescaler + 1 >= period ? 1 : period - cpu->prescaler;
+    return first + (255 - cpu->wdt) * period - 1;
+}
+
+// Timer0, the prescaler and the WDT for cycles that got skipped, exactly like the engines would have
+static void _memo_tick(CPU *cpu, uint64_t cycles)
+{
+    bool tmr0 = (cpu->option & (1 << TOCS)) == 0;
+    bool wdt = (cpu->config & WDTE) != 0 && (cpu->option & (1 << PSA)) != 0;
+    if (!tmr0 && !wdt) {
+        cpu->prescaler += cycles; // All a tick does then
+        return;
+    }
+    for (uint64_t i = 0; i < cycles; i++)
+        instruction_tick(cpu);
+}
+
+static bool _memo_breakpoint_in(const CPU *cpu, const MemoRoutine *r)
+{
+    if (cpu->breakpoint >= 0 && cpu->breakpoint < ANALYSIS_WORDS && _MEMO_HAS(r->words, cpu->breakpoint))
+        return true;
+    if (cpu->breakpoints == NULL)
+        return false;
+    for (int byte = 0; byte < ANALYSIS_WORDS / 8; byte++)
+    {
+        if (r->words[byte] == 0)
+            continue;
+        for (int bit = 0; bit < 8; bit++)
+            if (((r->words[byte] >> bit) & 1) && cpu->breakpoints[byte * 8 + bit])
+                return true;
+    }
+    return false;
+}
+
+static MemoEntry *_memo_slot(Memo *memo, int index, const uint8_t *key, int size)
+{
+    uint32_t hash = 2166136261u ^ index;
+    hash *= 16777619u;
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+    return &memo->entries[hash & (memo->capacity - 1)];
+}
+
+// Runs the call for real from the CALL on, and records it if it makes it back
+static bool _memo_record(Memo *memo, int index, const uint8_t *key, MemoEntry *slot, uint64_t limit)
+{
+    CPU *cpu = memo->cpu;
+    MemoRoutine *r = &memo->routines[index - 1];
+    uint64_t start = cpu->inst_cycles;
+    uint64_t room = _memo_wdt_room(cpu);
+    if (room < 2)
+        return false;
+
+    // The stack followed along as where each slot came from, so it can be replayed at any call site
+    uint16_t stack[2] = { MEMO_STACK_FROM | 0, MEMO_STACK_FROM | 1 };
+    int depth = 0;
+    while (1)
+    {
+        uint8_t op = cpu->skipnext ? OP_NOP : instruction_decode(cpu->inst[cpu->pc & 0x1FF] & 0xFFF);
+        instruction_cycle(cpu);
+        if (op == OP_CALL) {
+            stack[1] = stack[0];
+            stack[0] = depth == 0 ? MEMO_STACK_FROM | 2 : cpu->stack[0];
+            depth++;
+        }
+        else if (op == OP_RETLW) {
+            stack[0] = stack[1];
+            depth--;
+        }
+        if (depth == 0)
+            break;
+        // Anything the engine has to deal with ends it here, part way through and unrecorded
+        if (cpu->inst_cycles >= limit || cpu->inst_cycles - start + 2 > room || cpu_atbreakpoint(cpu)
+            || cpu->watch_stop || cpu->yield)
+            return true;
+    }
+
+    uint64_t cycles = cpu->inst_cycles - start;
+    if (cycles > UINT32_MAX)
+        return true;
+
+    slot->routine = index;
+    memcpy(slot->key, key, r->key_size);
+    for (int i = 0; i < r->out_size; i++)
+        slot->out[i] = _memo_get(cpu, r->out[i]);
+    slot->stack[0] = stack[0];
+    slot->stack[1] = stack[1];
+    slot->cycles = cycles;
+    r->recorded++;
+    return true;
+}
+
+static void _memo_inst_change(CPU *cpu, const uint8_t *changed, int num_changed)
+{
+    Memo *memo = cpu->memo;
+    if (memo->inst_change_callback)
+        memo->inst_change_callback(cpu, changed, num_changed);
+    memo_refresh(memo);
+}
+
+
+int memo_init(Memo *memo, CPU *cpu, size_t capacity)
+{
+    memset(memo, 0, sizeof(Memo));
+    memo->cpu = cpu;
+    if (cpu->device != &device_pic12f508) // The analysis only knows its 512 words and 32 registers
+        return MEMO_ERR_DEVICE;
+    if (capacity == 0)
+        capacity = MEMO_DEFAULT_ENTRIES;
+    memo->capacity = 1;
+    while (memo->capacity < capacity)
+        memo->capacity *= 2;
+    memo->analysis = malloc(sizeof(Analysis));
+    memo->entries = calloc(memo->capacity, sizeof(MemoEntry));
+    if (memo->analysis == NULL || memo->entries == NULL) {
+        free(memo->analysis);
+        free(memo->entries);
+        memo->analysis = NULL;
+        memo->entries = NULL;
+        return MEMO_ERR_MEMORY;
+    }
+
+    memo->inst_change_callback = cpu->inst_change_callback;
+    cpu->inst_change_callback = _memo_inst_change;
+    cpu->memo = memo;
+    memo_refresh(memo);
+    return MEMO_OK;
+}
+
+void memo_deinit(Memo *memo)
+{
+    CPU *cpu = memo->cpu;
+    if (cpu->memo == memo) {
+        cpu->inst_change_callback = memo->inst_change_callback;
+        cpu->memo = NULL;
+    }
+    free(memo->analysis);
+    free(memo->entries);
+    memo->analysis = NULL;
+    memo->entries = NULL;
+}
+
+void memo_refresh(Memo *memo)
+{
+    Analysis *an = memo->analysis;
+    analysis_init(an);
+    analysis_run(an, memo->cpu->inst);
+
+    // Every CALL target, the reset vector isn't one
+    memset(memo->routine_at, 0, sizeof(memo->routine_at));
+    memo->num_routines = 0;
+    for (int i = 0; i < an->num_routines; i++)
+    {
+        if (an->routines[i].entry == ANALYSIS_RESET_VECTOR)
+            continue;
+        MemoRoutine *r = &memo->routines[memo->num_routines++];
+        memset(r, 0, sizeof(MemoRoutine));
+        r->entry = an->routines[i].entry;
+        memo->routine_at[r->entry] = memo->num_routines;
+    }
+
+    uint8_t state[MEMO_MAX_ROUTINES] = {0};
+    for (int i = 0; i < memo->num_routines; i++)
+        _memo_classify(memo, i, state);
+    memo_clear(memo);
+}
+
+void memo_clear(Memo *memo)
+{
+    memset(memo->entries, 0, memo->capacity * sizeof(MemoEntry));
+    for (int i = 0; i < memo->num_routines; i++)
+    {
+        MemoRoutine *r = &memo->routines[i];
+        r->calls = r->hits = r->recorded = 0;
+        r->recording = r->purity == MEMO_PURE;
+    }
+    memo->hits = memo->misses = memo->cycles_skipped = 0;
+}
+
+bool memo_call(Memo *memo, uint64_t limit)
+{
+    CPU *cpu = memo->cpu;
+    uint16_t pc = cpu->pc & 0x1FF;
+    uint16_t target = ((((cpu->f[STATUS] & 0x60) << 4) | (cpu->inst[pc] & 0xFF))) & 0x1FF;
+    int index = memo->routine_at[target];
+    if (index == 0 || memo->routines[index - 1].purity != MEMO_PURE)
+        return false;
+    MemoRoutine *r = &memo->routines[index - 1];
+    r->calls++;
+
+    uint8_t key[MEMO_MAX_REGS];
+    for (int i = 0; i < r->key_size; i++)
+        key[i] = _memo_get(cpu, r->key[i]);
+    MemoEntry *slot = _memo_slot(memo, index, key, r->key_size);
+
+    if (slot->routine == index && memcmp(slot->key, key, r->key_size) == 0) {
+        // Only if nothing could have happened part way through
+        if (cpu->inst_cycles + slot->cycles > limit || slot->cycles > _memo_wdt_room(cpu)
+            || (cpu->watch_mask & (uint32_t)r->outputs) != 0 || _memo_breakpoint_in(cpu, r))
+            return false;
+
+        for (int i = 0; i < r->out_size; i++)
+            _memo_set(cpu, r->out[i], slot->out[i]);
+        uint16_t from[3] = { cpu->stack[0], cpu->stack[1], cpu->pc + 1 };
+        for (int i = 0; i < 2; i++)
+            cpu->stack[i] = slot->stack[i] & MEMO_STACK_FROM ? from[slot->stack[i] & 3] : slot->stack[i];
+        cpu->pc = from[2];
+        cpu->inst_cycles += slot->cycles;
+        _memo_tick(cpu, slot->cycles);
+        r->hits++;
+        memo->hits++;
+        memo->cycles_skipped += slot->cycles;
+        return true;
+    }
+
+    memo->misses++;
+    if (!r->recording)
+        return false;
+    if (r->calls >= MEMO_PROFILE_CALLS && r->hits * MEMO_MIN_HIT_RATIO < r->calls) {
+        r->recording = false; // Not paying for itself
+        return false;
+    }
+    return _memo_record(memo, index, key, slot, limit);
+}
+
+const MemoRoutine *memo_routine(const Memo *memo, uint16_t entry)
+{
+    int index = memo->routine_at[entry & 0x1FF];
+    return index ? &memo->routines[index - 1] : NULL;
+}
+
+const char *memo_purity_name(int purity)
+{
+    switch (purity)
+    {
+        case MEMO_PURE:      return "pure";
+        case MEMO_IO:        return "does I/O";
+        case MEMO_SLEEPS:    return "sleeps or clears the WDT";
+        case MEMO_NO_RETURN: return "doesn't always return";
+        case MEMO_RECURSIVE: return "recursive";
+    }
+    return "unknown";
+}
+
+const char *memo_strerror(int err)
+{
+    switch (err)
+    {
+        case MEMO_OK:         return "OK";
+        case MEMO_ERR_MEMORY: return "Out of memory";
+        case MEMO_ERR_DEVICE: return "Only the PIC12F508 can be memoised";
+    }
+    return "Unknown error";
+}
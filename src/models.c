@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "models.h"
+
+// Button
+static void _button_apply(Button *button)
+{
+    if (button->closed)
+        bench_drive(&button->base, button->pin, button->active_low ? 0 : button->pin);
+    else
+        bench_release(&button->base, button->pin);
+}
+
+static void _button_schedule_bounce(Button *button, Bench *bench)
+{
+    // Anywhere from none to twice the average gap, so the bounces take about bounce_cycles in total
+    uint32_t span = 2 * button->bounce_cycles / BUTTON_BOUNCES;
+    button->seed = button->seed * 1103515245 + 12345;
+    uint32_t gap = span ? (button->seed >> 16) % span + 1 : 1;
+    bench_schedule(&button->base, bench_now(bench) + gap);
+}
+
+static void _button_timer(Peripheral *p, Bench *bench)
+{
+    Button *button = (Button *)p;
+    if (--button->bounces_left > 0) {
+        button->closed = !button->closed;
+        _button_schedule_bounce(button, bench);
+    }
+    else
+        button->closed = button->pressed;
+    _button_apply(button);
+}
+
+static const PeripheralOps button_ops = {"button", NULL, _button_timer};
+
+void button_init(Button *button, uint8_t pin, bool active_low, uint32_t bounce_cycles)
+{
+    bench_init_peripheral(&button->base, &button_ops, 0);
+    button->pin = pin;
+    button->active_low = active_low;
+    button->bounce_cycles = bounce_cycles;
+    button->pressed = false;
+    button->closed = false;
+    button->bounces_left = 0;
+    button->seed = 0xB0B;
+}
+
+void button_set(Button *button, Bench *bench, bool pressed)
+{
+    if (pressed == button->pressed)
+        return;
+    button->pressed = pressed;
+    if (button->bounce_cycles == 0) {
+        button->closed = pressed;
+        _button_apply(button);
+    }
+    else {
+        // Contacts touch straight away, then chatter for a bit
+        button->closed = !button->closed;
+        button->bounces_left = BUTTON_BOUNCES;
+        _button_apply(button);
+        _button_schedule_bounce(button, bench);
+    }
+    bench_update(bench);
+}
+
+
+// LED
+static void _led_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed)
+{
+    Led *led = (Led *)p;
+    bool lit = ((pins & led->pin) != 0) != led->active_low;
+    uint64_t now = bench_now(bench);
+    if (changed == 0) {
+        led->lit = lit;
+        led->changed_at = now;
+        return;
+    }
+    if (lit == led->lit)
+        return;
+    if (led->lit)
+        led->lit_cycles += now - led->changed_at;
+    led->lit = lit;
+    led->changed_at = now;
+    led->toggles++;
+}
+
+static const PeripheralOps led_ops = {"led", _led_pins_changed, NULL};
+
+void led_init(Led *led, uint8_t pin, bool active_low)
+{
+    bench_init_peripheral(&led->base, &led_ops, pin);
+    led->pin = pin;
+    led->active_low = active_low;
+    led->lit = false;
+    led->changed_at = 0;
+    led->lit_cycles = 0;
+    led->toggles = 0;
+}
+
+uint64_t led_lit_cycles(const Led *led, const Bench *bench)
+{
+    return led->lit_cycles + (led->lit ? bench_now(bench) - led->changed_at : 0);
+}
+
+
+// Shift register
+static void _shift_register_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed)
+{
+    ShiftRegister *sr = (ShiftRegister *)p;
+    (void)bench;
+    if ((changed & sr->clock) && (pins & sr->clock)) {
+        sr->shift = (sr->shift << 1) | ((pins & sr->data) != 0);
+        if (sr->serial_out)
+            bench_drive(p, sr->serial_out, (sr->shift & 0x80) ? sr->serial_out : 0);
+    }
+    if ((changed & sr->latch) && (pins & sr->latch)) {
+        sr->outputs = sr->shift;
+        sr->latches++;
+    }
+}
+
+static const PeripheralOps shift_register_ops = {"shift register", _shift_register_pins_changed, NULL};
+
+void shift_register_init(ShiftRegister *sr, uint8_t data, uint8_t clock, uint8_t latch, uint8_t serial_out)
+{
+    bench_init_peripheral(&sr->base, &shift_register_ops, clock | latch); // Data only matters on a clock edge
+    sr->data = data;
+    sr->clock = clock;
+    sr->latch = latch;
+    sr->serial_out = serial_out;
+    sr->shift = 0;
+    sr->outputs = 0;
+    sr->latches = 0;
+    if (serial_out)
+        bench_drive(&sr->base, serial_out, 0);
+}
+
+
+// RC delay
+static void _rc_delay_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed)
+{
+    RcDelay *rc = (RcDelay *)p;
+    rc->target = (pins & rc->input) != 0;
+    if (changed == 0) {
+        // Starts out settled
+        bench_drive(p, rc->output, rc->target ? rc->output : 0);
+        return;
+    }
+    bench_schedule(p, bench_now(bench) + rc->delay);
+}
+
+static void _rc_delay_timer(Peripheral *p, Bench *bench)
+{
+    RcDelay *rc = (RcDelay *)p;
+    (void)bench;
+    bench_drive(p, rc->output, rc->target ? rc->output : 0);
+}
+
+static const PeripheralOps rc_delay_ops = {"rc delay", _rc_delay_pins_changed, _rc_delay_timer};
+
+void rc_delay_init(RcDelay *rc, uint8_t input, uint8_t output, uint64_t delay)
+{
+    bench_init_peripheral(&rc->base, &rc_delay_ops, input);
+    rc->input = input;
+    rc->output = output;
+    rc->delay = delay;
+    rc->target = false;
+}
+
+
+// Pulls
+static const PeripheralOps pull_ops = {"pull", NULL, NULL};
+
+void pull_init(Pull *pull, uint8_t pins, bool high)
+{
+    bench_init_peripheral(&pull->base, &pull_ops, 0);
+    pull->base.pull_mask = pins;
+    pull->base.pull_value = high ? pins : 0;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include "pipeline.h"
+#include "instructions.h"
+
+void pipeline_init(Pipeline *pipe)
+{
+    pipe->ir = 0;
+    pipe->ir_addr = 0;
+    pipe->ir_generation = 0;
+    pipe->ir_valid = false;
+    pipe->flush = false;
+
+    pipe->q = 0;
+    pipe->exec_cycles = 1;
+    pipe->gpio_written = false;
+    pipe->gpio_write_callback = NULL;
+
+    pipe->q_callback = NULL;
+    pipe->q_cycles = 0;
+}
+
+static void _pipeline_fetch(CPU *cpu, Pipeline *pipe)
+{
+    pipe->ir_addr = cpu->pc & (cpu->device->program_words - 1);
+    pipe->ir = cpu->inst[pipe->ir_addr] & 0xFFF;
+    pipe->ir_generation = cpu->inst_generation;
+    pipe->ir_valid = true;
+}
+
+// Stand-in write callback during Q2, the real one gets called at Q4
+static void _pipeline_hold_write(CPU *cpu, uint8_t *gpio)
+{
+    (void)gpio; // Still in f[GPIO], the real callback gets it from there
+    cpu->pipeline->gpio_written = true;
+}
+
+static void _pipeline_q1(CPU *cpu, Pipeline *pipe)
+{
+    // PC moved under us (reset, wake-up, host poking it) or the program was reloaded, so the latch is stale
+    // Real hardware would refetch too, we just don't charge a cycle for it to stay in step with instruction_cycle()
+    if (!pipe->flush && (!pipe->ir_valid || pipe->ir_addr != (cpu->pc & (cpu->device->program_words - 1)) || pipe->ir_generation != cpu->inst_generation))
+        _pipeline_fetch(cpu, pipe);
+    pipe->exec_cycles = 1;
+    pipe->gpio_written = false;
+}
+
+static void _pipeline_q2(CPU *cpu, Pipeline *pipe)
+{
+    // Forced NOP while the branch target is fetched
+    if (pipe->flush) {
+        if (cpu->verbose)
+            printf("FLUSH\n");
+        return;
+    }
+    if (cpu->asleep)
+        return;
+
+    // Skipped instructions still go through the pipeline, just as a NOP
+    if (cpu->skipnext) {
+        if (cpu->verbose)
+            printf("STALL\n");
+        cpu->skipnext = false;
+        inst_NOP(cpu);
+        return;
+    }
+
+    // Inputs get sampled by the handler right now, outputs wait for Q4
+    cpu->pc &= cpu->device->program_words - 1;
+    pipe->gpio_write_callback = cpu->gpio_write_callback;
+    if (pipe->gpio_write_callback)
+        cpu->gpio_write_callback = _pipeline_hold_write;
+    pipe->exec_cycles = instruction_execute(cpu, pipe->ir);
+    cpu->gpio_write_callback = pipe->gpio_write_callback;
+}
+
+static void _pipeline_q4(CPU *cpu, Pipeline *pipe)
+{
+    // Drive the pins
+    if (pipe->gpio_written && cpu->gpio_write_callback)
+        cpu->gpio_write_callback(cpu, &cpu->f[GPIO]);
+
+    if (pipe->flush) {
+        // The branch target has been fetched now, PC was already moved by the branch
+        pipe->flush = false;
+        _pipeline_fetch(cpu, pipe);
+    } else {
+        cpu->pc++;
+        if (pipe->exec_cycles == 2)
+            pipe->flush = true; // Whatever was prefetched is from the wrong address
+        else
+            _pipeline_fetch(cpu, pipe);
+    }
+
+    cpu->inst_cycles++;
+    instruction_tick(cpu);
+}
+
+void pipeline_qstep(CPU *cpu)
+{
+    Pipeline *pipe = cpu->pipeline;
+    uint8_t q = pipe->q;
+
+    if (pipe->q_callback)
+        pipe->q_callback(cpu, q + 1);
+
+    switch (q) {
+        case 0:
+            _pipeline_q1(cpu, pipe);
+            break;
+        case 1:
+            _pipeline_q2(cpu, pipe);
+            break;
+        case 2:
+            // Q3 is all ALU, nothing visible happens
+            break;
+        case 3:
+            _pipeline_q4(cpu, pipe);
+            break;
+    }
+
+    pipe->q = (q + 1) & 3;
+    pipe->q_cycles++;
+}
+
+void pipeline_cycle(CPU *cpu)
+{
+    do {
+        pipeline_qstep(cpu);
+    } while (cpu->pipeline->q != 0);
+}
+
+void pipeline_step(CPU *cpu)
+{
+    // Finish whatever cycle we're in the middle of, then keep going through any flush
+    pipeline_cycle(cpu);
+    while (cpu->pipeline->flush)
+        pipeline_cycle(cpu);
+}
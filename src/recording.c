@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "recording.h"
+
+static uint32_t _recording_checksum(const CPU *cpu)
+{
+    // FNV-1a again, same as the images, starting from the part so another one's recordings don't match
+    uint32_t hash = 2166136261u;
+    hash ^= cpu->device->index;
+    hash *= 16777619u;
+    for (int i = 0; i < cpu->device->program_words; i++)
+    {
+        hash ^= cpu->inst[i] & 0xFF;
+        hash *= 16777619u;
+        hash ^= cpu->inst[i] >> 8;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+// Writing
+static void _recording_flush(Recording *rec)
+{
+    if (rec->buffer_len > 0 && fwrite(rec->buffer, 1, rec->buffer_len, rec->file) != rec->buffer_len)
+        rec->failed = true;
+    rec->buffer_len = 0;
+}
+
+static void _recording_write(Recording *rec, int kind, uint8_t value)
+{
+    // Longest record is a 10 byte varint and the value
+    if (rec->buffer_len + 11 > RECORDING_BUFFER)
+        _recording_flush(rec);
+
+    uint64_t now = rec->cpu->inst_cycles;
+    uint64_t tag = ((now - rec->last_cycle) << 2) | kind;
+    rec->last_cycle = now;
+    do
+    {
+        uint8_t byte = tag & 0x7F;
+        tag >>= 7;
+        rec->buffer[rec->buffer_len++] = byte | (tag ? 0x80 : 0);
+    } while (tag);
+    if (kind != RECORDING_END)
+        rec->buffer[rec->buffer_len++] = value;
+    rec->num_records++;
+}
+
+static void _recording_read(CPU *cpu, uint8_t *gpio)
+{
+    Recording *rec = cpu->recording;
+    rec->gpio_read_callback(cpu, gpio);
+    if (!rec->have_read || *gpio != rec->last_read) {
+        _recording_write(rec, RECORDING_READ, *gpio);
+        rec->have_read = true;
+        rec->last_read = *gpio;
+    }
+}
+
+void recording_log_set(Recording *rec, uint8_t newgpio)
+{
+    if (rec->mode == RECORDING_RECORD)
+        _recording_write(rec, RECORDING_SET, newgpio);
+}
+
+
+// Reading
+// Decodes up to RECORDING_BATCH more records of the stream's kind, false if there weren't any
+static bool _recording_decode(Recording *rec, RecordingStream *stream)
+{
+    stream->num_events = 0;
+    stream->next_event = 0;
+    while (!stream->ended && stream->num_events < RECORDING_BATCH)
+    {
+        uint64_t tag = 0;
+        int shift = 0;
+        while (1)
+        {
+            if (stream->pos >= rec->data_len || shift > 63) {
+                stream->ended = true; // Truncated, whatever was there still gets replayed
+                return stream->num_events > 0;
+            }
+            uint8_t byte = rec->data[stream->pos++];
+            tag |= (uint64_t)(byte & 0x7F) << shift;
+            shift += 7;
+            if (!(byte & 0x80))
+                break;
+        }
+
+        int kind = tag & 3;
+        stream->cycle += tag >> 2;
+        if (kind == RECORDING_END) {
+            stream->ended = true;
+            rec->end_cycle = stream->cycle;
+            break;
+        }
+        if (stream->pos >= rec->data_len) {
+            stream->ended = true;
+            break;
+        }
+        uint8_t value = rec->data[stream->pos++];
+        if (kind == stream->kind) {
+            stream->events[stream->num_events].cycle = stream->cycle;
+            stream->events[stream->num_events++].value = value;
+        }
+    }
+    return stream->num_events > 0;
+}
+
+// The next event in the stream, NULL once there aren't any more
+static const RecordingEvent *_recording_peek(Recording *rec, RecordingStream *stream)
+{
+    if (stream->next_event == stream->num_events && !_recording_decode(rec, stream))
+        return NULL;
+    return &stream->events[stream->next_event];
+}
+
+static void _recording_replay_read(CPU *cpu, uint8_t *gpio)
+{
+    // Reads happen at the same cycles as they did while recording, so the latest change at or before now is the one
+    Recording *rec = cpu->recording;
+    const RecordingEvent *event;
+    while ((event = _recording_peek(rec, &rec->reads)) != NULL && event->cycle <= cpu->inst_cycles)
+    {
+        rec->read_value = event->value;
+        rec->reads.next_event++;
+    }
+    *gpio = rec->read_value;
+}
+
+static void _recording_apply_sets(Recording *rec)
+{
+    CPU *cpu = rec->cpu;
+    const RecordingEvent *event;
+    while ((event = _recording_peek(rec, &rec->sets)) != NULL && event->cycle <= cpu->inst_cycles)
+    {
+        rec->sets.next_event++;
+        cpu_setgpio(cpu, event->value);
+    }
+}
+
+
+int recording_start(Recording *rec, CPU *cpu, const char *path)
+{
+    memset(rec, 0, sizeof(Recording));
+    rec->file = fopen(path, "wb");
+    if (rec->file == NULL)
+        return RECORDING_ERR_IO;
+
+    RecordingHeader header;
+    memset(&header, 0, sizeof(header)); // Padding too, so the same run always makes the same file
+    header.magic = RECORDING_MAGIC;
+    header.version = RECORDING_VERSION;
+    header.state_size = sizeof(CPUState);
+    header.program_checksum = _recording_checksum(cpu);
+    header.flags = cpu->gpio_read_callback ? RECORDING_FLAG_READS : 0;
+    cpu_save_state(cpu, &header.state);
+    if (fwrite(&header, sizeof(header), 1, rec->file) != 1) {
+        fclose(rec->file);
+        return RECORDING_ERR_IO;
+    }
+
+    rec->cpu = cpu;
+    rec->mode = RECORDING_RECORD;
+    rec->buffer = malloc(RECORDING_BUFFER);
+    rec->last_cycle = cpu->inst_cycles;
+
+    // No read callback means reads are deterministic, nothing to log
+    rec->gpio_read_callback = cpu->gpio_read_callback;
+    if (cpu->gpio_read_callback)
+        cpu->gpio_read_callback = _recording_read;
+    cpu->recording = rec;
+    return RECORDING_OK;
+}
+
+int recording_stop(Recording *rec)
+{
+    CPU *cpu = rec->cpu;
+    _recording_write(rec, RECORDING_END, 0);
+    _recording_flush(rec);
+    if (fclose(rec->file) != 0)
+        rec->failed = true;
+    free(rec->buffer);
+
+    cpu->gpio_read_callback = rec->gpio_read_callback;
+    cpu->recording = NULL;
+    rec->mode = RECORDING_OFF;
+    return rec->failed ? RECORDING_ERR_IO : RECORDING_OK;
+}
+
+
+int recording_replay(Recording *rec, CPU *cpu, const char *path)
+{
+    memset(rec, 0, sizeof(Recording));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return RECORDING_ERR_IO;
+
+    // Small enough to just load the lot
+    RecordingHeader header;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < (long)sizeof(header) || fread(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return size < 0 ? RECORDING_ERR_IO : RECORDING_ERR_FORMAT;
+    }
+    if (header.magic != RECORDING_MAGIC || header.state_size != sizeof(CPUState)) {
+        fclose(file);
+        return RECORDING_ERR_FORMAT;
+    }
+    if (header.version != RECORDING_VERSION) {
+        fclose(file);
+        return RECORDING_ERR_VERSION;
+    }
+    if (header.program_checksum != _recording_checksum(cpu)) {
+        fclose(file);
+        return RECORDING_ERR_PROGRAM;
+    }
+
+    rec->data_len = size - sizeof(header);
+    rec->data = malloc(rec->data_len ? rec->data_len : 1);
+    if (fread(rec->data, 1, rec->data_len, file) != rec->data_len) {
+        fclose(file);
+        free(rec->data);
+        return RECORDING_ERR_IO;
+    }
+    fclose(file);
+
+    rec->cpu = cpu;
+    rec->mode = RECORDING_REPLAY;
+    rec->end_cycle = UINT64_MAX;
+    rec->reads.kind = RECORDING_READ;
+    rec->sets.kind = RECORDING_SET;
+    rec->reads.cycle = rec->sets.cycle = header.state.inst_cycles;
+    rec->reads.events = malloc(RECORDING_BATCH * sizeof(RecordingEvent));
+    rec->sets.events = malloc(RECORDING_BATCH * sizeof(RecordingEvent));
+
+    // Either way there's nothing of the host's to call, without a callback back then reads were deterministic
+    cpu_load_state(cpu, &header.state);
+    rec->read_value = cpu->f[GPIO] & cpu->device->pins;
+    rec->gpio_read_callback = cpu->gpio_read_callback;
+    cpu->gpio_read_callback = header.flags & RECORDING_FLAG_READS ? _recording_replay_read : NULL;
+    cpu->recording = rec;
+    return RECORDING_OK;
+}
+
+int recording_run(Recording *rec, uint64_t max_cycles)
+{
+    CPU *cpu = rec->cpu;
+    uint64_t end = cpu->inst_cycles + max_cycles;
+    if (end < cpu->inst_cycles)
+        end = UINT64_MAX;
+
+    while (1)
+    {
+        _recording_apply_sets(rec);
+
+        // Looking for the next set finds the end record once they run out
+        const RecordingEvent *next = _recording_peek(rec, &rec->sets);
+        uint64_t until = end < rec->end_cycle ? end : rec->end_cycle;
+        if (cpu->inst_cycles >= until)
+            return STOP_CYCLES;
+        if (next != NULL && next->cycle < until)
+            until = next->cycle;
+
+        int reason = cpu_run_cycles(cpu, until - cpu->inst_cycles);
+        if (reason != STOP_CYCLES)
+            return reason;
+    }
+}
+
+bool recording_done(const Recording *rec)
+{
+    return rec->cpu->inst_cycles >= rec->end_cycle;
+}
+
+void recording_close(Recording *rec)
+{
+    CPU *cpu = rec->cpu;
+    cpu->gpio_read_callback = rec->gpio_read_callback;
+    cpu->recording = NULL;
+    rec->mode = RECORDING_OFF;
+    free(rec->data);
+    free(rec->reads.events);
+    free(rec->sets.events);
+}
+
+
+const char *recording_strerror(int err)
+{
+    switch (err)
+    {
+        case RECORDING_OK:          return "OK";
+        case RECORDING_ERR_IO:      return "Failed to access recording file";
+        case RECORDING_ERR_FORMAT:  return "Not a recording";
+        case RECORDING_ERR_VERSION: return "Unsupported recording version";
+        case RECORDING_ERR_PROGRAM: return "Recording was made with different program memory or another part";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "savestate.h"
+#include "cpu.h"
+
+// Everything after the header is covered by the checksum
+#define SAVESTATE_PAYLOAD_OFFSET offsetof(SaveState, program_hash)
+
+uint32_t savestate_checksum(const SaveState *save)
+{
+    // FNV-1a, same as images
+    const uint8_t *bytes = (const uint8_t *)save + SAVESTATE_PAYLOAD_OFFSET;
+    size_t len = sizeof(SaveState) - SAVESTATE_PAYLOAD_OFFSET;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint64_t savestate_program_hash(const uint16_t *inst, int num_words)
+{
+    // 64-bit FNV-1a, a word at a time in a fixed byte order so it doesn't depend on the host
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int addr = 0; addr < num_words; addr++)
+    {
+        uint16_t word = inst[addr] & 0xFFF;
+        hash = (hash ^ (word & 0xFF)) * 0x100000001B3ull;
+        hash = (hash ^ (word >> 8)) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+void savestate_from_cpu(SaveState *save, const CPU *cpu)
+{
+    CPUState state;
+    cpu_save_state(cpu, &state);
+
+    memset(save, 0, sizeof(SaveState));
+    save->magic = SAVESTATE_MAGIC;
+    save->version = SAVESTATE_VERSION;
+    save->size = sizeof(SaveState);
+    save->program_hash = savestate_program_hash(cpu->inst, cpu->device->program_words);
+    save->inst_cycles = state.inst_cycles;
+    save->prescaler = state.prescaler;
+    save->pc = state.pc;
+    save->config = state.config;
+    save->stack[0] = state.stack[0];
+    save->stack[1] = state.stack[1];
+    save->w = state.w;
+    save->trisgpio = state.trisgpio;
+    save->option = state.option;
+    save->timer0_inhibit = state.timer0_inhibit;
+    save->wdt = state.wdt;
+    save->skipnext = state.skipnext;
+    save->asleep = state.asleep;
+    save->device = cpu->device->index;
+    memcpy(save->f, state.f, sizeof(save->f));
+    save->checksum = savestate_checksum(save);
+}
+
+
+int savestate_write(const CPU *cpu, const char *path)
+{
+    SaveState save;
+    savestate_from_cpu(&save, cpu);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return SAVESTATE_ERR_IO;
+
+    size_t written = fwrite(&save, 1, sizeof(SaveState), file);
+    if (fclose(file) != 0 || written != sizeof(SaveState))
+        return SAVESTATE_ERR_IO;
+    return SAVESTATE_OK;
+}
+
+int savestate_validate(const SaveState *save, size_t size)
+{
+    if (size < SAVESTATE_PAYLOAD_OFFSET || save->magic != SAVESTATE_MAGIC)
+        return SAVESTATE_ERR_FORMAT;
+    if (save->version != SAVESTATE_VERSION)
+        return SAVESTATE_ERR_VERSION;
+    if (size != sizeof(SaveState) || save->size != sizeof(SaveState))
+        return SAVESTATE_ERR_FORMAT;
+    if (save->checksum != savestate_checksum(save))
+        return SAVESTATE_ERR_CHECKSUM;
+    return SAVESTATE_OK;
+}
+
+const SaveState *savestate_map(const char *path, int *err)
+{
+    int dummy;
+    if (err == NULL)
+        err = &dummy;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *err = SAVESTATE_ERR_IO;
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        *err = SAVESTATE_ERR_IO;
+        return NULL;
+    }
+    if ((size_t)st.st_size != sizeof(SaveState)) {
+        close(fd);
+        *err = SAVESTATE_ERR_FORMAT;
+        return NULL;
+    }
+
+    // The mapping stays valid after the fd is closed
+    void *mapping = mmap(NULL, sizeof(SaveState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        *err = SAVESTATE_ERR_IO;
+        return NULL;
+    }
+
+    const SaveState *save = mapping;
+    *err = savestate_validate(save, st.st_size);
+    if (*err != SAVESTATE_OK) {
+        munmap(mapping, sizeof(SaveState));
+        return NULL;
+    }
+    return save;
+}
+
+void savestate_unmap(const SaveState *save)
+{
+    if (save != NULL)
+        munmap((void *)save, sizeof(SaveState));
+}
+
+
+int savestate_restore(CPU *cpu, const SaveState *save)
+{
+    if (save->device != cpu->device->index)
+        return SAVESTATE_ERR_DEVICE;
+    if (save->program_hash != savestate_program_hash(cpu->inst, cpu->device->program_words))
+        return SAVESTATE_ERR_PROGRAM;
+
+    CPUState state;
+    state.pc = save->pc;
+    state.skipnext = save->skipnext;
+    state.asleep = save->asleep;
+    state.inst_cycles = save->inst_cycles;
+    state.inst_generation = cpu->inst_generation; // It's this CPU's program memory, the hash says so
+    state.stack[0] = save->stack[0];
+    state.stack[1] = save->stack[1];
+    state.w = save->w;
+    memcpy(state.f, save->f, sizeof(state.f));
+    state.trisgpio = save->trisgpio;
+    state.option = save->option;
+    state.config = save->config;
+    state.prescaler = save->prescaler;
+    state.timer0_inhibit = save->timer0_inhibit;
+    state.wdt = save->wdt;
+    cpu_load_state(cpu, &state);
+    return SAVESTATE_OK;
+}
+
+int savestate_load(CPU *cpu, const char *path)
+{
+    int err;
+    const SaveState *save = savestate_map(path, &err);
+    if (save == NULL)
+        return err;
+    err = savestate_restore(cpu, save);
+    savestate_unmap(save);
+    return err;
+}
+
+const char *savestate_strerror(int err)
+{
+    switch (err)
+    {
+        case SAVESTATE_OK:           return "OK";
+        case SAVESTATE_ERR_IO:       return "Failed to access save-state file";
+        case SAVESTATE_ERR_FORMAT:   return "Not a save-state file";
+        case SAVESTATE_ERR_VERSION:  return "Unsupported save-state version";
+        case SAVESTATE_ERR_CHECKSUM: return "Save-state checksum mismatch";
+        case SAVESTATE_ERR_PROGRAM:  return "Save-state is for different program memory";
+        case SAVESTATE_ERR_DEVICE:   return "Save-state is for a different device";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,540 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "stimulus.h"
+
+// Options that can follow a statement, "<name> <value>" in any order
+enum {
+    STIM_AT, STIM_WIDTH, STIM_LEVEL, STIM_PERIOD, STIM_COUNT, STIM_HIGH, STIM_BIT, STIM_JITTER, STIM_EVERY,
+    STIM_NUM_OPTIONS
+};
+
+static const char *stimulus_options[STIM_NUM_OPTIONS] = {
+    "at", "width", "level", "period", "count", "high", "bit", "jitter", "every",
+};
+
+typedef struct StimulusArgs {
+    uint64_t values[STIM_NUM_OPTIONS];
+    unsigned given; // 1 << option for each one that was there
+} StimulusArgs;
+
+// An edge before sorting, seq keeps file order for ones on the same cycle
+typedef struct StimulusEdge {
+    uint64_t cycle;
+    uint64_t seq;
+    uint32_t line;
+    uint8_t kind;
+    uint8_t mask;
+    uint8_t value;
+} StimulusEdge;
+
+typedef struct StimulusParser {
+    char **lines;
+    int num_lines;
+    uint32_t rng;
+    uint64_t length;
+    bool have_length;
+    StimulusEdge *edges;
+    size_t num_edges;
+    size_t capacity;
+} StimulusParser;
+
+static uint32_t _stimulus_random(StimulusParser *p)
+{
+    // xorshift32, plenty for jitter and the same everywhere
+    uint32_t x = p->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    p->rng = x;
+    return x;
+}
+
+static void _stimulus_seed(StimulusParser *p, uint64_t seed)
+{
+    p->rng = (uint32_t)(seed ^ (seed >> 32)) ^ 0x9E3779B9;
+    if (p->rng == 0)
+        p->rng = 1;
+}
+
+static int _stimulus_number(const char *token, uint64_t *value)
+{
+    char *end;
+    if (token[0] == '-')
+        return STIMULUS_ERR_SYNTAX;
+    *value = strtoull(token, &end, 0);
+    return (end != token && *end == '\0') ? STIMULUS_OK : STIMULUS_ERR_SYNTAX;
+}
+
+static int _stimulus_pin(const char *token, uint8_t *mask)
+{
+    if (strncmp(token, "gp", 2) != 0 || token[2] < '0' || token[2] > '5' || token[3] != '\0')
+        return STIMULUS_ERR_PIN;
+    *mask = 1 << (token[2] - '0');
+    return STIMULUS_OK;
+}
+
+static int _stimulus_level(const char *token, bool *level)
+{
+    if (strcmp(token, "1") == 0 || strcmp(token, "high") == 0)
+        *level = true;
+    else if (strcmp(token, "0") == 0 || strcmp(token, "low") == 0)
+        *level = false;
+    else
+        return STIMULUS_ERR_SYNTAX;
+    return STIMULUS_OK;
+}
+
+// Splits a line into lowercase tokens in place, dropping the comment
+static int _stimulus_tokenize(char *line, char **tokens)
+{
+    int n = 0;
+    char *c = line;
+    while (1)
+    {
+        while (*c == ' ' || *c == '\t' || *c == '\r')
+            c++;
+        if (*c == '\0' || *c == '#')
+            return n;
+        if (n == STIMULUS_MAX_TOKENS)
+            return -1;
+        tokens[n++] = c;
+        for (; *c != '\0' && *c != ' ' && *c != '\t' && *c != '\r' && *c != '#'; c++)
+            *c = tolower((unsigned char)*c);
+        if (*c == '#') {
+            *c = '\0';
+            return n;
+        }
+        if (*c != '\0')
+            *c++ = '\0';
+    }
+}
+
+// Options after the positional arguments, required ones are a mask of what has to be there
+static int _stimulus_args(char **tokens, int num_tokens, int first, unsigned allowed, unsigned required,
+                          StimulusArgs *args)
+{
+    args->given = 0;
+    if ((num_tokens - first) % 2 != 0)
+        return STIMULUS_ERR_SYNTAX;
+    for (int i = first; i < num_tokens; i += 2)
+    {
+        int option = 0;
+        while (option < STIM_NUM_OPTIONS && strcmp(tokens[i], stimulus_options[option]) != 0)
+            option++;
+        if (option == STIM_NUM_OPTIONS || !(allowed & (1 << option)) || (args->given & (1 << option)))
+            return STIMULUS_ERR_SYNTAX;
+        if (option == STIM_LEVEL) {
+            bool level;
+            if (_stimulus_level(tokens[i + 1], &level) < 0)
+                return STIMULUS_ERR_SYNTAX;
+            args->values[option] = level;
+        }
+        else if (_stimulus_number(tokens[i + 1], &args->values[option]) < 0)
+            return STIMULUS_ERR_SYNTAX;
+        args->given |= 1 << option;
+    }
+    if ((args->given & required) != required)
+        return STIMULUS_ERR_SYNTAX;
+    if (!(args->given & (1 << STIM_JITTER)))
+        args->values[STIM_JITTER] = 0;
+    return STIMULUS_OK;
+}
+
+// Adds an edge, jittered but never before the statement's previous one (last starts out as UINT64_MAX)
+static int _stimulus_edge(StimulusParser *p, uint64_t cycle, uint64_t jitter, uint64_t *last, int line,
+                          uint8_t kind, uint8_t mask, bool level)
+{
+    if (jitter > 0) {
+        uint64_t offset = _stimulus_random(p) % (2 * jitter + 1);
+        if (offset >= jitter)
+            cycle += offset - jitter;
+        else
+            cycle = cycle > jitter - offset ? cycle - (jitter - offset) : 0;
+    }
+    if (*last != UINT64_MAX && cycle <= *last)
+        cycle = *last + 1;
+    *last = cycle;
+
+    if (p->num_edges == STIMULUS_MAX_EVENTS)
+        return STIMULUS_ERR_TOO_BIG;
+    if (p->num_edges == p->capacity) {
+        size_t capacity = p->capacity ? p->capacity * 2 : 256;
+        StimulusEdge *edges = realloc(p->edges, capacity * sizeof(StimulusEdge));
+        if (edges == NULL)
+            return STIMULUS_ERR_MEMORY;
+        p->edges = edges;
+        p->capacity = capacity;
+    }
+    StimulusEdge *edge = &p->edges[p->num_edges];
+    edge->cycle = cycle;
+    edge->seq = p->num_edges++;
+    edge->line = line + 1;
+    edge->kind = kind;
+    edge->mask = mask;
+    edge->value = level ? mask : 0;
+    return STIMULUS_OK;
+}
+
+#define STIM_OPT(o) (1u << (o))
+#define STIM_TIMED  (STIM_OPT(STIM_AT) | STIM_OPT(STIM_JITTER))
+
+// Parses from line until the matching "}" (or the end at the top level), emitting edges offset by base
+// Returns the line after the block, or an error with *error_line set. Blocks repeated zero times get parsed with
+// emit off, so mistakes in them still get caught.
+static int _stimulus_block(StimulusParser *p, int line, uint64_t base, int depth, bool emit, int *error_line)
+{
+    char buf[256];
+    char *tokens[STIMULUS_MAX_TOKENS];
+    StimulusArgs args;
+    uint8_t pin;
+    bool level;
+    int err;
+
+    for (; line < p->num_lines; line++)
+    {
+        *error_line = line + 1;
+        if (strlen(p->lines[line]) >= sizeof(buf))
+            return STIMULUS_ERR_SYNTAX;
+        strcpy(buf, p->lines[line]);
+        int n = _stimulus_tokenize(buf, tokens);
+        if (n < 0)
+            return STIMULUS_ERR_SYNTAX;
+        if (n == 0)
+            continue;
+        const char *op = tokens[0];
+        uint64_t last = UINT64_MAX;
+
+        if (strcmp(op, "}") == 0) {
+            if (n != 1)
+                return STIMULUS_ERR_SYNTAX;
+            if (depth == 0)
+                return STIMULUS_ERR_BLOCK;
+            return line + 1;
+        }
+        else if (strcmp(op, "seed") == 0) {
+            uint64_t seed;
+            if (n != 2 || _stimulus_number(tokens[1], &seed) < 0)
+                return STIMULUS_ERR_SYNTAX;
+            _stimulus_seed(p, seed);
+        }
+        else if (strcmp(op, "run") == 0) {
+            uint64_t length;
+            if (n != 2 || _stimulus_number(tokens[1], &length) < 0 || depth != 0)
+                return STIMULUS_ERR_SYNTAX;
+            p->length = length;
+            p->have_length = true;
+        }
+        else if (strcmp(op, "set") == 0 || strcmp(op, "expect") == 0) {
+            bool expect = strcmp(op, "expect") == 0;
+            if (n < 3)
+                return STIMULUS_ERR_SYNTAX;
+            if ((err = _stimulus_pin(tokens[1], &pin)) < 0)
+                return err;
+            if (_stimulus_level(tokens[2], &level) < 0)
+                return STIMULUS_ERR_SYNTAX;
+            if ((err = _stimulus_args(tokens, n, 3, expect ? STIM_OPT(STIM_AT) : STIM_TIMED, STIM_OPT(STIM_AT), &args)) < 0)
+                return err;
+            if (emit && (err = _stimulus_edge(p, base + args.values[STIM_AT], args.values[STIM_JITTER], &last, line,
+                                              expect ? STIMULUS_EXPECT : STIMULUS_SET, pin, level)) < 0)
+                return err;
+        }
+        else if (strcmp(op, "pulse") == 0) {
+            if (n < 2)
+                return STIMULUS_ERR_SYNTAX;
+            if ((err = _stimulus_pin(tokens[1], &pin)) < 0)
+                return err;
+            if ((err = _stimulus_args(tokens, n, 2, STIM_TIMED | STIM_OPT(STIM_WIDTH) | STIM_OPT(STIM_LEVEL),
+                                      STIM_OPT(STIM_AT) | STIM_OPT(STIM_WIDTH), &args)) < 0)
+                return err;
+            if (args.values[STIM_WIDTH] == 0)
+                return STIMULUS_ERR_SYNTAX;
+            level = (args.given & STIM_OPT(STIM_LEVEL)) ? args.values[STIM_LEVEL] : true;
+            uint64_t at = base + args.values[STIM_AT];
+            if (emit && ((err = _stimulus_edge(p, at, args.values[STIM_JITTER], &last, line, STIMULUS_SET, pin, level)) < 0
+                         || (err = _stimulus_edge(p, at + args.values[STIM_WIDTH], args.values[STIM_JITTER], &last, line,
+                                                  STIMULUS_SET, pin, !level)) < 0))
+                return err;
+        }
+        else if (strcmp(op, "clock") == 0) {
+            if (n < 2)
+                return STIMULUS_ERR_SYNTAX;
+            if ((err = _stimulus_pin(tokens[1], &pin)) < 0)
+                return err;
+            if ((err = _stimulus_args(tokens, n, 2, STIM_TIMED | STIM_OPT(STIM_PERIOD) | STIM_OPT(STIM_COUNT) | STIM_OPT(STIM_HIGH),
+                                      STIM_OPT(STIM_AT) | STIM_OPT(STIM_PERIOD) | STIM_OPT(STIM_COUNT), &args)) < 0)
+                return err;
+            uint64_t period = args.values[STIM_PERIOD];
+            uint64_t high = (args.given & STIM_OPT(STIM_HIGH)) ? args.values[STIM_HIGH] : period / 2;
+            if (high == 0 || high >= period)
+                return STIMULUS_ERR_SYNTAX;
+            for (uint64_t i = 0; emit && i < args.values[STIM_COUNT]; i++)
+            {
+                uint64_t at = base + args.values[STIM_AT] + i * period;
+                if ((err = _stimulus_edge(p, at, args.values[STIM_JITTER], &last, line, STIMULUS_SET, pin, true)) < 0
+                    || (err = _stimulus_edge(p, at + high, args.values[STIM_JITTER], &last, line, STIMULUS_SET, pin, false)) < 0)
+                    return err;
+            }
+        }
+        else if (strcmp(op, "pattern") == 0) {
+            if (n < 3)
+                return STIMULUS_ERR_SYNTAX;
+            if ((err = _stimulus_pin(tokens[1], &pin)) < 0)
+                return err;
+            if ((err = _stimulus_args(tokens, n - 1, 2, STIM_TIMED | STIM_OPT(STIM_BIT), STIM_OPT(STIM_AT) | STIM_OPT(STIM_BIT), &args)) < 0)
+                return err;
+            // Only where the level changes, bits repeating the previous one don't need an event
+            uint64_t at = base + args.values[STIM_AT];
+            bool first = true;
+            bool previous = false;
+            for (const char *c = tokens[n - 1]; *c != '\0'; c++)
+            {
+                if (*c == '_')
+                    continue;
+                if (*c != '0' && *c != '1')
+                    return STIMULUS_ERR_SYNTAX;
+                level = *c == '1';
+                if (emit && (first || level != previous)
+                    && (err = _stimulus_edge(p, at, args.values[STIM_JITTER], &last, line, STIMULUS_SET, pin, level)) < 0)
+                    return err;
+                first = false;
+                previous = level;
+                at += args.values[STIM_BIT];
+            }
+        }
+        else if (strcmp(op, "repeat") == 0) {
+            uint64_t count;
+            if (n < 3 || strcmp(tokens[n - 1], "{") != 0 || _stimulus_number(tokens[1], &count) < 0)
+                return STIMULUS_ERR_SYNTAX;
+            if ((err = _stimulus_args(tokens, n - 1, 2, STIM_OPT(STIM_EVERY), STIM_OPT(STIM_EVERY), &args)) < 0)
+                return err;
+            if (depth + 1 >= STIMULUS_MAX_DEPTH)
+                return STIMULUS_ERR_BLOCK;
+            int end = line + 1;
+            for (uint64_t i = 0; i < (count ? count : 1); i++)
+            {
+                end = _stimulus_block(p, line + 1, base + i * args.values[STIM_EVERY], depth + 1, emit && count > 0, error_line);
+                if (end < 0)
+                    return end;
+            }
+            line = end - 1;
+        }
+        else
+            return STIMULUS_ERR_SYNTAX;
+    }
+
+    if (depth != 0) {
+        *error_line = p->num_lines;
+        return STIMULUS_ERR_BLOCK;
+    }
+    return line;
+}
+
+static int _stimulus_compare(const void *a, const void *b)
+{
+    const StimulusEdge *x = a;
+    const StimulusEdge *y = b;
+    if (x->cycle != y->cycle)
+        return x->cycle < y->cycle ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+int stimulus_parse(Stimulus *stim, const char *text)
+{
+    memset(stim, 0, sizeof(Stimulus));
+
+    // Our own copy, split into lines
+    size_t len = strlen(text);
+    char *copy = malloc(len + 1);
+    char **lines = malloc((len + 1) * sizeof(char *));
+    if (copy == NULL || lines == NULL) {
+        free(copy);
+        free(lines);
+        return STIMULUS_ERR_MEMORY;
+    }
+    memcpy(copy, text, len + 1);
+    int num_lines = 0;
+    for (char *c = copy; *c != '\0' || num_lines == 0; )
+    {
+        lines[num_lines++] = c;
+        char *nl = strchr(c, '\n');
+        if (nl == NULL)
+            break;
+        *nl = '\0';
+        c = nl + 1;
+    }
+
+    StimulusParser p = {lines, num_lines, 0, 0, false, NULL, 0, 0};
+    _stimulus_seed(&p, 0);
+    int err = _stimulus_block(&p, 0, 0, 0, true, &stim->error_line);
+    free(copy);
+    free(lines);
+    if (err < 0) {
+        free(p.edges);
+        return err;
+    }
+    stim->error_line = 0;
+
+    // Sort, then merge sets on the same cycle
+    qsort(p.edges, p.num_edges, sizeof(StimulusEdge), _stimulus_compare);
+    stim->events = malloc((p.num_edges ? p.num_edges : 1) * sizeof(StimulusEvent));
+    if (stim->events == NULL) {
+        free(p.edges);
+        return STIMULUS_ERR_MEMORY;
+    }
+    for (size_t i = 0; i < p.num_edges; i++)
+    {
+        const StimulusEdge *edge = &p.edges[i];
+        StimulusEvent *prev = stim->num_events ? &stim->events[stim->num_events - 1] : NULL;
+        if (prev != NULL && edge->kind == STIMULUS_SET && prev->kind == STIMULUS_SET && prev->cycle == edge->cycle) {
+            prev->mask |= edge->mask;
+            prev->value = (prev->value & ~edge->mask) | edge->value;
+            prev->line = edge->line;
+            continue;
+        }
+        StimulusEvent *event = &stim->events[stim->num_events++];
+        event->cycle = edge->cycle;
+        event->line = edge->line;
+        event->kind = edge->kind;
+        event->mask = edge->mask;
+        event->value = edge->value;
+    }
+    free(p.edges);
+
+    if (p.have_length)
+        stim->length = p.length;
+    else if (stim->num_events)
+        stim->length = stim->events[stim->num_events - 1].cycle + 1;
+    return STIMULUS_OK;
+}
+
+int stimulus_load(Stimulus *stim, const char *path)
+{
+    memset(stim, 0, sizeof(Stimulus));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return STIMULUS_ERR_IO;
+
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return STIMULUS_ERR_IO;
+    }
+
+    char *buf = malloc(size + 1);
+    if (buf == NULL) {
+        fclose(file);
+        return STIMULUS_ERR_MEMORY;
+    }
+    size_t got = fread(buf, 1, size, file);
+    fclose(file);
+    if (got != (size_t)size) {
+        free(buf);
+        return STIMULUS_ERR_IO;
+    }
+    buf[got] = '\0';
+
+    int err = stimulus_parse(stim, buf);
+    free(buf);
+    return err;
+}
+
+void stimulus_free(Stimulus *stim)
+{
+    free(stim->events);
+    stim->events = NULL;
+    stim->num_events = 0;
+}
+
+
+void stimulus_start(Stimulus *stim, CPU *cpu)
+{
+    stim->cpu = cpu;
+    stim->start = cpu->inst_cycles;
+    stim->next = 0;
+    stim->expects = 0;
+    stim->failures = 0;
+    stim->contentions = 0;
+    stim->failed_line = 0;
+    stim->failed_cycle = 0;
+    stim->failed_pins = 0;
+}
+
+static void _stimulus_apply(Stimulus *stim)
+{
+    CPU *cpu = stim->cpu;
+    uint64_t now = cpu->inst_cycles - stim->start;
+    while (stim->next < stim->num_events && stim->events[stim->next].cycle <= now)
+    {
+        const StimulusEvent *event = &stim->events[stim->next++];
+        uint8_t gpio = cpu_getgpio(cpu);
+        if (event->kind == STIMULUS_EXPECT) {
+            stim->expects++;
+            if ((gpio & event->mask) != event->value && stim->failures++ == 0) {
+                stim->failed_line = event->line;
+                stim->failed_cycle = now;
+                stim->failed_pins = gpio;
+            }
+            continue;
+        }
+        uint8_t driven = event->mask & cpu_driven_pins(cpu);
+        if (driven) {
+            stim->contentions++;
+            if (driven == event->mask)
+                continue;
+        }
+        uint8_t mask = event->mask & ~driven;
+        uint8_t newgpio = (gpio & ~mask) | (event->value & mask);
+        if (newgpio != gpio)
+            cpu_setgpio(cpu, newgpio);
+    }
+}
+
+int stimulus_run(Stimulus *stim, uint64_t max_cycles)
+{
+    CPU *cpu = stim->cpu;
+    uint64_t end = cpu->inst_cycles + max_cycles;
+    if (end < cpu->inst_cycles)
+        end = UINT64_MAX;
+    uint64_t finish = stim->start + stim->length;
+    if (finish < end)
+        end = finish;
+
+    while (1)
+    {
+        _stimulus_apply(stim);
+        if (cpu->inst_cycles >= end)
+            return STOP_CYCLES;
+        uint64_t until = end;
+        if (stim->next < stim->num_events && stim->start + stim->events[stim->next].cycle < until)
+            until = stim->start + stim->events[stim->next].cycle;
+
+        int reason = cpu_run_cycles(cpu, until - cpu->inst_cycles);
+        if (reason != STOP_CYCLES)
+            return reason;
+    }
+}
+
+bool stimulus_done(const Stimulus *stim)
+{
+    return stim->cpu->inst_cycles >= stim->start + stim->length;
+}
+
+
+const char *stimulus_strerror(int err)
+{
+    switch (err)
+    {
+        case STIMULUS_OK:          return "OK";
+        case STIMULUS_ERR_IO:      return "Couldn't read the stimulus file";
+        case STIMULUS_ERR_SYNTAX:  return "Syntax error";
+        case STIMULUS_ERR_PIN:     return "Not a pin (gp0-gp5)";
+        case STIMULUS_ERR_BLOCK:   return "Unbalanced braces or repeats nested too deep";
+        case STIMULUS_ERR_TOO_BIG: return "Too many events";
+        case STIMULUS_ERR_MEMORY:  return "Out of memory";
+    }
+    return "Unknown error";
+}
@@ -0,0 +1,343 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "sweep.h"
+#include "cpu.h"
+#include "image.h"
+
+// What one thread has found, merged into the Sweep once everyone's done
+typedef struct SweepWorker {
+    Sweep *sweep;
+    struct SweepShared *shared;
+    pthread_t thread;
+
+    uint64_t passed;
+    uint64_t mismatches;
+    uint64_t timeouts;
+    uint64_t min_cycles;
+    uint64_t max_cycles;
+    uint64_t total_cycles;
+    uint64_t histogram[SWEEP_HISTOGRAM + 1];
+    SweepMismatch failed[SWEEP_MAX_MISMATCHES]; // Its own first ones, already in case order
+    int num_failed;
+} SweepWorker;
+
+typedef struct SweepShared {
+    pthread_mutex_t lock;
+    uint64_t next_case;
+} SweepShared;
+
+static double _sweep_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _sweep_set(CPU *cpu, uint8_t reg, uint8_t value)
+{
+    if (reg == SWEEP_REG_W)
+        cpu->w = value;
+    else
+        cpu->f[reg] = value;
+}
+
+static uint8_t _sweep_get(CPU *cpu, uint8_t reg)
+{
+    return reg == SWEEP_REG_W ? cpu->w : cpu_getreg(cpu, reg);
+}
+
+// One case from the snapshot to end_pc (or the budget running out)
+static void _sweep_case(Sweep *sweep, SweepWorker *worker, CPU *cpu, uint64_t index)
+{
+    uint8_t inputs[SWEEP_MAX_INPUTS], got[SWEEP_MAX_OUTPUTS], expected[SWEEP_MAX_OUTPUTS];
+    sweep_case_inputs(sweep, index, inputs);
+    cpu_load_state(cpu, &sweep->start);
+    for (int i = 0; i < sweep->num_inputs; i++)
+        _sweep_set(cpu, sweep->inputs[i].reg, inputs[i]);
+
+    bool timed_out = cpu_run_cycles(cpu, sweep->budget) != STOP_BREAKPOINT;
+    uint64_t cycles = cpu->inst_cycles - sweep->start.inst_cycles;
+    for (int i = 0; i < sweep->num_outputs; i++)
+        got[i] = _sweep_get(cpu, sweep->outputs[i]);
+    sweep->reference(inputs, expected, sweep->ctx);
+
+    bool match = !timed_out && memcmp(got, expected, sweep->num_outputs) == 0;
+    if (!timed_out) {
+        worker->histogram[cycles < SWEEP_HISTOGRAM ? cycles : SWEEP_HISTOGRAM]++;
+        worker->total_cycles += cycles;
+        if (cycles < worker->min_cycles)
+            worker->min_cycles = cycles;
+        if (cycles > worker->max_cycles)
+            worker->max_cycles = cycles;
+    }
+    if (match) {
+        worker->passed++;
+        return;
+    }
+
+    if (timed_out)
+        worker->timeouts++;
+    else
+        worker->mismatches++;
+    if (worker->num_failed < SWEEP_MAX_MISMATCHES) {
+        SweepMismatch *m = &worker->failed[worker->num_failed++];
+        m->index = index;
+        memcpy(m->inputs, inputs, sizeof(inputs));
+        memcpy(m->got, got, sizeof(got));
+        memcpy(m->expected, expected, sizeof(expected));
+        m->cycles = cycles;
+        m->timed_out = timed_out;
+    }
+}
+
+static void *_sweep_worker(void *arg)
+{
+    SweepWorker *worker = arg;
+    Sweep *sweep = worker->sweep;
+    uint64_t cases = sweep_num_cases(sweep);
+
+    CPU cpu;
+    cpu_init(&cpu);
+    image_attach(&cpu, sweep->image);
+    cpu_setbreakpoint(&cpu, sweep->end_pc);
+    while (1)
+    {
+        pthread_mutex_lock(&worker->shared->lock);
+        uint64_t first = worker->shared->next_case;
+        worker->shared->next_case += SWEEP_CHUNK;
+        pthread_mutex_unlock(&worker->shared->lock);
+        if (first >= cases)
+            break;
+        uint64_t last = first + SWEEP_CHUNK < cases ? first + SWEEP_CHUNK : cases;
+        for (uint64_t index = first; index < last; index++)
+            _sweep_case(sweep, worker, &cpu, index);
+    }
+    cpu_deinit(&cpu);
+    return NULL;
+}
+
+
+int sweep_init(Sweep *sweep, const CPU *cpu, uint16_t start_pc, uint16_t end_pc)
+{
+    memset(sweep, 0, sizeof(Sweep));
+    if (cpu->device != &device_pic12f508) // The workers are plain 12F508s sharing one image
+        return SWEEP_ERR_DEVICE;
+    sweep->image = calloc(1, sizeof(FirmwareImage));
+    if (sweep->image == NULL)
+        return SWEEP_ERR_MEMORY;
+
+    FirmwareImage *image = sweep->image;
+    image->magic = IMAGE_MAGIC;
+    image->version = IMAGE_VERSION;
+    image->num_words = IMAGE_WORDS;
+    image->size = sizeof(FirmwareImage);
+    image->config = cpu->config;
+    image->osccal = cpu->inst[0x1FF] & 0xFF;
+    memcpy(image->inst, cpu->inst, sizeof(image->inst));
+    image_finalise(image);
+
+    cpu_save_state(cpu, &sweep->start);
+    sweep->start.pc = start_pc & 0x1FF;
+    sweep->start.skipnext = false;
+    sweep->start.asleep = false;
+    sweep->end_pc = end_pc & 0x1FF;
+    sweep->budget = SWEEP_DEFAULT_BUDGET;
+    return SWEEP_OK;
+}
+
+void sweep_deinit(Sweep *sweep)
+{
+    free(sweep->image);
+    sweep->image = NULL;
+}
+
+int sweep_add_input(Sweep *sweep, uint8_t reg, uint8_t first, uint8_t last)
+{
+    if (sweep->num_inputs == SWEEP_MAX_INPUTS || reg > SWEEP_REG_W || first > last)
+        return SWEEP_ERR_ARG;
+    SweepInput *input = &sweep->inputs[sweep->num_inputs++];
+    input->reg = reg;
+    input->first = first;
+    input->last = last;
+    return SWEEP_OK;
+}
+
+int sweep_add_output(Sweep *sweep, uint8_t reg)
+{
+    if (sweep->num_outputs == SWEEP_MAX_OUTPUTS || reg > SWEEP_REG_W)
+        return SWEEP_ERR_ARG;
+    sweep->outputs[sweep->num_outputs++] = reg;
+    return SWEEP_OK;
+}
+
+void sweep_set_reference(Sweep *sweep, SweepReference reference, void *ctx)
+{
+    sweep->reference = reference;
+    sweep->ctx = ctx;
+}
+
+uint64_t sweep_num_cases(const Sweep *sweep)
+{
+    uint64_t cases = 1;
+    for (int i = 0; i < sweep->num_inputs; i++)
+        cases *= sweep->inputs[i].last - sweep->inputs[i].first + 1;
+    return cases;
+}
+
+void sweep_case_inputs(const Sweep *sweep, uint64_t index, uint8_t *inputs)
+{
+    for (int i = sweep->num_inputs - 1; i >= 0; i--)
+    {
+        const SweepInput *input = &sweep->inputs[i];
+        uint64_t size = input->last - input->first + 1;
+        inputs[i] = input->first + index % size;
+        index /= size;
+    }
+}
+
+int sweep_run(Sweep *sweep, int num_threads)
+{
+    if (sweep->reference == NULL)
+        return SWEEP_ERR_ARG;
+    if (num_threads < 1)
+        num_threads = 1;
+    SweepWorker *workers = calloc(num_threads, sizeof(SweepWorker));
+    if (workers == NULL)
+        return SWEEP_ERR_MEMORY;
+
+    double start = _sweep_now();
+    SweepShared shared = { .next_case = 0 };
+    pthread_mutex_init(&shared.lock, NULL);
+    int started = 1;
+    for (int t = 0; t < num_threads; t++)
+    {
+        workers[t].sweep = sweep;
+        workers[t].shared = &shared;
+        workers[t].min_cycles = UINT64_MAX;
+    }
+    for (; started < num_threads; started++)
+        if (pthread_create(&workers[started].thread, NULL, _sweep_worker, &workers[started]) != 0)
+            break;
+    // The calling thread is worker 0, and whatever did start still gets through everything between them
+    _sweep_worker(&workers[0]);
+    for (int t = 1; t < started; t++)
+        pthread_join(workers[t].thread, NULL);
+    pthread_mutex_destroy(&shared.lock);
+
+    sweep->cases = sweep_num_cases(sweep);
+    sweep->passed = sweep->mismatches = sweep->timeouts = sweep->total_cycles = sweep->max_cycles = 0;
+    sweep->min_cycles = UINT64_MAX;
+    memset(sweep->histogram, 0, sizeof(sweep->histogram));
+    sweep->num_failed = 0;
+    for (int t = 0; t < started; t++)
+    {
+        SweepWorker *worker = &workers[t];
+        sweep->passed += worker->passed;
+        sweep->mismatches += worker->mismatches;
+        sweep->timeouts += worker->timeouts;
+        sweep->total_cycles += worker->total_cycles;
+        if (worker->min_cycles < sweep->min_cycles)
+            sweep->min_cycles = worker->min_cycles;
+        if (worker->max_cycles > sweep->max_cycles)
+            sweep->max_cycles = worker->max_cycles;
+        for (int i = 0; i <= SWEEP_HISTOGRAM; i++)
+            sweep->histogram[i] += worker->histogram[i];
+
+        // Merge its first failures into the overall first ones, both sorted by case
+        SweepMismatch merged[SWEEP_MAX_MISMATCHES];
+        int a = 0, b = 0, n = 0;
+        while (n < SWEEP_MAX_MISMATCHES && (a < sweep->num_failed || b < worker->num_failed))
+        {
+            if (b == worker->num_failed || (a < sweep->num_failed && sweep->failed[a].index < worker->failed[b].index))
+                merged[n++] = sweep->failed[a++];
+            else
+                merged[n++] = worker->failed[b++];
+        }
+        memcpy(sweep->failed, merged, n * sizeof(SweepMismatch));
+        sweep->num_failed = n;
+    }
+    if (sweep->min_cycles == UINT64_MAX)
+        sweep->min_cycles = 0;
+    sweep->seconds = _sweep_now() - start;
+    free(workers);
+    return started == num_threads ? SWEEP_OK : SWEEP_ERR_THREADS;
+}
+
+static void _sweep_print_regs(FILE *out, const uint8_t *regs, const uint8_t *values, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (regs[i] == SWEEP_REG_W)
+            fprintf(out, "%sW=%u", i ? " " : "", values[i]);
+        else
+            fprintf(out, "%s0x%02X=%u", i ? " " : "", regs[i], values[i]);
+    }
+}
+
+void sweep_print(const Sweep *sweep, FILE *out)
+{
+    fprintf(out, "%llu cases in %.3fs: %llu passed, %llu mismatched, %llu timed out\n", (unsigned long long)sweep->cases,
+            sweep->seconds, (unsigned long long)sweep->passed, (unsigned long long)sweep->mismatches,
+            (unsigned long long)sweep->timeouts);
+
+    uint8_t input_regs[SWEEP_MAX_INPUTS];
+    for (int i = 0; i < sweep->num_inputs; i++)
+        input_regs[i] = sweep->inputs[i].reg;
+    for (int i = 0; i < sweep->num_failed; i++)
+    {
+        const SweepMismatch *m = &sweep->failed[i];
+        fprintf(out, "  ");
+        _sweep_print_regs(out, input_regs, m->inputs, sweep->num_inputs);
+        if (m->timed_out) {
+            fprintf(out, ": timed out after %llu cycles\n", (unsigned long long)m->cycles);
+            continue;
+        }
+        fprintf(out, ": got ");
+        _sweep_print_regs(out, sweep->outputs, m->got, sweep->num_outputs);
+        fprintf(out, ", expected ");
+        _sweep_print_regs(out, sweep->outputs, m->expected, sweep->num_outputs);
+        fprintf(out, " (%llu cycles)\n", (unsigned long long)m->cycles);
+    }
+
+    uint64_t finished = sweep->passed + sweep->mismatches;
+    if (finished == 0)
+        return;
+    fprintf(out, "cycles: min %llu, max %llu, mean %.2f\n", (unsigned long long)sweep->min_cycles,
+            (unsigned long long)sweep->max_cycles, (double)sweep->total_cycles / finished);
+
+    // Up to 16 equal ranges between min and max, anything past the histogram lumped into the last one
+    uint64_t low = sweep->min_cycles, high = sweep->max_cycles < SWEEP_HISTOGRAM ? sweep->max_cycles : SWEEP_HISTOGRAM;
+    uint64_t width = (high - low) / 16 + 1;
+    uint64_t biggest = 0, counts[16] = {0};
+    for (uint64_t c = low; c <= high; c++)
+        counts[(c - low) / width] += sweep->histogram[c];
+    for (int i = 0; i < 16; i++)
+        if (counts[i] > biggest)
+            biggest = counts[i];
+    for (int i = 0; i < 16 && low + i * width <= high; i++)
+    {
+        uint64_t from = low + i * width, to = from + width - 1 < high ? from + width - 1 : high;
+        int bar = (int)(counts[i] * 40 / biggest);
+        fprintf(out, "  %5llu-%-5llu%s %10llu ", (unsigned long long)from, (unsigned long long)to,
+                to == SWEEP_HISTOGRAM ? "+" : " ", (unsigned long long)counts[i]);
+        for (int j = 0; j < bar; j++)
+            fputc('#', out);
+        fputc('\n', out);
+    }
+}
+
+const char *sweep_strerror(int err)
+{
+    switch (err)
+    {
+        case SWEEP_OK:          return "OK";
+        case SWEEP_ERR_ARG:     return "Bad input, output or reference";
+        case SWEEP_ERR_MEMORY:  return "Out of memory";
+        case SWEEP_ERR_THREADS: return "Couldn't start the worker threads";
+        case SWEEP_ERR_DEVICE:  return "Only the PIC12F508 can be swept";
+    }
+    return "Unknown error";
+}
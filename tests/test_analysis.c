@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "hex.h"
+#include "instructions.h"
+#include "analysis.h"
+
+// Static cycle bounds checked against what the CPU actually takes
+
+#define NUMERATOR_REG   0x0A
+#define DENOMINATOR_REG 0x09
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Cycles from a CALL at call_addr to getting back to the word after it, less the CALL's own 2
+static uint64_t measure_call(CPU *cpu, uint16_t call_addr) {
+	cpu->pc = call_addr;
+	cpu->skipnext = false;
+	uint64_t start = cpu->inst_cycles;
+	do
+		instruction_cycle(cpu);
+	while ((cpu->pc & 0x1FF) != call_addr + 1);
+	return cpu->inst_cycles - start - 2;
+}
+
+// The UART sender from test_decoders, a counted loop around calls to a counted delay
+static const uint16_t uart_program[] = {
+	0xC3E, 0x006, 0x506, 0xC48, 0x030, 0x90A, 0xC69, 0x030, 0x90A, 0x003,
+	0x406, // 10: send: BCF GPIO,0
+	0xC08, // 11: MOVLW 8
+	0x031, // 12: MOVWF 0x11
+	0x923, // 13: CALL delay
+	0x000, // 14: NOP
+	0xA10, // 15: GOTO loop
+	0x330, // 16: loop: RRF 0x10,f
+	0x703, // 17: BTFSS STATUS,C
+	0xA16, // 18: GOTO zero
+	0x000, // 19: NOP
+	0x506, // 20: BSF GPIO,0
+	0xA18, // 21: GOTO next
+	0x406, // 22: zero: BCF GPIO,0
+	0xA18, // 23: GOTO next
+	0x923, // 24: next: CALL delay
+	0x2F1, // 25: DECFSZ 0x11,f
+	0xA10, // 26: GOTO loop
+	0x000, 0x000, 0x000, 0x000, 0x000,
+	0x506, // 32: BSF GPIO,0
+	0x923, // 33: CALL delay
+	0x800, // 34: RETLW 0
+	0xC1E, // 35: delay: MOVLW 30
+	0x032, // 36: MOVWF 0x12
+	0x2F2, // 37: DECFSZ 0x12,f
+	0xA25, // 38: GOTO 37
+	0x800, // 39: RETLW 0
+};
+
+int main(void) {
+	int failures = 0;
+	static Analysis an;
+	CPU cpu;
+	cpu_init(&cpu);
+
+	// Divide: the loop runs once per subtraction, so it needs telling how many there can be
+	if (cpu_load_hex(&cpu, "divide/divide-12f508.HEX") != HEX_OK) {
+		printf("divide/divide-12f508.HEX didn't load, run this from tests/\n1 failure(s)\n");
+		return 1;
+	}
+	analysis_init(&an);
+	analysis_run(&an, cpu.inst);
+	analysis_print(&an, stdout);
+	const AnalysisRoutine *divide = analysis_routine(&an, 1);
+	const AnalysisLoop *loop = analysis_loop(&an, 4);
+	failures += check("divide routine and loop found", divide != NULL && loop != NULL && loop->routine == 1
+	                  && an.num_routines == 2 && an.routines[0].entry == ANALYSIS_RESET_VECTOR);
+	failures += check("data dependent loop unbounded", loop->bound == LOOP_UNBOUNDED && divide->best == 10
+	                  && divide->worst == ANALYSIS_UNBOUNDED && loop->trip_best == 8 && loop->trip_worst == 8);
+	const AnalysisBlock *block = analysis_block(&an, 5);
+	failures += check("loop test block", block != NULL && block->start == 4 && block->length == 3 && block->cycles == 3
+	                  && block->num_succ == 2 && block->succ[0] == 7 && block->succ[1] == 8);
+
+	// A quotient of up to 255 goes round at most 256 times
+	analysis_set_loop_bound(&an, 4, 1, 256);
+	analysis_run(&an, cpu.inst);
+	analysis_print(&an, stdout);
+	divide = analysis_routine(&an, 1);
+	const AnalysisRoutine *main_routine = analysis_routine(&an, ANALYSIS_RESET_VECTOR);
+	failures += check("divide bounded", divide->best == 10 && divide->worst == 10 + 8 * 255 && divide->returns);
+	failures += check("main includes the call", main_routine->sleeps && main_routine->best == 20
+	                  && main_routine->worst == 20 + 8 * 255);
+
+	static const int pairs[][2] = { { 11, 3 }, { 255, 1 }, { 0, 5 }, { 200, 7 }, { 3, 200 }, { 128, 2 } };
+	bool within = true, tight = false;
+	for (int i = 0; i < 6; i++)
+	{
+		cpu.f[NUMERATOR_REG] = pairs[i][0];
+		cpu.f[DENOMINATOR_REG] = pairs[i][1];
+		uint64_t cycles = measure_call(&cpu, 16);
+		printf("%d/%d: %llu cycles\n", pairs[i][0], pairs[i][1], (unsigned long long)cycles);
+		within &= cycles >= divide->best && cycles <= divide->worst;
+		tight |= cycles == divide->worst;
+	}
+	failures += check("measured divides within bounds", within);
+	failures += check("255/1 hits the worst case", tight);
+
+	// UART: both loops counted from their MOVLW/MOVWF, and exact
+	analysis_init(&an);
+	memcpy(cpu.inst, uart_program, sizeof(uart_program));
+	analysis_run(&an, cpu.inst);
+	analysis_print(&an, stdout);
+	const AnalysisRoutine *delay = analysis_routine(&an, 35);
+	const AnalysisRoutine *send = analysis_routine(&an, 10);
+	const AnalysisLoop *bits = analysis_loop(&an, 16);
+	const AnalysisLoop *wait = analysis_loop(&an, 37);
+	failures += check("counted loops", bits != NULL && bits->bound == LOOP_COUNTED && bits->counter == 0x11
+	                  && bits->max_trips == 8 && wait != NULL && wait->bound == LOOP_COUNTED && wait->max_trips == 30);
+	failures += check("105 cycles a bit", bits->trip_best == 105 && bits->trip_worst == 105);
+	failures += check("delay exact", delay->best == 93 && delay->worst == 93);
+	uint64_t measured = measure_call(&cpu, 5);
+	printf("send: %llu cycles\n", (unsigned long long)measured);
+	failures += check("send exact and matches", send->best == 1043 && send->worst == 1043 && measured == 1043);
+	block = analysis_block(&an, 36);
+	failures += check("delay blocks", block->start == 35 && block->length == 2 && block->num_succ == 1
+	                  && block->succ[0] == 37 && analysis_block(&an, 37)->length == 1
+	                  && analysis_block(&an, 38)->succ[0] == 37);
+
+	// A jump table routine and a main loop that never ends
+	analysis_init(&an);
+	memset(cpu.inst, 0, 512 * sizeof(uint16_t));
+	cpu.inst[0x1FF] = 0xC00; // MOVLW 0
+	cpu.inst[0] = 0xC01;     // MOVLW 1
+	cpu.inst[1] = 0x903;     // CALL 3
+	cpu.inst[2] = 0xA00;     // GOTO 0
+	cpu.inst[3] = 0x1E2;     // ADDWF PCL,f
+	cpu.inst[4] = 0x801;     // RETLW 1
+	cpu.inst[5] = 0x802;     // RETLW 2
+	cpu.inst[6] = 0xA04;     // GOTO 4
+	analysis_run(&an, cpu.inst);
+	analysis_print(&an, stdout);
+	const AnalysisRoutine *table = analysis_routine(&an, 3);
+	failures += check("jump table", table != NULL && table->best == 4 && table->worst == 6 && table->returns
+	                  && (an.flags[3] & ANALYSIS_COMPUTED_JUMP));
+	main_routine = analysis_routine(&an, ANALYSIS_RESET_VECTOR);
+	failures += check("endless main loop", main_routine->worst == ANALYSIS_UNBOUNDED && an.num_loops == 1
+	                  && analysis_loop(&an, 0)->num_exits == 0);
+
+	cpu_deinit(&cpu);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "bench.h"
+#include "models.h"
+
+// Buttons and LEDs around a press counter, a shift register fed by bit-banging, and an RC filter
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Pulls GP0 low from its first timer, then answers GP0 going low by pulling GP4 low from a
+// timer at a deadline that can already have passed
+typedef struct Echo {
+	Peripheral base;
+	int fired;
+	uint64_t deadline;
+} Echo;
+
+static void echo_pins_changed(Peripheral *p, Bench *bench, uint8_t pins, uint8_t changed) {
+	if ((changed & GP0) && !(pins & GP0))
+		bench_schedule(p, ((Echo *)p)->deadline);
+}
+
+static void echo_timer(Peripheral *p, Bench *bench) {
+	(void)bench;
+	if (((Echo *)p)->fired++ == 0)
+		bench_drive(p, GP0, 0);
+	else
+		bench_drive(p, GP4, 0);
+}
+
+static const PeripheralOps echo_ops = { .name = "echo", .pins_changed = echo_pins_changed, .timer = echo_timer };
+
+// Lights the LED on GP1 while the button on GP0 is held (active low, weak pull-ups), counting presses in 0x10
+static void load_counter(CPU *cpu) {
+	cpu->inst[0] = 0xC3D;  // MOVLW 0x3D
+	cpu->inst[1] = 0x006;  // TRIS GPIO (GP1 out, before the pull-ups can get into its latch)
+	cpu->inst[2] = 0xC1F;  // MOVLW 0x1F (pull-ups on)
+	cpu->inst[3] = 0x002;  // OPTION
+	cpu->inst[4] = 0x606;  // BTFSC GPIO,0
+	cpu->inst[5] = 0xA04;  // GOTO 4
+	cpu->inst[6] = 0x526;  // BSF GPIO,1
+	cpu->inst[7] = 0x2B0;  // INCF 0x10,f
+	cpu->inst[8] = 0x706;  // BTFSS GPIO,0
+	cpu->inst[9] = 0xA08;  // GOTO 8
+	cpu->inst[10] = 0x426; // BCF GPIO,1
+	cpu->inst[11] = 0xA04; // GOTO 4
+	cpu->pc = 0;
+}
+
+// Shifts 0xA5 out MSB first on GP0 with GP1 as the clock, then latches with GP2
+static void load_shifter(CPU *cpu) {
+	cpu->inst[0] = 0xCDF;  // MOVLW 0xDF (TOCS clear, so GP2 is an output)
+	cpu->inst[1] = 0x002;  // OPTION
+	cpu->inst[2] = 0xC38;  // MOVLW 0x38
+	cpu->inst[3] = 0x006;  // TRIS GPIO (GP0-GP2 out)
+	cpu->inst[4] = 0xCA5;  // MOVLW 0xA5
+	cpu->inst[5] = 0x030;  // MOVWF 0x10
+	cpu->inst[6] = 0xC08;  // MOVLW 8
+	cpu->inst[7] = 0x031;  // MOVWF 0x11
+	cpu->inst[8] = 0x406;  // BCF GPIO,0
+	cpu->inst[9] = 0x370;  // RLF 0x10,f
+	cpu->inst[10] = 0x603; // BTFSC STATUS,C
+	cpu->inst[11] = 0x506; // BSF GPIO,0
+	cpu->inst[12] = 0x526; // BSF GPIO,1
+	cpu->inst[13] = 0x426; // BCF GPIO,1
+	cpu->inst[14] = 0x2F1; // DECFSZ 0x11,f
+	cpu->inst[15] = 0xA08; // GOTO 8
+	cpu->inst[16] = 0x546; // BSF GPIO,2
+	cpu->inst[17] = 0x446; // BCF GPIO,2
+	cpu->inst[18] = 0x003; // SLEEP
+	cpu->pc = 0;
+}
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	Bench bench;
+
+	// Clean button, then a bouncy one
+	for (int bouncy = 0; bouncy < 2; bouncy++)
+	{
+		cpu_init(&cpu);
+		cpu.config &= ~WDTE;
+		load_counter(&cpu);
+		bench_init(&bench, &cpu);
+		Button button;
+		Led led;
+		button_init(&button, GP0, true, bouncy ? 2000 : 0);
+		led_init(&led, GP1, false);
+		bench_attach(&bench, &button.base);
+		bench_attach(&bench, &led.base);
+
+		uint64_t reads = 0;
+		for (int press = 0; press < 10; press++)
+		{
+			bench_run(&bench, 100000);
+			button_set(&button, &bench, true);
+			bench_run(&bench, 50000);
+			button_set(&button, &bench, false);
+			reads += 150000 / 3; // Roughly, the wait loops are a read every 3 cycles
+		}
+		bench_run(&bench, 100000);
+
+		printf("%s: %d presses counted, LED lit %llu cycles over %llu toggles, %llu model calls\n", bouncy ? "bouncy" : "clean",
+		       cpu.f[0x10], (unsigned long long)led_lit_cycles(&led, &bench), (unsigned long long)led.toggles,
+		       (unsigned long long)bench.evaluations);
+		if (!bouncy) {
+			failures += check("clean button: every press counted once", cpu.f[0x10] == 10 && led.toggles == 20);
+			failures += check("clean button: LED lit while held", led_lit_cycles(&led, &bench) >= 10 * 49990
+			                  && led_lit_cycles(&led, &bench) <= 10 * 50010);
+			failures += check("models only run on edges and timers", bench.evaluations < 100 && bench.evaluations * 1000 < reads);
+		}
+		else
+			failures += check("bouncy button: bounces get counted too", cpu.f[0x10] > 10 && led.toggles > 20);
+		bench_deinit(&bench);
+		cpu_deinit(&cpu);
+	}
+
+	// Bit-banged shift register, with Q7' coming back in on GP4
+	cpu_init(&cpu);
+	cpu.config &= ~WDTE;
+	load_shifter(&cpu);
+	bench_init(&bench, &cpu);
+	ShiftRegister sr;
+	shift_register_init(&sr, GP0, GP1, GP2, GP4);
+	bench_attach(&bench, &sr.base);
+	bench_run(&bench, 1000);
+	failures += check("shift register latched 0xA5", sr.outputs == 0xA5 && sr.latches == 1);
+	failures += check("serial out reads back on GP4", cpu.asleep && (cpu.f[GPIO] & GP4));
+	bench_deinit(&bench);
+	cpu_deinit(&cpu);
+
+	// Button through an RC filter into an LED, the CPU just sleeps
+	cpu_init(&cpu);
+	cpu.config &= ~WDTE;
+	cpu.inst[0] = 0x003; // SLEEP
+	cpu.pc = 0;
+	bench_init(&bench, &cpu);
+	Button button;
+	Pull pull;
+	RcDelay rc;
+	Led led;
+	button_init(&button, GP0, false, 0);
+	pull_init(&pull, GP0, false);
+	rc_delay_init(&rc, GP0, GP2, 200);
+	led_init(&led, GP2, false);
+	bench_attach(&bench, &button.base);
+	bench_attach(&bench, &pull.base);
+	bench_attach(&bench, &rc.base);
+	bench_attach(&bench, &led.base);
+	bench_run(&bench, 1000);
+	uint64_t pressed_at = bench_now(&bench);
+	button_set(&button, &bench, true);
+	bench_run(&bench, 199);
+	failures += check("RC output still low before the delay", !led.lit && (cpu.f[GPIO] & GP0));
+	bench_run(&bench, 1);
+	failures += check("RC output follows exactly delay cycles later", led.lit && led.changed_at == pressed_at + 200
+	                  && (cpu.f[GPIO] & GP2));
+	button_set(&button, &bench, false);
+	bench_run(&bench, 50);
+	button_set(&button, &bench, true);
+	bench_run(&bench, 1000);
+	failures += check("RC swallows a pulse shorter than the delay", led.lit && led.toggles == 1);
+	button_set(&button, &bench, false);
+	bench_run(&bench, 1000);
+	failures += check("pull takes the released pin low", !(cpu.f[GPIO] & GP0) && !led.lit);
+	bench_deinit(&bench);
+	failures += check("callbacks handed back", cpu.gpio_write_callback == NULL && cpu.bench == NULL);
+	cpu_deinit(&cpu);
+
+	// Writes over input pins and OPTION changes get the pins resolved again before the next read
+	cpu_init(&cpu);
+	cpu.config &= ~(WDTE | MCLRE);
+	cpu.option = 0xDF;    // Timer0 on the instruction clock, so GP2 can be an output
+	cpu.trisgpio = 0x3B;  // GP2 out
+	cpu.inst[0] = 0x066; // CLRF GPIO
+	cpu.inst[1] = 0x206; // MOVF GPIO,w
+	cpu.inst[2] = 0x030; // MOVWF 0x10
+	cpu.inst[3] = 0xCBF; // MOVLW 0xBF (pull-ups on, T0CKI takes GP2)
+	cpu.inst[4] = 0x002; // OPTION
+	cpu.inst[5] = 0x206; // MOVF GPIO,w
+	cpu.inst[6] = 0x031; // MOVWF 0x11
+	cpu.inst[7] = 0x003; // SLEEP
+	cpu.pc = 0;
+	bench_init(&bench, &cpu);
+	pull_init(&pull, GP0 | GP2, true);
+	bench_attach(&bench, &pull.base);
+	bench_run(&bench, 20);
+	failures += check("pulled input still reads high after CLRF GPIO", cpu.f[0x10] == GP0);
+	failures += check("pull-ups and T0CKI seen right after OPTION", cpu.f[0x11] == (GP0 | GP1 | GP2 | GP3));
+	bench_deinit(&bench);
+	failures += check("OPTION callback handed back", cpu.option_write_callback == NULL);
+	cpu_deinit(&cpu);
+
+	// A timer the update schedules in the past fires at once, rather than wrapping the run length
+	cpu_init(&cpu);
+	cpu.config &= ~WDTE;
+	cpu.inst[0] = 0xA00; // GOTO 0
+	cpu.pc = 0;
+	bench_init(&bench, &cpu);
+	Echo echo;
+	memset(&echo, 0, sizeof(Echo));
+	bench_init_peripheral(&echo.base, &echo_ops, GP0);
+	pull_init(&pull, GP0 | GP4, true);
+	bench_attach(&bench, &pull.base);
+	bench_attach(&bench, &echo.base);
+	uint64_t start = bench_now(&bench);
+	echo.deadline = start + 5;
+	bench_schedule(&echo.base, start + 10);
+	int reason = bench_run(&bench, 1000);
+	failures += check("overdue timer fires and the run still ends", reason == STOP_CYCLES && echo.fired == 2
+	                  && !(bench.pins & GP4) && bench_now(&bench) - start < 1010);
+	bench_deinit(&bench);
+	cpu_deinit(&cpu);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
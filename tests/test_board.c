@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "board.h"
+
+// Blinkers wired to followers that count their edges, run on 1 and 4 threads, plus pull-ups, floating nets and contention
+
+#define NUM_PAIRS 8
+#define RUN_CYCLES 150000
+
+static bool same_state(const CPUState *a, const CPUState *b) {
+	return a->pc == b->pc && a->skipnext == b->skipnext && a->asleep == b->asleep && a->inst_cycles == b->inst_cycles
+	    && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1] && a->w == b->w && memcmp(a->f, b->f, 32) == 0
+	    && a->trisgpio == b->trisgpio && a->option == b->option && a->prescaler == b->prescaler
+	    && a->timer0_inhibit == b->timer0_inhibit && a->wdt == b->wdt;
+}
+
+// Toggles GP0 every ~770 cycles, counting toggles in 0x12
+static void load_blinker(CPU *cpu) {
+	cpu->inst[0] = 0xC3E; // MOVLW 0x3E
+	cpu->inst[1] = 0x006; // TRIS GPIO (GP0 out)
+	cpu->inst[2] = 0x266; // COMF GPIO,f
+	cpu->inst[3] = 0x2B2; // INCF 0x12,f
+	cpu->inst[4] = 0x2F0; // DECFSZ 0x10,f
+	cpu->inst[5] = 0xA04; // GOTO 4
+	cpu->inst[6] = 0xA02; // GOTO 2
+	cpu->pc = 0;
+}
+
+// Copies GP0 onto GP1, counting rising edges in 0x11
+static void load_follower(CPU *cpu) {
+	cpu->inst[0] = 0xC3D; // MOVLW 0x3D
+	cpu->inst[1] = 0x006; // TRIS GPIO (GP1 out)
+	cpu->inst[2] = 0x706; // BTFSS GPIO,0
+	cpu->inst[3] = 0xA02; // GOTO 2
+	cpu->inst[4] = 0x526; // BSF GPIO,1
+	cpu->inst[5] = 0x2B1; // INCF 0x11,f
+	cpu->inst[6] = 0x606; // BTFSC GPIO,0
+	cpu->inst[7] = 0xA06; // GOTO 6
+	cpu->inst[8] = 0x426; // BCF GPIO,1
+	cpu->inst[9] = 0xA02; // GOTO 2
+	cpu->pc = 0;
+}
+
+// Keeps copying GPIO into 0x10, optionally with the weak pull-ups on
+static void load_reader(CPU *cpu, bool pullups) {
+	cpu->inst[0] = pullups ? 0xC9F : 0xCDF; // MOVLW OPTION value, GPPU clear or set
+	cpu->inst[1] = 0x002; // OPTION
+	cpu->inst[2] = 0x206; // MOVF GPIO,w
+	cpu->inst[3] = 0x030; // MOVWF 0x10
+	cpu->inst[4] = 0xA02; // GOTO 2
+	cpu->pc = 0;
+}
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Builds the blinker/follower pairs, each pair sharing a net on GP0, and runs them
+static void run_pairs(int num_threads, CPU *cpus, CPUState *states, Board *board) {
+	board_init(board, num_threads);
+	for (int p = 0; p < NUM_PAIRS; p++)
+	{
+		CPU *blinker = &cpus[p * 2], *follower = &cpus[p * 2 + 1];
+		cpu_init(blinker);
+		cpu_init(follower);
+		load_blinker(blinker);
+		load_follower(follower);
+		blinker->f[0x10] = p * 17; // Different rates
+
+		int net = board_add_net(board);
+		board_connect(board, net, board_add_device(board, blinker), 0);
+		board_connect(board, net, board_add_device(board, follower), 0);
+	}
+	board_run(board, RUN_CYCLES);
+	for (int i = 0; i < NUM_PAIRS * 2; i++)
+		cpu_save_state(&cpus[i], &states[i]);
+}
+
+int main(void) {
+	int failures = 0;
+	static CPU cpus[2][NUM_PAIRS * 2];
+	CPUState states[2][NUM_PAIRS * 2];
+	Board board;
+
+	for (int run = 0; run < 2; run++)
+	{
+		int num_threads = run == 0 ? 1 : 4;
+		run_pairs(num_threads, cpus[run], states[run], &board);
+		printf("%d thread(s): %llu quanta, quantum now %llu, net 0 toggled %llu times\n", num_threads,
+		       (unsigned long long)board.num_quanta, (unsigned long long)board.quantum,
+		       (unsigned long long)board.nets[0].toggles);
+
+		bool counted = true;
+		for (int p = 0; p < NUM_PAIRS; p++)
+		{
+			uint8_t toggles = states[run][p * 2].f[0x12], edges = states[run][p * 2 + 1].f[0x11];
+			int expected = (toggles + 1) / 2;
+			if (edges != expected && edges != expected - 1)
+				counted = false;
+		}
+		failures += check(run == 0 ? "1 thread: followers see every edge" : "4 threads: followers see every edge", counted);
+		failures += check("quanta shrink while nets toggle", board.num_quanta > RUN_CYCLES / BOARD_MAX_QUANTUM * 2);
+		board_deinit(&board);
+	}
+
+	bool same = true;
+	for (int i = 0; i < NUM_PAIRS * 2; i++)
+		if (!same_state(&states[0][i], &states[1][i]))
+			same = false;
+	failures += check("thread count doesn't change the results", same);
+	for (int run = 0; run < 2; run++)
+		for (int i = 0; i < NUM_PAIRS * 2; i++)
+			cpu_deinit(&cpus[run][i]);
+
+	// Pull-ups pull, floating nets keep their value, external drivers win over pull-ups
+	CPU pulled, floating;
+	cpu_init(&pulled);
+	cpu_init(&floating);
+	load_reader(&pulled, true);
+	load_reader(&floating, false);
+	board_init(&board, 2);
+	int pulled_net = board_add_net(&board), floating_net = board_add_net(&board);
+	board_connect(&board, pulled_net, board_add_device(&board, &pulled), 0);
+	board_connect(&board, floating_net, board_add_device(&board, &floating), 0);
+	board_run(&board, 10000); // Long enough for OPTION to get set and the net to settle
+	failures += check("pull-up pulls an undriven net high", board_getnet(&board, pulled_net) && (pulled.f[0x10] & GP0));
+	failures += check("undriven net without pull-up floats", !board_getnet(&board, floating_net) && !(floating.f[0x10] & GP0));
+	board_drive(&board, pulled_net, false);
+	board_drive(&board, floating_net, true);
+	board_run(&board, 1000);
+	failures += check("external drivers win over pull-ups", !board_getnet(&board, pulled_net) && !(pulled.f[0x10] & GP0));
+	board_release(&board, floating_net);
+	board_run(&board, 1000);
+	failures += check("released net holds its last value", board_getnet(&board, floating_net) && (floating.f[0x10] & GP0));
+
+	// Fighting a blinker
+	CPU blinker;
+	cpu_init(&blinker);
+	load_blinker(&blinker);
+	board_connect(&board, floating_net, board_add_device(&board, &blinker), 0);
+	board_drive(&board, floating_net, false);
+	board_run(&board, 10000);
+	failures += check("outputs fighting count as contention", board.contentions > 0);
+	failures += check("bad wiring is refused", board_connect(&board, 5, 0, 0) == BOARD_ERR_RANGE
+	                  && board_connect(&board, 0, 0, 6) == BOARD_ERR_RANGE);
+	board_deinit(&board);
+	cpu_deinit(&pulled);
+	cpu_deinit(&floating);
+	cpu_deinit(&blinker);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "cosim.h"
+
+// Testbench routines as coroutines around a press counter
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Lights the LED on GP1 while the button on GP0 is held (active low), counting presses in 0x10
+static void load_counter(CPU *cpu) {
+	cpu->inst[0] = 0xC1F;  // MOVLW 0x1F (pull-ups on)
+	cpu->inst[1] = 0x002;  // OPTION
+	cpu->inst[2] = 0xC3D;  // MOVLW 0x3D
+	cpu->inst[3] = 0x006;  // TRIS GPIO (GP1 out)
+	cpu->inst[4] = 0x606;  // BTFSC GPIO,0
+	cpu->inst[5] = 0xA04;  // GOTO 4
+	cpu->inst[6] = 0x526;  // BSF GPIO,1
+	cpu->inst[7] = 0x2B0;  // INCF 0x10,f
+	cpu->inst[8] = 0x706;  // BTFSS GPIO,0
+	cpu->inst[9] = 0xA08;  // GOTO 8
+	cpu->inst[10] = 0x426; // BCF GPIO,1
+	cpu->inst[11] = 0xA04; // GOTO 4
+	cpu->pc = 0;
+	cpu->config &= ~WDTE;
+}
+
+// Presses the button, waits for the LED, holds it a bit, lets go and waits for the LED to go out
+typedef struct Presser {
+	CoRoutine co;
+	int i;
+	uint64_t pressed_at;
+	uint64_t worst_latency;
+	int missed;
+} Presser;
+
+static int presser(CoRoutine *co, Cosim *sim) {
+	Presser *p = (Presser *)co;
+	CO_BEGIN(co);
+	cpu_writepins(sim->cpu, GP0, true);
+	for (p->i = 0; p->i < 10; p->i++)
+	{
+		CO_WAIT_CYCLES(co, sim, 1000);
+		cpu_writepins(sim->cpu, GP0, false);
+		p->pressed_at = cosim_now(sim);
+		CO_TIMEOUT(co, 100);
+		CO_WAIT_PINS(co, sim, GP1, GP1);
+		if (co->timed_out)
+			p->missed++;
+		if (cosim_now(sim) - p->pressed_at > p->worst_latency)
+			p->worst_latency = cosim_now(sim) - p->pressed_at;
+		CO_WAIT_CYCLES(co, sim, 500);
+		cpu_writepins(sim->cpu, GP0, true);
+		CO_WAIT_PINS(co, sim, GP1, 0);
+	}
+	CO_END(co);
+}
+
+// Counts the times the firmware gets to the INCF
+typedef struct Watcher {
+	CoRoutine co;
+	int hits;
+} Watcher;
+
+static int watcher(CoRoutine *co, Cosim *sim) {
+	Watcher *w = (Watcher *)co;
+	CO_BEGIN(co);
+	while (w->hits < 10)
+	{
+		CO_WAIT_PC(co, sim, 7);
+		w->hits++;
+	}
+	CO_END(co);
+}
+
+// Waits for something that never happens
+static int impatient(CoRoutine *co, Cosim *sim) {
+	CO_BEGIN(co);
+	CO_TIMEOUT(co, 5000);
+	CO_WAIT_PINS(co, sim, GP5, GP5);
+	CO_END(co);
+}
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	cpu_init(&cpu);
+	load_counter(&cpu);
+
+	Cosim sim;
+	Presser p;
+	Watcher w;
+	CoRoutine never;
+	memset(&p, 0, sizeof(p));
+	memset(&w, 0, sizeof(w));
+	cosim_init(&sim, &cpu);
+	cosim_spawn(&sim, &p.co, presser);
+	cosim_spawn(&sim, &w.co, watcher);
+	cosim_spawn(&sim, &never, impatient);
+	int reason = cosim_run(&sim, 1000000);
+	printf("%d presses, %d hits, worst latency %llu cycles, %llu resumes over %llu cycles\n", cpu.f[0x10], w.hits,
+	       (unsigned long long)p.worst_latency, (unsigned long long)sim.resumes, (unsigned long long)cpu.inst_cycles);
+	failures += check("every routine finished", reason == STOP_CYCLES && cosim_done(&sim) && cpu.inst_cycles < 20000);
+	failures += check("presses counted and seen at PC 7", cpu.f[0x10] == 10 && w.hits == 10);
+	failures += check("LED waits resume right after the write", p.missed == 0 && p.worst_latency <= 6);
+	failures += check("timeouts", never.timed_out && never.wait == COSIM_WAIT_DONE);
+	failures += check("only resumed when something happened", sim.resumes == 3 + 10 * 4 + 10 + 1);
+	failures += check("routine breakpoints taken out", cpu.breakpoints[7] == 0);
+
+	// A host breakpoint still stops the run, with the routines seeing it too
+	Watcher w2;
+	memset(&w2, 0, sizeof(w2));
+	cosim_spawn(&sim, &w2.co, watcher);
+	cpu_addbreakpoint(&cpu, 7);
+	cpu_writepins(&cpu, GP0, false);
+	reason = cosim_run(&sim, 1000);
+	failures += check("host breakpoint passes through", reason == STOP_BREAKPOINT && cpu.pc == 7 && w2.hits == 1);
+	cosim_deinit(&sim);
+	failures += check("callback handed back, host breakpoint kept", cpu.gpio_write_callback == NULL && cpu.cosim == NULL
+	                  && cpu.breakpoints[7] == BREAK_SET);
+	cpu_deinit(&cpu);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
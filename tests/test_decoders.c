@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "bench.h"
+#include "models.h"
+#include "decoders.h"
+
+// Bit-banging firmware for each protocol, checked through the decoders
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static void load(CPU *cpu, const uint16_t *program, int len) {
+	for (int i = 0; i < len; i++)
+		cpu->inst[i] = program[i];
+	cpu->pc = 0;
+	cpu->config &= ~WDTE;
+}
+
+static void print_bytes(const char *name, const Decoder *decoder) {
+	printf("%s:", name);
+	for (size_t i = 0; i < decoder->count; i++)
+		printf(" %02X/%02X", decoder->buffer[i].value, decoder->buffer[i].flags);
+	printf("\n");
+}
+
+// Sends "Hi" on GP0 at 105 cycles per bit
+static const uint16_t uart_program[] = {
+	0xC3E, // 0:  MOVLW 0x3E
+	0x006, // 1:  TRIS GPIO (GP0 out)
+	0x506, // 2:  BSF GPIO,0 (idle high)
+	0xC48, // 3:  MOVLW 'H'
+	0x030, // 4:  MOVWF 0x10
+	0x90A, // 5:  CALL send
+	0xC69, // 6:  MOVLW 'i'
+	0x030, // 7:  MOVWF 0x10
+	0x90A, // 8:  CALL send
+	0x003, // 9:  SLEEP
+	0x406, // 10: send: BCF GPIO,0 (start bit)
+	0xC08, // 11: MOVLW 8
+	0x031, // 12: MOVWF 0x11
+	0x923, // 13: CALL delay
+	0x000, // 14: NOP
+	0xA10, // 15: GOTO loop
+	0x330, // 16: loop: RRF 0x10,f
+	0x703, // 17: BTFSS STATUS,C
+	0xA16, // 18: GOTO zero
+	0x000, // 19: NOP (so both paths take as long)
+	0x506, // 20: BSF GPIO,0
+	0xA18, // 21: GOTO next
+	0x406, // 22: zero: BCF GPIO,0
+	0xA18, // 23: GOTO next
+	0x923, // 24: next: CALL delay
+	0x2F1, // 25: DECFSZ 0x11,f
+	0xA10, // 26: GOTO loop
+	0x000, // 27: NOP x5
+	0x000, // 28:
+	0x000, // 29:
+	0x000, // 30:
+	0x000, // 31:
+	0x506, // 32: BSF GPIO,0 (stop bit)
+	0x923, // 33: CALL delay
+	0x800, // 34: RETLW 0
+	0xC1E, // 35: delay: MOVLW 30
+	0x032, // 36: MOVWF 0x12
+	0x2F2, // 37: DECFSZ 0x12,f
+	0xA25, // 38: GOTO 37
+	0x800, // 39: RETLW 0
+};
+
+// Sends 0xA5, 0x3C in mode 0 with GP0 MOSI, GP1 SCK and GP2 chip select
+static const uint16_t spi_program[] = {
+	0xCDF, // 0:  MOVLW 0xDF (TOCS clear, so GP2 is an output)
+	0x002, // 1:  OPTION
+	0x546, // 2:  BSF GPIO,2 (deselected)
+	0xC38, // 3:  MOVLW 0x38
+	0x006, // 4:  TRIS GPIO (GP0-GP2 out)
+	0x446, // 5:  BCF GPIO,2 (selected)
+	0xCA5, // 6:  MOVLW 0xA5
+	0x030, // 7:  MOVWF 0x10
+	0x90F, // 8:  CALL spi
+	0xC3C, // 9:  MOVLW 0x3C
+	0x030, // 10: MOVWF 0x10
+	0x90F, // 11: CALL spi
+	0x546, // 12: BSF GPIO,2 (deselected)
+	0x003, // 13: SLEEP
+	0x000, // 14:
+	0xC08, // 15: spi: MOVLW 8
+	0x031, // 16: MOVWF 0x11
+	0x406, // 17: loop: BCF GPIO,0
+	0x370, // 18: RLF 0x10,f
+	0x603, // 19: BTFSC STATUS,C
+	0x506, // 20: BSF GPIO,0
+	0x526, // 21: BSF GPIO,1
+	0x426, // 22: BCF GPIO,1
+	0x2F1, // 23: DECFSZ 0x11,f
+	0xA11, // 24: GOTO loop
+	0x800, // 25: RETLW 0
+};
+
+// Writes 0x42 to address 0xA0 with GP0 SDA and GP1 SCL, open drain (TRIS shadowed in 0x13)
+static const uint16_t i2c_program[] = {
+	0xC3F, // 0:  MOVLW 0x3F
+	0x033, // 1:  MOVWF 0x13
+	0x066, // 2:  CLRF GPIO
+	0x006, // 3:  TRIS GPIO (everything released)
+	0x413, // 4:  BCF 0x13,0 (start: SDA low while SCL's high)
+	0x915, // 5:  CALL apply
+	0x433, // 6:  BCF 0x13,1
+	0x915, // 7:  CALL apply
+	0xCA0, // 8:  MOVLW 0xA0
+	0x030, // 9:  MOVWF 0x10
+	0x919, // 10: CALL byte
+	0xC42, // 11: MOVLW 0x42
+	0x030, // 12: MOVWF 0x10
+	0x919, // 13: CALL byte
+	0x413, // 14: BCF 0x13,0 (stop: SDA low, SCL high, SDA high)
+	0x915, // 15: CALL apply
+	0x533, // 16: BSF 0x13,1
+	0x915, // 17: CALL apply
+	0x513, // 18: BSF 0x13,0
+	0x915, // 19: CALL apply
+	0x003, // 20: SLEEP
+	0x213, // 21: apply: MOVF 0x13,w
+	0x066, // 22: CLRF GPIO (input latches pick up the pin levels, so they need clearing every time)
+	0x006, // 23: TRIS GPIO
+	0x800, // 24: RETLW 0
+	0xC08, // 25: byte: MOVLW 8
+	0x031, // 26: MOVWF 0x11
+	0x370, // 27: loop: RLF 0x10,f
+	0x513, // 28: BSF 0x13,0
+	0x703, // 29: BTFSS STATUS,C
+	0x413, // 30: BCF 0x13,0
+	0x915, // 31: CALL apply
+	0x533, // 32: BSF 0x13,1 (SCL released)
+	0x915, // 33: CALL apply
+	0x433, // 34: BCF 0x13,1
+	0x915, // 35: CALL apply
+	0x2F1, // 36: DECFSZ 0x11,f
+	0xA1B, // 37: GOTO loop
+	0x513, // 38: BSF 0x13,0 (ack clock with SDA released)
+	0x915, // 39: CALL apply
+	0x533, // 40: BSF 0x13,1
+	0x915, // 41: CALL apply
+	0x433, // 42: BCF 0x13,1
+	0x915, // 43: CALL apply
+	0x800, // 44: RETLW 0
+};
+
+static int callback_bytes = 0;
+
+static void count_callback(Decoder *decoder, const DecodedByte *byte) {
+	callback_bytes++;
+}
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	Bench bench;
+
+	// UART, plus a second decoder at the wrong baud rate
+	cpu_init(&cpu);
+	load(&cpu, uart_program, sizeof(uart_program) / sizeof(uart_program[0]));
+	bench_init(&bench, &cpu);
+	DecodedByte uart_bytes[8], wrong_bytes[8];
+	UartDecoder uart, wrong;
+	uart_decoder_init(&uart, GP0, 105);
+	uart_decoder_init(&wrong, GP0, 150);
+	decoder_set_buffer(&uart.decoder, uart_bytes, 8);
+	decoder_set_buffer(&wrong.decoder, wrong_bytes, 8);
+	uart.decoder.callback = count_callback;
+	bench_attach(&bench, &uart.decoder.base);
+	bench_attach(&bench, &wrong.decoder.base);
+	bench_run(&bench, 5000);
+	print_bytes("uart", &uart.decoder);
+	print_bytes("wrong baud", &wrong.decoder);
+	failures += check("uart decodes \"Hi\"", uart.decoder.count == 2 && uart_bytes[0].value == 'H' && uart_bytes[1].value == 'i'
+	                  && uart_bytes[0].flags == 0 && uart_bytes[1].flags == 0 && callback_bytes == 2);
+	failures += check("wrong baud rate gets flagged", wrong.decoder.framing_errors + wrong.decoder.timing_errors > 0);
+	bench_deinit(&bench);
+	cpu_deinit(&cpu);
+
+	// SPI, with a shift register on the bus whose serial out comes back as MISO
+	cpu_init(&cpu);
+	load(&cpu, spi_program, sizeof(spi_program) / sizeof(spi_program[0]));
+	bench_init(&bench, &cpu);
+	DecodedByte spi_bytes[8];
+	SpiDecoder spi;
+	ShiftRegister sr;
+	spi_decoder_init(&spi, GP1, GP0, GP4, GP2, 0);
+	shift_register_init(&sr, GP0, GP1, GP2, GP4);
+	decoder_set_buffer(&spi.decoder, spi_bytes, 8);
+	bench_attach(&bench, &spi.decoder.base);
+	bench_attach(&bench, &sr.base);
+	bench_run(&bench, 1000);
+	print_bytes("spi", &spi.decoder);
+	failures += check("spi decodes both bytes and the end of the frame", spi.decoder.count == 3 && spi_bytes[0].value == 0xA5
+	                  && spi_bytes[1].value == 0x3C && spi_bytes[2].flags == DECODE_STOP
+	                  && spi_bytes[0].flags == 0 && spi_bytes[1].flags == 0);
+	failures += check("spi picks up MISO", spi_bytes[0].miso == 0x00 && spi_bytes[1].miso == 0xA5 && sr.outputs == 0x3C);
+	bench_deinit(&bench);
+	cpu_deinit(&cpu);
+
+	// I2C with pull-ups and nobody answering
+	cpu_init(&cpu);
+	load(&cpu, i2c_program, sizeof(i2c_program) / sizeof(i2c_program[0]));
+	bench_init(&bench, &cpu);
+	DecodedByte i2c_bytes[8];
+	I2cDecoder i2c;
+	Pull pullups;
+	i2c_decoder_init(&i2c, GP1, GP0);
+	pull_init(&pullups, GP0 | GP1, true);
+	decoder_set_buffer(&i2c.decoder, i2c_bytes, 8);
+	bench_attach(&bench, &pullups.base);
+	bench_attach(&bench, &i2c.decoder.base);
+	bench_run(&bench, 2000);
+	print_bytes("i2c", &i2c.decoder);
+	failures += check("i2c decodes address, data and stop", i2c.decoder.count == 3
+	                  && i2c_bytes[0].value == 0xA0 && i2c_bytes[0].flags == (DECODE_START | DECODE_NACK)
+	                  && i2c_bytes[1].value == 0x42 && i2c_bytes[1].flags == DECODE_NACK
+	                  && i2c_bytes[2].flags == DECODE_STOP);
+	failures += check("i2c firmware finished", cpu.asleep);
+	bench_deinit(&bench);
+	cpu_deinit(&cpu);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "device.h"
+#include "engine.h"
+#include "expr.h"
+#include "fault.h"
+#include "image.h"
+#include "instructions.h"
+#include "memo.h"
+#include "savestate.h"
+#include "sweep.h"
+
+// Device descriptors: each part's own engine variants against the generic instruction_cycle() and pipeline, plus
+// the things that actually differ between parts (banking, paging, missing registers, reset vector, pins)
+
+#define RUN_CYCLES 10000000 // A couple of WDT resets
+
+// Runs on every part, the same words just mean different things
+static const uint16_t program[] = {
+	0xCC8, // 0x000: MOVLW 0xC8 (Timer0 on the instruction clock, prescaler 1:1 on the WDT)
+	0x002, // 0x001: OPTION
+	0xC30, // 0x002: loop: MOVLW 0x30
+	0x024, // 0x003: MOVWF FSR (bank 1 on the 12F509, 0x10 everywhere else)
+	0x2A0, // 0x004: INCF INDF,f
+	0x201, // 0x005: MOVF TMR0,w
+	0x038, // 0x006: MOVWF 0x18 (banked)
+	0x4A4, // 0x007: BCF FSR,5
+	0x1B8, // 0x008: XORWF 0x18,f (bank 0)
+	0x268, // 0x009: COMF 0x08,f (doesn't exist on the 10F200)
+	0x288, // 0x00A: INCF 0x08,w
+	0x039, // 0x00B: MOVWF 0x19
+	0x5A3, // 0x00C: BSF STATUS,PA0
+	0x911, // 0x00D: CALL 0x11 (0x211 on the 12F509)
+	0x03A, // 0x00E: MOVWF 0x1A
+	0x4A3, // 0x00F: BCF STATUS,PA0
+	0xA02, // 0x010: GOTO loop
+	0x811, // 0x011: RETLW 0x11
+};
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static void load_program(CPU *cpu) {
+	memcpy(cpu->inst, program, sizeof(program));
+	if (cpu->device->program_words > 0x211)
+		cpu->inst[0x211] = 0x822; // RETLW 0x22, page 1
+}
+
+static bool same_state(const CPU *a, const CPU *b) {
+	return a->pc == b->pc && a->w == b->w && a->inst_cycles == b->inst_cycles
+	    && memcmp(a->f, b->f, DEVICE_MAX_REGS) == 0 && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1]
+	    && a->skipnext == b->skipnext && a->asleep == b->asleep && a->option == b->option
+	    && a->trisgpio == b->trisgpio && a->prescaler == b->prescaler && a->wdt == b->wdt;
+}
+
+int main(void) {
+	int failures = 0;
+	char name[96];
+
+	failures += check("find by name", device_find("PIC12F509") == &device_pic12f509 && device_find("10f200") == &device_pic10f200
+	                  && device_find("pic10F202") == &device_pic10f202 && device_find("12F508") == &device_pic12f508
+	                  && device_find("PIC") == NULL && device_find("16F84") == NULL);
+	bool indexed = true, ram = true;
+	for (int i = 0; i < DEVICE_COUNT; i++)
+	{
+		const Device *device = device_list[i];
+		indexed &= device->index == i && device->reset_vector == device->program_words - 1;
+		int gprs = 0;
+		for (int r = 0x07; r < 0x20; r++)
+			gprs += !(device->unimplemented & (1u << r));
+		ram &= device->num_gpr == gprs + (device->banks - 1) * 16;
+	}
+	failures += check("device_list in index order", indexed);
+	failures += check("num_gpr matches the register map", ram);
+
+	CPU plain;
+	cpu_init(&plain);
+	failures += check("12F508 by default", plain.device == &device_pic12f508 && plain.pc == 0x1FF && plain.trisgpio == 0x3F
+	                  && strcmp(engine_variant_name(&plain), "psa_wdt") == 0);
+	cpu_deinit(&plain);
+
+	// Every part's fast engine against the generic one and the pipeline
+	for (int d = 0; d < DEVICE_COUNT; d++)
+	{
+		const Device *device = device_list[d];
+		CPU ref, fast, pipe;
+		cpu_init_device(&ref, device);
+		cpu_init_device(&fast, device);
+		cpu_init_device(&pipe, device);
+		cpu_set_engine(&pipe, ENGINE_PIPELINE);
+		load_program(&ref);
+		load_program(&fast);
+		load_program(&pipe);
+
+		bool ok = ref.pc == device->reset_vector && ref.inst[device->reset_vector] == MOVLW;
+		uint64_t chunk = 1;
+		int resets = 0;
+		while (ok && fast.inst_cycles < RUN_CYCLES)
+		{
+			uint64_t end = fast.inst_cycles + chunk;
+			chunk = chunk * 3 % 4099 + 1;
+			cpu_run_cycles(&fast, end - fast.inst_cycles);
+			cpu_run_cycles(&pipe, fast.inst_cycles - pipe.inst_cycles);
+			while (ref.inst_cycles < fast.inst_cycles)
+			{
+				instruction_cycle(&ref);
+				resets += ref.pc == device->reset_vector;
+			}
+			ok = same_state(&ref, &fast) && same_state(&ref, &pipe);
+		}
+		snprintf(name, sizeof(name), "%s engines agree (%d resets)", device->name, resets);
+		failures += check(name, ok && resets >= 2);
+
+		cpu_deinit(&ref);
+		cpu_deinit(&fast);
+		cpu_deinit(&pipe);
+	}
+
+	// What the program did on each, the first time round the loop
+	CPU cpu[DEVICE_COUNT];
+	for (int d = 0; d < DEVICE_COUNT; d++)
+	{
+		cpu_init_device(&cpu[d], device_list[d]);
+		load_program(&cpu[d]);
+		cpu_setbreakpoint(&cpu[d], 0x00F);
+		cpu_run(&cpu[d]);
+	}
+	CPU *p508 = &cpu[0], *p509 = &cpu[1], *p200 = &cpu[2], *p202 = &cpu[3];
+	failures += check("12F508 unbanked", p508->f[0x10] == 1 && p508->f[0x30] == 0 && p508->f[0x18] == 0
+	                  && p508->f[0x1A] == 0x11 && cpu_getreg(p508, FSR) == 0xF0);
+	failures += check("12F509 bank 1 through FSR<5>", p509->f[0x30] == 1 && p509->f[0x10] == 0
+	                  && p509->f[0x18] == p509->f[0x38] && cpu_getreg(p509, FSR) == 0xD0);
+	failures += check("12F509 CALL into page 1", p509->f[0x1A] == 0x22);
+	failures += check("10F200 missing registers", p200->f[0x08] == 0 && p200->f[0x19] == 1 && p200->trisgpio == 0x0F);
+	failures += check("10F202 has 0x08", p202->f[0x08] == 0xFF && p202->f[0x19] == 0);
+
+	// Through the API too, INDF included
+	cpu_setreg(p509, FSR, 0x3C);
+	cpu_setreg(p509, INDF, 0x5A);
+	cpu_setreg(p509, 0x1D, 0xA5);
+	cpu_setreg(p509, FSR, 0x1C);
+	failures += check("12F509 cpu_setreg()/cpu_getreg() banking", p509->f[0x3C] == 0x5A && p509->f[0x3D] == 0xA5
+	                  && cpu_getreg(p509, INDF) == p509->f[0x1C] && cpu_getreg(p509, 0x1D) == p509->f[0x1D]);
+	cpu_setreg(p200, 0x0F, 0xFF);
+	cpu_setreg(p200, FSR, 0x0E);
+	cpu_setreg(p200, INDF, 0xFF);
+	cpu_setgpio(p200, 0xFF);
+	failures += check("10F200 drops writes to what isn't there", p200->f[0x0F] == 0 && p200->f[0x0E] == 0
+	                  && cpu_getreg(p200, 0x0F) == 0 && cpu_getgpio(p200) == 0x0F);
+
+	// Breakpoints are per address of the part's program memory, PC only gets wrapped on the next fetch
+	cpu_addbreakpoint(p509, 0x211);
+	failures += check("12F509 breakpoint in page 1", cpu_run_cycles(p509, 1000) == STOP_BREAKPOINT && p509->pc == 0x211);
+	cpu_addbreakpoint(p200, 0x011);
+	failures += check("10F200 breakpoint wraps at 256 words", cpu_run_cycles(p200, 1000) == STOP_BREAKPOINT
+	                  && (p200->pc & 0xFF) == 0x011);
+
+	// Conditions see the part like the instructions do
+	Expr expr;
+	cpu_setreg(p509, FSR, 0x3C);
+	expr_compile(&expr, "pc == 0x211 && f[0x1D] == 0xA5 && indf == 0x5A && fsr == 0xFC");
+	bool banked = expr_eval(&expr, p509) == 1;
+	cpu_setreg(p509, FSR, 0x1C);
+	failures += check("12F509 conditions banked and paged", banked && expr_eval(&expr, p509) == 0);
+	expr_compile(&expr, "gpio == 0x0F && f[0x0F] == 0");
+	failures += check("10F200 conditions only see what's there", expr_eval(&expr, p200) == 1);
+
+	// Fault campaigns run on the CPU's own part, with its program size
+	FaultCampaign campaign;
+	bool sized = fault_init(&campaign, p509, 0x00E, 100000) == FAULT_OK && campaign.device == &device_pic12f509
+	          && fault_add(&campaign, 0, FAULT_TARGET_INST, 0x3FF, 0) == FAULT_OK
+	          && fault_add(&campaign, 0, FAULT_TARGET_STACK, 0, 9) == FAULT_OK
+	          && fault_add_random(&campaign, 64, FAULT_TARGETS_ALL, 1) == FAULT_OK && fault_run(&campaign, 1) == FAULT_OK;
+	fault_deinit(&campaign);
+	sized &= fault_init(&campaign, p200, 0x00E, 100000) == FAULT_OK
+	      && fault_add(&campaign, 0, FAULT_TARGET_INST, 0x100, 0) == FAULT_ERR_ARG
+	      && fault_add(&campaign, 0, FAULT_TARGET_STACK, 0, 8) == FAULT_ERR_ARG;
+	fault_deinit(&campaign);
+	failures += check("fault campaigns sized by the part", sized);
+
+	// Loading and the things that only fit some parts
+	const char *page1_hex = ":020600002208CE\n:00000001FF\n"; // RETLW 0x22 at 0x300
+	failures += check("HEX sized by the part", cpu_load_hex_buffer(p509, page1_hex, strlen(page1_hex)) == HEX_OK
+	                  && p509->inst[0x300] == 0x822
+	                  && cpu_load_hex_buffer(p508, page1_hex, strlen(page1_hex)) == HEX_ERR_ADDRESS);
+	FirmwareImage *image = calloc(1, sizeof(FirmwareImage));
+	failures += check("images only for 512 words", image_attach(p509, image) == IMAGE_ERR_DEVICE
+	                  && image_attach(p200, image) == IMAGE_ERR_DEVICE && cpu_reload_image(p509, image, RESET_NONE) == IMAGE_ERR_DEVICE);
+	free(image);
+	const char *config_hex = ":021FFE000000E1\n:00000001FF\n"; // Config word 0x000
+	failures += check("config bits the part doesn't have read as 1", cpu_load_hex_buffer(p200, config_hex, strlen(config_hex)) == HEX_OK
+	                  && p200->config == 0xFE3 && cpu_load_hex_buffer(p508, config_hex, strlen(config_hex)) == HEX_OK
+	                  && p508->config == 0xFE0);
+	SaveState save;
+	savestate_from_cpu(&save, p202);
+	failures += check("save-states stay on their part", savestate_restore(p508, &save) == SAVESTATE_ERR_DEVICE
+	                  && savestate_restore(p202, &save) == SAVESTATE_OK);
+	Memo memo;
+	failures += check("memo refuses other parts", memo_init(&memo, p509, 0) == MEMO_ERR_DEVICE && p509->memo == NULL);
+	Sweep sweep;
+	failures += check("sweeps refuse other parts", sweep_init(&sweep, p202, 0x000, 0x00E) == SWEEP_ERR_DEVICE);
+	sweep_deinit(&sweep);
+
+	for (int d = 0; d < DEVICE_COUNT; d++)
+		cpu_deinit(&cpu[d]);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "engine.h"
+#include "instructions.h"
+
+// Checks every specialised engine variant against the reference instruction_cycle() across OPTION/config combinations
+
+#define RUN_CYCLES 6000000
+
+static void load_program(CPU *cpu, uint8_t option) {
+	uint16_t program[] = {
+		0xC00 | option, // MOVLW option
+		0x002,          // OPTION
+		0xC3F,          // MOVLW 0x3F
+		0x006,          // TRIS GPIO
+		0xC81,          // MOVLW 0x81
+		0x030,          // MOVWF 0x10
+		0x370,          // RLF 0x10,f
+		0x331,          // RRF 0x11,f
+		0x201,          // MOVF TMR0,w
+		0x1F2,          // ADDWF 0x12,f
+		0x0B3,          // SUBWF 0x13,f
+		0x672,          // BTFSC 0x12,3
+		0x2B4,          // INCF 0x14,f
+		0x710,          // BTFSS 0x10,0
+		0x275,          // COMF 0x15,f
+		0x392,          // SWAPF 0x12,w
+		0x1B6,          // XORWF 0x16,f
+		0x2F7,          // DECFSZ 0x17,f
+		0xA06,          // GOTO 6
+		0x021,          // MOVWF TMR0
+		0x3F8,          // INCFSZ 0x18,f
+		0xA06,          // GOTO 6
+		0x003,          // SLEEP (only the WDT gets us out of this one)
+	};
+	for (int i = 0; i < (int)(sizeof(program) / sizeof(program[0])); i++)
+		cpu->inst[i] = program[i];
+}
+
+static bool same_state(CPU *a, CPU *b) {
+	return a->pc == b->pc && a->w == b->w && a->inst_cycles == b->inst_cycles
+	    && memcmp(a->f, b->f, 32) == 0 && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1]
+	    && a->skipnext == b->skipnext && a->asleep == b->asleep && a->option == b->option
+	    && a->trisgpio == b->trisgpio && a->prescaler == b->prescaler && a->timer0_inhibit == b->timer0_inhibit
+	    && a->wdt == b->wdt;
+}
+
+int main(void) {
+	const uint8_t options[] = {0x00, 0x07, 0x08, 0x0F, 0xD8, 0xFF};
+	const uint16_t configs[] = {0xFFF, 0xFFB}; // WDT on, WDT off
+	const uint64_t chunks[] = {1, 7, 1000, 250000};
+	int failures = 0;
+	double ref_seconds = 0, fast_seconds = 0;
+	uint64_t total_cycles = 0;
+
+	for (int o = 0; o < (int)sizeof(options); o++)
+	for (int c = 0; c < 2; c++)
+	{
+		CPU ref, fast;
+		cpu_init(&ref);
+		cpu_init(&fast);
+		ref.config = fast.config = configs[c];
+		load_program(&ref, options[o]);
+		load_program(&fast, options[o]);
+
+		// Let the program's OPTION run so we can see which variant it ends up in
+		for (int i = 0; i < 3; i++) {
+			instruction_cycle(&ref);
+			cpu_run_cycles(&fast, 1);
+		}
+		const char *variant = engine_variant_name(&fast);
+
+		// Compare at chunk boundaries of varying sizes
+		int chunk = 0;
+		bool ok = true;
+		while (ok && fast.inst_cycles < RUN_CYCLES)
+		{
+			uint64_t end = fast.inst_cycles + chunks[chunk++ % 4];
+
+			clock_t start = clock();
+			cpu_run_cycles(&fast, end - fast.inst_cycles);
+			fast_seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+			start = clock();
+			while (ref.inst_cycles < end)
+				instruction_cycle(&ref);
+			ref_seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+			ok = same_state(&ref, &fast);
+		}
+		total_cycles += fast.inst_cycles;
+
+		printf("option=0x%02x config=0x%03x variant=%-12s %s (pc=%u, TMR0=%u, wdt=%u, asleep=%d, cycles=%llu)\n",
+		       options[o], configs[c], variant, ok ? "agree" : "DIVERGED", fast.pc, fast.f[TMR0], fast.wdt, fast.asleep,
+		       (unsigned long long)fast.inst_cycles);
+		if (!ok)
+			failures++;
+		cpu_deinit(&ref);
+		cpu_deinit(&fast);
+	}
+
+	printf("Reference: %.1f MHz, specialised: %.1f MHz (simulated instruction cycles)\n",
+	       total_cycles / ref_seconds / 1e6, total_cycles / fast_seconds / 1e6);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "expr.h"
+
+// Condition expressions on their own, then as conditional breakpoints in the divide program
+
+typedef struct Case {
+	const char *src;
+	int64_t expected; // Or the error code
+} Case;
+
+static const Case cases[] = {
+	{"1 + 2 * 3", 7},
+	{"(1 + 2) * 3", 9},
+	{"0x10 | 0b11", 19},
+	{"pc == 20 && W > 3", 1},
+	{"pc=20", EXPR_ERR_SYNTAX},
+	{"f[0x09] == 0 and w > 3", 1},
+	{"F[0x09] != 0 OR not z", 0},
+	{"status & 0x04", 4},
+	{"z && !c", 1},
+	{"gp0 + gp1 * 2 + gp5 * 4", 5},
+	{"gpio", 0x21},
+	{"indf", 0x2A}, // FSR points at 0x10
+	{"pcl", 21}, // What the program itself would read
+	{"pcl == pc + 1", 1},
+	{"cycles > 4000000000", 1},
+	{"cycles % 1000", 1},
+	{"~w & 0xFF", 0xFA},
+	{"-w", -5},
+	{"1 << 4 >> 2", 4},
+	{"3 < 4 == 1", 1},
+	{"option >> 3 & 1", 1},
+	{"f[0x40]", EXPR_ERR_RANGE},
+	{"foo > 1", EXPR_ERR_NAME},
+	{"1 +", EXPR_ERR_SYNTAX},
+	{"(1 + 2", EXPR_ERR_SYNTAX},
+	{"1 2", EXPR_ERR_SYNTAX},
+};
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	cpu_init(&cpu);
+	cpu.pc = 20;
+	cpu.w = 5;
+	cpu.f[0x09] = 0;
+	cpu.f[STATUS] = 0x18 | Z;
+	cpu.f[GPIO] = GP0 | GP5;
+	cpu.f[FSR] = 0x10;
+	cpu.f[0x10] = 0x2A;
+	cpu.inst_cycles = 4000000001ULL;
+
+	for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+	{
+		Expr expr;
+		int err = expr_compile(&expr, cases[i].src);
+		int64_t result = err == EXPR_OK ? expr_eval(&expr, &cpu) : err;
+		bool ok = result == cases[i].expected;
+		printf("%-28s = %-12lld (%2d bytes) %s\n", cases[i].src, (long long)result, expr.code_len, ok ? "ok" : "FAILED");
+		if (!ok)
+			failures++;
+	}
+	cpu_deinit(&cpu);
+
+	// "Stop at the SUBWF once the remainder is under 5", in both engines
+	for (int engine = ENGINE_FAST; engine <= ENGINE_PIPELINE; engine++)
+	{
+		cpu_init(&cpu);
+		cpu_set_engine(&cpu, engine);
+		cpu_load_hex(&cpu, "divide/divide-12f508.HEX");
+		if (cpu_addcondbreakpoint(&cpu, 4, "f[0x08] < 5") != EXPR_OK)
+			failures++;
+		if (cpu_addcondbreakpoint(&cpu, 9, "w == 200") != EXPR_OK) // Never true
+			failures++;
+		int reason = cpu_run_cycles(&cpu, 10000);
+		bool ok = reason == STOP_BREAKPOINT && cpu.pc == 4 && cpu.f[0x08] == 2;
+		printf("%s: conditional breakpoint at pc=%d with f[0x08]=%d %s\n", engine == ENGINE_FAST ? "fast" : "pipeline",
+		       cpu.pc, cpu.f[0x08], ok ? "ok" : "FAILED");
+		if (!ok)
+			failures++;
+
+		// Removed, the run goes on to the end
+		cpu_removecondbreakpoint(&cpu, 4);
+		cpu_setbreakpoint(&cpu, 20);
+		reason = cpu_run_cycles(&cpu, 10000);
+		ok = reason == STOP_BREAKPOINT && cpu.pc == 20 && cpu.f[0x07] == 3;
+		printf("%s: removed, ran to pc=%d %s\n", engine == ENGINE_FAST ? "fast" : "pipeline", cpu.pc, ok ? "ok" : "FAILED");
+		if (!ok)
+			failures++;
+		cpu_deinit(&cpu);
+	}
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
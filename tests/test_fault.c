@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "fault.h"
+
+// Bit flips in a program dividing 11 by 1, classified against the fault-free run
+
+#define DIVIDE  0x20
+#define END_PC  9
+#define MOVWF_DENOMINATOR_DONE 7 // Cycles from power-on to just after MOVWF denominator
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static const uint16_t program[] = {
+	0xC08, // 0: MOVLW 0x08 (prescaler to the WDT at 1:1)
+	0x002, // 1: OPTION
+	0xC0B, // 2: MOVLW 11
+	0x02A, // 3: MOVWF numerator
+	0xC01, // 4: MOVLW 1
+	0x029, // 5: MOVWF denominator
+	0x900 | DIVIDE, // 6: CALL divide
+	0x207, // 7: MOVF quotient,w
+	0x030, // 8: MOVWF 0x10
+	0x003, // 9: SLEEP
+};
+
+// tests/divide's routine
+static const uint16_t divide_routine[] = {
+	0x20A, 0x028, 0x067, 0x209, 0x088, 0x703, 0xA00 | (DIVIDE + 10), 0x028, 0x2A7, 0xA00 | (DIVIDE + 3), 0x800,
+};
+
+static void load(CPU *cpu, bool wdt) {
+	cpu_init(cpu);
+	memset(cpu->inst, 0, 512 * sizeof(uint16_t));
+	memcpy(cpu->inst, program, sizeof(program));
+	memcpy(cpu->inst + DIVIDE, divide_routine, sizeof(divide_routine));
+	cpu->inst[0x1FF] = 0xC00;
+	cpu->config = wdt ? 0xFFF : 0xFFF & ~WDTE;
+}
+
+int main(void) {
+	int failures = 0;
+	static FaultCampaign c;
+	CPU cpu;
+
+	// Without the WDT a stuck loop is just a hang
+	load(&cpu, false);
+	int err = fault_init(&c, &cpu, END_PC, 100000);
+	failures += check("golden run", err == FAULT_OK && c.golden.f[0x10] == 11 && c.golden_cycles > 100
+	                  && c.num_checkpoints > 100 && c.hang_cycles == c.golden_cycles * FAULT_HANG_FACTOR + FAULT_HANG_MARGIN);
+	fault_add(&c, 3, FAULT_TARGET_REG, 0x07, 0);                       // Quotient, cleared before it's used
+	fault_add(&c, MOVWF_DENOMINATOR_DONE, FAULT_TARGET_REG, 0x0A, 1); // Numerator 11 -> 9
+	fault_add(&c, MOVWF_DENOMINATOR_DONE, FAULT_TARGET_REG, 0x09, 0); // Denominator 1 -> 0, subtracts forever
+	fault_add(&c, MOVWF_DENOMINATOR_DONE, FAULT_TARGET_W, 0, 7);      // W gets reloaded first thing
+	fault_add(&c, 20, FAULT_TARGET_INST, 7, 5);                       // MOVF quotient,w -> MOVF quotient,f
+	fault_add(&c, 10, FAULT_TARGET_STACK, 0, 3);                      // Returns to 7 ^ 8 = 15, runs through to 0x1FF and round again
+	failures += check("bad faults refused", fault_add(&c, c.golden_cycles, FAULT_TARGET_W, 0, 0) == FAULT_ERR_ARG
+	                  && fault_add(&c, 0, FAULT_TARGET_STACK, 0, 9) == FAULT_ERR_ARG
+	                  && fault_add(&c, 0, FAULT_TARGET_REG, 32, 0) == FAULT_ERR_ARG && c.num_faults == 6);
+	fault_run(&c, 2);
+	fault_print(&c, stdout);
+	for (size_t i = 0; i < c.num_faults; i++)
+		printf("%s %u bit %u at %llu: %s after %llu cycles\n", fault_target_name(c.faults[i].target), c.faults[i].index,
+		       c.faults[i].bit, (unsigned long long)c.faults[i].cycle, fault_outcome_name(c.faults[i].outcome),
+		       (unsigned long long)c.faults[i].cycles);
+	failures += check("overwritten register masked", c.faults[0].outcome == FAULT_MASKED);
+	failures += check("numerator corrupted", c.faults[1].outcome == FAULT_CORRUPTION);
+	failures += check("divide by zero hangs", c.faults[2].outcome == FAULT_HANG && c.faults[2].cycles >= c.hang_cycles);
+	failures += check("dead W masked", c.faults[3].outcome == FAULT_MASKED);
+	failures += check("program word corrupted", c.faults[4].outcome == FAULT_CORRUPTION);
+	failures += check("bad return runs the program again", c.faults[5].outcome == FAULT_MASKED
+	                  && c.faults[5].cycles > c.golden_cycles);
+	failures += check("counts", c.counts[FAULT_MASKED] == 3 && c.counts[FAULT_CORRUPTION] == 2 && c.counts[FAULT_HANG] == 1
+	                  && c.by_target[FAULT_TARGET_REG][FAULT_HANG] == 1);
+
+	// Random faults come out the same however many threads run them
+	fault_clear(&c);
+	fault_add_random(&c, 20000, FAULT_TARGETS_ALL, 1234);
+	fault_run(&c, 1);
+	uint8_t *single = malloc(c.num_faults);
+	for (size_t i = 0; i < c.num_faults; i++)
+		single[i] = c.faults[i].outcome;
+	fault_run(&c, 4);
+	fault_print(&c, stdout);
+	bool same = c.num_faults == 20000;
+	for (size_t i = 0; i < c.num_faults; i++)
+		same &= single[i] == c.faults[i].outcome;
+	free(single);
+	failures += check("thread count doesn't matter", same);
+	failures += check("evenly spread", c.by_target[FAULT_TARGET_W][FAULT_MASKED] + c.by_target[FAULT_TARGET_W][FAULT_HANG]
+	                  + c.by_target[FAULT_TARGET_W][FAULT_CORRUPTION] == 5000 && c.counts[FAULT_DETECTED] == 0
+	                  && c.counts[FAULT_MASKED] > 0 && c.counts[FAULT_HANG] > 0 && c.counts[FAULT_CORRUPTION] > 0);
+	fault_deinit(&c);
+	cpu_deinit(&cpu);
+
+	// With it, the same stuck loop gets reset
+	load(&cpu, true);
+	err = fault_init(&c, &cpu, END_PC, 100000);
+	failures += check("golden run with the WDT", err == FAULT_OK && c.hang_cycles > 256 * 18000);
+	fault_add(&c, MOVWF_DENOMINATOR_DONE, FAULT_TARGET_REG, 0x09, 0);
+	fault_add(&c, 3, FAULT_TARGET_REG, 0x07, 0);
+	fault_run(&c, 1);
+	fault_print(&c, stdout);
+	failures += check("WDT detects the hang", c.faults[0].outcome == FAULT_DETECTED
+	                  && c.faults[0].cycles < c.hang_cycles && c.faults[1].outcome == FAULT_MASKED);
+	fault_deinit(&c);
+	cpu_deinit(&cpu);
+
+	// A golden run that never gets there
+	load(&cpu, false);
+	failures += check("golden run has to reach the end", fault_init(&c, &cpu, 0x100, 10000) == FAULT_ERR_GOLDEN);
+	fault_deinit(&c);
+	cpu_deinit(&cpu);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
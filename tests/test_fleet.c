@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "image.h"
+#include "fleet.h"
+#include "stimulus.h"
+
+// A fleet of edge counters on mostly the same inputs, checked instance by instance against running them alone
+
+#define INSTANCES 1000
+#define CYCLES    100000
+#define EDGES_REG 0x11
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Counts changes on GP0 into EDGES_REG, 0x10 holding the last level seen
+static const uint16_t counter_program[] = {
+	0x206, // 0: loop: MOVF GPIO,w
+	0xE01, // 1: ANDLW 1
+	0x190, // 2: XORWF 0x10,w
+	0x643, // 3: BTFSC STATUS,Z
+	0xA00, // 4: GOTO loop
+	0x1B0, // 5: XORWF 0x10,f
+	0x2B1, // 6: INCF edges,f
+	0xA00, // 7: GOTO loop
+};
+
+static void make_image(FirmwareImage *image, uint8_t edges_reg) {
+	memset(image, 0, sizeof(FirmwareImage));
+	image->magic = IMAGE_MAGIC;
+	image->version = IMAGE_VERSION;
+	image->num_words = IMAGE_WORDS;
+	image->size = sizeof(FirmwareImage);
+	image->config = 0xFFF & ~WDTE;
+	memcpy(image->inst, counter_program, sizeof(counter_program));
+	image->inst[6] = 0x2A0 | edges_reg;
+	image->inst[0x1FF] = 0xC00;
+	image_finalise(image);
+}
+
+// Everyone: GP0 toggles a few times
+static const StimulusEvent common[] = {
+	{ 5000, 0, STIMULUS_SET, 0x01, 0x01 },
+	{ 20000, 0, STIMULUS_SET, 0x01, 0x00 },
+	{ 20500, 0, STIMULUS_EXPECT, 0x01, 0x00 },
+	{ 60000, 0, STIMULUS_SET, 0x01, 0x01 },
+};
+// Same, plus a blip on GP1 that the program never looks at
+static const StimulusEvent blip[] = {
+	{ 5000, 0, STIMULUS_SET, 0x01, 0x01 },
+	{ 7000, 0, STIMULUS_SET, 0x02, 0x02 },
+	{ 7100, 0, STIMULUS_SET, 0x02, 0x00 },
+	{ 20000, 0, STIMULUS_SET, 0x01, 0x00 },
+	{ 20500, 0, STIMULUS_EXPECT, 0x01, 0x00 },
+	{ 60000, 0, STIMULUS_SET, 0x01, 0x01 },
+};
+// Same, plus an extra pulse on GP0 and a failing expectation
+static const StimulusEvent extra[] = {
+	{ 5000, 0, STIMULUS_SET, 0x01, 0x01 },
+	{ 20000, 0, STIMULUS_SET, 0x01, 0x00 },
+	{ 20500, 0, STIMULUS_EXPECT, 0x01, 0x01 },
+	{ 41234, 0, STIMULUS_SET, 0x01, 0x01 },
+	{ 41300, 0, STIMULUS_SET, 0x01, 0x00 },
+	{ 60000, 0, STIMULUS_SET, 0x01, 0x01 },
+};
+
+static const StimulusEvent *inputs_for(int i, size_t *n) {
+	if (i == 7) {
+		*n = sizeof(blip) / sizeof(blip[0]);
+		return blip;
+	}
+	if (i == 8) {
+		*n = sizeof(extra) / sizeof(extra[0]);
+		return extra;
+	}
+	*n = sizeof(common) / sizeof(common[0]);
+	return common;
+}
+
+int main(void) {
+	int failures = 0;
+	static FirmwareImage image, other_image;
+	make_image(&image, EDGES_REG);
+	make_image(&other_image, 0x12);
+
+	static Fleet fleet;
+	fleet_init(&fleet);
+	fleet.epoch = 1000;
+	for (int i = 0; i < INSTANCES; i++)
+	{
+		size_t n;
+		const StimulusEvent *events = inputs_for(i, &n);
+		int index = fleet_add(&fleet, i == 500 ? &other_image : &image);
+		fleet_set_inputs(&fleet, index, events, n);
+	}
+	StimulusEvent backwards[2] = { common[1], common[0] };
+	failures += check("unsorted inputs refused", fleet_set_inputs(&fleet, 0, backwards, 2) == FLEET_ERR_ORDER
+	                  && fleet_set_inputs(&fleet, INSTANCES, common, 4) == FLEET_ERR_INDEX);
+	failures += check("run", fleet_run(&fleet, CYCLES - 1) == FLEET_OK && fleet_run(&fleet, 1) == FLEET_OK);
+	printf("%llu epochs, %llu group runs for %llu instance runs, %d groups at the end\n",
+	       (unsigned long long)fleet.epochs, (unsigned long long)fleet.group_runs,
+	       (unsigned long long)fleet.instance_runs, fleet_num_groups(&fleet));
+
+	// Every one of them on its own
+	bool same = true;
+	for (int i = 0; i < INSTANCES; i++)
+	{
+		CPU cpu;
+		cpu_init(&cpu);
+		image_attach(&cpu, i == 500 ? &other_image : &image);
+		Stimulus stim;
+		memset(&stim, 0, sizeof(Stimulus));
+		stim.events = (StimulusEvent *)inputs_for(i, &stim.num_events);
+		stim.length = CYCLES;
+		stimulus_start(&stim, &cpu);
+		while (!stimulus_done(&stim))
+			stimulus_run(&stim, UINT64_MAX);
+
+		CPUState alone, in_fleet;
+		memset(&alone, 0, sizeof(CPUState));
+		cpu_save_state(&cpu, &alone);
+		fleet_get_state(&fleet, i, &in_fleet);
+		const FleetInstance *inst = &fleet.instances[i];
+		if (memcmp(&alone, &in_fleet, sizeof(CPUState)) != 0 || inst->expects != stim.expects
+		    || inst->failures != stim.failures || inst->next != stim.num_events) {
+			printf("instance %d differs\n", i);
+			same = false;
+		}
+		cpu_deinit(&cpu);
+	}
+	failures += check("every instance exactly as if run alone", same);
+
+	CPUState first, blipped, extra_pulse, other;
+	fleet_get_state(&fleet, 0, &first);
+	fleet_get_state(&fleet, 7, &blipped);
+	fleet_get_state(&fleet, 8, &extra_pulse);
+	fleet_get_state(&fleet, 500, &other);
+	failures += check("edges counted", first.f[EDGES_REG] == 3 && extra_pulse.f[EDGES_REG] == 5
+	                  && other.f[0x12] == 3 && other.f[EDGES_REG] == 0);
+	failures += check("expectations", fleet.instances[0].expects == 1 && fleet.instances[0].failures == 0
+	                  && fleet.instances[8].failures == 1 && fleet.instances[8].failed_cycle >= 20500);
+	failures += check("blip rejoined the rest", fleet.instances[7].group == fleet.instances[0].group
+	                  && fleet_num_groups(&fleet) == 3);
+	failures += check("deduplicated", fleet.instance_runs == fleet.epochs * INSTANCES && fleet.group_runs < fleet.instance_runs / 100);
+
+	fleet_deinit(&fleet);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
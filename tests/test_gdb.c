@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE // usleep()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "cpu.h"
+#include "gdb.h"
+#include "hex.h"
+#include "history.h"
+
+// Talks RSP to the stub over a socketpair, with the server running in a child process
+
+static int fd;
+static int failures = 0;
+
+static void send_packet(const char *data) {
+	char frame[GDB_PACKET_SIZE + 8];
+	uint8_t checksum = 0;
+	for (const char *p = data; *p; p++)
+		checksum += (uint8_t)*p;
+	int len = sprintf(frame, "$%s#%02x", data, checksum);
+	write(fd, frame, len);
+}
+
+// Reads up to the next packet and acks it, skipping acks for our own packets
+static void read_packet(char *out) {
+	char c;
+	do {
+		// The server's gone, waiting would just hang
+		if (read(fd, &c, 1) != 1) {
+			printf("Server hung up\n%d failure(s)\n", failures + 1);
+			exit(1);
+		}
+	} while (c != '$');
+	int len = 0;
+	while (read(fd, &c, 1) == 1 && c != '#')
+		out[len++] = c;
+	out[len] = '\0';
+	char checksum[2];
+	read(fd, checksum, 2);
+	write(fd, "+", 1);
+}
+
+static void expect(const char *request, const char *reply) {
+	char got[GDB_PACKET_SIZE + 1];
+	send_packet(request);
+	read_packet(got);
+	bool ok = strncmp(got, reply, strlen(reply)) == 0;
+	printf("%-24s -> %-40.40s %s\n", request, got, ok ? "ok" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+static void serve(int server_fd) {
+	CPU cpu;
+	cpu_init(&cpu);
+	if (cpu_load_hex(&cpu, "divide/divide-12f508.HEX") != HEX_OK)
+		_exit(1);
+	cpu.inst[0x40] = 0xA40; // GOTO 0x40, somewhere to spin until interrupted
+
+	History history;
+	history_init(&history, &cpu, 0);
+
+	GdbServer gdb;
+	gdb_attach_fd(&gdb, &cpu, server_fd);
+	gdb.history = &history;
+	int result = gdb_serve(&gdb);
+	gdb_close(&gdb);
+	history_deinit(&history);
+	cpu_deinit(&cpu);
+	_exit(result == GDB_KILLED ? 0 : 1);
+}
+
+int main(void) {
+	if (access("divide/divide-12f508.HEX", R_OK) != 0) {
+		printf("divide/divide-12f508.HEX isn't there, run this from tests/\n1 failure(s)\n");
+		return 1;
+	}
+	int fds[2];
+	socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		serve(fds[1]);
+	}
+	close(fds[1]);
+	fd = fds[0];
+
+	expect("qSupported:xmlRegisters=i386", "PacketSize=1000;qXfer:features:read+;QStartNoAckMode+;ReverseStep+");
+	expect("qXfer:features:read:target.xml:0,40", "m<?xml");
+	expect("?", "S05");
+	expect("p21", "fe03"); // Reset vector 0x1FF is byte address 0x3FE
+
+	// Write watchpoint on the quotient, first hit is clearing it at word 3
+	expect("Z2,800007,1", "OK");
+	expect("c", "T05watch:800007;");
+	expect("p21", "0800");
+	expect("z2,800007,1", "OK");
+
+	// Run to word 20 like test_divide does, breakpoints and continue go through the native run loop
+	expect("Z0,28,2", "OK");
+	expect("c", "S05");
+	expect("p21", "2800");
+	expect("m800007,4", "0302030b"); // Quotient, remainder, denominator, numerator
+
+	// Back one instruction and forward again
+	expect("bs", "S05");
+	expect("s", "S05");
+	expect("p21", "2800");
+	expect("z0,28,2", "OK");
+
+	// Single stepping and the instruction under the PC
+	expect("s", "S05");
+	expect("p21", "2a00");
+	expect("m0,2", "");
+
+	// Registers and memory writes
+	expect("P0=5a", "OK");
+	expect("p0", "5a");
+	expect("M800010,1:7f", "OK");
+	expect("m800010,1", "7f");
+	expect("M80,2:400a", "OK"); // Word 0x40 = 0xA40 again, which it already is
+	expect("m80,2", "400a");
+	expect("m1ffe,2", "fa0f"); // Config word
+	expect("m4000,1", "E01");
+
+	// The divide program ends up asleep, so wake it with a reset then spin at 0x40 until we interrupt it
+	expect("qRcmd,7265736574", "OK"); // monitor reset
+	expect("P21=8000", "OK");
+	send_packet("c");
+	char ack;
+	read(fd, &ack, 1);
+	usleep(50000);
+	write(fd, "\x03", 1);
+	char reply[GDB_PACKET_SIZE + 1];
+	read_packet(reply);
+	printf("%-24s -> %-40s %s\n", "c + Ctrl-C", reply, strcmp(reply, "S02") == 0 ? "ok" : "FAILED");
+	if (strcmp(reply, "S02") != 0)
+		failures++;
+	expect("p21", "8000");
+
+	// Kill doesn't get a reply, the server just exits
+	send_packet("k");
+	int status;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		failures++;
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
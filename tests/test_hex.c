@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "hex.h"
+
+static int failures = 0;
+
+static void check(const char *name, int got, int expected) {
+	printf("%-40s %s (got %d, expected %d)\n", name, got == expected ? "ok  " : "FAIL", got, expected);
+	if (got != expected)
+		failures++;
+}
+
+static int load(const char *text) {
+	CPU cpu;
+	cpu_init(&cpu);
+	int err = cpu_load_hex_buffer(&cpu, text, strlen(text));
+	cpu_deinit(&cpu);
+	return err;
+}
+
+int main(void) {
+	CPU cpu;
+	cpu_init(&cpu);
+
+	// The divide test program, config word and all
+	check("divide file", cpu_load_hex(&cpu, "divide/divide-12f508.HEX"), HEX_OK);
+	check("divide inst[0]", cpu.inst[0], 0xA0C);
+	check("divide inst[17]", cpu.inst[17], 0x003);
+	check("divide config", cpu.config, 0xFFA);
+	check("missing file", cpu_load_hex(&cpu, "divide/nope.HEX"), HEX_ERR_IO);
+
+	// Same records in lowercase, with CRLF line endings
+	const char *lower = ":020000040000fa\r\n:100000000c0a0a02280067000902880003070b0a8d\r\n:00000001ff\r\n";
+	check("lowercase + CRLF", cpu_load_hex_buffer(&cpu, lower, strlen(lower)), HEX_OK);
+
+	check("bad checksum", load(":100000000C0A0A02280067000902880003070B0A8E\n:00000001FF\n"), HEX_ERR_CHECKSUM);
+	check("bad digit", load(":100000000C0A0G02280067000902880003070B0A8D\n:00000001FF\n"), HEX_ERR_SYNTAX);
+	check("truncated record", load(":100000000C0A0A0228006700"), HEX_ERR_SYNTAX);
+	check("no EOF record", load(":100000000C0A0A02280067000902880003070B0A8D\n"), HEX_ERR_NO_EOF);
+	check("unknown record type", load(":00000007F9\n:00000001FF\n"), HEX_ERR_RECORD);
+
+	// Extended linear address of 0x0001 puts this word at byte 0x10000, way past anything a baseline PIC has
+	check("extended address out of range", load(":020000040001F9\n:02000000FF0FF0\n:00000001FF\n"), HEX_ERR_ADDRESS);
+
+	// Extended segment address 0x0100 << 4 = byte 0x1000, word 0x800, which isn't program memory
+	check("segment address out of range", load(":020000020100FB\n:02000000FF0FF0\n:00000001FF\n"), HEX_ERR_ADDRESS);
+
+	cpu_deinit(&cpu);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
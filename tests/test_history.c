@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "history.h"
+
+// Records a run with nondeterministic inputs, then travels back through it and checks every state matches
+
+#define NUM_SAMPLES 64
+
+static uint32_t lcg = 12345;
+static int num_writes = 0;
+
+// Different every call, so replays only match if they come from the log
+static void read_callback(CPU *cpu, uint8_t *gpio) {
+	lcg = lcg * 1103515245 + 12345;
+	*gpio = (lcg >> 16) & 0x3F;
+}
+
+static void write_callback(CPU *cpu, uint8_t *gpio) {
+	num_writes++;
+}
+
+static bool same_state(const CPUState *a, const CPUState *b) {
+	return a->pc == b->pc && a->skipnext == b->skipnext && a->asleep == b->asleep && a->inst_cycles == b->inst_cycles
+	    && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1] && a->w == b->w && memcmp(a->f, b->f, 32) == 0
+	    && a->trisgpio == b->trisgpio && a->option == b->option && a->prescaler == b->prescaler
+	    && a->timer0_inhibit == b->timer0_inhibit && a->wdt == b->wdt;
+}
+
+static void load_program(CPU *cpu) {
+	cpu->inst[0] = 0x206; // MOVF GPIO,w
+	cpu->inst[1] = 0x1F0; // ADDWF 0x10,f
+	cpu->inst[2] = 0x371; // RLF 0x11,f
+	cpu->inst[3] = 0x1B1; // XORWF 0x11,f
+	cpu->inst[4] = 0x026; // MOVWF GPIO
+	cpu->inst[5] = 0x2F2; // DECFSZ 0x12,f
+	cpu->inst[6] = 0xA00; // GOTO 0
+	cpu->inst[7] = 0x2B3; // INCF 0x13,f
+	cpu->inst[8] = 0xA00; // GOTO 0
+	cpu->pc = 0;
+}
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	cpu_init(&cpu);
+	load_program(&cpu);
+	cpu.gpio_read_callback = read_callback;
+	cpu.gpio_write_callback = write_callback;
+
+	History history;
+	history_init(&history, &cpu, 16);
+
+	// Record, with external pin changes now and then, and remember the state at the end of every chunk
+	CPUState samples[NUM_SAMPLES];
+	for (int i = 0; i < NUM_SAMPLES; i++)
+	{
+		history_run(&history, 1000 + (i * 7919) % 50000);
+		if (i % 5 == 0)
+			history_setgpio(&history, i & 0x3F);
+		cpu_save_state(&cpu, &samples[i]);
+	}
+	CPUState end = samples[NUM_SAMPLES - 1];
+	printf("Recorded %llu cycles, %d checkpoints %llu apart, %llu reads in %zu runs, %zu events, %zu bytes\n",
+	       (unsigned long long)cpu.inst_cycles, history.num_checkpoints, (unsigned long long)history.interval,
+	       (unsigned long long)history.num_reads, history.num_runs, history.num_events, history_memory(&history));
+	failures += check("checkpoints stay bounded", history.num_checkpoints <= 16 && history.interval > HISTORY_INTERVAL);
+
+	// Jump around in a scrambled order
+	int writes_before = num_writes;
+	bool all_match = true;
+	for (int i = 0; i < NUM_SAMPLES; i++)
+	{
+		int s = (i * 37) % NUM_SAMPLES;
+		CPUState now;
+		int err = history_seek(&history, samples[s].inst_cycles);
+		cpu_save_state(&cpu, &now);
+		if (err != HISTORY_OK || !same_state(&now, &samples[s])) {
+			printf("  seek to %llu: err=%d pc=%u/%u\n", (unsigned long long)samples[s].inst_cycles, err, now.pc, samples[s].pc);
+			all_match = false;
+		}
+	}
+	failures += check("seeking reproduces every recorded state", all_match);
+	failures += check("write callbacks stay quiet while replaying", num_writes == writes_before);
+
+	// One instruction back and forward again
+	history_seek(&history, end.inst_cycles);
+	CPUState now;
+	failures += check("step back lands before the end", history_step_back(&history) == HISTORY_OK && cpu.inst_cycles < end.inst_cycles
+	                  && cpu.inst_cycles >= end.inst_cycles - 2);
+	history_step(&history);
+	cpu_save_state(&cpu, &now);
+	failures += check("step forward gets back to the same state", same_state(&now, &end));
+
+	// Reverse continue to the last two INCF 0x13,f
+	cpu_addbreakpoint(&cpu, 8);
+	int reason;
+	int err = history_reverse_continue(&history, &reason);
+	uint64_t first_hit = cpu.inst_cycles;
+	uint8_t count = cpu.f[0x13];
+	failures += check("reverse continue finds the last hit", err == HISTORY_OK && reason == STOP_BREAKPOINT && cpu.pc == 8
+	                  && first_hit < end.inst_cycles);
+	err = history_reverse_continue(&history, &reason);
+	failures += check("and the one before that", err == HISTORY_OK && reason == STOP_BREAKPOINT && cpu.pc == 8
+	                  && cpu.inst_cycles < first_hit && cpu.f[0x13] == (uint8_t)(count - 1));
+	reason = history_run(&history, UINT64_MAX);
+	failures += check("running forward replays into the next hit", reason == STOP_BREAKPOINT && cpu.inst_cycles == first_hit);
+	cpu_removebreakpoint(&cpu, 8);
+
+	// Running past the end of history goes live again
+	history_seek(&history, end.inst_cycles);
+	history_run(&history, 10000);
+	failures += check("live again past the end", num_writes > writes_before && history.end_cycle == cpu.inst_cycles);
+
+	// Changing the past drops the future
+	history_seek(&history, samples[10].inst_cycles);
+	history_setgpio(&history, 0x15);
+	failures += check("changing an input in the past truncates history", history.end_cycle == samples[10].inst_cycles
+	                  && history_seek(&history, end.inst_cycles) == HISTORY_ERR_RANGE);
+
+	history_deinit(&history);
+	failures += check("callbacks handed back", cpu.gpio_read_callback == read_callback && cpu.history == NULL);
+	cpu_deinit(&cpu);
+
+	// The host setting pins directly gets recorded too, without a read callback those are the only inputs
+	cpu_init(&cpu);
+	load_program(&cpu);
+	history_init(&history, &cpu, 16);
+	for (int i = 0; i < NUM_SAMPLES; i++)
+	{
+		history_run(&history, 500 + (i * 7919) % 5000);
+		if (i % 2 == 0)
+			cpu_setgpio(&cpu, (i * 11) & 0x3F);
+		else
+			cpu_writepins(&cpu, GP4, i % 3 == 0);
+		cpu_save_state(&cpu, &samples[i]);
+	}
+	all_match = true;
+	for (int i = 0; i < NUM_SAMPLES; i++)
+	{
+		history_seek(&history, samples[i].inst_cycles);
+		cpu_save_state(&cpu, &now);
+		all_match &= same_state(&now, &samples[i]);
+	}
+	failures += check("host cpu_setgpio()/cpu_writepins() get replayed", all_match && history.num_events == NUM_SAMPLES);
+	history_deinit(&history);
+	cpu_deinit(&cpu);
+
+	// Full logs drop the oldest history instead of growing forever
+	cpu_init(&cpu);
+	load_program(&cpu);
+	cpu.gpio_read_callback = read_callback;
+	history_init(&history, &cpu, 16);
+	history.max_log = 32768; // A few intervals' worth of reads
+	for (int i = 0; i < NUM_SAMPLES; i++)
+	{
+		history_run(&history, 50000);
+		cpu_save_state(&cpu, &samples[i]);
+	}
+	printf("Kept %d checkpoints from %llu, %zu runs of %zu\n", history.num_checkpoints,
+	       (unsigned long long)history.checkpoints[0].state.inst_cycles, history.num_runs, history.runs_capacity);
+	failures += check("read log stays bounded", history.runs_capacity <= 32768 && history.checkpoints[0].state.inst_cycles > 0
+	                  && history_seek(&history, 0) == HISTORY_ERR_RANGE);
+	uint64_t oldest = history.checkpoints[0].state.inst_cycles;
+	all_match = true;
+	for (int i = 0; i < NUM_SAMPLES; i++)
+	{
+		if (samples[i].inst_cycles < oldest)
+			continue;
+		history_seek(&history, samples[i].inst_cycles);
+		cpu_save_state(&cpu, &now);
+		all_match &= same_state(&now, &samples[i]);
+	}
+	failures += check("what's left still replays exactly", all_match);
+	history_deinit(&history);
+
+	// Too small for even one interval, so it keeps starting over rather than replaying wrong
+	history_init(&history, &cpu, 16);
+	history.max_log = 256;
+	uint64_t start = cpu.inst_cycles;
+	history_run(&history, 1000000);
+	failures += check("log that can't keep up starts history over", history.runs_capacity <= 256
+	                  && history.checkpoints[0].state.inst_cycles > start && history_seek(&history, cpu.inst_cycles) == HISTORY_OK);
+	history_deinit(&history);
+	cpu_deinit(&cpu);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
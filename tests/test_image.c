@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu.h"
+#include "image.h"
+
+#define QUOTIENT_REG    0x07
+#define REMAINDER_REG   0x08
+
+#define IMAGE_PATH   "test_image.img"
+#define CORRUPT_PATH "test_image_corrupt.img"
+
+static int words_changed;
+
+static void count_changed(CPU *cpu, const uint8_t *changed, int num_changed) {
+	(void)cpu;
+	for (int addr = 0; addr < IMAGE_WORDS; addr++)
+		if (changed[addr >> 3] & (1 << (addr & 7)))
+			words_changed++;
+	if (words_changed != num_changed)
+		words_changed = -1;
+}
+
+int main(void) {
+	int failures = 0;
+	
+	// HEX -> image -> file
+	HexImage *hex = malloc(sizeof(HexImage));
+	FirmwareImage *built = malloc(sizeof(FirmwareImage));
+	hex_image_clear(hex);
+	if (hex_read_file(hex, "divide/divide-12f508.HEX") != HEX_OK || image_from_hex(built, hex, 0x40) != IMAGE_OK
+	    || image_write(built, IMAGE_PATH) != IMAGE_OK) {
+		printf("Failed to build image\n");
+		return 1;
+	}
+	printf("Built image, checksum=0x%08x, inst[0x1FF]=0x%03x\n", built->checksum, built->inst[0x1FF]);
+	
+	// Two CPUs running off the same mapping
+	int err;
+	const FirmwareImage *image = image_map(IMAGE_PATH, &err);
+	if (image == NULL) {
+		printf("Failed to map image: %s\n", image_strerror(err));
+		return 1;
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		CPU cpu;
+		cpu_init(&cpu);
+		image_attach(&cpu, image);
+		cpu_setbreakpoint(&cpu, 20);
+		cpu_run(&cpu);
+		
+		int quotient  = cpu_getreg(&cpu, QUOTIENT_REG);
+		int remainder = cpu_getreg(&cpu, REMAINDER_REG);
+		printf("CPU %d: 11/3 = %d remainder %d\n", i, quotient, remainder);
+		if (quotient != 3 || remainder != 2)
+			failures++;
+		cpu_deinit(&cpu);
+	}
+	image_unmap(image);
+	
+	// Hot reload a build with a different numerator (MOVLW 11 -> MOVLW 20), only that word should change
+	{
+		CPU cpu;
+		cpu_init(&cpu);
+		cpu_load_hex(&cpu, "divide/divide-12f508.HEX");
+		cpu_setbreakpoint(&cpu, 20);
+		cpu_run(&cpu);
+		
+		FirmwareImage *edited = malloc(sizeof(FirmwareImage));
+		*edited = *built;
+		edited->inst[12] = 0xC14;
+		edited->inst[0x1FF] = cpu.inst[0x1FF]; // Same calibration value as the running CPU
+		image_finalise(edited);
+		int changed = cpu_reload_image(&cpu, edited, RESET_MCLR_NORMAL);
+		cpu_setbreakpoint(&cpu, 20);
+		cpu_run(&cpu);
+		
+		int quotient  = cpu_getreg(&cpu, QUOTIENT_REG);
+		int remainder = cpu_getreg(&cpu, REMAINDER_REG);
+		printf("Reloaded %d word(s), generation %u: 20/3 = %d remainder %d\n", changed, cpu.inst_generation, quotient, remainder);
+		if (changed != 1 || quotient != 6 || remainder != 2)
+			failures++;
+		free(edited);
+		cpu_deinit(&cpu);
+	}
+	
+	// Attaching over a loaded program is a change to all of it, caches keyed on the generation have to notice
+	{
+		CPU cpu;
+		cpu_init(&cpu);
+		cpu_load_hex(&cpu, "divide/divide-12f508.HEX");
+		uint32_t generation = cpu.inst_generation;
+		cpu.inst_change_callback = count_changed;
+		image_attach(&cpu, built);
+		printf("Attached: %d word(s) changed, generation %u -> %u\n", words_changed, generation, cpu.inst_generation);
+		if (words_changed != IMAGE_WORDS || cpu.inst_generation == generation)
+			failures++;
+		cpu_deinit(&cpu);
+	}
+	
+	// A flipped bit in the payload should get caught
+	built->inst[3] ^= 0x10;
+	image_write(built, CORRUPT_PATH);
+	image = image_map(CORRUPT_PATH, &err);
+	printf("Corrupted image: %s\n", image_strerror(err));
+	if (image != NULL || err != IMAGE_ERR_CHECKSUM)
+		failures++;
+	
+	remove(IMAGE_PATH);
+	remove(CORRUPT_PATH);
+	free(hex);
+	free(built);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
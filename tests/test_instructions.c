@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "instructions.h"
+
+// One instruction at a time against what the datasheet says it does, for the ones that are easy to get subtly wrong
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Runs word at 0x000 through the whole cycle, ticks included
+static void run_one(CPU *cpu, uint16_t word) {
+	cpu->pc = 0;
+	cpu->inst[0] = word;
+	instruction_cycle(cpu);
+}
+
+static void ticks(CPU *cpu, int n) {
+	for (int i = 0; i < n; i++)
+		instruction_tick(cpu);
+}
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	cpu_init(&cpu);
+
+	// Rotates go through carry
+	cpu.f[0x10] = 0x81;
+	cpu.f[STATUS] |= C;
+	instruction_execute(&cpu, 0x370); // RLF 0x10,f
+	bool rlf_in = cpu.f[0x10] == 0x03 && (cpu.f[STATUS] & C);
+	cpu.f[0x10] = 0x40;
+	cpu.f[STATUS] &= ~C;
+	instruction_execute(&cpu, 0x370);
+	failures += check("RLF rotates through carry", rlf_in && cpu.f[0x10] == 0x80 && !(cpu.f[STATUS] & C));
+	cpu.f[0x10] = 0x01;
+	cpu.f[STATUS] |= C;
+	instruction_execute(&cpu, 0x330); // RRF 0x10,f
+	bool rrf_in = cpu.f[0x10] == 0x80 && (cpu.f[STATUS] & C);
+	cpu.f[0x10] = 0x02;
+	cpu.f[STATUS] &= ~C;
+	instruction_execute(&cpu, 0x310); // RRF 0x10,w
+	failures += check("RRF rotates through carry", rrf_in && cpu.w == 0x01 && cpu.f[0x10] == 0x02 && !(cpu.f[STATUS] & C));
+
+	// Bit tests skip on the right bit
+	cpu.f[0x10] = 0x04;
+	cpu.skipnext = false;
+	instruction_execute(&cpu, 0x650); // BTFSC 0x10,2
+	bool set_bit = !cpu.skipnext;
+	instruction_execute(&cpu, 0x670); // BTFSC 0x10,3
+	failures += check("BTFSC skips only when the bit is clear", set_bit && cpu.skipnext);
+	cpu.skipnext = false;
+	instruction_execute(&cpu, 0x770); // BTFSS 0x10,3
+	bool clear_bit = !cpu.skipnext;
+	instruction_execute(&cpu, 0x750); // BTFSS 0x10,2
+	failures += check("BTFSS skips only when the bit is set", clear_bit && cpu.skipnext);
+	cpu.skipnext = false;
+
+	// Watchdog and sleep bits
+	cpu.f[STATUS] &= ~(TO | PD);
+	instruction_execute(&cpu, 0x004); // CLRWDT
+	failures += check("CLRWDT sets TO and PD", (cpu.f[STATUS] & (TO | PD)) == (TO | PD));
+	cpu.f[STATUS] &= ~TO;
+	instruction_execute(&cpu, 0x003); // SLEEP
+	failures += check("SLEEP sets TO and clears PD", cpu.asleep && (cpu.f[STATUS] & (TO | PD)) == TO);
+	cpu.asleep = false;
+
+	// TRIS takes W, and only for GPIO
+	cpu.w = 0x2A;
+	instruction_execute(&cpu, 0x006); // TRIS GPIO
+	bool from_w = cpu.trisgpio == 0x2A;
+	cpu.w = 0xFF;
+	instruction_execute(&cpu, 0x006);
+	bool masked = cpu.trisgpio == 0x3F;
+	cpu.w = 0x00;
+	instruction_execute(&cpu, 0x007); // TRIS 7, no such port
+	failures += check("TRIS GPIO loads W, pins that exist only", from_w && masked && cpu.trisgpio == 0x3F);
+
+	// PSA is bit 3 of OPTION, the prescaler only gets cleared by CLRWDT/SLEEP when it's the WDT's
+	cpu.option = 0xCF; // Prescaler on the WDT
+	cpu.prescaler = 100;
+	instruction_execute(&cpu, 0x004);
+	bool wdt_cleared = cpu.prescaler == 0;
+	cpu.option = 0xC7; // Prescaler on Timer0
+	cpu.prescaler = 100;
+	instruction_execute(&cpu, 0x004);
+	failures += check("CLRWDT clears the prescaler only when it's the WDT's", wdt_cleared && cpu.prescaler == 100);
+
+	// Timer0 off the instruction clock: 1:1 with the prescaler on the WDT, 1:2 at PS=000, frozen with TOCS set
+	cpu.option = 0xC8;
+	cpu.f[TMR0] = 0;
+	cpu.timer0_inhibit = 0;
+	ticks(&cpu, 10);
+	bool one_to_one = cpu.f[TMR0] == 10;
+	cpu.option = 0xC0;
+	cpu.f[TMR0] = 0;
+	cpu.prescaler = 0;
+	ticks(&cpu, 10);
+	bool one_to_two = cpu.f[TMR0] == 5;
+	cpu.option = 0xE8;
+	cpu.f[TMR0] = 0;
+	ticks(&cpu, 10);
+	failures += check("Timer0 follows TOCS, PSA and PS", one_to_one && one_to_two && cpu.f[TMR0] == 0);
+
+	// Writing TMR0 holds it for 2 cycles whichever way the prescaler goes
+	cpu.option = 0xC8;
+	cpu.inst[1] = 0x000; // NOP
+	run_one(&cpu, 0x021); // MOVWF TMR0, W is 0
+	bool held = cpu.f[TMR0] == 0;
+	instruction_cycle(&cpu);
+	bool still_held = cpu.f[TMR0] == 0;
+	instruction_cycle(&cpu);
+	failures += check("TMR0 writes hold it for 2 cycles", held && still_held && cpu.f[TMR0] == 1);
+
+	// Pin change wake-up only wakes, it doesn't reset a running CPU
+	cpu.option = 0x48; // GPWU clear, so enabled
+	cpu.pc = 0x010;
+	cpu.trisgpio = 0x3F;
+	cpu_setgpio(&cpu, cpu_getgpio(&cpu) ^ GP0);
+	bool awake_ignored = cpu.pc == 0x010;
+	cpu.asleep = true;
+	cpu_setgpio(&cpu, cpu_getgpio(&cpu) ^ GP0);
+	failures += check("pin change wake-up only from SLEEP", awake_ignored && !cpu.asleep && cpu.pc == 0x1FF
+	                  && (cpu.f[STATUS] & 0x80));
+
+	cpu_deinit(&cpu);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
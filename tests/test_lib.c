@@ -0,0 +1,183 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "c12f508.h"
+
+// The library interface, only through the opaque handle like a foreign caller would
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Lights the LED on GP1 while the button on GP0 is held (active low, weak pull-ups), counting presses in 0x10
+static const uint16_t counter[] = {
+	0xC1F, // 0:  MOVLW 0x1F (pull-ups on)
+	0x002, // 1:  OPTION
+	0xC3D, // 2:  MOVLW 0x3D
+	0x006, // 3:  TRIS GPIO (GP1 out)
+	0x606, // 4:  BTFSC GPIO,0
+	0xA04, // 5:  GOTO 4
+	0x526, // 6:  BSF GPIO,1
+	0x2B0, // 7:  INCF 0x10,f
+	0x706, // 8:  BTFSS GPIO,0
+	0xA08, // 9:  GOTO 8
+	0x426, // 10: BCF GPIO,1
+	0xA04, // 11: GOTO 4
+};
+
+#define PRESSES 100
+
+int main(void) {
+	int failures = 0;
+	failures += check("abi version", c12f508_abi_version() == C12F508_ABI_VERSION);
+	C12f508 *sim = c12f508_new();
+	failures += check("words load", c12f508_load_words(sim, counter, sizeof(counter) / sizeof(counter[0]), 0xFEA) == C12F508_OK);
+	failures += check("too many words don't", c12f508_load_words(sim, counter, 513, -1) == C12F508_ERR_LOAD);
+	failures += check("missing HEX file doesn't", c12f508_load_hex(sim, "nope.HEX") == C12F508_ERR_LOAD
+	                  && strcmp(c12f508_error_detail(sim), "OK") != 0);
+
+	// A hundred presses in one call, released to start with
+	C12f508Input inputs[2 * PRESSES + 1];
+	memset(inputs, 0, sizeof(inputs));
+	inputs[0].mask = 0x01;
+	inputs[0].value = 0x01;
+	for (int i = 0; i < PRESSES; i++)
+	{
+		inputs[1 + 2 * i].cycle = 1000 + i * 2000;
+		inputs[1 + 2 * i].mask = 0x01;
+		inputs[2 + 2 * i].cycle = 2000 + i * 2000;
+		inputs[2 + 2 * i].mask = 0x01;
+		inputs[2 + 2 * i].value = 0x01;
+	}
+	size_t applied;
+	c12f508_trace_enable(sim, 4096);
+	int stop = c12f508_run_inputs(sim, inputs, 2 * PRESSES + 1, 2000 * PRESSES + 1000, &applied);
+	C12f508State state;
+	c12f508_get_state(sim, &state);
+	failures += check("inputs applied in one call", stop == C12F508_STOP_CYCLES && applied == 2 * PRESSES + 1
+	                  && state.f[0x10] == PRESSES && state.cycles >= 2000 * PRESSES + 1000 && state.config == 0xFEA);
+
+	// Two TRIS writes, then the LED on and off for every press
+	C12f508TraceEntry trace[4096];
+	size_t n = c12f508_trace_read(sim, trace, 4096);
+	bool trace_ok = n == 1 + 2 * PRESSES && trace[0].tris == 0x3D && trace[0].driven == 0x02;
+	for (size_t i = 1; trace_ok && i < n; i++)
+		trace_ok = (trace[i].gpio & 0x02) == (i % 2 ? 0x02 : 0) && trace[i].cycle > trace[i - 1].cycle;
+	failures += check("trace has every LED change", trace_ok && c12f508_trace_read(sim, trace, 10) == 0);
+
+	// A small trace buffer stops the run so it can be drained
+	c12f508_trace_enable(sim, 8);
+	size_t total = 0;
+	int stops = 0;
+	uint64_t start = state.cycles, end = state.cycles + 2000 * PRESSES + 1000;
+	while (1)
+	{
+		c12f508_get_state(sim, &state);
+		if (state.cycles >= end)
+			break;
+		// Same presses again, rebased each time
+		C12f508Input rebased[2 * PRESSES];
+		size_t num = 0;
+		for (int i = 1; i < 2 * PRESSES + 1; i++)
+			if (start + inputs[i].cycle >= state.cycles) {
+				rebased[num] = inputs[i];
+				rebased[num++].cycle = start + inputs[i].cycle - state.cycles;
+			}
+		stop = c12f508_run_inputs(sim, rebased, num, end - state.cycles, NULL);
+		if (stop == C12F508_STOP_TRACE_FULL)
+			stops++;
+		total += c12f508_trace_read(sim, trace, 4096);
+	}
+	c12f508_get_state(sim, &state);
+	failures += check("full trace buffer stops the run", stops == 2 * PRESSES / 8 && total == 2 * PRESSES
+	                  && state.f[0x10] == 2 * PRESSES);
+
+	// Running again without draining it doesn't start, so nothing gets lost
+	C12f508 *small = c12f508_new();
+	c12f508_load_words(small, counter, sizeof(counter) / sizeof(counter[0]), 0xFEA);
+	c12f508_trace_enable(small, 4);
+	int first = c12f508_run_inputs(small, inputs, 2 * PRESSES + 1, 2000 * PRESSES + 1000, NULL);
+	C12f508State small_state;
+	c12f508_get_state(small, &small_state);
+	uint64_t full_at = small_state.cycles;
+	int again = c12f508_run(small, 10000);
+	int again_inputs = c12f508_run_inputs(small, inputs, 2 * PRESSES + 1, 10000, NULL);
+	c12f508_get_state(small, &small_state);
+	failures += check("undrained trace buffer stops the next run too", first == C12F508_STOP_TRACE_FULL
+	                  && again == C12F508_STOP_TRACE_FULL && again_inputs == C12F508_STOP_TRACE_FULL
+	                  && small_state.cycles == full_at && c12f508_trace_read(small, trace, 4096) == 4
+	                  && c12f508_run(small, 1000) == C12F508_STOP_CYCLES);
+	c12f508_free(small);
+
+	// State round trip, breakpoints and resets
+	C12f508State saved;
+	c12f508_get_state(sim, &saved);
+	c12f508_run(sim, 12345);
+	c12f508_set_state(sim, &saved);
+	c12f508_get_state(sim, &state);
+	failures += check("state round trip", memcmp(&state, &saved, sizeof(state)) == 0);
+	failures += check("bad breakpoint condition", c12f508_add_breakpoint(sim, 7, "w ==") == C12F508_ERR_SYNTAX
+	                  && c12f508_add_breakpoint(sim, 0x200, NULL) == C12F508_ERR_ARG);
+	c12f508_add_breakpoint(sim, 7, "gpio & 2");
+	c12f508_set_pins(sim, 0x03, 0x00); // GP1's an output, so only GP0 changes
+	stop = c12f508_run(sim, 1000);
+	c12f508_get_state(sim, &state);
+	failures += check("conditional breakpoint", stop == C12F508_STOP_BREAKPOINT && state.pc == 7 && state.f[0x10] == 2 * PRESSES);
+	c12f508_remove_breakpoint(sim, 7);
+	c12f508_add_watchpoint(sim, 0x10);
+	stop = c12f508_run(sim, 1000);
+	c12f508_get_state(sim, &state);
+	failures += check("watchpoint", stop == C12F508_STOP_WATCHPOINT && state.f[0x10] == 2 * PRESSES + 1);
+	c12f508_remove_watchpoint(sim, 0x10);
+	c12f508_reset(sim, C12F508_RESET_POWER_ON);
+	c12f508_get_state(sim, &state);
+	failures += check("power-on reset", state.cycles == 0 && state.pc == 0x1FF && state.f[0x10] == 0 && state.tris == 0x3F
+	                  && state.config == 0xFEA);
+	failures += check("bad arguments", c12f508_reset(sim, 9) == C12F508_ERR_ARG && c12f508_set_engine(sim, 5) == C12F508_ERR_ARG);
+	inputs[1].cycle = 5000;
+	failures += check("unsorted inputs", c12f508_run_inputs(sim, inputs, 3, 100, NULL) == C12F508_ERR_ORDER);
+
+	// Same thing on the pipeline engine ends up in the same place
+	c12f508_trace_enable(sim, 0);
+	C12f508 *pipe = c12f508_new();
+	c12f508_load_words(pipe, counter, sizeof(counter) / sizeof(counter[0]), 0xFEA);
+	c12f508_set_engine(pipe, C12F508_ENGINE_PIPELINE);
+	c12f508_load_words(sim, counter, sizeof(counter) / sizeof(counter[0]), 0xFEA);
+	inputs[1].cycle = 1000;
+	c12f508_run_inputs(sim, inputs, 2 * PRESSES + 1, 2000 * PRESSES, NULL);
+	c12f508_run_inputs(pipe, inputs, 2 * PRESSES + 1, 2000 * PRESSES, NULL);
+	c12f508_get_state(sim, &state);
+	c12f508_get_state(pipe, &saved);
+	failures += check("pipeline engine agrees", memcmp(&state, &saved, sizeof(state)) == 0 && state.f[0x10] == PRESSES);
+	c12f508_free(pipe);
+
+	// Loads replace everything, nothing of the last program or its config sticks around
+	const uint16_t longer[] = {0xC55, 0x030, 0xC66, 0x031}; // MOVLW 0x55, MOVWF 0x10, MOVLW 0x66, MOVWF 0x11
+	const uint16_t shorter[] = {0xC11, 0x030};              // MOVLW 0x11, MOVWF 0x10
+	c12f508_load_words(sim, longer, 4, 0xFEA);
+	c12f508_load_words(sim, shorter, 2, -1);
+	c12f508_run(sim, 5);
+	c12f508_get_state(sim, &state);
+	failures += check("shorter words load erases the rest", state.f[0x10] == 0x11 && state.f[0x11] == 0 && state.config == 0xFFF);
+	const char *with_config = ":021FFE00EA0FE8\n:00000001FF\n";
+	const char *without_config = ":04000000550C30006B\n:00000001FF\n";
+	c12f508_load_words(sim, longer, 4, -1);
+	c12f508_load_hex_buffer(sim, with_config, strlen(with_config));
+	c12f508_get_state(sim, &state);
+	failures += check("HEX config loads", state.config == 0xFEA);
+	c12f508_load_hex_buffer(sim, without_config, strlen(without_config));
+	c12f508_run(sim, 5);
+	c12f508_get_state(sim, &state);
+	failures += check("HEX load erases the rest and the config", state.f[0x10] == 0x55 && state.f[0x11] == 0
+	                  && state.config == 0xFFF);
+	int bad = c12f508_load_hex_buffer(sim, ":00", 3);
+	c12f508_reset(sim, C12F508_RESET_POWER_ON);
+	c12f508_run(sim, 5);
+	c12f508_get_state(sim, &state);
+	failures += check("bad HEX leaves the program alone", bad == C12F508_ERR_LOAD && state.f[0x10] == 0x55 && state.config == 0xFFF);
+	c12f508_free(sim);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
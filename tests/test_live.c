@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "cpu.h"
+#include "live.h"
+
+// Live state export: what a viewer reads has to be what the CPU had, never a mix of two publishes
+
+#define TORTURE_PUBLISHES 200000
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Counts up in 0x10, carrying into 0x11, with a CALL in the loop so the stack's got something on it
+static const uint16_t counter_program[] = {
+	0x904, // 0: loop: CALL bump
+	0x290, // 1: INCF 0x10,w  (just for W)
+	0x000, // 2: NOP
+	0xA00, // 3: GOTO loop
+	0x3F0, // 4: bump: INCFSZ 0x10,f
+	0x800, // 5: RETLW 0
+	0x2B1, // 6: INCF 0x11,f
+	0x800, // 7: RETLW 0
+};
+
+static void load_counter(CPU *cpu) {
+	memcpy(cpu->inst, counter_program, sizeof(counter_program));
+	cpu->inst[0x1FF] = 0xC00;
+	cpu->config &= ~WDTE;
+}
+
+typedef struct Torture {
+	Live *live;
+	CPU cpu;
+	volatile bool done;
+} Torture;
+
+// Publishes states where every field comes from the same counter, so any mix of two shows
+static void *torture_writer(void *arg) {
+	Torture *t = arg;
+	for (uint32_t k = 1; k <= TORTURE_PUBLISHES; k++)
+	{
+		t->cpu.inst_cycles = k;
+		t->cpu.pc = k & 0x1FF;
+		t->cpu.w = k;
+		memset(t->cpu.f, k, 32);
+		live_publish(t->live, 0, &t->cpu);
+	}
+	t->done = true;
+	return NULL;
+}
+
+int main(void) {
+	int failures = 0;
+	char name[64];
+	snprintf(name, sizeof(name), "/c12f508-test-live-%d", (int)getpid());
+
+	Live live, viewer;
+	failures += check("bad names refused", live_create(&live, "no-slash", 1, 0) == LIVE_ERR_ARG
+	                  && live_create(&live, name, 0, 0) == LIVE_ERR_ARG);
+	failures += check("create", live_create(&live, name, 2, 1000) == LIVE_OK);
+	failures += check("attach", live_attach(&viewer, name) == LIVE_OK && viewer.num_slots == 2 && viewer.interval == 1000);
+	LiveState state;
+	failures += check("nothing published yet", !live_read(&viewer, 1, &state) && !live_read(&viewer, 2, &state));
+
+	// Publishing along the way changes nothing about the run
+	CPU cpu, plain;
+	cpu_init(&cpu);
+	cpu_init(&plain);
+	load_counter(&cpu);
+	load_counter(&plain);
+	cpu_addbreakpoint(&cpu, 6);
+	cpu_addbreakpoint(&plain, 6);
+	int stop = live_run_cycles(&live, 1, &cpu, 100000);
+	int plain_stop = cpu_run_cycles(&plain, 100000);
+	CPUState a, b;
+	memset(&a, 0, sizeof(CPUState));
+	memset(&b, 0, sizeof(CPUState));
+	cpu_save_state(&cpu, &a);
+	cpu_save_state(&plain, &b);
+	failures += check("stops where a plain run does", stop == STOP_BREAKPOINT && plain_stop == STOP_BREAKPOINT
+	                  && memcmp(&a, &b, sizeof(CPUState)) == 0);
+	failures += check("viewer sees the final state", live_read(&viewer, 1, &state) && state.cycles == cpu.inst_cycles
+	                  && state.pc == 6 && state.w == cpu.w && state.stack[0] == cpu.stack[0]
+	                  && memcmp(state.f, cpu.f, 32) == 0 && state.gpio == cpu.f[GPIO] && state.tris == cpu.trisgpio);
+	failures += check("published every interval", state.publishes == (cpu.inst_cycles + 999) / 1000);
+	cpu_removebreakpoint(&cpu, 6);
+	live_run_cycles(&live, 1, &cpu, 2500);
+	failures += check("carries on", live_read(&viewer, 1, &state) && state.cycles == cpu.inst_cycles
+	                  && memcmp(state.f, cpu.f, 32) == 0 && state.publishes > 3);
+	uint8_t carries = cpu.f[0x11];
+	cpu_deinit(&cpu);
+	cpu_deinit(&plain);
+
+	// A writer going flat out against a reader that never gets a torn copy
+	static Torture t;
+	t.live = &live;
+	cpu_init(&t.cpu);
+	pthread_t writer;
+	pthread_create(&writer, NULL, torture_writer, &t);
+	uint64_t reads = 0, torn = 0, last = 0;
+	bool backwards = false;
+	while (!t.done)
+	{
+		if (!live_read(&viewer, 0, &state))
+			continue;
+		reads++;
+		uint8_t k = state.cycles;
+		bool same = state.w == k && state.pc == (state.cycles & 0x1FF) && state.publishes == state.cycles;
+		for (int r = 0; r < 32; r++)
+			same &= state.f[r] == k;
+		torn += !same;
+		backwards |= state.cycles < last;
+		last = state.cycles;
+	}
+	pthread_join(writer, NULL);
+	printf("%llu reads during %d publishes\n", (unsigned long long)reads, TORTURE_PUBLISHES);
+	failures += check("no torn reads", torn == 0 && !backwards);
+	failures += check("last publish", live_read(&viewer, 0, &state) && state.cycles == TORTURE_PUBLISHES);
+	cpu_deinit(&t.cpu);
+
+	// Viewers keep what they've got, new ones find nothing
+	live_destroy(&live);
+	failures += check("still readable after destroy", live_read(&viewer, 1, &state) && state.f[0x11] == carries);
+	live_detach(&viewer);
+	failures += check("gone once destroyed", live_attach(&viewer, name) == LIVE_ERR_IO);
+
+	// Something else by that name
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+	bool made = fd >= 0 && ftruncate(fd, 4096) == 0;
+	if (fd >= 0)
+		close(fd);
+	failures += check("not a live segment", made && live_attach(&viewer, name) == LIVE_ERR_FORMAT);
+	shm_unlink(name);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "hex.h"
+#include "memo.h"
+
+// Memoised calls have to leave the CPU exactly where running them would have
+
+#define NUMERATOR_REG   0x0A
+#define DENOMINATOR_REG 0x09
+#define DIVIDE          0x20
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Divides TMR0 based numbers over and over with Timer0 running, so the timer has to come out right for the
+// numbers to, and XORs every quotient into 0x10
+static const uint16_t driver_program[] = {
+	0xC00, // 0: MOVLW option (patched)
+	0x002, // 1: OPTION
+	0x201, // 2: loop: MOVF TMR0,w
+	0xE0F, // 3: ANDLW 0x0F
+	0x029, // 4: MOVWF denominator
+	0x2A9, // 5: INCF denominator,f
+	0x201, // 6: MOVF TMR0,w
+	0xE3F, // 7: ANDLW 0x3F
+	0x02A, // 8: MOVWF numerator
+	0x900 | DIVIDE, // 9: CALL divide
+	0x207, // 10: MOVF quotient,w
+	0x1B0, // 11: XORWF 0x10,f
+	0x2B1, // 12: INCF 0x11,f
+	0xA02, // 13: GOTO loop
+};
+
+// tests/divide's routine
+static const uint16_t divide_routine[] = {
+	0x20A,            // divide: MOVF numerator,w
+	0x028,            // MOVWF remainder
+	0x067,            // CLRF quotient
+	0x209,            // loop: MOVF denominator,w
+	0x088,            // SUBWF remainder,w
+	0x703,            // BTFSS STATUS,C
+	0xA00 | (DIVIDE + 10), // GOTO end
+	0x028,            // MOVWF remainder
+	0x2A7,            // INCF quotient,f
+	0xA00 | (DIVIDE + 3), // GOTO loop
+	0x800,            // end: RETLW 0
+};
+
+static void load_driver(CPU *cpu, uint8_t option, bool wdt) {
+	memset(cpu->inst, 0, 512 * sizeof(uint16_t));
+	memcpy(cpu->inst, driver_program, sizeof(driver_program));
+	memcpy(cpu->inst + DIVIDE, divide_routine, sizeof(divide_routine));
+	cpu->inst[0] |= option;
+	cpu->inst[0x1FF] = 0xC00;
+	if (wdt)
+		cpu->config |= WDTE;
+	else
+		cpu->config &= ~WDTE;
+	cpu_reset(cpu, RESET_MCLR_NORMAL);
+	memset(cpu->f + 0x07, 0, 32 - 0x07);
+	cpu->inst_cycles = 0;
+	if (cpu->memo != NULL)
+		memo_refresh(cpu->memo);
+}
+
+static bool same_state(const CPU *a, const CPU *b) {
+	return a->pc == b->pc && a->inst_cycles == b->inst_cycles && a->w == b->w && memcmp(a->f, b->f, 32) == 0
+	       && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1] && a->option == b->option
+	       && a->prescaler == b->prescaler && a->timer0_inhibit == b->timer0_inhibit && a->wdt == b->wdt
+	       && a->skipnext == b->skipnext && a->asleep == b->asleep;
+}
+
+// Runs both in the same odd sized chunks, comparing after every one
+static bool run_alongside(CPU *plain, CPU *memoised, uint64_t total) {
+	static const uint64_t chunks[] = { 997, 1, 13, 4099, 2, 251 };
+	int i = 0;
+	while (plain->inst_cycles < total)
+	{
+		uint64_t n = chunks[i++ % 6];
+		int a = cpu_run_cycles(plain, n);
+		int b = cpu_run_cycles(memoised, n);
+		if (a != b || !same_state(plain, memoised)) {
+			printf("differs at cycle %llu\n", (unsigned long long)plain->inst_cycles);
+			return false;
+		}
+	}
+	return true;
+}
+
+// The UART sender from test_analysis: the delay touches nothing but its counter, sending drives GPIO
+static const uint16_t uart_program[] = {
+	0xC3E, 0x006, 0x506, 0xC48, 0x030, 0x90A, 0xC69, 0x030, 0x90A, 0x003,
+	0x406, 0xC08, 0x031, 0x923, 0x000, 0xA10, 0x330, 0x703, 0xA16, 0x000,
+	0x506, 0xA18, 0x406, 0xA18, 0x923, 0x2F1, 0xA10, 0x000, 0x000, 0x000,
+	0x000, 0x000, 0x506, 0x923, 0x800, 0xC1E, 0x032, 0x2F2, 0xA25, 0x800,
+};
+
+int main(void) {
+	int failures = 0;
+	static Memo memo;
+	CPU cpu, plain;
+	cpu_init(&cpu);
+	cpu_init(&plain);
+
+	// Classification of tests/divide, whose result depends on nothing but the two operands
+	if (cpu_load_hex(&cpu, "divide/divide-12f508.HEX") != HEX_OK) {
+		printf("divide/divide-12f508.HEX didn't load, run this from tests/\n1 failure(s)\n");
+		return 1;
+	}
+	failures += check("init", memo_init(&memo, &cpu, 0) == MEMO_OK && cpu.memo == &memo);
+	const MemoRoutine *divide = memo_routine(&memo, 1);
+	failures += check("divide is pure", divide != NULL && divide->purity == MEMO_PURE && memo.num_routines == 1);
+	failures += check("keyed on the operands", divide->key_size == 2
+	                  && divide->inputs == ((1ull << DENOMINATOR_REG) | (1ull << NUMERATOR_REG)));
+	failures += check("writes quotient, remainder, W and the flags", divide->outputs == ((1ull << 7) | (1ull << 8)
+	                  | (1ull << MEMO_REG_W) | (1ull << MEMO_REG_C) | (1ull << MEMO_REG_DC) | (1ull << MEMO_REG_Z)));
+
+	// The driver with Timer0 on the instruction clock through the prescaler
+	load_driver(&cpu, 0xC2, false);
+	load_driver(&plain, 0xC2, false);
+	failures += check("driver classified", memo_routine(&memo, DIVIDE) != NULL
+	                  && memo_routine(&memo, DIVIDE)->purity == MEMO_PURE && memo_routine(&memo, 1) == NULL);
+	failures += check("same state as running it, Timer0 on", run_alongside(&plain, &cpu, 2000000));
+	divide = memo_routine(&memo, DIVIDE);
+	printf("%llu calls, %llu hits, %llu recorded, %llu cycles skipped\n", (unsigned long long)divide->calls,
+	       (unsigned long long)divide->hits, (unsigned long long)divide->recorded,
+	       (unsigned long long)memo.cycles_skipped);
+	failures += check("calls hit", divide->hits > divide->calls / 2 && memo.cycles_skipped > 0);
+
+	// Prescaler on the WDT, which times out every so often
+	load_driver(&cpu, 0xC8, true);
+	load_driver(&plain, 0xC8, true);
+	uint64_t skipped = memo.cycles_skipped;
+	failures += check("same state as running it, WDT on", run_alongside(&plain, &cpu, 6000000));
+	failures += check("WDT timed out", (cpu.f[STATUS] & 0x10) == 0);
+	failures += check("calls hit with the WDT on", memo.cycles_skipped > skipped);
+
+	// A breakpoint inside still gets stopped at
+	cpu_setbreakpoint(&cpu, DIVIDE + 10);
+	int stop = cpu_run_cycles(&cpu, 100000);
+	failures += check("breakpoint inside the routine", stop == STOP_BREAKPOINT && cpu.pc == DIVIDE + 10);
+	cpu_clearbreakpoint(&cpu);
+
+	// Patching the routine throws away what was recorded
+	cpu_write_inst(&cpu, DIVIDE + 2, 0x000);
+	divide = memo_routine(&memo, DIVIDE);
+	failures += check("patch forgets recorded calls", divide->calls == 0 && divide->recorded == 0
+	                  && divide->purity == MEMO_PURE);
+	cpu_write_inst(&cpu, DIVIDE + 2, 0x006); // TRIS GPIO
+	failures += check("patched impure", memo_routine(&memo, DIVIDE)->purity == MEMO_IO);
+
+	// UART: the delay only needs its own counter, which it always sets first, so every call is the same
+	load_driver(&cpu, 0xC2, false);
+	memcpy(cpu.inst, uart_program, sizeof(uart_program));
+	memo_refresh(&memo);
+	const MemoRoutine *delay = memo_routine(&memo, 35);
+	const MemoRoutine *send = memo_routine(&memo, 10);
+	failures += check("delay pure with nothing to key on", delay != NULL && delay->purity == MEMO_PURE
+	                  && delay->key_size == 0);
+	failures += check("send does I/O", send != NULL && send->purity == MEMO_IO);
+	cpu_run_cycles(&cpu, 5000);
+	failures += check("every delay after the first hits", delay->recorded == 1 && delay->hits == delay->calls - 1
+	                  && delay->calls > 10);
+
+	memo_deinit(&memo);
+	failures += check("deinit detaches", cpu.memo == NULL);
+	cpu_deinit(&cpu);
+	cpu_deinit(&plain);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "pipeline.h"
+
+// Runs the fast and pipeline engines in lockstep and checks they agree at every instruction boundary
+
+#define MAX_WRITES 256
+
+typedef struct Trace {
+	int num_writes;
+	uint64_t write_cycle[MAX_WRITES];
+	uint8_t write_value[MAX_WRITES];
+} Trace;
+
+static Trace traces[2];
+static int q_counts[4];
+
+// Same answer for both engines as long as they sample at the same instruction cycle
+static void read_callback(CPU *cpu, uint8_t *gpio) {
+	*gpio = (*gpio & ~GP0) | ((cpu->inst_cycles >> 2) & 1);
+}
+
+static void write_callback_fast(CPU *cpu, uint8_t *gpio) {
+	Trace *t = &traces[0];
+	if (t->num_writes < MAX_WRITES) {
+		t->write_cycle[t->num_writes] = cpu->inst_cycles;
+		t->write_value[t->num_writes++] = *gpio;
+	}
+}
+
+static void write_callback_pipeline(CPU *cpu, uint8_t *gpio) {
+	Trace *t = &traces[1];
+	if (t->num_writes < MAX_WRITES) {
+		t->write_cycle[t->num_writes] = cpu->inst_cycles;
+		t->write_value[t->num_writes++] = *gpio;
+	}
+	// Outputs only ever change at Q4
+	if (cpu->pipeline->q != 3)
+		printf("GPIO driven outside of Q4!\n");
+}
+
+static void q_callback(CPU *cpu, uint8_t q) {
+	q_counts[q - 1]++;
+}
+
+static bool same_state(CPU *a, CPU *b) {
+	return a->pc == b->pc && a->w == b->w && a->inst_cycles == b->inst_cycles
+	    && memcmp(a->f, b->f, 32) == 0 && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1]
+	    && a->skipnext == b->skipnext && a->asleep == b->asleep && a->option == b->option
+	    && a->trisgpio == b->trisgpio && a->prescaler == b->prescaler && a->timer0_inhibit == b->timer0_inhibit
+	    && a->wdt == b->wdt;
+}
+
+static int lockstep(const char *name, CPU *fast, CPU *pipe, int steps) {
+	for (int i = 0; i < steps; i++)
+	{
+		cpu_step(fast);
+		cpu_step(pipe);
+		if (!same_state(fast, pipe)) {
+			printf("%s: engines diverged after %d steps (pc %u vs %u, cycles %llu vs %llu)\n", name, i + 1,
+			       fast->pc, pipe->pc, (unsigned long long)fast->inst_cycles, (unsigned long long)pipe->inst_cycles);
+			return 1;
+		}
+	}
+	printf("%s: %d steps, %llu cycles, pc=%u, engines agree\n", name, steps, (unsigned long long)fast->inst_cycles, fast->pc);
+	return 0;
+}
+
+static void load_loop_program(CPU *cpu) {
+	cpu->inst[0]  = 0xC05; // MOVLW 5
+	cpu->inst[1]  = 0x030; // MOVWF 0x10
+	cpu->inst[2]  = 0x2F0; // DECFSZ 0x10,f
+	cpu->inst[3]  = 0xA02; // GOTO 2
+	cpu->inst[4]  = 0xA05; // GOTO $+1 (2 cycle delay)
+	cpu->inst[5]  = 0xC01; // MOVLW 1
+	cpu->inst[6]  = 0x910; // CALL 0x10
+	cpu->inst[7]  = 0xC09; // MOVLW 9
+	cpu->inst[8]  = 0x022; // MOVWF PCL (jumps to 9)
+	cpu->inst[9]  = 0x206; // MOVF GPIO,w
+	cpu->inst[10] = 0x026; // MOVWF GPIO
+	cpu->inst[11] = 0x021; // MOVWF TMR0
+	cpu->inst[12] = 0x606; // BTFSC GPIO,0
+	cpu->inst[13] = 0x2B1; // INCF 0x11,f
+	cpu->inst[14] = 0xA00; // GOTO 0
+	cpu->inst[16] = 0x1E2; // ADDWF PCL,f (computed jump)
+	cpu->inst[17] = 0x801; // RETLW 1
+	cpu->inst[18] = 0x807; // RETLW 7 (W=1 lands here, PCL reads as the next address)
+}
+
+int main(void) {
+	int failures = 0;
+	CPU fast, pipe;
+
+	// The divide test program
+	cpu_init(&fast);
+	cpu_init(&pipe);
+	cpu_set_engine(&pipe, ENGINE_PIPELINE);
+	cpu_load_hex(&fast, "divide/divide-12f508.HEX");
+	cpu_load_hex(&pipe, "divide/divide-12f508.HEX");
+	failures += lockstep("divide", &fast, &pipe, 100);
+	if (cpu_getreg(&pipe, 0x07) != 3 || cpu_getreg(&pipe, 0x08) != 2)
+		failures++;
+	cpu_deinit(&fast);
+	cpu_deinit(&pipe);
+
+	// Loops, skips, computed jumps and GPIO traffic
+	cpu_init(&fast);
+	cpu_init(&pipe);
+	cpu_set_engine(&pipe, ENGINE_PIPELINE);
+	load_loop_program(&fast);
+	load_loop_program(&pipe);
+	fast.gpio_read_callback = read_callback;
+	pipe.gpio_read_callback = read_callback;
+	fast.gpio_write_callback = write_callback_fast;
+	pipe.gpio_write_callback = write_callback_pipeline;
+	pipe.pipeline->q_callback = q_callback;
+	failures += lockstep("loops", &fast, &pipe, 2000);
+
+	// Same GPIO writes at the same cycles
+	if (traces[0].num_writes == 0 || traces[0].num_writes != traces[1].num_writes
+	    || memcmp(traces[0].write_cycle, traces[1].write_cycle, sizeof(uint64_t) * traces[0].num_writes) != 0
+	    || memcmp(traces[0].write_value, traces[1].write_value, traces[0].num_writes) != 0) {
+		printf("GPIO write traces differ (%d vs %d writes)\n", traces[0].num_writes, traces[1].num_writes);
+		failures++;
+	}
+
+	// 4 Q-cycles per instruction cycle
+	printf("Q1-Q4 callbacks: %d %d %d %d over %llu cycles\n", q_counts[0], q_counts[1], q_counts[2], q_counts[3],
+	       (unsigned long long)pipe.inst_cycles);
+	for (int q = 0; q < 4; q++)
+		if ((uint64_t)q_counts[q] != pipe.inst_cycles)
+			failures++;
+
+	cpu_deinit(&fast);
+	cpu_deinit(&pipe);
+
+	// A jump table actually executed, ADDWF PCL,f adds to the address of the instruction after it
+	bool tables_ok = true;
+	for (int engine = ENGINE_FAST; engine <= ENGINE_PIPELINE; engine++)
+	for (uint8_t k = 0; k < 3; k++)
+	{
+		CPU cpu;
+		cpu_init(&cpu);
+		cpu_set_engine(&cpu, engine);
+		const uint16_t table[] = {
+			0xC00 | k, // 0: MOVLW k
+			0x904,     // 1: CALL 4
+			0x030,     // 2: MOVWF 0x10
+			0x003,     // 3: SLEEP
+			0x1E2,     // 4: ADDWF PCL,f
+			0x811,     // 5: RETLW 0x11
+			0x822,     // 6: RETLW 0x22
+			0x833,     // 7: RETLW 0x33
+		};
+		memcpy(cpu.inst, table, sizeof(table));
+		cpu_setbreakpoint(&cpu, 3);
+		cpu_run_cycles(&cpu, 100);
+		tables_ok &= cpu.pc == 3 && cpu.f[0x10] == 0x11 * (k + 1);
+		cpu_deinit(&cpu);
+	}
+	if (!tables_ok) {
+		printf("Jump table landed in the wrong place\n");
+		failures++;
+	}
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "recording.h"
+
+// Records a run with nondeterministic inputs to a file, then replays it into fresh CPUs and checks they end up identical
+
+#define LOG_PATH "test_recording.log"
+
+static uint32_t lcg = 4242;
+static int num_host_reads = 0;
+
+// Changes now and then, so replays only match if they come from the log
+static void read_callback(CPU *cpu, uint8_t *gpio) {
+	num_host_reads++;
+	lcg = lcg * 1103515245 + 12345;
+	if ((lcg >> 16) % 16 == 0)
+		*gpio = (lcg >> 8) & 0x3F;
+}
+
+static bool same_state(const CPUState *a, const CPUState *b) {
+	return a->pc == b->pc && a->skipnext == b->skipnext && a->asleep == b->asleep && a->inst_cycles == b->inst_cycles
+	    && a->stack[0] == b->stack[0] && a->stack[1] == b->stack[1] && a->w == b->w && memcmp(a->f, b->f, 32) == 0
+	    && a->trisgpio == b->trisgpio && a->option == b->option && a->prescaler == b->prescaler
+	    && a->timer0_inhibit == b->timer0_inhibit && a->wdt == b->wdt;
+}
+
+static void load_program(CPU *cpu) {
+	cpu->inst[0] = 0x206; // MOVF GPIO,w
+	cpu->inst[1] = 0x1F0; // ADDWF 0x10,f
+	cpu->inst[2] = 0x371; // RLF 0x11,f
+	cpu->inst[3] = 0x1B1; // XORWF 0x11,f
+	cpu->inst[4] = 0x026; // MOVWF GPIO
+	cpu->inst[5] = 0x2F2; // DECFSZ 0x12,f
+	cpu->inst[6] = 0xA00; // GOTO 0
+	cpu->inst[7] = 0x2B3; // INCF 0x13,f
+	cpu->inst[8] = 0xA00; // GOTO 0
+	cpu->pc = 0;
+}
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main(void) {
+	int failures = 0;
+	CPU cpu;
+	cpu_init(&cpu);
+	load_program(&cpu);
+	cpu_run_cycles(&cpu, 1234); // Doesn't have to start at 0
+	cpu.gpio_read_callback = read_callback;
+
+	Recording rec;
+	failures += check("recording starts", recording_start(&rec, &cpu, LOG_PATH) == RECORDING_OK);
+	for (int i = 0; i < 200; i++)
+	{
+		cpu_run_cycles(&cpu, 500 + (i * 7919) % 20000);
+		if (i % 3 == 0)
+			cpu_setgpio(&cpu, i & 0x3F);
+		if (i % 7 == 0) {
+			cpu_writepins(&cpu, GP1, true);
+			cpu_writepins(&cpu, GP1, false); // Same cycle, order matters
+		}
+	}
+	CPUState end;
+	cpu_save_state(&cpu, &end);
+	int host_reads = num_host_reads;
+	failures += check("recording stops", recording_stop(&rec) == RECORDING_OK && cpu.gpio_read_callback == read_callback
+	                  && cpu.recording == NULL);
+
+	FILE *file = fopen(LOG_PATH, "rb");
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	printf("Recorded %llu cycles, %d reads, %llu records in %ld bytes\n", (unsigned long long)end.inst_cycles,
+	       host_reads, (unsigned long long)rec.num_records, size);
+	cpu_deinit(&cpu);
+
+	// Replays in both engines, from a CPU that's somewhere else entirely
+	for (int engine = ENGINE_FAST; engine <= ENGINE_PIPELINE; engine++)
+	{
+		const char *name = engine == ENGINE_FAST ? "fast" : "pipeline";
+		char label[64];
+		cpu_init(&cpu);
+		cpu_set_engine(&cpu, engine);
+		load_program(&cpu);
+		cpu.gpio_read_callback = read_callback;
+		cpu_run_cycles(&cpu, 99);
+		num_host_reads = 0;
+
+		snprintf(label, sizeof(label), "%s: replay loads", name);
+		failures += check(label, recording_replay(&rec, &cpu, LOG_PATH) == RECORDING_OK);
+
+		// In odd sized chunks, so they don't line up with the recorded ones
+		while (!recording_done(&rec))
+			recording_run(&rec, 33333);
+		CPUState now;
+		cpu_save_state(&cpu, &now);
+		snprintf(label, sizeof(label), "%s: replay ends in the recorded state", name);
+		failures += check(label, same_state(&now, &end));
+		snprintf(label, sizeof(label), "%s: host read callback never called", name);
+		failures += check(label, num_host_reads == 0);
+		recording_run(&rec, 10000);
+		snprintf(label, sizeof(label), "%s: replay stops where recording did", name);
+		failures += check(label, cpu.inst_cycles == end.inst_cycles);
+		recording_close(&rec);
+		cpu_deinit(&cpu);
+	}
+
+	// Without a read callback only the sets get logged, and replays have to read the pins like the recording did
+	cpu_init(&cpu);
+	load_program(&cpu);
+	failures += check("no callback: recording starts", recording_start(&rec, &cpu, LOG_PATH) == RECORDING_OK);
+	for (int i = 0; i < 50; i++)
+	{
+		cpu_setgpio(&cpu, (i * 37) & 0x3F);
+		cpu_run_cycles(&cpu, 1000 + i * 13);
+	}
+	cpu_save_state(&cpu, &end);
+	recording_stop(&rec);
+	cpu_deinit(&cpu);
+
+	cpu_init(&cpu);
+	load_program(&cpu);
+	cpu.gpio_read_callback = read_callback;
+	num_host_reads = 0;
+	failures += check("no callback: replay loads", recording_replay(&rec, &cpu, LOG_PATH) == RECORDING_OK);
+	while (!recording_done(&rec))
+		recording_run(&rec, 777);
+	CPUState now;
+	cpu_save_state(&cpu, &now);
+	failures += check("no callback: replay ends in the recorded state", same_state(&now, &end));
+	failures += check("no callback: host read callback never called", num_host_reads == 0);
+	recording_close(&rec);
+	failures += check("no callback: callback given back", cpu.gpio_read_callback == read_callback);
+	cpu_deinit(&cpu);
+
+	// Different firmware can't use it
+	cpu_init(&cpu);
+	load_program(&cpu);
+	cpu.inst[3] = 0x000;
+	failures += check("different program memory is refused", recording_replay(&rec, &cpu, LOG_PATH) == RECORDING_ERR_PROGRAM);
+	cpu_deinit(&cpu);
+	remove(LOG_PATH);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "savestate.h"
+
+// Save-states: a CPU restored from one has to carry on exactly like the one that saved it
+
+#define POINTS  40
+#define SPACING 245000
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Timer0 running, the prescaler on the WDT at 1:1 and sleeping once every 65536 times round, so the WDT wakes it up
+// again (with a reset) after a while
+static const uint16_t sleepy_program[] = {
+	0xCC8, // 0: MOVLW 0xC8
+	0x002, // 1: OPTION
+	0x201, // 2: loop: MOVF TMR0,w
+	0x1B1, // 3: XORWF 0x11,f
+	0x3F0, // 4: INCFSZ 0x10,f
+	0xA02, // 5: GOTO loop
+	0x3F2, // 6: INCFSZ 0x12,f
+	0xA02, // 7: GOTO loop
+	0x003, // 8: SLEEP
+};
+
+static void load_sleepy(CPU *cpu) {
+	memcpy(cpu->inst, sleepy_program, sizeof(sleepy_program));
+	cpu->inst[0x1FF] = 0xC00;
+}
+
+static void save(const CPU *cpu, CPUState *state) {
+	memset(state, 0, sizeof(CPUState));
+	cpu_save_state(cpu, state);
+}
+
+static bool write_file(const char *path, const void *data, size_t size) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	size_t written = fwrite(data, 1, size, file);
+	return fclose(file) == 0 && written == size;
+}
+
+int main(void) {
+	int failures = 0;
+	char path[64], bad_path[64];
+	snprintf(path, sizeof(path), "/tmp/c12f508-test-%d.state", (int)getpid());
+	snprintf(bad_path, sizeof(bad_path), "/tmp/c12f508-test-%d-bad.state", (int)getpid());
+
+	// Save every so often along the way, then check a fresh CPU restored from each gets to the same place
+	CPU cpu;
+	cpu_init(&cpu);
+	load_sleepy(&cpu);
+	bool all_same = true, all_ok = true;
+	int asleep = 0, wdt_counted = 0;
+	for (int p = 0; p < POINTS; p++)
+	{
+		cpu_run_cycles(&cpu, SPACING + p * 7);
+		all_ok &= savestate_write(&cpu, path) == SAVESTATE_OK;
+		asleep += cpu.asleep;
+		wdt_counted += cpu.wdt != 0;
+
+		CPU restored;
+		cpu_init(&restored);
+		load_sleepy(&restored);
+		all_ok &= savestate_load(&restored, path) == SAVESTATE_OK;
+		CPUState a, b;
+		save(&cpu, &a);
+		save(&restored, &b);
+		all_same &= memcmp(&a, &b, sizeof(CPUState)) == 0;
+
+		// Running on from both
+		CPU original;
+		cpu_init(&original);
+		load_sleepy(&original);
+		cpu_load_state(&original, &a);
+		cpu_run_cycles(&original, SPACING);
+		cpu_run_cycles(&restored, SPACING);
+		save(&original, &a);
+		save(&restored, &b);
+		all_same &= memcmp(&a, &b, sizeof(CPUState)) == 0;
+		cpu_deinit(&original);
+		cpu_deinit(&restored);
+	}
+	printf("%d of %d saved asleep, %d with the WDT part way\n", asleep, POINTS, wdt_counted);
+	failures += check("saved and loaded", all_ok);
+	failures += check("restored CPUs carry on the same", all_same);
+	failures += check("saved asleep and awake", asleep > 0 && asleep < POINTS && wdt_counted > 0);
+
+	// The file itself
+	int err;
+	const SaveState *mapped = savestate_map(path, &err);
+	failures += check("maps", mapped != NULL && err == SAVESTATE_OK && mapped->inst_cycles == cpu.inst_cycles
+	                  && mapped->pc == cpu.pc && mapped->prescaler == cpu.prescaler && mapped->wdt == cpu.wdt
+	                  && mapped->program_hash == savestate_program_hash(cpu.inst, 512));
+	SaveState copy = *mapped;
+	savestate_unmap(mapped);
+
+	// Anything else gets refused and leaves the CPU alone
+	CPU other;
+	cpu_init(&other);
+	load_sleepy(&other);
+	other.inst[7] = 0xA03;
+	CPUState before, after;
+	save(&other, &before);
+	failures += check("different program refused", savestate_load(&other, path) == SAVESTATE_ERR_PROGRAM);
+	save(&other, &after);
+	failures += check("CPU untouched", memcmp(&before, &after, sizeof(CPUState)) == 0);
+	cpu_deinit(&other);
+
+	SaveState bad = copy;
+	bad.f[0x10] ^= 1;
+	failures += check("corruption caught", write_file(bad_path, &bad, sizeof(bad))
+	                  && savestate_map(bad_path, &err) == NULL && err == SAVESTATE_ERR_CHECKSUM);
+	bad = copy;
+	bad.version++;
+	failures += check("other versions refused", write_file(bad_path, &bad, sizeof(bad))
+	                  && savestate_map(bad_path, &err) == NULL && err == SAVESTATE_ERR_VERSION);
+	failures += check("truncated file refused", write_file(bad_path, &copy, sizeof(copy) - 8)
+	                  && savestate_map(bad_path, &err) == NULL && err == SAVESTATE_ERR_FORMAT);
+	unlink(bad_path);
+	failures += check("missing file", savestate_load(&cpu, bad_path) == SAVESTATE_ERR_IO);
+
+	unlink(path);
+	cpu_deinit(&cpu);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
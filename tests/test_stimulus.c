@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "stimulus.h"
+
+// Compiling stimulus files into schedules, then running a press counter from tests/stimulus/counter.stim
+
+#define COUNTER_PATH "stimulus/counter.stim"
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+// Lights the LED on GP1 while the button on GP0 is held (active low, weak pull-ups), counting presses in 0x10
+static void load_counter(CPU *cpu) {
+	cpu->inst[0] = 0xC1F;  // MOVLW 0x1F (pull-ups on)
+	cpu->inst[1] = 0x002;  // OPTION
+	cpu->inst[2] = 0xC3D;  // MOVLW 0x3D
+	cpu->inst[3] = 0x006;  // TRIS GPIO (GP1 out)
+	cpu->inst[4] = 0x606;  // BTFSC GPIO,0
+	cpu->inst[5] = 0xA04;  // GOTO 4
+	cpu->inst[6] = 0x526;  // BSF GPIO,1
+	cpu->inst[7] = 0x2B0;  // INCF 0x10,f
+	cpu->inst[8] = 0x706;  // BTFSS GPIO,0
+	cpu->inst[9] = 0xA08;  // GOTO 8
+	cpu->inst[10] = 0x426; // BCF GPIO,1
+	cpu->inst[11] = 0xA04; // GOTO 4
+	cpu->pc = 0;
+	cpu->config &= ~WDTE;
+}
+
+static bool parses_to(const char *text, int err, int line) {
+	Stimulus stim;
+	int got = stimulus_parse(&stim, text);
+	if (got == STIMULUS_OK)
+		stimulus_free(&stim);
+	if (got != err || stim.error_line != line)
+		printf("  \"%s\": %s on line %d\n", text, stimulus_strerror(got), stim.error_line);
+	return got == err && stim.error_line == line;
+}
+
+int main(void) {
+	int failures = 0;
+	Stimulus stim, other;
+
+	// Schedules
+	failures += check("sets on the same cycle merge", stimulus_parse(&stim, "set gp0 high at 10\nSET GP2 1 at 10\nset gp0 low at 10\n") == STIMULUS_OK
+	                  && stim.num_events == 1 && stim.events[0].mask == (GP0 | GP2) && stim.events[0].value == GP2
+	                  && stim.events[0].line == 3 && stim.length == 11);
+	stimulus_free(&stim);
+	failures += check("clock and pattern edges", stimulus_parse(&stim, "clock gp2 at 100 period 10 count 5 high 3\n"
+	                                                             "pattern gp0 at 0 bit 8 0_0110_1110 # only changes count\nrun 500") == STIMULUS_OK
+	                  && stim.num_events == 10 + 5 && stim.length == 500 && stim.events[1].cycle == 16 && stim.events[2].cycle == 32
+	                  && stim.events[5].cycle == 100 && stim.events[6].cycle == 103 && stim.events[14].cycle == 143);
+	stimulus_free(&stim);
+	failures += check("repeats nest and sort", stimulus_parse(&stim, "repeat 3 every 1000 {\n  repeat 2 every 100 {\n"
+	                                                           "    pulse gp4 at 10 width 5\n  }\n}\nrepeat 0 every 1 {\n set gp1 1 at 0\n}\n") == STIMULUS_OK
+	                  && stim.num_events == 12 && stim.events[2].cycle == 110 && stim.events[11].cycle == 2115);
+	stimulus_free(&stim);
+
+	// Jitter is random but the same every time for a seed, and never swaps edges around
+	const char *jittery = "seed %d\nclock gp3 at 1000 period 20 count 1000 jitter 15\n";
+	char text[128];
+	snprintf(text, sizeof(text), jittery, 1);
+	stimulus_parse(&stim, text);
+	stimulus_parse(&other, text);
+	bool same = stim.num_events == other.num_events && memcmp(stim.events, other.events, stim.num_events * sizeof(StimulusEvent)) == 0;
+	bool ordered = true, moved = false;
+	for (size_t i = 0; i < stim.num_events; i++)
+	{
+		if (i > 0 && stim.events[i].cycle <= stim.events[i - 1].cycle)
+			ordered = false;
+		if ((stim.events[i].value != 0) != (i % 2 == 0))
+			ordered = false;
+		if (stim.events[i].cycle != 1000 + (i / 2) * 20 + (i % 2) * 10)
+			moved = true;
+	}
+	stimulus_free(&other);
+	snprintf(text, sizeof(text), jittery, 2);
+	stimulus_parse(&other, text);
+	bool differs = memcmp(stim.events, other.events, stim.num_events * sizeof(StimulusEvent)) != 0;
+	failures += check("jitter is seeded and keeps edges in order", same && ordered && moved && differs);
+	stimulus_free(&stim);
+	stimulus_free(&other);
+
+	// Errors
+	failures += check("unknown statement", parses_to("set gp0 1 at 5\n\nwiggle gp0\n", STIMULUS_ERR_SYNTAX, 3));
+	failures += check("bad pin", parses_to("pulse gp6 at 0 width 5", STIMULUS_ERR_PIN, 1));
+	failures += check("missing option", parses_to("clock gp0 at 0 count 3", STIMULUS_ERR_SYNTAX, 1));
+	failures += check("no jitter on expectations", parses_to("expect gp0 1 at 0 jitter 2", STIMULUS_ERR_SYNTAX, 1));
+	failures += check("bad bit in a pattern", parses_to("pattern gp0 at 0 bit 5 0102", STIMULUS_ERR_SYNTAX, 1));
+	failures += check("unclosed repeat", parses_to("repeat 2 every 5 {\nset gp0 1 at 0\n", STIMULUS_ERR_BLOCK, 2));
+	failures += check("stray brace", parses_to("set gp0 1 at 0\n}\n", STIMULUS_ERR_BLOCK, 2));
+	failures += check("missing file", stimulus_load(&stim, "stimulus/nope.stim") == STIMULUS_ERR_IO);
+
+	// The counter scenario, no read callback needed
+	int err = stimulus_load(&stim, COUNTER_PATH);
+	failures += check("counter scenario loads", err == STIMULUS_OK);
+	if (err != STIMULUS_OK)
+		printf("  %s on line %d\n", stimulus_strerror(err), stim.error_line);
+	CPU cpu;
+	cpu_init(&cpu);
+	load_counter(&cpu);
+	cpu_writepins(&cpu, GP0, true); // Button's released to begin with
+	cpu_run_cycles(&cpu, 777); // Times are from the start, wherever that is
+	stimulus_start(&stim, &cpu);
+	while (!stimulus_done(&stim))
+		stimulus_run(&stim, 12345);
+	printf("counter: %d presses, %llu/%llu expectations failed\n", cpu.f[0x10],
+	       (unsigned long long)stim.failures, (unsigned long long)stim.expects);
+	if (stim.failures)
+		printf("  first failure on line %u at cycle %llu, pins %02X\n", stim.failed_line,
+		       (unsigned long long)stim.failed_cycle, stim.failed_pins);
+	failures += check("every press counted, expectations met", cpu.f[0x10] == 10 && stim.expects == 21 && stim.failures == 0);
+	failures += check("ran exactly the scenario's length", cpu.inst_cycles - stim.start >= 1000000
+	                  && cpu.inst_cycles - stim.start < 1000002);
+
+	// Expectations that don't hold get reported, and driving the LED pin counts as contention
+	stimulus_free(&stim);
+	stimulus_parse(&stim, "set gp1 low at 10\nset gp0 low at 10\nexpect gp1 low at 100\nexpect gp1 high at 200\n");
+	cpu_init(&cpu);
+	load_counter(&cpu);
+	stimulus_start(&stim, &cpu);
+	stimulus_run(&stim, 1000);
+	failures += check("failed expectation reported", stim.expects == 2 && stim.failures == 1 && stim.failed_line == 3
+	                  && stim.failed_cycle >= 100 && (stim.failed_pins & GP1));
+	failures += check("driven pins left alone", stim.contentions == 1 && cpu.f[0x10] == 1);
+	stimulus_free(&stim);
+	cpu_deinit(&cpu);
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include "cpu.h"
+#include "sweep.h"
+
+// Every numerator/denominator pair through tests/divide, against C's own division
+
+#define NUMERATOR_REG   0x0A
+#define DENOMINATOR_REG 0x09
+#define QUOTIENT_REG    0x07
+#define REMAINDER_REG   0x08
+#define CALL_ADDR       16 // CALL divide
+#define AFTER_CALL      17
+
+static int check(const char *name, bool ok) {
+	printf("%-56s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static void divide(const uint8_t *inputs, uint8_t *expected, void *ctx) {
+	(void)ctx;
+	expected[0] = inputs[0] / inputs[1];
+	expected[1] = inputs[0] % inputs[1];
+}
+
+// Off by one whenever the numerator's a multiple of 64, as if the routine had a bug
+static void wrong_divide(const uint8_t *inputs, uint8_t *expected, void *ctx) {
+	divide(inputs, expected, ctx);
+	if (inputs[0] % 64 == 0)
+		expected[0]++;
+}
+
+static void nothing(const uint8_t *inputs, uint8_t *expected, void *ctx) {
+	(void)inputs;
+	(void)ctx;
+	expected[0] = 0;
+}
+
+int main(void) {
+	int failures = 0;
+	static Sweep sweep;
+	CPU cpu;
+	cpu_init(&cpu);
+	cpu_load_hex(&cpu, "divide/divide-12f508.HEX");
+
+	// Everything but dividing by zero, which never finishes
+	failures += check("init", sweep_init(&sweep, &cpu, CALL_ADDR, AFTER_CALL) == SWEEP_OK);
+	sweep_add_input(&sweep, NUMERATOR_REG, 0, 255);
+	sweep_add_input(&sweep, DENOMINATOR_REG, 1, 255);
+	sweep_add_output(&sweep, QUOTIENT_REG);
+	sweep_add_output(&sweep, REMAINDER_REG);
+	sweep_set_reference(&sweep, divide, NULL);
+	failures += check("65280 cases", sweep_num_cases(&sweep) == 65280);
+	uint8_t inputs[SWEEP_MAX_INPUTS];
+	sweep_case_inputs(&sweep, 256, inputs);
+	failures += check("last input counts fastest", inputs[0] == 1 && inputs[1] == 2);
+
+	failures += check("run", sweep_run(&sweep, 4) == SWEEP_OK);
+	sweep_print(&sweep, stdout);
+	failures += check("all pass", sweep.cases == 65280 && sweep.passed == 65280 && sweep.mismatches == 0
+	                  && sweep.timeouts == 0 && sweep.num_failed == 0);
+
+	// The CALL, 10 cycles of routine and 8 more per subtraction
+	uint64_t total = 0, histogram_total = 0, quotient_zero = 0;
+	for (int n = 0; n < 256; n++)
+		for (int d = 1; d < 256; d++)
+		{
+			total += 12 + 8 * (n / d);
+			quotient_zero += n < d;
+		}
+	for (int i = 0; i <= SWEEP_HISTOGRAM; i++)
+		histogram_total += sweep.histogram[i];
+	failures += check("cycle distribution", sweep.min_cycles == 12 && sweep.max_cycles == 12 + 8 * 255
+	                  && sweep.total_cycles == total && histogram_total == 65280 && sweep.histogram[12] == quotient_zero
+	                  && sweep.histogram[12 + 8 * 255] == 1);
+
+	// Same answers on one thread, and the first mismatches come out in case order either way
+	sweep_set_reference(&sweep, wrong_divide, NULL);
+	sweep_run(&sweep, 1);
+	SweepMismatch first = sweep.failed[0];
+	uint64_t single_mismatches = sweep.mismatches;
+	sweep_run(&sweep, 3);
+	sweep_print(&sweep, stdout);
+	failures += check("mismatches found", single_mismatches == 4 * 255 && sweep.mismatches == single_mismatches
+	                  && sweep.num_failed == SWEEP_MAX_MISMATCHES && sweep.passed == 65280 - 4 * 255);
+	failures += check("first mismatch", first.index == 0 && first.inputs[0] == 0 && first.inputs[1] == 1
+	                  && first.got[0] == 0 && first.expected[0] == 1 && !first.timed_out && first.cycles == 12);
+	bool ordered = sweep.failed[0].index == first.index;
+	for (int i = 1; i < sweep.num_failed; i++)
+		ordered &= sweep.failed[i].index > sweep.failed[i - 1].index;
+	failures += check("kept in case order", ordered && sweep.failed[SWEEP_MAX_MISMATCHES - 1].inputs[0] == 0);
+
+	// Dividing by zero subtracts forever
+	sweep_deinit(&sweep);
+	sweep_init(&sweep, &cpu, CALL_ADDR, AFTER_CALL);
+	sweep_add_input(&sweep, NUMERATOR_REG, 0, 255);
+	sweep_add_output(&sweep, QUOTIENT_REG);
+	sweep_set_reference(&sweep, nothing, NULL);
+	sweep.budget = 5000;
+	sweep_run(&sweep, 2);
+	failures += check("divide by zero times out", sweep.timeouts == 256 && sweep.passed == 0
+	                  && sweep.failed[0].timed_out && sweep.failed[0].cycles >= 5000);
+
+	failures += check("bad arguments", sweep_add_output(&sweep, 33) == SWEEP_ERR_ARG
+	                  && sweep_add_input(&sweep, 5, 10, 9) == SWEEP_ERR_ARG);
+	sweep_deinit(&sweep);
+	cpu_deinit(&cpu);
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+
+// Watchpoints on direct, indirect and side-effect register writes, in both engines
+
+#define MAX_HITS 64
+
+static WatchHit hits[MAX_HITS];
+static int num_hits;
+
+static bool log_callback(CPU *cpu, const WatchHit *hit) {
+	if (num_hits < MAX_HITS)
+		hits[num_hits++] = *hit;
+	return false; // Keep going
+}
+
+static void load_program(CPU *cpu) {
+	cpu->inst[0] = 0xC10; // MOVLW 0x10
+	cpu->inst[1] = 0x024; // MOVWF FSR
+	cpu->inst[2] = 0xC05; // MOVLW 5
+	cpu->inst[3] = 0x020; // MOVWF INDF (so 0x10)
+	cpu->inst[4] = 0x2B0; // INCF 0x10,f
+	cpu->inst[5] = 0x021; // MOVWF TMR0
+	cpu->inst[6] = 0x026; // MOVWF GPIO
+	cpu->inst[7] = 0xA04; // GOTO 4
+	cpu->pc = 0;
+}
+
+static int check(const char *name, bool ok) {
+	printf("%-48s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main(void) {
+	int failures = 0;
+
+	for (int engine = ENGINE_FAST; engine <= ENGINE_PIPELINE; engine++)
+	{
+		const char *engine_name = engine == ENGINE_FAST ? "fast" : "pipeline";
+		printf("%s engine:\n", engine_name);
+		CPU cpu;
+
+		// Stopping, the run ends right after the instruction doing the write
+		cpu_init(&cpu);
+		cpu_set_engine(&cpu, engine);
+		load_program(&cpu);
+		cpu_addwatchpoint(&cpu, 0x10);
+		int reason = cpu_run_cycles(&cpu, 1000);
+		failures += check("  INDF write stops the run", reason == STOP_WATCHPOINT && cpu.pc == 4);
+		failures += check("  hit has the register, values, PC and cycle", cpu.watch_hit.reg == 0x10 && cpu.watch_hit.old_value == 0
+		                  && cpu.watch_hit.new_value == 5 && cpu.watch_hit.pc == 3 && cpu.watch_hit.cycle == 3);
+		failures += check("  INDF itself wasn't written", cpu.f[INDF] == 0);
+		reason = cpu_run_cycles(&cpu, 1000);
+		failures += check("  INCF stops the next one", reason == STOP_WATCHPOINT && cpu.watch_hit.pc == 4 && cpu.watch_hit.new_value == 6);
+		cpu_deinit(&cpu);
+
+		// Callbacks that keep going, on TMR0 and GPIO as well
+		cpu_init(&cpu);
+		cpu_set_engine(&cpu, engine);
+		load_program(&cpu);
+		cpu.watch_callback = log_callback;
+		cpu_addwatchpoint(&cpu, 0x10);
+		cpu_addwatchpoint(&cpu, TMR0);
+		cpu_addwatchpoint(&cpu, GPIO);
+		num_hits = 0;
+		reason = cpu_run_cycles(&cpu, 3 + 5 * 10);
+		failures += check("  callback returning false doesn't stop", reason == STOP_CYCLES);
+		failures += check("  every write seen", num_hits == 1 + 3 * 10);
+		bool in_order = hits[1].reg == 0x10 && hits[2].reg == TMR0 && hits[3].reg == GPIO
+		             && hits[2].pc == 5 && hits[3].pc == 6 && hits[3].new_value == 5 && hits[4].old_value == 6;
+		failures += check("  in program order", in_order);
+
+		// Removing them all goes back to the fast path
+		cpu_removewatchpoint(&cpu, 0x10);
+		cpu_removewatchpoint(&cpu, TMR0);
+		cpu_removewatchpoint(&cpu, GPIO);
+		num_hits = 0;
+		cpu_run_cycles(&cpu, 1000);
+		failures += check("  removed watchpoints don't fire", num_hits == 0 && cpu.watch_mask == 0);
+		cpu_deinit(&cpu);
+
+		// Side effects: flags and Timer0 counting, with the direct write to TMR0 only reported once
+		cpu_init(&cpu);
+		cpu_set_engine(&cpu, engine);
+		load_program(&cpu);
+		cpu.option = 0xC0; // Timer0 on the instruction clock, 1:2
+		cpu.pc = 4;        // Straight into the loop with 0x10 about to wrap, so Z gets set and cleared
+		cpu.f[0x10] = 0xFE;
+		cpu.watch_callback = log_callback;
+		cpu_addwatchpoint(&cpu, STATUS);
+		cpu_addwatchpoint(&cpu, TMR0);
+		num_hits = 0;
+		cpu_run_cycles(&cpu, 40);
+		int status_hits = 0, tmr0_ticks = 0, tmr0_writes = 0;
+		bool consistent = true;
+		for (int i = 0; i < num_hits; i++)
+		{
+			consistent &= hits[i].old_value != hits[i].new_value || hits[i].pc == 5;
+			status_hits += hits[i].reg == STATUS;
+			tmr0_writes += hits[i].reg == TMR0 && hits[i].pc == 5;
+			tmr0_ticks += hits[i].reg == TMR0 && hits[i].pc != 5;
+		}
+		printf("  %d STATUS changes, %d TMR0 writes, %d ticks\n", status_hits, tmr0_writes, tmr0_ticks);
+		failures += check("  flag changes and Timer0 ticks seen", status_hits > 0 && tmr0_ticks > 0 && tmr0_writes > 0 && consistent);
+		cpu_removewatchpoint(&cpu, TMR0);
+		cpu.watch_callback = NULL;
+		reason = cpu_run_cycles(&cpu, 2000);
+		failures += check("  watching STATUS stops the run on a flag", reason == STOP_WATCHPOINT && cpu.watch_hit.reg == STATUS
+		                  && (cpu.watch_hit.new_value & Z));
+		cpu_deinit(&cpu);
+	}
+
+	printf("%d failure(s)\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "gdb.h"
+#include "hex.h"
+#include "history.h"
+
+// Serves a CPU running the given firmware to gdb (or anything else speaking RSP), one client after another
+// Usage: gdbstub <firmware.HEX> [port | host:port | /path/to/socket] [-v]
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr, "Usage: %s <firmware.HEX> [port | host:port | /path/to/socket] [-v]\n", argv[0]);
+		return 2;
+	}
+	const char *address = argc >= 3 && strcmp(argv[2], "-v") != 0 ? argv[2] : "3333";
+	bool verbose = strcmp(argv[argc - 1], "-v") == 0;
+	
+	CPU cpu;
+	cpu_init(&cpu);
+	int err = cpu_load_hex(&cpu, argv[1]);
+	if (err != HEX_OK) {
+		fprintf(stderr, "%s: %s\n", argv[1], hex_strerror(err));
+		return 1;
+	}
+	
+	// Everything gets recorded so reverse-step/reverse-continue work
+	History history;
+	history_init(&history, &cpu, 0);
+	
+	GdbServer gdb;
+	err = gdb_listen(&gdb, &cpu, address);
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", address, gdb_strerror(err));
+		return 1;
+	}
+	gdb.verbose = verbose;
+	gdb.history = &history;
+	
+	// Detaching leaves the CPU as is for the next client, killing ends it all
+	printf("Listening on %s\n", address);
+	while (gdb_accept(&gdb) == 0)
+	{
+		err = gdb_serve(&gdb);
+		printf("Client %s\n", gdb_strerror(err));
+		if (err == GDB_KILLED)
+			break;
+	}
+	
+	gdb_close(&gdb);
+	history_deinit(&history);
+	cpu_deinit(&cpu);
+	return 0;
+}
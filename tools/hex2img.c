@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "hex.h"
+#include "image.h"
+
+// Converts an Intel HEX file into a precompiled firmware image
+// Usage: hex2img <input.HEX> <output.img> [osccal]
+int main(int argc, char **argv) {
+	if (argc < 3 || argc > 4) {
+		fprintf(stderr, "Usage: %s <input.HEX> <output.img> [osccal]\n", argv[0]);
+		return 2;
+	}
+	uint8_t osccal = argc == 4 ? (uint8_t)strtoul(argv[3], NULL, 0) : 0x00;
+	
+	HexImage *hex = malloc(sizeof(HexImage));
+	FirmwareImage *image = malloc(sizeof(FirmwareImage));
+	if (hex == NULL || image == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	hex_image_clear(hex);
+	
+	int err = hex_read_file(hex, argv[1]);
+	if (err != HEX_OK) {
+		fprintf(stderr, "%s:%u: %s\n", argv[1], hex->error_line, hex_strerror(err));
+		return 1;
+	}
+	err = image_from_hex(image, hex, osccal);
+	if (err == IMAGE_OK)
+		err = image_write(image, argv[2]);
+	if (err != IMAGE_OK) {
+		fprintf(stderr, "%s: %s\n", argv[2], image_strerror(err));
+		return 1;
+	}
+	
+	printf("%s -> %s (config=0x%03x, checksum=0x%08x)\n", argv[1], argv[2], image->config, image->checksum);
+	free(hex);
+	free(image);
+	return 0;
+}
@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "live.h"
+
+// Shows a CPU's live state from a shared memory segment (./main --live NAME, or anything else using live.h) at 60 Hz
+// Usage: liveview <name> [slot] [--once]
+// Runs until interrupted, --once prints the state once and exits (waiting for something to be published first)
+
+static void print_state(const Live *live, int slot, const LiveState *s, double mhz) {
+	printf("%s slot %d/%d  cycle %llu  %.2f MHz  publish %llu (every %llu cycles)\n", live->name, slot, live->num_slots,
+	       (unsigned long long)s->cycles, mhz, (unsigned long long)s->publishes, (unsigned long long)live->interval);
+	printf("PC %03x  W %02x  STATUS %02x  FSR %02x  OPTION %02x  CONFIG %03x  stack [%03x %03x]%s\n", s->pc, s->w,
+	       s->f[STATUS], s->f[FSR], s->option, s->config, s->stack[0], s->stack[1], s->asleep ? "  asleep" : "");
+	printf("GPIO ");
+	for (int pin = 5; pin >= 0; pin--)
+		printf("%c", (s->tris & (1 << pin)) ? ((s->gpio & (1 << pin)) ? 'H' : 'L') : ((s->gpio & (1 << pin)) ? '1' : '0'));
+	printf("  (1/0 driven, H/L input)\n");
+	for (int r = 0; r < 32; r++)
+		printf(r % 8 == 7 ? "%02x\n" : "%02x ", s->f[r]);
+	if (s->memo_hits)
+		printf("memo: %llu hits, %llu cycles skipped\n", (unsigned long long)s->memo_hits,
+		       (unsigned long long)s->memo_cycles_skipped);
+}
+
+int main(int argc, char **argv) {
+	const char *name = NULL;
+	int slot = 0;
+	bool once = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--once") == 0)
+			once = true;
+		else if (name == NULL)
+			name = argv[i];
+		else
+			slot = atoi(argv[i]);
+	}
+	if (name == NULL) {
+		fprintf(stderr, "Usage: %s <name> [slot] [--once]\n", argv[0]);
+		return 2;
+	}
+	
+	Live live;
+	int err = live_attach(&live, name);
+	if (err != LIVE_OK) {
+		fprintf(stderr, "%s: %s\n", name, live_strerror(err));
+		return 1;
+	}
+	if (slot < 0 || slot >= live.num_slots) {
+		fprintf(stderr, "%s: %s\n", name, live_strerror(LIVE_ERR_ARG));
+		live_detach(&live);
+		return 1;
+	}
+	
+	// A frame every 1/60 s, speed from how far it got since the last new state
+	struct timespec frame = {0, 1000000000 / 60};
+	LiveState state, last;
+	bool have_last = false;
+	double mhz = 0;
+	while (1)
+	{
+		if (!live_read(&live, slot, &state)) {
+			nanosleep(&frame, NULL);
+			continue;
+		}
+		if (have_last && state.publishes != last.publishes && state.wall_ns > last.wall_ns)
+			mhz = (state.cycles - last.cycles) * 1e3 / (state.wall_ns - last.wall_ns);
+		if (!once)
+			printf("\033[H\033[J");
+		print_state(&live, slot, &state, mhz);
+		fflush(stdout);
+		if (once)
+			break;
+		last = state;
+		have_last = true;
+		nanosleep(&frame, NULL);
+	}
+	
+	live_detach(&live);
+	return 0;
+}